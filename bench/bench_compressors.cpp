@@ -0,0 +1,178 @@
+#include "bench_util.h"
+#include "compression_type.h"
+#include "compressor_bzip2.h"
+#include "compressor_xz.h"
+#include "compressor_zip.h"
+#include "compressor_zlib.h"
+#include "compressor_zstd.h"
+#include "compressor_lz4.h"
+#include "compressor_libdeflate.h"
+#include "tail_engine.h"
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+std::string corpusPath(LineLengths lengths, CorpusFormat format) {
+    return "/tmp/ztail_bench_" + std::to_string(::getpid()) + "_" + lineLengthsName(lengths) + "." +
+           corpusExtension(format);
+}
+
+std::unique_ptr<ICompressor> openBenchCompressor(CorpusFormat format, const std::string& path,
+                                                 bool libdeflate = false) {
+    DetectionResult det = detectCompressionType(path);
+    switch (format) {
+    case CorpusFormat::GZIP:
+    case CorpusFormat::BGZF:
+#ifdef ZTAIL_USE_LIBDEFLATE
+        if (libdeflate) {
+            return std::make_unique<CompressorLibdeflate>(std::move(det.file), path);
+        }
+#else
+        (void)libdeflate;
+#endif
+        return std::make_unique<CompressorZlib>(std::move(det.file), path);
+    case CorpusFormat::BZIP2:
+        return std::make_unique<CompressorBzip2>(std::move(det.file), path);
+    case CorpusFormat::XZ:
+        return std::make_unique<CompressorXz>(std::move(det.file), path);
+    case CorpusFormat::ZIP:
+        return std::make_unique<CompressorZip>(std::move(det.file), path);
+    case CorpusFormat::ZSTD:
+        return std::make_unique<CompressorZstd>(std::move(det.file), path);
+    case CorpusFormat::LZ4:
+        return std::make_unique<CompressorLz4>(std::move(det.file), path);
+    case CorpusFormat::PLAIN:
+        break;
+    }
+    return nullptr;
+}
+
+// Decompresses the whole corpus through one ICompressor per iteration.
+void decompressCorpus(benchmark::State& state, CorpusFormat format, bool libdeflate) {
+    const LineLengths lengths = lineLengthsArg(state);
+    const std::string& data = benchCorpus(lengths);
+    const std::string path = corpusPath(lengths, format);
+    try {
+        writeCorpusFile(path, data, format);
+        std::vector<char> buf(1 << 20);
+        for (auto _ : state) {
+            std::unique_ptr<ICompressor> comp = openBenchCompressor(format, path, libdeflate);
+            size_t n = 0;
+            size_t total = 0;
+            while (comp->decompress(buf, n)) {
+                total += n;
+            }
+            benchmark::DoNotOptimize(total);
+        }
+        reportThroughput(state, data);
+    } catch (const std::exception& ex) {
+        state.SkipWithError(ex.what());
+    }
+    std::remove(path.c_str());
+}
+
+void BM_Decompress(benchmark::State& state, CorpusFormat format) {
+    decompressCorpus(state, format, false);
+}
+
+// Tails 64 small files (16 KiB of text each) per iteration, like a run over
+// log rotations.  range(1) selects one engine for every file, reusing its
+// decoder contexts, buffers and ring, instead of a new engine per file.
+void BM_SmallFilesEngine(benchmark::State& state, CorpusFormat format) {
+    constexpr size_t FILES = 64;
+    const LineLengths lengths = lineLengthsArg(state);
+    const std::string data = benchCorpus(lengths).substr(0, 16u << 10);
+    const bool shared = state.range(1) != 0;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < FILES; ++i) {
+        paths.push_back(corpusPath(lengths, format) + "." + std::to_string(i));
+    }
+    try {
+        for (const std::string& path : paths) {
+            writeCorpusFile(path, data, format);
+        }
+        ztail::TailEngine engine;
+        StringSink sink;
+        for (auto _ : state) {
+            for (const std::string& path : paths) {
+                if (shared) {
+                    engine.tailFile(path, sink);
+                } else {
+                    ztail::TailEngine(engine.options()).tailFile(path, sink);
+                }
+                benchmark::DoNotOptimize(sink.take());
+            }
+        }
+        state.counters["files/s"] = benchmark::Counter(static_cast<double>(state.iterations() * FILES),
+                                                       benchmark::Counter::kIsRate);
+        state.SetLabel(std::string(lineLengthsName(lengths)) + (shared ? "/pooled" : "/fresh"));
+    } catch (const std::exception& ex) {
+        state.SkipWithError(ex.what());
+    }
+    for (const std::string& path : paths) {
+        std::remove(path.c_str());
+    }
+}
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+// The gzip and bgzf inputs of BM_Decompress through libdeflate.
+void BM_DecompressLibdeflate(benchmark::State& state, CorpusFormat format) {
+    decompressCorpus(state, format, true);
+}
+
+// Many small gzip files (log rotations), where per-file setup counts:
+// range(1) selects libdeflate instead of zlib.
+void BM_SmallGzipFiles(benchmark::State& state) {
+    const LineLengths lengths = lineLengthsArg(state);
+    const std::string data = benchCorpus(lengths).substr(0, 256u << 10);
+    const std::string path = corpusPath(lengths, CorpusFormat::GZIP) + ".small";
+    const bool libdeflate = state.range(1) != 0;
+    try {
+        writeCorpusFile(path, data, CorpusFormat::GZIP);
+        std::vector<char> buf(1 << 20);
+        for (auto _ : state) {
+            std::unique_ptr<ICompressor> comp = openBenchCompressor(CorpusFormat::GZIP, path, libdeflate);
+            size_t n = 0;
+            size_t total = 0;
+            while (comp->decompress(buf, n)) {
+                total += n;
+            }
+            benchmark::DoNotOptimize(total);
+        }
+        reportThroughput(state, data);
+        state.counters["files/s"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                       benchmark::Counter::kIsRate);
+        state.SetLabel(std::string(lineLengthsName(lengths)) + (libdeflate ? "/libdeflate" : "/zlib"));
+    } catch (const std::exception& ex) {
+        state.SkipWithError(ex.what());
+    }
+    std::remove(path.c_str());
+}
+#endif
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_Decompress, gzip, CorpusFormat::GZIP)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, bgzf, CorpusFormat::BGZF)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, bzip2, CorpusFormat::BZIP2)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, xz, CorpusFormat::XZ)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, zip, CorpusFormat::ZIP)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, zstd, CorpusFormat::ZSTD)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Decompress, lz4, CorpusFormat::LZ4)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_CAPTURE(BM_SmallFilesEngine, gzip, CorpusFormat::GZIP)
+    ->ArgsProduct({{static_cast<int>(LineLengths::UNIFORM)}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_SmallFilesEngine, zstd, CorpusFormat::ZSTD)
+    ->ArgsProduct({{static_cast<int>(LineLengths::UNIFORM)}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_SmallFilesEngine, xz, CorpusFormat::XZ)
+    ->ArgsProduct({{static_cast<int>(LineLengths::UNIFORM)}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+BENCHMARK_CAPTURE(BM_DecompressLibdeflate, gzip, CorpusFormat::GZIP)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_DecompressLibdeflate, bgzf, CorpusFormat::BGZF)->Apply(allLineLengths)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SmallGzipFiles)->ArgsProduct({{static_cast<int>(LineLengths::UNIFORM)}, {0, 1}})->Unit(benchmark::kMicrosecond);
+#endif
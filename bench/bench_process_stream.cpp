@@ -0,0 +1,39 @@
+#include "bench_util.h"
+#include "circular_buffer.h"
+#include "parser.h"
+#include "process_stream.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The full read -> parse -> ring -> print pipeline over an in-memory input;
+// the second argument selects the threaded producer/consumer path.
+void BM_ProcessStream(benchmark::State& state) {
+    const std::string& data = benchCorpus(lineLengthsArg(state));
+    const bool threaded = state.range(1) != 0;
+    DiscardStdout discard;
+    for (auto _ : state) {
+        CircularBuffer cb(10, 512);
+        Parser parser(cb, 512);
+        size_t pos = 0;
+        processStream([&](std::vector<char>& buf, size_t& n) {
+                n = std::min(buf.size(), data.size() - pos);
+                std::memcpy(buf.data(), data.data() + pos, n);
+                pos += n;
+                return n > 0;
+            },
+            parser, cb, 1 << 20, 8u << 20, threaded);
+    }
+    reportThroughput(state, data);
+}
+
+} // namespace
+
+BENCHMARK(BM_ProcessStream)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1}})
+    ->ArgNames({"lengths", "threaded"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,104 @@
+#include "bench_util.h"
+#include "char_ring_buffer.h"
+#include "circular_buffer.h"
+#include "parser.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct LineSpan {
+    const char* data;
+    size_t size;
+};
+
+std::vector<LineSpan> splitLines(const std::string& data) {
+    std::vector<LineSpan> lines;
+    const char* p = data.data();
+    const char* end = p + data.size();
+    while (const char* nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)))) {
+        lines.push_back({p, static_cast<size_t>(nl - p)});
+        p = nl + 1;
+    }
+    return lines;
+}
+
+// Parser::parse over 1 MiB chunks, as processStream feeds it.
+void BM_ParserParse(benchmark::State& state) {
+    const std::string& data = benchCorpus(lineLengthsArg(state));
+    const size_t ring = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        CircularBuffer cb(ring, 512);
+        Parser parser(cb, 512);
+        for (size_t pos = 0; pos < data.size(); pos += 1 << 20) {
+            parser.parse(data.data() + pos, std::min<size_t>(1 << 20, data.size() - pos));
+        }
+        parser.finalize();
+        benchmark::DoNotOptimize(cb.memoryUsage());
+    }
+    reportThroughput(state, data);
+}
+
+// Ring is CircularBuffer (32-bit offsets) or WideCircularBuffer (64-bit).
+template <typename Ring>
+void BM_RingAppendLine(benchmark::State& state) {
+    const std::string& data = benchCorpus(lineLengthsArg(state));
+    const std::vector<LineSpan> lines = splitLines(data);
+    const size_t ring = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        Ring cb(ring, 512);
+        for (const LineSpan& line : lines) {
+            cb.append_line(line.data, line.size);
+        }
+        benchmark::DoNotOptimize(cb.memoryUsage());
+    }
+    reportThroughput(state, data);
+}
+
+// Every line arrives in two segments, as lines crossing a read boundary do.
+void BM_RingAppendSegment(benchmark::State& state) {
+    const std::string& data = benchCorpus(lineLengthsArg(state));
+    const std::vector<LineSpan> lines = splitLines(data);
+    const size_t ring = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        CharRingBuffer<> cb(ring, 512);
+        for (const LineSpan& line : lines) {
+            const size_t half = line.size / 2;
+            cb.append_segment(line.data, half);
+            cb.append_segment(line.data + half, line.size - half);
+            cb.end_line();
+        }
+        benchmark::DoNotOptimize(cb.memoryUsage());
+    }
+    reportThroughput(state, data);
+}
+
+void BM_RingPrint(benchmark::State& state) {
+    const std::string& data = benchCorpus(lineLengthsArg(state));
+    const std::vector<LineSpan> lines = splitLines(data);
+    const size_t ring = static_cast<size_t>(state.range(1));
+    CharRingBuffer<> cb(ring, 512);
+    size_t printedBytes = 0;
+    for (size_t i = lines.size() > ring ? lines.size() - ring : 0; i < lines.size(); ++i) {
+        printedBytes += lines[i].size + 1;
+    }
+    for (const LineSpan& line : lines) {
+        cb.append_line(line.data, line.size);
+    }
+    DiscardStdout discard;
+    for (auto _ : state) {
+        cb.print(8u << 20);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(printedBytes));
+    state.SetLabel(lineLengthsName(lineLengthsArg(state)));
+}
+
+} // namespace
+
+BENCHMARK(BM_ParserParse)->Apply(allLineLengthsAndRings)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RingAppendLine, CircularBuffer)->Apply(allLineLengthsAndRings)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_RingAppendLine, WideCircularBuffer)->Apply(allLineLengthsAndRings)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RingAppendSegment)->Apply(allLineLengthsAndRings)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RingPrint)->Apply(allLineLengthsAndRings)->Unit(benchmark::kMicrosecond);
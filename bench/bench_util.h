@@ -0,0 +1,78 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include "corpus.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Uncompressed size of every benchmark input.
+constexpr size_t BENCH_CORPUS_BYTES = 16u << 20;
+
+// Benchmarks take the line length distribution as their first argument.
+inline LineLengths lineLengthsArg(const benchmark::State& state) {
+    return static_cast<LineLengths>(state.range(0));
+}
+
+// Generates each distribution once per process.
+inline const std::string& benchCorpus(LineLengths lengths) {
+    static std::map<LineLengths, std::string> cache;
+    auto it = cache.find(lengths);
+    if (it == cache.end()) {
+        it = cache.emplace(lengths, generateCorpus(BENCH_CORPUS_BYTES, lengths)).first;
+    }
+    return it->second;
+}
+
+inline size_t lineCountOf(const std::string& data) {
+    size_t lines = 0;
+    for (char c : data) lines += c == '\n';
+    return lines;
+}
+
+// Reports MB/s and lines/s for `iterations` passes over data.
+inline void reportThroughput(benchmark::State& state, const std::string& data) {
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(data.size()));
+    state.counters["lines/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) * static_cast<double>(lineCountOf(data)), benchmark::Counter::kIsRate);
+    state.SetLabel(lineLengthsName(lineLengthsArg(state)));
+}
+
+// Swallows std::cout while alive so print() benchmarks measure formatting
+// and not the terminal.
+class DiscardStdout {
+public:
+    DiscardStdout() : previous(std::cout.rdbuf(&sink)) {}
+    ~DiscardStdout() { std::cout.rdbuf(previous); }
+
+private:
+    class NullBuffer : public std::streambuf {
+    protected:
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+        int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+    };
+
+    NullBuffer sink;
+    std::streambuf* previous;
+};
+
+// Every line length distribution, optionally crossed with ring sizes.
+inline void allLineLengths(benchmark::internal::Benchmark* b) {
+    for (int d = 0; d <= static_cast<int>(LineLengths::LONG); ++d) {
+        b->Arg(d);
+    }
+}
+
+inline void allLineLengthsAndRings(benchmark::internal::Benchmark* b) {
+    for (int d = 0; d <= static_cast<int>(LineLengths::LONG); ++d) {
+        for (int ring : {10, 1000, 100000}) {
+            b->Args({d, ring});
+        }
+    }
+}
+
+#endif // BENCH_UTIL_H
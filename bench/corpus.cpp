@@ -0,0 +1,269 @@
+#include "corpus.h"
+#include <bzlib.h>
+#include <lzma.h>
+#include <zip.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <lz4frame.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// SplitMix64: tiny, fast and identical everywhere, unlike the distributions
+// of <random>.
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [lo, hi].
+    size_t between(size_t lo, size_t hi) {
+        return lo + static_cast<size_t>(next() % (hi - lo + 1));
+    }
+
+private:
+    uint64_t state;
+};
+
+const char* const WORDS[] = {
+    "request", "completed", "user", "session", "cache", "miss", "hit", "upstream", "timeout", "retry",
+    "connection", "closed", "opened", "GET", "POST", "/api/v1/items", "/api/v1/users", "status=200",
+    "status=404", "status=500", "latency_ms=12", "latency_ms=431", "bytes=5120", "db", "query", "slow",
+    "shard=3", "region=eu-west-1", "handler", "panic", "recovered", "queue", "depth=17", "worker"};
+const char* const LEVELS[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+
+size_t lineLength(Rng& rng, LineLengths lengths) {
+    switch (lengths) {
+    case LineLengths::FIXED:
+        return 80;
+    case LineLengths::UNIFORM:
+        return rng.between(20, 200);
+    case LineLengths::LONG_TAIL:
+        return rng.next() % 10 == 0 ? rng.between(500, 8000) : rng.between(40, 120);
+    case LineLengths::LONG:
+        return rng.between(2000, 4000);
+    }
+    return 80;
+}
+
+void appendLine(std::string& out, Rng& rng, uint64_t lineNo, size_t length) {
+    char prefix[96];
+    const uint64_t ms = lineNo * 37;
+    int n = std::snprintf(prefix, sizeof(prefix), "2024-05-01T%02u:%02u:%02u.%03uZ %s svc-%u req=%016llx ",
+                          static_cast<unsigned>(ms / 3600000 % 24), static_cast<unsigned>(ms / 60000 % 60),
+                          static_cast<unsigned>(ms / 1000 % 60), static_cast<unsigned>(ms % 1000),
+                          LEVELS[rng.next() % (sizeof(LEVELS) / sizeof(LEVELS[0]))],
+                          static_cast<unsigned>(rng.next() % 16), static_cast<unsigned long long>(rng.next()));
+    const size_t start = out.size();
+    out.append(prefix, static_cast<size_t>(n));
+    const size_t target = start + length - 1; // excluding '\n'
+    while (out.size() < target) {
+        const char* word = WORDS[rng.next() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        out.append(word);
+        out.push_back(' ');
+    }
+    out.resize(target); // short lines cut into the prefix
+    out.push_back('\n');
+}
+
+void writeBytes(const std::string& path, const char* data, size_t size) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(data, static_cast<std::streamsize>(size));
+    if (!ofs) {
+        throw std::runtime_error("Failed to write corpus file: " + path);
+    }
+}
+
+std::vector<char> deflateMember(const char* data, size_t size, int windowBits) {
+    z_stream zs{};
+    if (deflateInit2(&zs, 6, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::vector<char> out(deflateBound(&zs, static_cast<uLong>(size)) + 64);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int ret = deflate(&zs, Z_FINISH);
+    out.resize(out.size() - zs.avail_out);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+    return out;
+}
+
+void putLe32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+// BGZF: gzip members of at most 64 KiB input with the "BC" extra field,
+// followed by the empty end-of-file member.
+std::string encodeBgzf(const std::string& content) {
+    constexpr size_t BLOCK = 0xff00;
+    std::string out;
+    auto block = [&](const char* data, size_t len) {
+        const std::vector<char> deflated = deflateMember(data, len, -15);
+        const size_t bsize = 18 + deflated.size() + 8 - 1;
+        const unsigned char header[18] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+                                          static_cast<unsigned char>(bsize & 0xff),
+                                          static_cast<unsigned char>(bsize >> 8)};
+        out.append(reinterpret_cast<const char*>(header), sizeof(header));
+        out.append(deflated.data(), deflated.size());
+        putLe32(out, static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(len))));
+        putLe32(out, static_cast<uint32_t>(len));
+    };
+    for (size_t pos = 0; pos < content.size(); pos += BLOCK) {
+        block(content.data() + pos, std::min(BLOCK, content.size() - pos));
+    }
+    block("", 0);
+    return out;
+}
+
+} // namespace
+
+LineLengths parseLineLengths(const std::string& name) {
+    if (name == "fixed") return LineLengths::FIXED;
+    if (name == "uniform") return LineLengths::UNIFORM;
+    if (name == "long-tail") return LineLengths::LONG_TAIL;
+    if (name == "long") return LineLengths::LONG;
+    throw std::runtime_error("Unknown line length distribution: " + name);
+}
+
+CorpusFormat parseCorpusFormat(const std::string& name) {
+    if (name == "txt") return CorpusFormat::PLAIN;
+    if (name == "gz") return CorpusFormat::GZIP;
+    if (name == "bgz") return CorpusFormat::BGZF;
+    if (name == "bz2") return CorpusFormat::BZIP2;
+    if (name == "xz") return CorpusFormat::XZ;
+    if (name == "zip") return CorpusFormat::ZIP;
+    if (name == "zst") return CorpusFormat::ZSTD;
+    if (name == "lz4") return CorpusFormat::LZ4;
+    throw std::runtime_error("Unknown corpus format: " + name);
+}
+
+const char* lineLengthsName(LineLengths lengths) {
+    switch (lengths) {
+    case LineLengths::FIXED: return "fixed";
+    case LineLengths::UNIFORM: return "uniform";
+    case LineLengths::LONG_TAIL: return "long-tail";
+    case LineLengths::LONG: return "long";
+    }
+    return "?";
+}
+
+const char* corpusExtension(CorpusFormat format) {
+    switch (format) {
+    case CorpusFormat::PLAIN: return "txt";
+    case CorpusFormat::GZIP: return "gz";
+    case CorpusFormat::BGZF: return "bgz";
+    case CorpusFormat::BZIP2: return "bz2";
+    case CorpusFormat::XZ: return "xz";
+    case CorpusFormat::ZIP: return "zip";
+    case CorpusFormat::ZSTD: return "zst";
+    case CorpusFormat::LZ4: return "lz4";
+    }
+    return "?";
+}
+
+std::string generateCorpus(size_t bytes, LineLengths lengths, uint64_t seed) {
+    Rng rng(seed);
+    std::string out;
+    out.reserve(bytes + 8192);
+    for (uint64_t lineNo = 0; out.size() < bytes; ++lineNo) {
+        appendLine(out, rng, lineNo, lineLength(rng, lengths));
+    }
+    return out;
+}
+
+void writeCorpusFile(const std::string& path, const std::string& content, CorpusFormat format) {
+    switch (format) {
+    case CorpusFormat::PLAIN:
+        writeBytes(path, content.data(), content.size());
+        return;
+    case CorpusFormat::GZIP: {
+        const std::vector<char> out = deflateMember(content.data(), content.size(), 31);
+        writeBytes(path, out.data(), out.size());
+        return;
+    }
+    case CorpusFormat::BGZF: {
+        const std::string out = encodeBgzf(content);
+        writeBytes(path, out.data(), out.size());
+        return;
+    }
+    case CorpusFormat::BZIP2: {
+        unsigned int size = static_cast<unsigned int>(content.size() + content.size() / 100 + 600);
+        std::vector<char> out(size);
+        if (BZ2_bzBuffToBuffCompress(out.data(), &size, const_cast<char*>(content.data()),
+                                     static_cast<unsigned int>(content.size()), 9, 0, 0) != BZ_OK) {
+            throw std::runtime_error("bzip2 compression failed");
+        }
+        writeBytes(path, out.data(), size);
+        return;
+    }
+    case CorpusFormat::XZ: {
+        std::vector<uint8_t> out(lzma_stream_buffer_bound(content.size()));
+        size_t outPos = 0;
+        if (lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, nullptr, reinterpret_cast<const uint8_t*>(content.data()),
+                                    content.size(), out.data(), &outPos, out.size()) != LZMA_OK) {
+            throw std::runtime_error("xz compression failed");
+        }
+        writeBytes(path, reinterpret_cast<const char*>(out.data()), outPos);
+        return;
+    }
+    case CorpusFormat::ZIP: {
+        std::remove(path.c_str());
+        int error = 0;
+        zip_t* za = zip_open(path.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &error);
+        if (!za) {
+            throw std::runtime_error("Failed to create zip archive: " + path);
+        }
+        zip_source_t* src = zip_source_buffer(za, content.data(), content.size(), 0);
+        if (!src || zip_file_add(za, "corpus.log", src, ZIP_FL_OVERWRITE) < 0) {
+            if (src) zip_source_free(src);
+            zip_discard(za);
+            throw std::runtime_error("Failed to add zip entry: " + path);
+        }
+        if (zip_close(za) != 0) {
+            zip_discard(za);
+            throw std::runtime_error("Failed to write zip archive: " + path);
+        }
+        return;
+    }
+    case CorpusFormat::ZSTD: {
+        std::vector<char> out(ZSTD_compressBound(content.size()));
+        const size_t n = ZSTD_compress(out.data(), out.size(), content.data(), content.size(), 3);
+        if (ZSTD_isError(n)) {
+            throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(n));
+        }
+        writeBytes(path, out.data(), n);
+        return;
+    }
+    case CorpusFormat::LZ4: {
+        // What the lz4 tool writes by default: independent 4 MiB blocks.
+        LZ4F_preferences_t prefs{};
+        prefs.frameInfo.blockSizeID = LZ4F_max4MB;
+        prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+        prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+        std::vector<char> out(LZ4F_compressFrameBound(content.size(), &prefs));
+        const size_t n = LZ4F_compressFrame(out.data(), out.size(), content.data(), content.size(), &prefs);
+        if (LZ4F_isError(n)) {
+            throw std::runtime_error(std::string("lz4 compression failed: ") + LZ4F_getErrorName(n));
+        }
+        writeBytes(path, out.data(), n);
+        return;
+    }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Line length distributions of the synthetic log corpus.
+enum class LineLengths {
+    FIXED,     // every line 80 bytes
+    UNIFORM,   // 20 to 200 bytes
+    LONG_TAIL, // mostly 40 to 120 bytes, one line in ten 500 to 8000 bytes
+    LONG       // 2000 to 4000 bytes
+};
+
+enum class CorpusFormat {
+    PLAIN,
+    GZIP,
+    BGZF,
+    BZIP2,
+    XZ,
+    ZIP,
+    ZSTD,
+    LZ4
+};
+
+// Parses "fixed", "uniform", "long-tail", "long" and the format extensions
+// ("txt", "gz", "bgz", "bz2", "xz", "zip", "zst", "lz4"); throws on anything else.
+LineLengths parseLineLengths(const std::string& name);
+CorpusFormat parseCorpusFormat(const std::string& name);
+const char* lineLengthsName(LineLengths lengths);
+const char* corpusExtension(CorpusFormat format);
+
+// Returns about `bytes` bytes of log-like lines ('\n' terminated).  The
+// output depends only on the arguments, on every platform.
+std::string generateCorpus(size_t bytes, LineLengths lengths, uint64_t seed = 1);
+
+// Writes content to path in the given format; zip archives hold a single
+// entry named "corpus.log".  Throws std::runtime_error on failure.
+void writeCorpusFile(const std::string& path, const std::string& content, CorpusFormat format);
+
+#endif // CORPUS_H
@@ -0,0 +1,105 @@
+#include "corpus.h"
+#include <getopt.h>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+void usage(const char* progName) {
+    std::cerr
+        << "Usage: " << progName << " [options]\n"
+        << "  -s, --size N      : uncompressed bytes per file (default = 67108864)\n"
+        << "  -l, --lengths D   : line lengths: fixed, uniform, long-tail, long (default = uniform)\n"
+        << "  -f, --formats F   : comma separated list of txt,gz,bgz,bz2,xz,zip,zst,lz4 (default = all)\n"
+        << "      --seed N      : generator seed (default = 1)\n"
+        << "  -o, --out-dir DIR : output directory (default = .)\n"
+        << "Writes DIR/corpus-<lengths>.<format> for every format; the same options always\n"
+        << "produce the same bytes.\n";
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+unsigned long long parseNumber(const char* arg, const char* option) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long val = std::strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-') {
+        throw std::runtime_error(std::string(option) + " requires a non-negative integer");
+    }
+    return val;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        size_t size = 64u << 20;
+        LineLengths lengths = LineLengths::UNIFORM;
+        std::string formats = "txt,gz,bgz,bz2,xz,zip,zst,lz4";
+        uint64_t seed = 1;
+        std::string outDir = ".";
+
+        static struct option long_opts[] = {
+            {"help",    no_argument,       nullptr, 'h'},
+            {"size",    required_argument, nullptr, 's'},
+            {"lengths", required_argument, nullptr, 'l'},
+            {"formats", required_argument, nullptr, 'f'},
+            {"seed",    required_argument, nullptr, 1000},
+            {"out-dir", required_argument, nullptr, 'o'},
+            {0, 0, 0, 0}
+        };
+        int opt;
+        while ((opt = getopt_long(argc, argv, "hs:l:f:o:", long_opts, nullptr)) != -1) {
+            switch (opt) {
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 's':
+                size = static_cast<size_t>(parseNumber(optarg, "--size"));
+                break;
+            case 'l':
+                lengths = parseLineLengths(optarg);
+                break;
+            case 'f':
+                formats = optarg;
+                break;
+            case 1000:
+                seed = parseNumber(optarg, "--seed");
+                break;
+            case 'o':
+                outDir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+
+        const std::string content = generateCorpus(size, lengths, seed);
+        for (const std::string& name : splitList(formats)) {
+            const CorpusFormat format = parseCorpusFormat(name);
+            const std::string path = outDir + "/corpus-" + lineLengthsName(lengths) + "." + corpusExtension(format);
+            writeCorpusFile(path, content, format);
+            std::cerr << "Wrote " << path << std::endl;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,467 @@
+// End-to-end performance regression check: runs the ztail binary on a
+// generated corpus and compares wall time, CPU time and peak RSS with a
+// committed baseline.
+#include "corpus.h"
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t DEFAULT_CORPUS_BYTES = 32u << 20;
+constexpr uint64_t CORPUS_SEED = 1;
+constexpr double DEFAULT_TOLERANCE = 0.25;     // allowed relative slowdown
+constexpr double DEFAULT_RSS_TOLERANCE = 0.25; // allowed relative RSS growth
+constexpr double TIME_SLACK_MS = 25.0;         // absolute slack for short runs
+constexpr double RSS_SLACK_KB = 2048.0;
+
+struct PerfCase {
+    std::string name;
+    LineLengths lengths;
+    CorpusFormat format;
+    std::vector<std::string> args;
+};
+
+struct Measurement {
+    double wallMs = 0;
+    double cpuMs = 0;
+    double rssKb = 0;
+};
+
+std::vector<PerfCase> perfCases() {
+    std::vector<PerfCase> cases;
+    for (CorpusFormat format : {CorpusFormat::PLAIN, CorpusFormat::GZIP, CorpusFormat::BGZF, CorpusFormat::BZIP2,
+                                CorpusFormat::XZ, CorpusFormat::ZIP, CorpusFormat::ZSTD, CorpusFormat::LZ4}) {
+        cases.push_back({std::string(corpusExtension(format)) + "-uniform-tail10", LineLengths::UNIFORM, format,
+                         {"-n", "10"}});
+    }
+    cases.push_back({"txt-long-tail-tail100000", LineLengths::LONG_TAIL, CorpusFormat::PLAIN, {"-n", "100000"}});
+    cases.push_back({"gz-long-tail-tail100000", LineLengths::LONG_TAIL, CorpusFormat::GZIP, {"-n", "100000"}});
+    cases.push_back({"gz-uniform-nothreads", LineLengths::UNIFORM, CorpusFormat::GZIP, {"-n", "10", "--no-threads"}});
+    cases.push_back({"gz-uniform-grep", LineLengths::UNIFORM, CorpusFormat::GZIP, {"-n", "10", "--grep", "ERROR"}});
+    cases.push_back({"bgz-uniform-count", LineLengths::UNIFORM, CorpusFormat::BGZF, {"--count"}});
+    return cases;
+}
+
+std::string corpusPath(const std::string& dir, LineLengths lengths, CorpusFormat format) {
+    return dir + "/corpus-" + lineLengthsName(lengths) + "." + corpusExtension(format);
+}
+
+// ---------------------------------------------------------------------------
+// Minimal JSON for the baseline file: objects, strings and numbers.
+
+struct Json {
+    enum Kind { NUMBER, STRING, OBJECT } kind = NUMBER;
+    double number = 0;
+    std::string text;
+    std::map<std::string, Json> members;
+
+    const Json* find(const std::string& key) const {
+        auto it = members.find(key);
+        return it == members.end() ? nullptr : &it->second;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : s(text), pos(0) {}
+
+    Json parse() {
+        Json value = parseValue();
+        skipSpace();
+        if (pos != s.size()) {
+            fail("trailing characters");
+        }
+        return value;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("baseline JSON: " + what + " at offset " + std::to_string(pos));
+    }
+
+    void skipSpace() {
+        while (pos < s.size() && std::isspace(static_cast<unsigned char>(s[pos]))) ++pos;
+    }
+
+    void expect(char c) {
+        skipSpace();
+        if (pos >= s.size() || s[pos] != c) {
+            fail(std::string("expected '") + c + "'");
+        }
+        ++pos;
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string out;
+        while (pos < s.size() && s[pos] != '"') {
+            if (s[pos] == '\\' && pos + 1 < s.size()) ++pos;
+            out.push_back(s[pos++]);
+        }
+        expect('"');
+        return out;
+    }
+
+    Json parseValue() {
+        skipSpace();
+        Json value;
+        if (pos < s.size() && s[pos] == '{') {
+            ++pos;
+            value.kind = Json::OBJECT;
+            skipSpace();
+            if (pos < s.size() && s[pos] == '}') {
+                ++pos;
+                return value;
+            }
+            while (true) {
+                std::string key = parseString();
+                expect(':');
+                value.members[key] = parseValue();
+                skipSpace();
+                if (pos < s.size() && s[pos] == ',') {
+                    ++pos;
+                    continue;
+                }
+                expect('}');
+                return value;
+            }
+        }
+        if (pos < s.size() && s[pos] == '"') {
+            value.kind = Json::STRING;
+            value.text = parseString();
+            return value;
+        }
+        char* end = nullptr;
+        value.number = std::strtod(s.c_str() + pos, &end);
+        if (end == s.c_str() + pos) {
+            fail("expected a value");
+        }
+        pos = static_cast<size_t>(end - s.c_str());
+        return value;
+    }
+
+    const std::string& s;
+    size_t pos;
+};
+
+double numberOr(const Json* obj, const std::string& key, double fallback) {
+    const Json* v = obj ? obj->find(key) : nullptr;
+    return v && v->kind == Json::NUMBER ? v->number : fallback;
+}
+
+// ---------------------------------------------------------------------------
+
+// Writes the corpus unless a stamp shows it already matches size and seed.
+void writeCorpus(const std::string& dir, size_t bytes, const std::vector<PerfCase>& cases) {
+    ::mkdir(dir.c_str(), 0755);
+    const std::string stampPath = dir + "/corpus.stamp";
+    const std::string stamp = std::to_string(bytes) + " " + std::to_string(CORPUS_SEED);
+    std::string existing;
+    std::getline(std::ifstream(stampPath), existing);
+
+    std::map<LineLengths, std::vector<CorpusFormat>> needed;
+    for (const auto& c : cases) {
+        std::vector<CorpusFormat>& formats = needed[c.lengths];
+        if (std::find(formats.begin(), formats.end(), c.format) == formats.end()) {
+            formats.push_back(c.format);
+        }
+    }
+    for (const auto& entry : needed) {
+        std::string content;
+        for (CorpusFormat format : entry.second) {
+            const std::string path = corpusPath(dir, entry.first, format);
+            struct stat st;
+            if (existing == stamp && ::stat(path.c_str(), &st) == 0) {
+                continue;
+            }
+            if (content.empty()) {
+                content = generateCorpus(bytes, entry.first, CORPUS_SEED);
+            }
+            std::cerr << "Generating " << path << std::endl;
+            try {
+                writeCorpusFile(path, content, format);
+            } catch (const std::exception& ex) {
+                // The cases using this file fail on their own.
+                std::cerr << "WARNING: " << ex.what() << std::endl;
+                std::remove(path.c_str());
+            }
+        }
+    }
+    std::ofstream(stampPath) << stamp << "\n";
+}
+
+// Generates the corpus in a child process.  A forked ztail starts with the
+// parent's resident pages counted in its peak RSS, so the runner itself must
+// never hold the uncompressed corpus.
+void prepareCorpus(const std::string& dir, size_t bytes, const std::vector<PerfCase>& cases) {
+    std::cout.flush();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed: " + std::string(std::strerror(errno)));
+    }
+    if (pid == 0) {
+        try {
+            writeCorpus(dir, bytes, cases);
+        } catch (const std::exception& ex) {
+            std::cerr << "ERROR: " << ex.what() << std::endl;
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            throw std::runtime_error("waitpid failed: " + std::string(std::strerror(errno)));
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("Failed to generate the corpus in " + dir);
+    }
+}
+
+// Runs ztail once with stdout discarded; throws when it fails.
+Measurement runOnce(const std::string& ztail, const std::vector<std::string>& args) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(ztail.c_str()));
+    for (const auto& a : args) {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed: " + std::string(std::strerror(errno)));
+    }
+    if (pid == 0) {
+        const int devNull = ::open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            ::dup2(devNull, STDOUT_FILENO);
+            ::close(devNull);
+        }
+        ::execv(ztail.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    std::memset(&ru, 0, sizeof(ru));
+    while (::wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            throw std::runtime_error("wait4 failed: " + std::string(std::strerror(errno)));
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("ztail exited with status " + std::to_string(WIFEXITED(status) ? WEXITSTATUS(status) : -1));
+    }
+
+    auto ms = [](const struct timeval& tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; };
+    Measurement m;
+    m.wallMs = std::chrono::duration<double, std::milli>(end - start).count();
+    m.cpuMs = ms(ru.ru_utime) + ms(ru.ru_stime);
+    m.rssKb = static_cast<double>(ru.ru_maxrss);
+    return m;
+}
+
+// Best of runs: the minimum is the least noisy estimate of the achievable cost.
+Measurement measure(const std::string& ztail, const std::vector<std::string>& args, int runs) {
+    Measurement best = runOnce(ztail, args);
+    for (int i = 1; i < runs; ++i) {
+        const Measurement m = runOnce(ztail, args);
+        best.wallMs = std::min(best.wallMs, m.wallMs);
+        best.cpuMs = std::min(best.cpuMs, m.cpuMs);
+        best.rssKb = std::min(best.rssKb, m.rssKb);
+    }
+    return best;
+}
+
+void writeBaseline(const std::string& path, size_t corpusBytes, double tolerance, double rssTolerance,
+                   const std::map<std::string, Measurement>& results) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    out << "{\n"
+        << "  \"corpus_bytes\": " << corpusBytes << ",\n"
+        << "  \"tolerance\": " << std::setprecision(2) << tolerance << ",\n"
+        << "  \"rss_tolerance\": " << rssTolerance << ",\n"
+        << std::setprecision(1) << "  \"cases\": {\n";
+    size_t i = 0;
+    for (const auto& r : results) {
+        out << "    \"" << r.first << "\": {\"wall_ms\": " << r.second.wallMs << ", \"cpu_ms\": " << r.second.cpuMs
+            << ", \"rss_kb\": " << std::setprecision(0) << r.second.rssKb << std::setprecision(1) << "}"
+            << (++i < results.size() ? "," : "") << "\n";
+    }
+    out << "  }\n}\n";
+    std::ofstream ofs(path, std::ios::trunc);
+    ofs << out.str();
+    if (!ofs) {
+        throw std::runtime_error("Failed to write baseline: " + path);
+    }
+}
+
+void usage(const char* progName) {
+    std::cerr
+        << "Usage: " << progName << " --ztail PATH --baseline FILE [options]\n"
+        << "      --work-dir DIR  : where the corpus is generated and cached (default = perf_corpus)\n"
+        << "      --runs N        : runs per case, the best one counts (default = 3)\n"
+        << "      --filter TEXT   : only run cases whose name contains TEXT\n"
+        << "      --update        : rewrite the baseline with the current measurements\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        std::string ztail;
+        std::string baselinePath;
+        std::string workDir = "perf_corpus";
+        std::string filter;
+        int runs = 3;
+        bool update = false;
+
+        static struct option long_opts[] = {
+            {"help",     no_argument,       nullptr, 'h'},
+            {"ztail",    required_argument, nullptr, 1000},
+            {"baseline", required_argument, nullptr, 1001},
+            {"work-dir", required_argument, nullptr, 1002},
+            {"runs",     required_argument, nullptr, 1003},
+            {"filter",   required_argument, nullptr, 1004},
+            {"update",   no_argument,       nullptr, 1005},
+            {0, 0, 0, 0}
+        };
+        int opt;
+        while ((opt = getopt_long(argc, argv, "h", long_opts, nullptr)) != -1) {
+            switch (opt) {
+            case 'h': usage(argv[0]); return EXIT_SUCCESS;
+            case 1000: ztail = optarg; break;
+            case 1001: baselinePath = optarg; break;
+            case 1002: workDir = optarg; break;
+            case 1003: runs = std::max(1, std::atoi(optarg)); break;
+            case 1004: filter = optarg; break;
+            case 1005: update = true; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+            }
+        }
+        if (ztail.empty() || baselinePath.empty()) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        Json baseline;
+        std::ifstream in(baselinePath);
+        if (in) {
+            std::stringstream ss;
+            ss << in.rdbuf();
+            baseline = JsonParser(ss.str()).parse();
+        } else if (!update) {
+            throw std::runtime_error("Failed to read baseline: " + baselinePath);
+        }
+        const size_t corpusBytes = static_cast<size_t>(numberOr(&baseline, "corpus_bytes", DEFAULT_CORPUS_BYTES));
+        const double tolerance = numberOr(&baseline, "tolerance", DEFAULT_TOLERANCE);
+        const double rssTolerance = numberOr(&baseline, "rss_tolerance", DEFAULT_RSS_TOLERANCE);
+        const Json* baseCases = baseline.find("cases");
+
+        std::vector<PerfCase> cases;
+        for (const auto& c : perfCases()) {
+            if (c.name.find(filter) != std::string::npos) {
+                cases.push_back(c);
+            }
+        }
+        prepareCorpus(workDir, corpusBytes, cases);
+
+        std::map<std::string, Measurement> results;
+        int failures = 0;
+        std::cout << std::left << std::setw(28) << "case" << std::right << std::setw(12) << "wall ms"
+                  << std::setw(12) << "cpu ms" << std::setw(12) << "rss KiB" << "  verdict\n";
+        for (const auto& c : cases) {
+            std::vector<std::string> args = c.args;
+            args.push_back(corpusPath(workDir, c.lengths, c.format));
+            Measurement m;
+            try {
+                m = measure(ztail, args, runs);
+            } catch (const std::exception& ex) {
+                std::cout << std::left << std::setw(28) << c.name << "  FAILED: " << ex.what() << "\n";
+                ++failures;
+                continue;
+            }
+            results[c.name] = m;
+
+            // A case without a baseline would never fail, so it is an error
+            // until --update records it.
+            std::string verdict = "no baseline";
+            const Json* base = baseCases ? baseCases->find(c.name) : nullptr;
+            if (!base && !update) {
+                verdict = "FAILED: no baseline";
+                ++failures;
+            }
+            if (base) {
+                std::vector<std::string> regressions;
+                auto check = [&](const char* key, double value, double tol, double slack) {
+                    const double limit = numberOr(base, key, value) * (1.0 + tol) + slack;
+                    if (value > limit) {
+                        std::ostringstream r;
+                        r << key << " " << std::fixed << std::setprecision(1) << value << " > " << limit;
+                        regressions.push_back(r.str());
+                    }
+                };
+                check("wall_ms", m.wallMs, tolerance, TIME_SLACK_MS);
+                check("cpu_ms", m.cpuMs, tolerance, TIME_SLACK_MS);
+                check("rss_kb", m.rssKb, rssTolerance, RSS_SLACK_KB);
+                verdict = "ok";
+                if (!regressions.empty() && !update) {
+                    verdict = "REGRESSION";
+                    for (const auto& r : regressions) verdict += " (" + r + ")";
+                    ++failures;
+                }
+            }
+            std::cout << std::left << std::setw(28) << c.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(12) << m.wallMs << std::setw(12) << m.cpuMs << std::setprecision(0)
+                      << std::setw(12) << m.rssKb << "  " << verdict << "\n";
+        }
+
+        if (update) {
+            // Cases that were filtered out or failed keep their old numbers.
+            if (baseCases) {
+                for (const auto& member : baseCases->members) {
+                    if (results.count(member.first) == 0) {
+                        Measurement old;
+                        old.wallMs = numberOr(&member.second, "wall_ms", 0);
+                        old.cpuMs = numberOr(&member.second, "cpu_ms", 0);
+                        old.rssKb = numberOr(&member.second, "rss_kb", 0);
+                        results[member.first] = old;
+                    }
+                }
+            }
+            writeBaseline(baselinePath, corpusBytes, tolerance, rssTolerance, results);
+            std::cerr << "Updated " << baselinePath << std::endl;
+            return EXIT_SUCCESS;
+        }
+        if (failures > 0) {
+            std::cerr << failures << " case(s) failed or regressed" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "ERROR: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,335 @@
+#include "bloom_sidecar.h"
+#include "sidecar.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr char BLOOM_MAGIC[8] = {'Z', 'T', 'B', 'L', 'O', 'O', 'M', '2'};
+constexpr uint32_t HASH_COUNT = 7;      // ~1% false positives at 10 bits per token
+constexpr uint64_t BITS_PER_TOKEN = 10;
+constexpr uint64_t GRAM_SEED = 0x9e3779b97f4a7c15ULL; // keeps n-grams apart from whole tokens
+
+inline bool isTokenChar(unsigned char c) {
+    return std::isalnum(c) || c == '_' || c == '-';
+}
+
+template <typename F>
+void forEachToken(const char* data, size_t len, F&& fn) {
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && !isTokenChar(static_cast<unsigned char>(data[i]))) ++i;
+        size_t start = i;
+        while (i < len && isTokenChar(static_cast<unsigned char>(data[i]))) ++i;
+        if (i - start >= BloomSidecar::MIN_TOKEN) {
+            fn(data + start, i - start);
+        }
+    }
+}
+
+inline uint64_t bitIndex(uint64_t hash, uint32_t i, uint64_t nbits) {
+    const uint64_t h2 = ((hash >> 32) | (hash << 32)) | 1;
+    return (hash + i * h2) % nbits;
+}
+
+// Token hashes collected for the blocks a still unfinished line touches.
+struct PendingBlock {
+    std::vector<uint64_t> hashes;
+
+    void compact() {
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    }
+};
+
+// Calls fn with the hash of every n-gram of a token; shorter tokens have none.
+template <typename F>
+void forEachGram(const char* token, size_t len, size_t n, F&& fn) {
+    for (size_t i = 0; i + n <= len; ++i) {
+        fn(BloomSidecar::hashToken(token + i, n) ^ GRAM_SEED);
+    }
+}
+
+} // namespace
+
+uint64_t BloomSidecar::hashToken(const char* token, size_t len) {
+    uint64_t h = 14695981039346656037ULL; // FNV-1a, then a splitmix64 finalizer
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(token[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+std::string BloomSidecar::pathFor(const std::string& filename) {
+    return filename + ".ztbloom";
+}
+
+size_t BloomSidecar::build(const std::string& filename) {
+    DetectionResult det = detectCompressionType(filename);
+    if (!det.file) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    const SourceStamp stamp = sourceStampOf(filename);
+    const int fd = fileno(det.file.get());
+    const std::vector<CompressedBlock> blocks = listCompressedBlocks(fd, det.type);
+    if (blocks.empty()) {
+        throw std::runtime_error("'" + filename + "' has no independently decodable blocks (use BGZF, "
+                                 "multi-frame zstd or multi-block xz)");
+    }
+
+    std::string out;
+    out.append(BLOOM_MAGIC, sizeof(BLOOM_MAGIC));
+    putValue<uint64_t>(out, stamp.size);
+    putValue<int64_t>(out, stamp.mtimeSec);
+    putValue<int64_t>(out, stamp.mtimeNsec);
+    putValue<uint32_t>(out, static_cast<uint32_t>(det.type));
+    putValue<uint32_t>(out, HASH_COUNT);
+    putValue<uint32_t>(out, static_cast<uint32_t>(GRAM));
+    putValue<uint64_t>(out, blocks.size());
+
+    size_t emitted = 0;
+    auto emitBlock = [&](PendingBlock& pb) {
+        pb.compact();
+        const CompressedBlock& b = blocks[emitted++];
+        const uint64_t words = std::max<uint64_t>(1, (pb.hashes.size() * BITS_PER_TOKEN + 63) / 64);
+        std::vector<uint64_t> filter(static_cast<size_t>(words), 0);
+        for (uint64_t h : pb.hashes) {
+            for (uint32_t i = 0; i < HASH_COUNT; ++i) {
+                const uint64_t bit = bitIndex(h, i, words * 64);
+                filter[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+        putValue<uint64_t>(out, b.offset);
+        putValue<uint64_t>(out, b.size);
+        putValue<uint64_t>(out, b.rawSize);
+        putValue<uint32_t>(out, b.check);
+        putValue<uint32_t>(out, static_cast<uint32_t>(words));
+        out.append(reinterpret_cast<const char*>(filter.data()), filter.size() * sizeof(uint64_t));
+        pb.hashes.clear();
+    };
+
+    // open[k] holds the tokens of block emitted + k; the unfinished line at
+    // the end of the newest block touches all of them.
+    std::vector<PendingBlock> open;
+    std::string carry;
+    auto addLine = [&](const char* line, size_t len) {
+        auto add = [&](uint64_t h) {
+            for (auto& pb : open) {
+                pb.hashes.push_back(h);
+            }
+        };
+        forEachToken(line, len, [&](const char* tok, size_t tlen) {
+            add(hashToken(tok, tlen));
+            forEachGram(tok, tlen, GRAM, add);
+        });
+    };
+
+    BlockDecoder decoder(fd, det.type);
+    std::vector<char> data;
+    for (const CompressedBlock& block : blocks) {
+        decoder.decode(block, data);
+        if (carry.empty()) {
+            // No line continues into this block.
+            for (auto& pb : open) {
+                emitBlock(pb);
+            }
+            open.clear();
+        }
+        open.emplace_back();
+        const char* p = data.data();
+        const char* end = p + data.size();
+        while (const char* nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)))) {
+            if (!carry.empty()) {
+                carry.append(p, static_cast<size_t>(nl - p));
+                addLine(carry.data(), carry.size());
+                carry.clear();
+            } else {
+                addLine(p, static_cast<size_t>(nl - p));
+            }
+            p = nl + 1;
+            // Only the newest block can still be touched by later lines.
+            while (open.size() > 1) {
+                emitBlock(open.front());
+                open.erase(open.begin());
+            }
+            if (open.back().hashes.size() > (1u << 20)) {
+                open.back().compact();
+            }
+        }
+        carry.append(p, static_cast<size_t>(end - p));
+    }
+    if (!carry.empty()) {
+        addLine(carry.data(), carry.size());
+    }
+    for (auto& pb : open) {
+        emitBlock(pb);
+    }
+
+    writeSidecarFile(pathFor(filename), out);
+    return blocks.size();
+}
+
+bool BloomSidecar::load(const std::string& filename) {
+    std::string bytes;
+    if (!readSidecarFile(pathFor(filename), bytes)) {
+        return false;
+    }
+    SidecarCursor cur(bytes);
+    char magic[sizeof(BLOOM_MAGIC)];
+    SourceStamp stamp;
+    uint32_t storedType = 0;
+    uint64_t count = 0;
+    if (!cur.getBytes(magic, sizeof(magic)) || std::memcmp(magic, BLOOM_MAGIC, sizeof(magic)) != 0 ||
+        !cur.get(stamp.size) || !cur.get(stamp.mtimeSec) || !cur.get(stamp.mtimeNsec) ||
+        !cur.get(storedType) || !cur.get(hashCount) || !cur.get(gramLength) || !cur.get(count) ||
+        gramLength < MIN_TOKEN) {
+        return false;
+    }
+    if (!(stamp == sourceStampOf(filename))) {
+        return false;
+    }
+    // Every block takes its fixed fields and at least one filter word, so a
+    // count the file cannot hold is corrupt; it must not size allocations.
+    constexpr size_t MIN_BLOCK_BYTES = 3 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+    if (count > cur.remaining() / MIN_BLOCK_BYTES) {
+        return false;
+    }
+    type = static_cast<CompressionType>(storedType);
+    blockList.clear();
+    filterOffset.clear();
+    filterWords.clear();
+    bits.clear();
+    blockList.reserve(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; ++i) {
+        CompressedBlock b{};
+        uint32_t words = 0;
+        if (!cur.get(b.offset) || !cur.get(b.size) || !cur.get(b.rawSize) || !cur.get(b.check) ||
+            !cur.get(words) || words == 0 || words > cur.remaining() / sizeof(uint64_t)) {
+            return false;
+        }
+        const size_t offset = bits.size();
+        bits.resize(offset + words);
+        if (!cur.getBytes(bits.data() + offset, words * sizeof(uint64_t))) {
+            return false;
+        }
+        blockList.push_back(b);
+        filterOffset.push_back(offset);
+        filterWords.push_back(words);
+    }
+    return cur.atEnd();
+}
+
+bool BloomSidecar::mayContain(size_t block, uint64_t hash) const {
+    const uint64_t nbits = static_cast<uint64_t>(filterWords[block]) * 64;
+    const uint64_t* filter = bits.data() + filterOffset[block];
+    for (uint32_t i = 0; i < hashCount; ++i) {
+        const uint64_t bit = bitIndex(hash, i, nbits);
+        if ((filter[bit / 64] & (1ULL << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint64_t> BloomSidecar::probes(const std::string& needle) const {
+    // A token at either end of the needle may be part of a longer one in the
+    // line ("rror" of "error"), so it is only looked up by its n-grams, which
+    // any token containing it has too.
+    std::vector<uint64_t> hashes;
+    const char* begin = needle.data();
+    const char* end = begin + needle.size();
+    forEachToken(needle.data(), needle.size(), [&](const char* tok, size_t len) {
+        if (tok > begin && tok + len < end) {
+            hashes.push_back(hashToken(tok, len));
+        }
+        forEachGram(tok, len, gramLength, [&](uint64_t h) { hashes.push_back(h); });
+    });
+    return hashes;
+}
+
+bool BloomSidecar::canPrune(const std::string& needle) const {
+    return !probes(needle).empty();
+}
+
+std::vector<bool> BloomSidecar::candidates(const std::string& needle) const {
+    const std::vector<uint64_t> hashes = probes(needle);
+    std::vector<bool> result(blockList.size(), true);
+    for (size_t b = 0; b < blockList.size() && !hashes.empty(); ++b) {
+        for (uint64_t h : hashes) {
+            if (!mayContain(b, h)) {
+                result[b] = false;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+CandidateBlockReader::CandidateBlockReader(FilePtr&& f, const BloomSidecar& sidecar, std::vector<bool> cand)
+    : file(std::move(f)), blockList(sidecar.blocks()), candidates(std::move(cand)),
+      decoder(fileno(file.get()), sidecar.compressionType()), next(0), runStart(true),
+      decoded(), pending(), pendingPos(0), carry()
+{
+}
+
+// Decodes candidate blocks until some complete lines are pending.  Returns
+// false once every block has been visited.
+bool CandidateBlockReader::fillPending() {
+    pending.clear();
+    pendingPos = 0;
+    while (pending.empty() && next < blockList.size()) {
+        const size_t index = next++;
+        if (!candidates[index]) {
+            carry.clear();
+            runStart = true;
+            continue;
+        }
+        decoder.decode(blockList[index], decoded);
+        const char* p = decoded.data();
+        const char* end = p + decoded.size();
+        if (runStart && index > 0) {
+            // The first line started in a skipped block.
+            const char* nl = static_cast<const char*>(memchr(p, '\n', decoded.size()));
+            if (!nl) {
+                continue;
+            }
+            p = nl + 1;
+        }
+        runStart = false;
+        const bool lastBlock = index + 1 == blockList.size();
+        const char* cut = end;
+        if (!lastBlock) {
+            const char* nl = static_cast<const char*>(memrchr(p, '\n', static_cast<size_t>(end - p)));
+            cut = nl ? nl + 1 : p;
+        }
+        if (cut > p) {
+            pending.swap(carry);
+            carry.clear();
+            pending.insert(pending.end(), p, cut);
+        }
+        carry.insert(carry.end(), cut, end);
+    }
+    return !pending.empty();
+}
+
+bool CandidateBlockReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    bytesDecompressed = 0;
+    while (bytesDecompressed < outBuffer.size()) {
+        if (pendingPos == pending.size() && !fillPending()) {
+            break;
+        }
+        const size_t n = std::min(outBuffer.size() - bytesDecompressed, pending.size() - pendingPos);
+        std::memcpy(outBuffer.data() + bytesDecompressed, pending.data() + pendingPos, n);
+        bytesDecompressed += n;
+        pendingPos += n;
+    }
+    return bytesDecompressed > 0;
+}
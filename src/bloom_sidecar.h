@@ -0,0 +1,82 @@
+#ifndef BLOOM_SIDECAR_H
+#define BLOOM_SIDECAR_H
+
+#include "compression_type.h"
+#include "icompressor.h"
+#include "seekable_blocks.h"
+#include "file_ptr.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-block bloom filters of the tokens found in a block-seekable archive,
+// stored next to it as "<archive>.ztbloom".  A token is a run of letters,
+// digits, '_' or '-'; every line contributes its tokens, and the GRAM
+// character n-grams of each, to each block it touches, so a line split
+// across a block boundary is found from either side.
+class BloomSidecar {
+public:
+    static constexpr size_t MIN_TOKEN = 3; // shorter tokens are not indexed
+    static constexpr size_t GRAM = 6;      // n-gram length; needles need a token this long to match inside one
+
+    // Decodes every block of filename and writes its sidecar.  Returns the
+    // number of indexed blocks; throws when the file has no independently
+    // decodable blocks.
+    static size_t build(const std::string& filename);
+
+    static std::string pathFor(const std::string& filename);
+
+    // Loads the sidecar of filename.  Returns false when it is missing,
+    // malformed or older than the archive.
+    bool load(const std::string& filename);
+
+    CompressionType compressionType() const { return type; }
+    const std::vector<CompressedBlock>& blocks() const { return blockList; }
+
+    // Flags the blocks that may hold a line containing needle.  Tokens with
+    // a delimiter on both sides inside the needle are looked up whole; every
+    // token of at least GRAM characters, such as a bare id, by its n-grams.
+    // A needle with neither marks every block, and canPrune is false.
+    std::vector<bool> candidates(const std::string& needle) const;
+    bool canPrune(const std::string& needle) const;
+
+    static uint64_t hashToken(const char* token, size_t len);
+
+private:
+    bool mayContain(size_t block, uint64_t hash) const;
+    std::vector<uint64_t> probes(const std::string& needle) const;
+
+    CompressionType type = CompressionType::NONE;
+    uint32_t hashCount = 0;
+    uint32_t gramLength = 0;
+    std::vector<CompressedBlock> blockList;
+    std::vector<size_t> filterOffset;   // first word of each block's filter
+    std::vector<uint32_t> filterWords;  // filter length of each block in words
+    std::vector<uint64_t> bits;         // all filters, concatenated
+};
+
+// Streams the decoded contents of the candidate blocks of an archive.  Runs
+// of candidate blocks are emitted as complete lines only: partial lines that
+// continue into a skipped block cannot match and are dropped.
+class CandidateBlockReader : public ICompressor {
+public:
+    CandidateBlockReader(FilePtr&& file, const BloomSidecar& sidecar, std::vector<bool> candidates);
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    bool fillPending();
+
+    FilePtr file;
+    std::vector<CompressedBlock> blockList;
+    std::vector<bool> candidates;
+    BlockDecoder decoder;
+    size_t next;
+    bool runStart;
+    std::vector<char> decoded;
+    std::vector<char> pending;
+    size_t pendingPos;
+    std::vector<char> carry;
+};
+
+#endif // BLOOM_SIDECAR_H
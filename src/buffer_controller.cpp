@@ -0,0 +1,99 @@
+#include "buffer_controller.h"
+#include <algorithm>
+
+BufferController::BufferController(size_t initialSize, size_t maxSize)
+    : current(initialSize), minSize(std::min(MIN_SIZE, initialSize)),
+      maxSize(std::max(initialSize, maxSize)), peak(initialSize)
+{
+}
+
+size_t BufferController::onChunk(size_t bytes, uint64_t readNs, uint64_t producerWaitNs, uint64_t consumerWaitNs) {
+    windowBytes += bytes;
+    windowReadNs += readNs;
+    windowProducerWaitNs += producerWaitNs;
+    windowConsumerWaitNs += consumerWaitNs;
+    if (++chunks < WINDOW) {
+        return current;
+    }
+
+    const uint64_t busyNs = windowReadNs + windowProducerWaitNs;
+    const double rate = windowReadNs > 0 ? static_cast<double>(windowBytes) / static_cast<double>(windowReadNs) : 0;
+    if (busyNs > 0 && static_cast<double>(windowProducerWaitNs) > STALL_FRACTION * static_cast<double>(busyNs) &&
+        windowProducerWaitNs > windowConsumerWaitNs) {
+        growing = false;
+        step(false);
+    } else if (lastRate == 0) {
+        step(growing);
+    } else if (rate > lastRate * (1 + RATE_EPSILON)) {
+        step(growing);
+    } else if (rate < lastRate * (1 - RATE_EPSILON)) {
+        growing = !growing;
+        step(growing);
+    } else if (lastStep > 0) {
+        growing = false;
+        step(false);
+    } else {
+        hold();
+    }
+    lastRate = rate;
+
+    chunks = 0;
+    windowBytes = windowReadNs = windowProducerWaitNs = windowConsumerWaitNs = 0;
+    return current;
+}
+
+void BufferController::step(bool grow) {
+    const size_t next = grow ? std::min(current * 2, maxSize) : std::max(current / 2, minSize);
+    lastStep = 0;
+    if (next > current) {
+        ++growCount;
+        lastStep = 1;
+    } else if (next < current) {
+        ++shrinkCount;
+        lastStep = -1;
+    }
+    current = next;
+    peak = std::max(peak, current);
+}
+
+std::vector<char> BufferPool::acquire(size_t size) {
+    auto best = buffers.end();
+    for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+        if (it->capacity() >= size && it->capacity() / 4 <= size &&
+            (best == buffers.end() || it->capacity() < best->capacity())) {
+            best = it;
+        }
+    }
+    std::vector<char> buffer;
+    if (best != buffers.end()) {
+        buffer.swap(*best);
+        buffers.erase(best);
+    }
+    // Within the capacity of a pooled buffer only growth past its old size is
+    // zero-filled.
+    buffer.resize(size);
+    return buffer;
+}
+
+void BufferPool::release(std::vector<char>&& buffer) {
+    if (buffer.capacity() == 0) {
+        return;
+    }
+    buffers.push_back(std::move(buffer));
+    if (buffers.size() > maxPooled) {
+        // Drop the smallest buffer; large ones are the expensive ones to refill.
+        auto smallest = std::min_element(buffers.begin(), buffers.end(),
+            [](const std::vector<char>& a, const std::vector<char>& b) { return a.capacity() < b.capacity(); });
+        buffers.erase(smallest);
+    }
+}
+
+size_t scaleCodecBuffer(size_t baseIn, size_t baseOut, size_t outSize) {
+    constexpr size_t MIN_CODEC_BUFFER = 4096;
+    constexpr size_t MAX_CODEC_BUFFER = 16u << 20;
+    if (baseOut == 0 || outSize == baseOut) {
+        return baseIn;
+    }
+    const double scaled = static_cast<double>(baseIn) * static_cast<double>(outSize) / static_cast<double>(baseOut);
+    return std::min(MAX_CODEC_BUFFER, std::max(MIN_CODEC_BUFFER, static_cast<size_t>(scaled)));
+}
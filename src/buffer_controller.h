@@ -0,0 +1,81 @@
+#ifndef BUFFER_CONTROLLER_H
+#define BUFFER_CONTROLLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Picks the size of the read buffers of processStream from what the
+// pipeline measures.  Every WINDOW chunks it looks at how long the producer
+// and the consumer stalled and at the codec output rate of the window:
+//
+//  - a producer that mostly waits for free buffers, and longer than the
+//    consumer waited for filled ones, means parsing is the bottleneck, so
+//    larger buffers only cost memory: shrink;
+//  - otherwise hill-climb on the output rate: keep stepping (x2 or /2) in the
+//    current direction while the rate improves and turn around when it
+//    drops.  A growth that does not pay off is undone, since the smaller
+//    buffer is as fast and cheaper; otherwise a flat rate holds the size.
+class BufferController {
+public:
+    static constexpr size_t MIN_SIZE = 64 * 1024;
+    static constexpr unsigned WINDOW = 8;           // chunks per decision
+    static constexpr double STALL_FRACTION = 0.5;   // producer stall that forces shrinking
+    static constexpr double RATE_EPSILON = 0.10;    // relative rate change treated as noise
+
+    // Starts at initialSize and stays within [min(MIN_SIZE, initialSize), maxSize].
+    BufferController(size_t initialSize, size_t maxSize);
+
+    // Accounts one chunk of bytes produced in readNs; waits are the stalls
+    // since the previous chunk.  Returns the size the next buffers should have.
+    size_t onChunk(size_t bytes, uint64_t readNs, uint64_t producerWaitNs, uint64_t consumerWaitNs);
+
+    size_t size() const { return current; }
+    uint64_t grows() const { return growCount; }
+    uint64_t shrinks() const { return shrinkCount; }
+    size_t peakSize() const { return peak; }
+
+private:
+    void step(bool grow);
+    void hold() { lastStep = 0; }
+
+    size_t current;
+    size_t minSize;
+    size_t maxSize;
+    size_t peak;
+    bool growing = true;
+    int lastStep = 0; // +1 grown, -1 shrunk, 0 held by the last decision
+    double lastRate = 0;
+    unsigned chunks = 0;
+    uint64_t windowBytes = 0;
+    uint64_t windowReadNs = 0;
+    uint64_t windowProducerWaitNs = 0;
+    uint64_t windowConsumerWaitNs = 0;
+    uint64_t growCount = 0;
+    uint64_t shrinkCount = 0;
+};
+
+// Keeps released buffers for reuse, so resizing a pipeline buffer does not
+// allocate and zero-fill a fresh vector every time.  A pooled buffer is only
+// handed out if it is at most four times larger than requested; others are
+// freed when the pool is full.
+class BufferPool {
+public:
+    explicit BufferPool(size_t maxPooled = 4) : maxPooled(maxPooled) {}
+
+    // Returns a buffer of exactly size bytes; contents are unspecified.
+    std::vector<char> acquire(size_t size);
+    void release(std::vector<char>&& buffer);
+
+    size_t pooled() const { return buffers.size(); }
+
+private:
+    size_t maxPooled;
+    std::vector<std::vector<char>> buffers;
+};
+
+// Size of a codec's own input buffer when it is asked to fill outSize bytes,
+// scaled from the configured baseIn for the first request of baseOut bytes.
+size_t scaleCodecBuffer(size_t baseIn, size_t baseOut, size_t outSize);
+
+#endif // BUFFER_CONTROLLER_H
@@ -1,29 +1,77 @@
 #include "char_ring_buffer.h"
-#include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+size_t slotsFor(size_t capacity) {
+    size_t slots = 1;
+    while (slots < capacity) {
+        slots *= 2;
+    }
+    return capacity > 0 ? slots : 0;
+}
+
+} // namespace
 
 template <size_t MaxBytes>
-CharRingBuffer<MaxBytes>::CharRingBuffer(size_t cap, size_t lineCapacity, size_t bytesBudget)
-    : data(), offsets(cap), capacity(cap), start(0), end(0), offsetStart(0),
-      count(0), lineInProgress(false), currentLineStart(0)
+CharRingBuffer<MaxBytes>::CharRingBuffer(size_t cap, size_t lineCapacity, size_t bytesBudget,
+                                         const std::string& spillDir)
+    : data(), offsets(slotsFor(cap)), lineMask(cap > 0 ? offsets.size() - 1 : 0), capacity(cap), start(0),
+      end(0), offsetStart(0), count(0), lineInProgress(false), currentLineStart(0), spillDir(spillDir),
+      unsynced(0), bytesBudget(bytesBudget), dataTouched(0), slotsTouched(0)
 {
+    const size_t bytes = requiredBytes(cap, lineCapacity, bytesBudget);
+    if (bytes > MAX_DATA) {
+        throw std::runtime_error("ring of " + std::to_string(bytes) + " bytes exceeds the " +
+                                 std::to_string(MAX_DATA) + " bytes its offsets can address");
+    }
     if (bytesBudget > 0) {
-        data.resize(bytesBudget);
+        allocate(bytesBudget);
     } else if (capacity > 0 && lineCapacity > 0) {
-        data.resize(capacity * lineCapacity);
+        allocate(capacity * lineCapacity);
     }
 }
 
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::allocate(size_t bytes) {
+    if (spillDir.empty()) {
+        data.resize(bytes);
+    } else {
+        data.spill(spillDir, bytes);
+    }
+}
+
+template <size_t MaxBytes>
+size_t CharRingBuffer<MaxBytes>::requiredBytes(size_t capacity, size_t lineCapacity, size_t bytesBudget) {
+    if (bytesBudget > 0) {
+        return bytesBudget;
+    }
+    return capacity * (lineCapacity > 0 ? lineCapacity : LAZY_LINE_CAPACITY);
+}
+
+template <size_t MaxBytes>
+size_t CharRingBuffer<MaxBytes>::lazySize(size_t firstLen) const {
+    const size_t perLine = firstLen > LAZY_LINE_CAPACITY ? firstLen : LAZY_LINE_CAPACITY;
+    return capacity > MAX_DATA / perLine ? MAX_DATA : capacity * perLine;
+}
+
 template <size_t MaxBytes>
 void CharRingBuffer<MaxBytes>::add(std::string&& line) {
     if (capacity == 0) {
         return;
     }
+    if (!spillDir.empty()) {
+        append_segment(line.data(), line.size());
+        end_line();
+        return;
+    }
 
     size_t len = line.size();
     if (data.empty()) {
-        size_t perLine = len > 512 ? len : 512;
-        data.resize(capacity * perLine);
+        allocate(lazySize(len));
     }
 
     const size_t dataCap = data.size();
@@ -43,9 +91,9 @@ void CharRingBuffer<MaxBytes>::add(std::string&& line) {
 
     auto drop_oldest = [&]() {
         if (count == 0) return;
-        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) % capacity] : end;
+        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) & lineMask] : end;
         start = second_start;
-        offsetStart = (offsetStart + 1) % capacity;
+        offsetStart = (offsetStart + 1) & lineMask;
         count--;
     };
 
@@ -65,15 +113,16 @@ void CharRingBuffer<MaxBytes>::add(std::string&& line) {
     size_t e = static_cast<size_t>(end);
     if (e + len <= dataCap) {
         memcpy(&data[e], line.data(), len);
-        end = static_cast<Offset>((e + len) % dataCap);
+        end = static_cast<Offset>(e + len == dataCap ? 0 : e + len);
     } else {
         size_t first_part = dataCap - e;
         memcpy(&data[e], line.data(), first_part);
         memcpy(&data[0], line.data() + first_part, len - first_part);
         end = static_cast<Offset>(len - first_part);
     }
+    touch(e, len);
 
-    offsets[(offsetStart + count) % capacity] = lineStart;
+    setOffset((offsetStart + count) & lineMask, lineStart);
     if (count == 0) {
         start = lineStart;
     }
@@ -87,12 +136,11 @@ void CharRingBuffer<MaxBytes>::append_segment(const char* segment, size_t len) {
     }
 
     if (data.empty()) {
-        size_t perLine = len > 512 ? len : 512;
-        data.resize(capacity * perLine);
+        allocate(lazySize(len));
     }
 
-    const size_t dataCap = data.size();
-    if (len > dataCap) {
+    size_t dataCap = data.size();
+    if (len > dataCap && spillDir.empty()) {
         return; // segment too large to fit
     }
 
@@ -108,9 +156,10 @@ void CharRingBuffer<MaxBytes>::append_segment(const char* segment, size_t len) {
 
     auto drop_oldest = [&]() {
         if (count == 0) return;
-        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) % capacity] : end;
+        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) & lineMask]
+                                          : (lineInProgress ? currentLineStart : end);
         start = second_start;
-        offsetStart = (offsetStart + 1) % capacity;
+        offsetStart = (offsetStart + 1) & lineMask;
         count--;
     };
 
@@ -122,6 +171,19 @@ void CharRingBuffer<MaxBytes>::append_segment(const char* segment, size_t len) {
         lineInProgress = true;
     }
 
+    if (!spillDir.empty() && freeSpace() <= len) {
+        // A spilled ring grows instead of dropping lines while it is below
+        // its budget, and keeps a free byte so that start == end always
+        // means empty.
+        while (bytesBudget > 0 && dataCap >= bytesBudget && freeSpace() <= len && count > 0) {
+            drop_oldest();
+        }
+        if (freeSpace() <= len) {
+            grow(len + 1 - freeSpace());
+            dataCap = data.size();
+        }
+    }
+
     while (freeSpace() < len) {
         if (count == 0) break;
         drop_oldest();
@@ -134,13 +196,80 @@ void CharRingBuffer<MaxBytes>::append_segment(const char* segment, size_t len) {
     size_t e = static_cast<size_t>(end);
     if (e + len <= dataCap) {
         memcpy(&data[e], segment, len);
-        end = static_cast<Offset>((e + len) % dataCap);
+        end = static_cast<Offset>(e + len == dataCap ? 0 : e + len);
     } else {
         size_t first_part = dataCap - e;
         memcpy(&data[e], segment, first_part);
         memcpy(&data[0], segment + first_part, len - first_part);
         end = static_cast<Offset>(len - first_part);
     }
+    touch(e, len);
+    if (!spillDir.empty()) {
+        writeback(len);
+    }
+}
+
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::grow(size_t needed) {
+    const size_t oldCap = data.size();
+    const size_t required = oldCap + needed;
+    if (required > MAX_DATA) {
+        throw std::runtime_error("spilled ring of " + std::to_string(required) + " bytes exceeds the " +
+                                 std::to_string(MAX_DATA) + " bytes its offsets can address");
+    }
+    size_t newCap = std::min(MAX_DATA, std::max(oldCap * 2, required));
+    if (bytesBudget > 0) {
+        newCap = std::min(newCap, std::max(bytesBudget, required));
+    }
+    data.grow(newCap);
+
+    if (end < start) {
+        // The older part [start, oldCap) moves to the new end of the file so
+        // that the ring stays contiguous modulo newCap.
+        const size_t high = oldCap - static_cast<size_t>(start);
+        const size_t newStart = newCap - high;
+        memmove(&data[newStart], &data[static_cast<size_t>(start)], high);
+        const Offset delta = static_cast<Offset>(newStart - static_cast<size_t>(start));
+
+        // Lines are never empty here, so offsets in the moved part increase
+        // until the ring wraps.
+        Offset prev = start;
+        size_t i = 0;
+        for (; i < count; ++i) {
+            Offset& offset = offsets[(offsetStart + i) & lineMask];
+            if (offset < prev) {
+                break;
+            }
+            prev = offset;
+            offset += delta;
+        }
+        if (lineInProgress && i == count && currentLineStart >= prev) {
+            currentLineStart += delta;
+        }
+        start = static_cast<Offset>(newStart);
+    }
+
+    data.writeback(0, newCap);
+    unsynced = 0;
+}
+
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::writeback(size_t written) {
+    unsynced += written;
+    if (unsynced < WRITEBACK_BYTES) {
+        return;
+    }
+    const size_t dataCap = data.size();
+    const size_t e = static_cast<size_t>(end);
+    if (unsynced >= dataCap) {
+        data.writeback(0, dataCap);
+    } else if (unsynced <= e) {
+        data.writeback(e - unsynced, unsynced);
+    } else {
+        data.writeback(0, e);
+        data.writeback(dataCap - (unsynced - e), unsynced - e);
+    }
+    unsynced = 0;
 }
 
 template <size_t MaxBytes>
@@ -148,10 +277,14 @@ void CharRingBuffer<MaxBytes>::append_line(const char* line, size_t len) {
     if (capacity == 0) {
         return;
     }
+    if (!spillDir.empty()) {
+        append_segment(line, len);
+        end_line();
+        return;
+    }
 
     if (data.empty()) {
-        size_t perLine = len > 512 ? len : 512;
-        data.resize(capacity * perLine);
+        allocate(lazySize(len));
     }
 
     const size_t dataCap = data.size();
@@ -171,9 +304,9 @@ void CharRingBuffer<MaxBytes>::append_line(const char* line, size_t len) {
 
     auto drop_oldest = [&]() {
         if (count == 0) return;
-        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) % capacity] : end;
+        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) & lineMask] : end;
         start = second_start;
-        offsetStart = (offsetStart + 1) % capacity;
+        offsetStart = (offsetStart + 1) & lineMask;
         count--;
     };
 
@@ -195,15 +328,16 @@ void CharRingBuffer<MaxBytes>::append_line(const char* line, size_t len) {
         if (len > 0) {
             memcpy(&data[e], line, len);
         }
-        end = static_cast<Offset>((e + len) % dataCap);
+        end = static_cast<Offset>(e + len == dataCap ? 0 : e + len);
     } else {
         size_t first_part = dataCap - e;
         memcpy(&data[e], line, first_part);
         memcpy(&data[0], line + first_part, len - first_part);
         end = static_cast<Offset>(len - first_part);
     }
+    touch(e, len);
 
-    offsets[(offsetStart + count) % capacity] = lineStart;
+    setOffset((offsetStart + count) & lineMask, lineStart);
     if (count == 0) {
         start = lineStart;
     }
@@ -213,6 +347,9 @@ void CharRingBuffer<MaxBytes>::append_line(const char* line, size_t len) {
 
 template <size_t MaxBytes>
 void CharRingBuffer<MaxBytes>::end_line() {
+    if (!spillDir.empty() && capacity > 0) {
+        append_segment("\n", 1); // spilled lines are stored as printed
+    }
     if (capacity == 0 || data.empty()) {
         lineInProgress = false;
         return;
@@ -221,12 +358,12 @@ void CharRingBuffer<MaxBytes>::end_line() {
     if (!lineInProgress) {
         while (count == capacity) {
             if (count == 0) break;
-            Offset second_start = (count > 1) ? offsets[(offsetStart + 1) % capacity] : end;
+            Offset second_start = (count > 1) ? offsets[(offsetStart + 1) & lineMask] : end;
             start = second_start;
-            offsetStart = (offsetStart + 1) % capacity;
+            offsetStart = (offsetStart + 1) & lineMask;
             count--;
         }
-        offsets[(offsetStart + count) % capacity] = end;
+        setOffset((offsetStart + count) & lineMask, end);
         if (count == 0) {
             start = end;
         }
@@ -235,13 +372,13 @@ void CharRingBuffer<MaxBytes>::end_line() {
     }
 
     while (count == capacity) {
-        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) % capacity] : end;
+        Offset second_start = (count > 1) ? offsets[(offsetStart + 1) & lineMask] : end;
         start = second_start;
-        offsetStart = (offsetStart + 1) % capacity;
+        offsetStart = (offsetStart + 1) & lineMask;
         count--;
     }
 
-    offsets[(offsetStart + count) % capacity] = currentLineStart;
+    setOffset((offsetStart + count) & lineMask, currentLineStart);
     if (count == 0) {
         start = currentLineStart;
     }
@@ -250,15 +387,36 @@ void CharRingBuffer<MaxBytes>::end_line() {
 }
 
 template <size_t MaxBytes>
-void CharRingBuffer<MaxBytes>::print(size_t aggregationThreshold) const {
+void CharRingBuffer<MaxBytes>::print(size_t aggregationThreshold, OutputSink& out) const {
     if (count == 0) {
         return;
     }
+    if (!spillDir.empty()) {
+        // The ring holds the output verbatim: at most two regions of the file.
+        const size_t first = static_cast<size_t>(start);
+        const size_t last = static_cast<size_t>(lineInProgress ? currentLineStart : end);
+        out.flush();
+        const int fd = out.descriptor();
+        auto send = [&](size_t from, size_t len) {
+            if (fd >= 0) {
+                data.sendTo(fd, from, len);
+            } else {
+                out.write(&data[from], len);
+            }
+        };
+        if (first < last) {
+            send(first, last - first);
+        } else {
+            send(first, data.size() - first);
+            send(0, last);
+        }
+        return;
+    }
     const size_t dataCap = data.size();
     size_t totalLen = 0;
     for (size_t i = 0; i < count; ++i) {
-        size_t idx = (offsetStart + i) % capacity;
-        size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) % capacity : idx;
+        size_t idx = (offsetStart + i) & lineMask;
+        size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) & lineMask : idx;
         Offset startPos = offsets[idx];
         Offset endPos = (i + 1 < count) ? offsets[nextIdx] : end;
         if (startPos <= endPos) {
@@ -274,8 +432,8 @@ void CharRingBuffer<MaxBytes>::print(size_t aggregationThreshold) const {
         std::string output;
         output.reserve(totalLen);
         for (size_t i = 0; i < count; ++i) {
-            size_t idx = (offsetStart + i) % capacity;
-            size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) % capacity : idx;
+            size_t idx = (offsetStart + i) & lineMask;
+            size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) & lineMask : idx;
             Offset startPos = offsets[idx];
             Offset endPos = (i + 1 < count) ? offsets[nextIdx] : end;
 
@@ -287,23 +445,23 @@ void CharRingBuffer<MaxBytes>::print(size_t aggregationThreshold) const {
             }
             output.push_back('\n');
         }
-        std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+        out.write(output.data(), output.size());
     } else {
         std::string block;
         block.reserve(aggregationThreshold);
         for (size_t i = 0; i < count; ++i) {
-            size_t idx = (offsetStart + i) % capacity;
-            size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) % capacity : idx;
+            size_t idx = (offsetStart + i) & lineMask;
+            size_t nextIdx = (i + 1 < count) ? (offsetStart + i + 1) & lineMask : idx;
             Offset startPos = offsets[idx];
             Offset endPos = (i + 1 < count) ? offsets[nextIdx] : end;
 
             auto append_segment_to_block = [&](const char* ptr, size_t len) {
                 if (block.size() + len > aggregationThreshold && !block.empty()) {
-                    std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+                    out.write(block.data(), block.size());
                     block.clear();
                 }
                 if (len > aggregationThreshold) {
-                    std::cout.write(ptr, static_cast<std::streamsize>(len));
+                    out.write(ptr, len);
                 } else {
                     block.append(ptr, len);
                 }
@@ -317,20 +475,44 @@ void CharRingBuffer<MaxBytes>::print(size_t aggregationThreshold) const {
             }
 
             if (block.size() + 1 > aggregationThreshold && !block.empty()) {
-                std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+                out.write(block.data(), block.size());
                 block.clear();
             }
             block.push_back('\n');
         }
         if (!block.empty()) {
-            std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+            out.write(block.data(), block.size());
         }
     }
 }
 
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::touch(size_t from, size_t len) {
+    dataTouched = from + len > data.size() ? data.size() : std::max(dataTouched, from + len);
+}
+
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::setOffset(size_t slot, Offset value) {
+    offsets[slot] = value;
+    slotsTouched = std::max(slotsTouched, slot + 1);
+}
+
+// Both arrays are committed lazily, so only what was written counts.
 template <size_t MaxBytes>
 size_t CharRingBuffer<MaxBytes>::memoryUsage() const {
-    return sizeof(CharRingBuffer<MaxBytes>) + data.size() * sizeof(char) + offsets.size() * sizeof(Offset);
+    const size_t dataMemory = data.spilled() ? 0 : dataTouched * sizeof(char);
+    return sizeof(CharRingBuffer<MaxBytes>) + dataMemory + slotsTouched * sizeof(Offset);
+}
+
+template <size_t MaxBytes>
+void CharRingBuffer<MaxBytes>::clear() {
+    start = 0;
+    end = 0;
+    offsetStart = 0;
+    count = 0;
+    lineInProgress = false;
+    currentLineStart = 0;
+    unsynced = 0;
 }
 
 template class CharRingBuffer<UINT32_MAX>;
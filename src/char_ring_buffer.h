@@ -1,18 +1,47 @@
 #ifndef CHAR_RING_BUFFER_H
 #define CHAR_RING_BUFFER_H
 
-#include <vector>
+#include "mapped_array.h"
+#include "output_sink.h"
 #include <string>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <type_traits>
 
+// Stores the last capacity lines in one byte ring.  Offsets into it are
+// 32-bit unless MaxBytes needs more; a ring larger than its offsets can
+// address throws instead of wrapping them, so pick the instantiation with
+// requiredBytes().  Line slots are rounded up to a power of two and indexed
+// by masking; the byte ring wraps by comparison, so neither divides.  Both
+// live in lazily committed memory (MappedArray): construction is O(1) and
+// RSS grows with the lines actually stored, not with capacity.
+//
+// With a spillDir the byte ring is a sparse temporary file in that directory
+// instead.  It then stores lines with their newline, grows rather than
+// dropping lines for space (so lines of any length fit) until it reaches
+// bytesBudget, past which only a line longer than the whole ring grows it,
+// writes back every WRITEBACK_BYTES and print() sends it with sendfile when
+// the sink has a descriptor.
 template <size_t MaxBytes = UINT32_MAX>
 class CharRingBuffer {
 public:
     using Offset = std::conditional_t<MaxBytes<=UINT32_MAX,uint32_t,uint64_t>;
 
-    explicit CharRingBuffer(size_t capacity, size_t lineCapacity = 0, size_t bytesBudget = 0);
+    // Largest byte ring the offsets can address.
+    static constexpr size_t MAX_DATA = static_cast<size_t>(std::numeric_limits<Offset>::max());
+
+    // Line capacity assumed when the data is allocated lazily, on the first line.
+    static constexpr size_t LAZY_LINE_CAPACITY = 512;
+
+    // Bytes appended to a spilled ring between two writebacks.
+    static constexpr size_t WRITEBACK_BYTES = 64u << 20;
+
+    explicit CharRingBuffer(size_t capacity, size_t lineCapacity = 0, size_t bytesBudget = 0,
+                            const std::string& spillDir = "");
+
+    // Bytes of line data a ring constructed with these arguments allocates.
+    static size_t requiredBytes(size_t capacity, size_t lineCapacity, size_t bytesBudget);
 
     // Existing line based API
     void add(std::string&& line);
@@ -30,12 +59,24 @@ public:
     // and counts toward the ring capacity.
     void end_line();
 
-    void print(size_t aggregationThreshold) const;
+    void print(size_t aggregationThreshold, OutputSink& out = stdoutSink()) const;
+    // Bytes committed so far; the lazy reservation only counts once written.
     size_t memoryUsage() const;
 
+    // Drops every line but keeps the memory, for reuse on another input.
+    void clear();
+
 private:
-    std::vector<char> data;             // underlying byte storage
-    std::vector<Offset> offsets;        // ring of line start positions
+    size_t lazySize(size_t firstLen) const;
+    void allocate(size_t bytes);
+    void grow(size_t needed);
+    void writeback(size_t written);
+    void touch(size_t from, size_t len);
+    void setOffset(size_t slot, Offset value);
+
+    MappedArray<char> data;             // underlying byte storage
+    MappedArray<Offset> offsets;        // ring of line start positions, power-of-two sized
+    size_t lineMask;                    // offsets.size() - 1
     size_t capacity;                    // maximum number of lines
     Offset start;                       // index of first byte in data
     Offset end;                         // index one past the last byte
@@ -43,6 +84,11 @@ private:
     size_t count;                       // current number of lines
     bool lineInProgress;                // whether a line is being built
     Offset currentLineStart;            // start offset of current line
+    std::string spillDir;               // empty: data lives in memory
+    size_t unsynced;                    // bytes spilled since the last writeback
+    size_t bytesBudget;                 // bound of a spilled ring, 0 for none
+    size_t dataTouched;                 // bytes of data written at least once
+    size_t slotsTouched;                // entries of offsets written at least once
 };
 
 #endif // CHAR_RING_BUFFER_H
@@ -1,8 +1,7 @@
 #ifndef USE_CHAR_RING_BUFFER
 #include "circular_buffer.h"
-#include <iostream>
 
-CircularBuffer::CircularBuffer(size_t cap, size_t lineCapacity, size_t bytesBudget)
+CircularBuffer::CircularBuffer(size_t cap, size_t lineCapacity, size_t bytesBudget, const std::string& /*spillDir*/)
     : buffer(cap), capacity(cap), next(0), count(0), current_line(),
       bytesBudget(bytesBudget), currentBytes(0)
 {
@@ -63,7 +62,7 @@ void CircularBuffer::append_line(const char* line, size_t len) {
     add(std::move(tmp));
 }
 
-void CircularBuffer::print(size_t aggregationThreshold) const {
+void CircularBuffer::print(size_t aggregationThreshold, OutputSink& out) const {
     if (count == 0) {
         return;
     }
@@ -81,7 +80,7 @@ void CircularBuffer::print(size_t aggregationThreshold) const {
             output.append(buffer[idx]);
             output.push_back('\n');
         }
-        std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+        out.write(output.data(), output.size());
     } else {
         std::string block;
         block.reserve(aggregationThreshold);
@@ -89,19 +88,19 @@ void CircularBuffer::print(size_t aggregationThreshold) const {
             size_t idx = (start + i) % capacity;
             const std::string& line = buffer[idx];
             if (block.size() + line.size() + 1 > aggregationThreshold && !block.empty()) {
-                std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+                out.write(block.data(), block.size());
                 block.clear();
             }
             if (line.size() + 1 > aggregationThreshold) {
-                std::cout.write(line.data(), static_cast<std::streamsize>(line.size()));
-                std::cout.put('\n');
+                out.write(line.data(), line.size());
+                out.write("\n", 1);
             } else {
                 block.append(line);
                 block.push_back('\n');
             }
         }
         if (!block.empty()) {
-            std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+            out.write(block.data(), block.size());
         }
     }
 }
@@ -114,4 +113,14 @@ size_t CircularBuffer::memoryUsage() const {
     return total;
 }
 
+void CircularBuffer::clear() {
+    for (auto& line : buffer) {
+        line.clear();
+    }
+    next = 0;
+    count = 0;
+    current_line.clear();
+    currentBytes = 0;
+}
+
 #endif // USE_CHAR_RING_BUFFER
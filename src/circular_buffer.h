@@ -7,11 +7,21 @@
 #ifdef USE_CHAR_RING_BUFFER
 #include "char_ring_buffer.h"
 using CircularBuffer = CharRingBuffer<>;
+// For rings past 4 GiB or spilled to disk; see needsWideRing().
+using WideCircularBuffer = CharRingBuffer<static_cast<size_t>(UINT32_MAX) + 1>;
+
+// Whether a ring of these sizes needs 64-bit offsets, i.e. WideCircularBuffer.
+inline bool needsWideRing(size_t capacity, size_t lineCapacity, size_t bytesBudget) {
+    return CircularBuffer::requiredBytes(capacity, lineCapacity, bytesBudget) > UINT32_MAX;
+}
 #else
+#include "output_sink.h"
 
 class CircularBuffer {
 public:
-    explicit CircularBuffer(size_t capacity, size_t lineCapacity = 0, size_t bytesBudget = 0);
+    // Lines are kept in memory; spillDir is accepted for compatibility only.
+    explicit CircularBuffer(size_t capacity, size_t lineCapacity = 0, size_t bytesBudget = 0,
+                            const std::string& spillDir = "");
     void add(std::string&& line);
 
     // Streaming API compatible with CharRingBuffer
@@ -21,9 +31,12 @@ public:
     // Append a complete line from raw bytes in a single step.
     void append_line(const char* line, size_t len);
 
-    void print(size_t aggregationThreshold) const;
+    void print(size_t aggregationThreshold, OutputSink& out = stdoutSink()) const;
     size_t memoryUsage() const;
 
+    // Drops every line but keeps the memory, for reuse on another input.
+    void clear();
+
 private:
     std::vector<std::string> buffer;
     size_t capacity;
@@ -34,6 +47,13 @@ private:
     size_t currentBytes;
 };
 
+// Lines are separate strings, so there is no byte offset to outgrow.
+using WideCircularBuffer = CircularBuffer;
+
+inline bool needsWideRing(size_t, size_t, size_t) {
+    return false;
+}
+
 #endif // USE_CHAR_RING_BUFFER
 
 #endif // CIRCULAR_BUFFER_H
@@ -1,7 +1,9 @@
 #include "cli.h"
+#include "compression_type.h"
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <getopt.h>
 #include <cerrno>
 #include <limits>
@@ -16,10 +18,33 @@ void CLI::usage(const char* progName) {
         << "  -b, --zlib-buffer N : set zlib buffer size in bytes (default = 1048576)\n"
         << "      --xz-buffer N   : set xz buffer size in bytes (default = 32768)\n"
         << "      --zstd-window N : set max zstd window size in bytes (default = unlimited)\n"
+        << "      --zstd-dict FILE : decode zstd frames compressed with the dictionary in FILE (repeatable)\n"
         << "  -r, --read-buffer N : set read buffer size in bytes (default = 1048576)\n"
         << "  -e, --entry <name> : entry name inside zip archive\n"
+        << "      --all-entries : tail every entry of zip archives, in directory order\n"
+        << "      --member <name|glob> : tail members of a (compressed) tar archive\n"
+        << "      --format <type> : input type instead of detecting it: auto, none, gzip, bzip2, xz, zip, zstd, lz4\n"
+        << "      --no-cache[=direct] : drop the pages of each input from the page cache behind the\n"
+        << "                       reader; =direct reads compressed inputs with O_DIRECT instead\n"
         << "      --print-aggregation-threshold N : threshold in bytes for aggregated output (default = 8388608)\n"
         << "      --no-threads   : disable producer/consumer threading\n"
+        << "      --grep LITERAL : keep only lines containing LITERAL\n"
+        << "      --regex RE     : keep only lines matching the ECMAScript regex RE\n"
+        << "      --build-bloom  : write a per-block bloom filter sidecar (<file>.ztbloom) and exit\n"
+        << "      --bloom        : with --grep, decode only blocks whose sidecar filter may match\n"
+        << "      --per-key K    : keep the last N lines of every key; K is a 1-based field number\n"
+        << "                       or NAME for NAME=value pairs (--bytes-budget bounds the arena)\n"
+        << "      --count        : print the number of lines of each input instead of its tail\n"
+        << "      --count-bytes  : like --count, also printing the number of decompressed bytes\n"
+        << "      --index        : while tailing a block-seekable archive, write its line index\n"
+        << "                       (<file>.ztlines); later tails and --lines-range use it\n"
+        << "      --lines-range A:B : print lines A to B (1-based, inclusive; B may be omitted)\n"
+        << "      --stats[=json] : report bytes, per-stage times, waits and memory of each input on stderr\n"
+        << "      --trace FILE   : write Chrome trace-event JSON spans of every pipeline stage to FILE\n"
+        << "      --compress-ring : keep the stored lines zstd-compressed in 1 MiB segments (for very large -n)\n"
+        << "      --spill-dir DIR : keep the stored lines in a sparse temporary file in DIR instead of memory\n"
+        << "      --memory-limit N : memory budget in bytes (K, M, G suffixes; default = half of the\n"
+        << "                       memory available to the process or its cgroup)\n"
         << "  -V, --version  : display program version and exit\n"
         << "  -h, --help     : display this help and exit\n"
         << "If no file is provided, the program reads from stdin.\n"
@@ -44,6 +69,25 @@ CLIOptions CLI::parse(int argc, char* argv[]) {
         {"entry",         required_argument, nullptr, 'e'},
         {"print-aggregation-threshold", required_argument, nullptr, 1000},
         {"no-threads",    no_argument,       nullptr, 1002},
+        {"grep",          required_argument, nullptr, 1005},
+        {"regex",         required_argument, nullptr, 1006},
+        {"build-bloom",   no_argument,       nullptr, 1007},
+        {"bloom",         no_argument,       nullptr, 1008},
+        {"per-key",       required_argument, nullptr, 1009},
+        {"count",         no_argument,       nullptr, 1010},
+        {"count-bytes",   no_argument,       nullptr, 1011},
+        {"index",         no_argument,       nullptr, 1012},
+        {"lines-range",   required_argument, nullptr, 1013},
+        {"stats",         optional_argument, nullptr, 1014},
+        {"trace",         required_argument, nullptr, 1015},
+        {"memory-limit",  required_argument, nullptr, 1016},
+        {"compress-ring", no_argument,       nullptr, 1017},
+        {"spill-dir",     required_argument, nullptr, 1018},
+        {"all-entries",   no_argument,       nullptr, 1019},
+        {"member",        required_argument, nullptr, 1020},
+        {"format",        required_argument, nullptr, 1021},
+        {"zstd-dict",     required_argument, nullptr, 1022},
+        {"no-cache",      optional_argument, nullptr, 1023},
         {0, 0, 0, 0}
     };
 
@@ -145,12 +189,144 @@ CLIOptions CLI::parse(int argc, char* argv[]) {
         case 1002:
             options.useThreads = false;
             break;
+        case 1005:
+            options.grepPattern = optarg;
+            break;
+        case 1006:
+            options.regexPattern = optarg;
+            break;
+        case 1007:
+            options.buildBloom = true;
+            break;
+        case 1008:
+            options.useBloom = true;
+            break;
+        case 1009:
+            options.perKey = optarg;
+            break;
+        case 1010:
+            options.count = true;
+            break;
+        case 1011:
+            options.count = true;
+            options.countBytes = true;
+            break;
+        case 1012:
+            options.buildIndex = true;
+            break;
+        case 1013: {
+            const char* colon = std::strchr(optarg, ':');
+            char* end = nullptr;
+            errno = 0;
+            unsigned long long first = std::strtoull(optarg, &end, 10);
+            bool ok = colon && errno == 0 && end == colon && optarg[0] != '-' && end != optarg && first > 0;
+            unsigned long long last = std::numeric_limits<uint64_t>::max();
+            if (ok && colon[1] != '\0') {
+                last = std::strtoull(colon + 1, &end, 10);
+                ok = errno == 0 && *end == '\0' && last >= first && colon[1] != '-';
+            }
+            if (!ok) {
+                throw std::runtime_error("--lines-range requires A:B with 1 <= A <= B");
+            }
+            options.linesFirst = first;
+            options.linesLast = last;
+            break;
+        }
+        case 1014:
+            if (optarg && std::strcmp(optarg, "json") != 0 && std::strcmp(optarg, "text") != 0) {
+                throw std::runtime_error("--stats accepts text or json");
+            }
+            options.stats = true;
+            options.statsJson = optarg && std::strcmp(optarg, "json") == 0;
+            break;
+        case 1015:
+            options.traceFile = optarg;
+            break;
+        case 1016: {
+            char* end = nullptr;
+            errno = 0;
+            unsigned long long val = std::strtoull(optarg, &end, 10);
+            static const char units[] = "KMG";
+            unsigned shift = 0;
+            if (end != optarg && *end != '\0' && end[1] == '\0') {
+                const char* unit = std::strchr(units, std::toupper(static_cast<unsigned char>(*end)));
+                if (unit) {
+                    shift = 10 * static_cast<unsigned>(unit - units + 1);
+                    ++end;
+                }
+            }
+            if (errno != 0 || end == optarg || *end != '\0' || optarg[0] == '-' || val == 0 ||
+                val > (std::numeric_limits<uint64_t>::max() >> shift)) {
+                throw std::runtime_error("--memory-limit requires a positive size");
+            }
+            options.memoryLimit = static_cast<uint64_t>(val) << shift;
+            break;
+        }
+        case 1017:
+            options.compressRing = true;
+            break;
+        case 1018:
+            options.spillDir = optarg;
+            break;
+        case 1019:
+            options.allEntries = true;
+            break;
+        case 1020:
+            options.tarMember = optarg;
+            break;
+        case 1021: {
+            CompressionType type;
+            if (std::string(optarg) == "auto") {
+                options.format.clear();
+            } else if (compressionTypeFromName(optarg, type)) {
+                options.format = optarg;
+            } else {
+                throw std::runtime_error("--format requires one of auto, none, gzip, bzip2, xz, zip, zstd, lz4");
+            }
+            break;
+        }
+        case 1022:
+            options.zstdDictionaries.push_back(optarg);
+            break;
+        case 1023:
+            if (optarg && std::strcmp(optarg, "direct") != 0) {
+                throw std::runtime_error("--no-cache accepts direct");
+            }
+            options.noCache = true;
+            options.directIo = optarg != nullptr;
+            break;
         case '?':
         default:
             throw std::runtime_error("Unknown option");
         }
     }
 
+    if (!options.grepPattern.empty() && !options.regexPattern.empty()) {
+        throw std::runtime_error("--grep and --regex are mutually exclusive");
+    }
+    if (options.useBloom && options.grepPattern.empty()) {
+        throw std::runtime_error("--bloom requires --grep");
+    }
+    if (options.count && (!options.grepPattern.empty() || !options.regexPattern.empty() || !options.perKey.empty())) {
+        throw std::runtime_error("--count cannot be combined with --grep, --regex or --per-key");
+    }
+    if (options.linesFirst > 0 && (options.count || !options.grepPattern.empty() ||
+                                   !options.regexPattern.empty() || !options.perKey.empty())) {
+        throw std::runtime_error("--lines-range cannot be combined with --count, --grep, --regex or --per-key");
+    }
+    if (options.compressRing && !options.perKey.empty()) {
+        throw std::runtime_error("--compress-ring cannot be combined with --per-key");
+    }
+    if (!options.spillDir.empty() && (options.compressRing || !options.perKey.empty())) {
+        throw std::runtime_error("--spill-dir cannot be combined with --compress-ring or --per-key");
+    }
+    if (options.allEntries && (!options.zipEntry.empty() || options.count || options.linesFirst > 0)) {
+        throw std::runtime_error("--all-entries cannot be combined with --entry, --count or --lines-range");
+    }
+    if (!options.tarMember.empty() && (options.allEntries || options.count || options.linesFirst > 0)) {
+        throw std::runtime_error("--member cannot be combined with --all-entries, --count or --lines-range");
+    }
+
     for (int index = optind; index < argc; ++index) {
         options.filenames.push_back(argv[index]);
     }
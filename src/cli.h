@@ -1,6 +1,7 @@
 #ifndef CLI_H
 #define CLI_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -10,12 +11,36 @@ struct CLIOptions {
     size_t bytesBudget = 0;  // Optional total bytes budget for stored lines
     std::vector<std::string> filenames;   // Names of files to process
     std::string zipEntry;   // Optional entry name for zip files
+    bool allEntries = false; // Tail every entry of zip archives
+    std::string tarMember;   // Name or glob of the tar members to tail
+    std::string format;      // Input type to assume instead of detecting it, empty for auto
+    bool noCache = false;    // Keep the inputs out of the page cache
+    bool directIo = false;   // With noCache, read compressed inputs with O_DIRECT
     size_t zlibBufferSize = 1 << 20; // Buffer size for zlib operations
     size_t xzBufferSize = 1 << 15;   // Buffer size for xz operations
     size_t zstdWindowSize = 0;       // Max window size for zstd (0 = default)
+    std::vector<std::string> zstdDictionaries; // Dictionaries for zstd frames that name one
     size_t readBufferSize = 1 << 20; // Buffer size for reading files
     size_t printAggregationThreshold = 8 * 1024 * 1024; // Threshold for block printing
     bool useThreads = true; // Enable producer/consumer threads
+    std::string grepPattern;  // Keep only lines containing this literal
+    std::string regexPattern; // Keep only lines matching this ECMAScript regex
+    bool buildBloom = false;  // Write bloom sidecars for the inputs and exit
+    bool useBloom = false;    // Skip blocks excluded by a bloom sidecar during --grep
+    std::string perKey;       // Keep the last N lines per key selected by this spec
+    bool count = false;       // Print line counts instead of tails
+    bool countBytes = false;  // With count, also print decompressed byte counts
+    bool buildIndex = false;  // Write a line index sidecar while tailing
+    uint64_t linesFirst = 0;  // First line of --lines-range (0 = not requested)
+    uint64_t linesLast = 0;   // Last line of --lines-range
+    bool stats = false;       // Report per-stage timings on stderr
+    bool statsJson = false;   // With stats, report one JSON object per input
+    std::string traceFile;    // Write Chrome trace-event JSON of the pipeline here
+    bool compressRing = false; // Keep the stored lines zstd-compressed
+    std::string spillDir;     // Keep the stored lines in a temporary file in this directory
+    uint64_t memoryLimit = 0; // Memory budget of the run (0 = half of what is available)
+    uint64_t xzMemLimit = 0;  // Memory limit of the xz decoder (0 = unlimited), set by planMemory
+    uint64_t countMemory = 1u << 30; // Decoded bytes in flight while counting, set by planMemory
 };
 
 class CLI {
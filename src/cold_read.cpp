@@ -0,0 +1,223 @@
+#include "cold_read.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Offsets, lengths and buffers of O_DIRECT reads are multiples of this.
+constexpr uint64_t DIRECT_ALIGN = 4096;
+constexpr size_t MINCORE_PAGES = 1u << 18; // residency is read this many pages at a time
+
+uint64_t alignDown(uint64_t offset) {
+    return offset & ~(DIRECT_ALIGN - 1);
+}
+
+struct DirectCookie {
+    int fd;
+    char* buf;          // DIRECT_ALIGN aligned, DIRECT_BUFFER bytes
+    uint64_t bufStart;  // file offset of buf[0]
+    size_t bufLen;      // valid bytes in buf
+    uint64_t pos;       // of the next byte handed out
+};
+
+ssize_t directPread(int fd, char* buf, uint64_t offset) {
+    ssize_t r;
+    do {
+        r = ::pread(fd, buf, DIRECT_BUFFER, static_cast<off_t>(offset));
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+ssize_t directRead(void* cookie, char* out, size_t size) {
+    DirectCookie* c = static_cast<DirectCookie*>(cookie);
+    if (c->pos < c->bufStart || c->pos >= c->bufStart + c->bufLen) {
+        c->bufStart = alignDown(c->pos);
+        const ssize_t r = directPread(c->fd, c->buf, c->bufStart);
+        if (r < 0) {
+            c->bufLen = 0;
+            return -1;
+        }
+        c->bufLen = static_cast<size_t>(r);
+        if (c->pos >= c->bufStart + c->bufLen) {
+            return 0;
+        }
+    }
+    const size_t n = std::min<uint64_t>(size, c->bufStart + c->bufLen - c->pos);
+    std::memcpy(out, c->buf + (c->pos - c->bufStart), n);
+    c->pos += n;
+    return static_cast<ssize_t>(n);
+}
+
+int directSeek(void* cookie, off64_t* offset, int whence) {
+    DirectCookie* c = static_cast<DirectCookie*>(cookie);
+    int64_t base = 0;
+    if (whence == SEEK_CUR) {
+        base = static_cast<int64_t>(c->pos);
+    } else if (whence == SEEK_END) {
+        struct stat st;
+        if (::fstat(c->fd, &st) != 0) {
+            return -1;
+        }
+        base = static_cast<int64_t>(st.st_size);
+    } else if (whence != SEEK_SET) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (base + *offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    c->pos = static_cast<uint64_t>(base + *offset);
+    *offset = static_cast<off64_t>(c->pos);
+    return 0;
+}
+
+int directClose(void* cookie) {
+    DirectCookie* c = static_cast<DirectCookie*>(cookie);
+    ::close(c->fd);
+    std::free(c->buf);
+    delete c;
+    return 0;
+}
+
+} // namespace
+
+void dropCached(int fd, uint64_t offset, uint64_t length) {
+    ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+}
+
+CachedPages::CachedPages(int fd) : page(static_cast<uint64_t>(::sysconf(_SC_PAGESIZE))) {
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    const size_t pages = (size + page - 1) / page;
+    std::vector<unsigned char> vec(std::min(pages, MINCORE_PAGES));
+    bool any = false;
+    cached.reserve(pages);
+    for (size_t first = 0; first < pages; first += vec.size()) {
+        const size_t count = std::min(vec.size(), pages - first);
+        const size_t offset = first * page;
+        if (::mincore(static_cast<char*>(map) + offset, std::min<size_t>(count * page, size - offset), vec.data()) != 0) {
+            any = false;
+            break;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            cached.push_back((vec[i] & 1) != 0);
+            any = any || (vec[i] & 1) != 0;
+        }
+    }
+    ::munmap(map, size);
+    if (!any) {
+        cached.clear();
+    }
+}
+
+void CachedPages::dropNew(int fd, uint64_t offset, uint64_t length) const {
+    const uint64_t end = length == 0 ? UINT64_MAX : offset + length;
+    // Runs of pages that were not cached, up to the end of the snapshot.
+    uint64_t p = offset / page;
+    while (p < cached.size() && p * page < end) {
+        if (cached[p]) {
+            ++p;
+            continue;
+        }
+        const uint64_t first = p;
+        while (p < cached.size() && !cached[p] && p * page < end) {
+            ++p;
+        }
+        const uint64_t from = std::max(first * page, offset);
+        dropCached(fd, from, std::min(p * page, end) - from);
+    }
+    const uint64_t from = std::max<uint64_t>(cached.size() * page, offset);
+    if (from < end) {
+        dropCached(fd, from, length == 0 ? 0 : end - from);
+    }
+}
+
+DropBehind::DropBehind(int fd, uint64_t start)
+    : fd(fd), before(fd), dropped(alignDown(start)), requested(start)
+{
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    advance(start);
+}
+
+void DropBehind::advance(uint64_t position) {
+    // Whole pages only: the one holding position is still being read.
+    const uint64_t end = alignDown(position);
+    if (end >= dropped + COLD_WINDOW) {
+        before.dropNew(fd, dropped, end - dropped);
+        dropped = end;
+    }
+    if (position + COLD_WINDOW > requested) {
+        const uint64_t from = std::max(requested, position);
+        requested = position + 2 * COLD_WINDOW;
+        ::posix_fadvise(fd, static_cast<off_t>(from), static_cast<off_t>(requested - from), POSIX_FADV_WILLNEED);
+    }
+}
+
+DropBehindReader::DropBehindReader(std::unique_ptr<ICompressor> comp, int fd)
+    : comp(std::move(comp)), fd(fd), behind(fd)
+{
+}
+
+bool DropBehindReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    const bool more = comp->decompress(outBuffer, bytesDecompressed);
+    const off_t offset = ::lseek(fd, 0, SEEK_CUR);
+    if (offset > 0) {
+        behind.advance(static_cast<uint64_t>(offset));
+    }
+    return more;
+}
+
+DropOnClose::DropOnClose(int fd) : fd(::dup(fd)), before(this->fd) {
+}
+
+DropOnClose::DropOnClose(const std::string& path) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)), before(this->fd) {
+}
+
+DropOnClose::~DropOnClose() {
+    if (fd >= 0) {
+        before.dropNew(fd);
+        ::close(fd);
+    }
+}
+
+FilePtr openDirectStream(int fd) {
+    const std::string path = "/proc/self/fd/" + std::to_string(fd);
+    const int direct = ::open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (direct < 0) {
+        return nullptr;
+    }
+    void* buf = nullptr;
+    if (::posix_memalign(&buf, DIRECT_ALIGN, DIRECT_BUFFER) != 0) {
+        ::close(direct);
+        return nullptr;
+    }
+    // Some file systems accept the flag and only fail the reads.
+    DirectCookie* cookie = new DirectCookie{direct, static_cast<char*>(buf), 0, 0, 0};
+    const ssize_t r = directPread(direct, cookie->buf, 0);
+    if (r < 0) {
+        directClose(cookie);
+        return nullptr;
+    }
+    cookie->bufLen = static_cast<size_t>(r);
+    cookie_io_functions_t io{directRead, nullptr, directSeek, directClose};
+    FILE* file = ::fopencookie(cookie, "rb", io);
+    if (!file) {
+        directClose(cookie);
+        return nullptr;
+    }
+    return FilePtr(file);
+}
@@ -0,0 +1,98 @@
+#ifndef COLD_READ_H
+#define COLD_READ_H
+
+#include "file_ptr.h"
+#include "icompressor.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reading inputs without leaving them in the page cache (--no-cache), for
+// runs over large cold archives on hosts whose cache belongs to another
+// workload.  Every call is a hint: failures are ignored.
+
+// Drops the cached pages of [offset, offset + length) of fd, to the end of
+// the file when length is 0.  Pages still mapped or dirty stay.
+void dropCached(int fd, uint64_t offset = 0, uint64_t length = 0);
+
+// The pages of a file that were cached when it was built, so that a run
+// drops only the pages it brought in and leaves those another workload
+// had cached.  Pages of a file that cannot be mapped (fd -1, a pipe), and
+// those past its size at the time, count as not cached.
+class CachedPages {
+public:
+    explicit CachedPages(int fd);
+
+    // dropCached of the pages of [offset, offset + length) that were not
+    // cached.
+    void dropNew(int fd, uint64_t offset = 0, uint64_t length = 0) const;
+
+private:
+    uint64_t page;
+    std::vector<bool> cached; // per page; empty when none was
+};
+
+// Follows a sequential reader of fd.  The kernel is told the access is
+// sequential, the next COLD_WINDOW bytes are always requested ahead of the
+// reader and the pages behind it that were not cached when it was created
+// are dropped as it advances.
+class DropBehind {
+public:
+    static constexpr uint64_t COLD_WINDOW = 8u << 20;
+
+    explicit DropBehind(int fd, uint64_t start = 0);
+
+    // Everything before position has been consumed.
+    void advance(uint64_t position);
+
+private:
+    int fd;
+    CachedPages before;
+    uint64_t dropped;   // pages before this offset were dropped
+    uint64_t requested; // readahead was requested up to this offset
+};
+
+// Reads through comp, which reads fd through stdio, following the
+// descriptor's offset with a DropBehind.
+class DropBehindReader : public ICompressor {
+public:
+    DropBehindReader(std::unique_ptr<ICompressor> comp, int fd);
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    std::unique_ptr<ICompressor> comp;
+    int fd;
+    DropBehind behind;
+};
+
+// Drops the pages of the file open on fd, or named by path, that were not
+// cached when it was created, once destroyed.  Created before the input is
+// first read, it also drops what detecting its format read ahead.  It keeps
+// its own descriptor, so the input may be closed first.
+class DropOnClose {
+public:
+    explicit DropOnClose(int fd);
+    explicit DropOnClose(const std::string& path);
+    ~DropOnClose();
+
+    DropOnClose(const DropOnClose&) = delete;
+    DropOnClose& operator=(const DropOnClose&) = delete;
+
+private:
+    int fd;
+    CachedPages before;
+};
+
+// Bytes an O_DIRECT stream reads at a time.
+constexpr size_t DIRECT_BUFFER = 4u << 20;
+
+// Reopens the regular file open on fd for O_DIRECT reads, which bypass the
+// page cache, behind a FILE that reads aligned DIRECT_BUFFER blocks into its
+// own buffer and seeks anywhere.  The FILE has no descriptor (fileno() is
+// -1) and starts at offset 0.  Returns nullptr when the file system does not
+// support O_DIRECT.
+FilePtr openDirectStream(int fd);
+
+#endif // COLD_READ_H
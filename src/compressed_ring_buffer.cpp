@@ -0,0 +1,124 @@
+#include "compressed_ring_buffer.h"
+#include <cstring>
+#include <stdexcept>
+
+CompressedRingBuffer::CompressedRingBuffer(size_t cap, size_t /*lineCapacity*/, size_t budget)
+    : capacity(cap), bytesBudget(budget), segments(), open(), openComplete(0), openLines(0), sealedLines(0),
+      rawBytes(0), compressedBytes(0), cctx(ZSTD_createCCtx(), &ZSTD_freeCCtx), scratch()
+{
+    if (!cctx) {
+        throw std::runtime_error("zstd error (0) while creating the ring compressor");
+    }
+}
+
+void CompressedRingBuffer::append_segment(const char* segment, size_t len) {
+    if (capacity == 0) {
+        return;
+    }
+    open.append(segment, len);
+}
+
+void CompressedRingBuffer::end_line() {
+    if (capacity == 0) {
+        return;
+    }
+    open.push_back('\n');
+    openComplete = open.size();
+    ++openLines;
+    if (openComplete >= SEGMENT_BYTES) {
+        seal();
+    }
+}
+
+void CompressedRingBuffer::append_line(const char* line, size_t len) {
+    if (capacity == 0) {
+        return;
+    }
+    open.append(line, len);
+    end_line();
+}
+
+void CompressedRingBuffer::seal() {
+    scratch.resize(ZSTD_compressBound(open.size()));
+    const size_t n = ZSTD_compressCCtx(cctx.get(), scratch.data(), scratch.size(), open.data(), open.size(), LEVEL);
+    if (ZSTD_isError(n)) {
+        throw std::runtime_error(std::string("zstd error while sealing a ring segment: ") + ZSTD_getErrorName(n));
+    }
+    segments.push_back(Segment{std::vector<char>(scratch.begin(), scratch.begin() + static_cast<std::ptrdiff_t>(n)),
+                               open.size(), openLines});
+    sealedLines += openLines;
+    rawBytes += open.size();
+    compressedBytes += n;
+    open.clear();
+    openComplete = 0;
+    openLines = 0;
+    evict();
+}
+
+void CompressedRingBuffer::evict() {
+    while (!segments.empty()) {
+        const Segment& oldest = segments.front();
+        const bool unneeded = sealedLines + openLines - oldest.lines >= capacity;
+        const bool overBudget = bytesBudget > 0 && compressedBytes + open.capacity() > bytesBudget;
+        if (!unneeded && !overBudget) {
+            break;
+        }
+        sealedLines -= oldest.lines;
+        rawBytes -= oldest.rawSize;
+        compressedBytes -= oldest.data.size();
+        segments.pop_front();
+    }
+}
+
+void CompressedRingBuffer::print(size_t aggregationThreshold, OutputSink& out) const {
+    const size_t total = sealedLines + openLines;
+    size_t skip = total > capacity ? total - capacity : 0;
+
+    std::string block;
+    auto emit = [&](const char* ptr, size_t len) {
+        if (block.size() + len > aggregationThreshold && !block.empty()) {
+            out.write(block.data(), block.size());
+            block.clear();
+        }
+        if (len > aggregationThreshold) {
+            out.write(ptr, len);
+        } else {
+            block.append(ptr, len);
+        }
+    };
+    // Emits the lines of [ptr, ptr + len) after the first skip ones.
+    auto emitLines = [&](const char* ptr, size_t len, size_t lines) {
+        if (skip >= lines) {
+            skip -= lines;
+            return;
+        }
+        const char* end = ptr + len;
+        for (; skip > 0; --skip) {
+            ptr = static_cast<const char*>(std::memchr(ptr, '\n', static_cast<size_t>(end - ptr))) + 1;
+        }
+        emit(ptr, static_cast<size_t>(end - ptr));
+    };
+
+    std::string raw;
+    for (const Segment& segment : segments) {
+        if (skip >= segment.lines) {
+            skip -= segment.lines;
+            continue;
+        }
+        raw.resize(segment.rawSize);
+        const size_t n = ZSTD_decompress(&raw[0], raw.size(), segment.data.data(), segment.data.size());
+        if (ZSTD_isError(n) || n != segment.rawSize) {
+            throw std::runtime_error("zstd error while reading a ring segment");
+        }
+        emitLines(raw.data(), raw.size(), segment.lines);
+    }
+    emitLines(open.data(), openComplete, openLines);
+    if (!block.empty()) {
+        out.write(block.data(), block.size());
+    }
+}
+
+size_t CompressedRingBuffer::memoryUsage() const {
+    return sizeof(CompressedRingBuffer) + static_cast<size_t>(compressedBytes) +
+           segments.size() * sizeof(Segment) + open.capacity() + scratch.capacity();
+}
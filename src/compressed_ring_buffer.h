@@ -0,0 +1,62 @@
+#ifndef COMPRESSED_RING_BUFFER_H
+#define COMPRESSED_RING_BUFFER_H
+
+#include "output_sink.h"
+#include <zstd.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Keeps the last capacity lines like CharRingBuffer, but compressed: lines
+// are appended to an open segment, and a segment of SEGMENT_BYTES is sealed
+// with zstd level 1.  Whole sealed segments are evicted once the newer ones
+// hold capacity lines, or when the compressed bytes exceed bytesBudget (the
+// ring then holds fewer lines).  Segments are only decompressed by print(),
+// so on typical log text several times more history fits in the same memory
+// at the cost of compressing every byte once.
+class CompressedRingBuffer {
+public:
+    static constexpr size_t SEGMENT_BYTES = 1u << 20;
+    static constexpr int LEVEL = 1;
+
+    explicit CompressedRingBuffer(size_t capacity, size_t lineCapacity = 0, size_t bytesBudget = 0);
+
+    // Streaming API compatible with CharRingBuffer
+    void append_segment(const char* segment, size_t len);
+    void end_line();
+    void append_line(const char* line, size_t len);
+
+    void print(size_t aggregationThreshold, OutputSink& out = stdoutSink()) const;
+    size_t memoryUsage() const;
+
+    // Uncompressed and compressed bytes of the sealed segments.
+    uint64_t sealedRawBytes() const { return rawBytes; }
+    uint64_t sealedBytes() const { return compressedBytes; }
+
+private:
+    struct Segment {
+        std::vector<char> data; // zstd frame of newline terminated lines
+        size_t rawSize;
+        size_t lines;
+    };
+
+    void seal();
+    void evict();
+
+    size_t capacity;
+    size_t bytesBudget;             // 0: only capacity bounds the ring
+    std::deque<Segment> segments;   // oldest first
+    std::string open;               // newline terminated lines not yet sealed, then the current line
+    size_t openComplete;            // bytes of open holding complete lines
+    size_t openLines;
+    size_t sealedLines;
+    uint64_t rawBytes;
+    uint64_t compressedBytes;
+    std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> cctx;
+    std::vector<char> scratch;      // compression output before it is copied to its exact size
+};
+
+#endif // COMPRESSED_RING_BUFFER_H
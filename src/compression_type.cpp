@@ -1,29 +1,72 @@
 #include "compression_type.h"
+#include "pushback_stream.h"
+#include <cerrno>
 #include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// Enough for every magic number compressionTypeOf() checks.
+constexpr size_t MAGIC_PREFIX = 6;
+
+} // namespace
 
 DetectionResult detectCompressionType(const std::string& filename) {
     FilePtr file(std::fopen(filename.c_str(), "rb"));
     if (!file) {
         return {CompressionType::NONE, FilePtr(nullptr)};
     }
+    return detectCompressionType(std::move(file), filename);
+}
 
-    unsigned char bytes[6] = {0};
-    size_t read = std::fread(bytes, 1, sizeof(bytes), file.get());
+DetectionResult detectCompressionType(FilePtr file, const std::string& filename) {
+    unsigned char header[6] = {0};
+    size_t read = std::fread(header, 1, sizeof(header), file.get());
+    CompressionType type = compressionTypeOf(header, read, filename);
+    return {type, std::move(file)};
+}
 
+DetectionResult detectStreamCompressionType(int fd, const std::string& filename) {
+    // A pipe may hand out the prefix in several reads.
+    std::string prefix(MAGIC_PREFIX, '\0');
+    size_t got = 0;
+    while (got < prefix.size()) {
+        const ssize_t r = ::read(fd, &prefix[got], prefix.size() - got);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            throw std::runtime_error("read error (" + std::to_string(errno) + ") while reading '" + filename + "'");
+        }
+        if (r == 0) {
+            break;
+        }
+        got += static_cast<size_t>(r);
+    }
+    prefix.resize(got);
+    const CompressionType type = compressionTypeOf(prefix.data(), prefix.size(), filename);
+    return {type, openPushbackStream(fd, std::move(prefix))};
+}
+
+CompressionType compressionTypeOf(const void* data, size_t size, const std::string& filename) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
     CompressionType type = CompressionType::NONE;
-    if (read >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD) {
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD) {
         type = CompressionType::ZSTD;
-    } else if (read >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+    } else if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
         type = CompressionType::GZIP;      // gzip or bgz
-    } else if (read >= 3 && bytes[0] == 'B' && bytes[1] == 'Z' && bytes[2] == 'h') {
+    } else if (size >= 3 && bytes[0] == 'B' && bytes[1] == 'Z' && bytes[2] == 'h') {
         type = CompressionType::BZIP2;     // bzip2
-    } else if (read >= 6 && bytes[0] == 0xFD && bytes[1] == 0x37 && bytes[2] == 0x7A &&
+    } else if (size >= 6 && bytes[0] == 0xFD && bytes[1] == 0x37 && bytes[2] == 0x7A &&
                bytes[3] == 0x58 && bytes[4] == 0x5A && bytes[5] == 0x00) {
         type = CompressionType::XZ;        // xz
-    } else if (read >= 4 && bytes[0] == 0x50 && bytes[1] == 0x4B &&
+    } else if (size >= 4 && bytes[0] == 0x50 && bytes[1] == 0x4B &&
                (bytes[2] == 0x03 || bytes[2] == 0x05 || bytes[2] == 0x07) &&
                (bytes[3] == 0x04 || bytes[3] == 0x06 || bytes[3] == 0x08)) {
         type = CompressionType::ZIP;       // zip
+    } else if (size >= 4 && bytes[0] == 0x04 && bytes[1] == 0x22 && bytes[2] == 0x4D && bytes[3] == 0x18) {
+        type = CompressionType::LZ4;       // lz4 frame
     } else {
         // Fallback based on file extension
         if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".zst") == 0) {
@@ -38,8 +81,33 @@ DetectionResult detectCompressionType(const std::string& filename) {
             type = CompressionType::XZ;
         } else if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".zip") == 0) {
             type = CompressionType::ZIP;
+        } else if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".lz4") == 0) {
+            type = CompressionType::LZ4;
         }
     }
+    return type;
+}
 
-    return {type, std::move(file)};
+bool compressionTypeFromName(const std::string& name, CompressionType& type) {
+    static const struct {
+        const char* name;
+        CompressionType type;
+    } names[] = {
+        {"none", CompressionType::NONE}, {"gzip", CompressionType::GZIP}, {"bzip2", CompressionType::BZIP2},
+        {"xz", CompressionType::XZ},     {"zip", CompressionType::ZIP},   {"zstd", CompressionType::ZSTD},
+        {"lz4", CompressionType::LZ4},
+    };
+    for (const auto& entry : names) {
+        if (name == entry.name) {
+            type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+void overrideCompressionType(DetectionResult& det, const std::string& format) {
+    if (!format.empty() && !compressionTypeFromName(format, det.type)) {
+        throw std::runtime_error("unknown format '" + format + "'");
+    }
 }
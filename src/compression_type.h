@@ -1,6 +1,7 @@
 #ifndef COMPRESSION_TYPE_H
 #define COMPRESSION_TYPE_H
 
+#include <cstddef>
 #include <string>
 #include "file_ptr.h"
 
@@ -10,7 +11,8 @@ enum class CompressionType {
     BZIP2,
     XZ,
     ZIP,
-    ZSTD
+    ZSTD,
+    LZ4
 };
 
 struct DetectionResult {
@@ -20,5 +22,25 @@ struct DetectionResult {
 
 DetectionResult detectCompressionType(const std::string& filename);
 
+// Detects the type of an already open file from its current position; the
+// name only serves the extension fallback.
+DetectionResult detectCompressionType(FilePtr file, const std::string& filename);
+
+// Detects the type of a descriptor that cannot seek, such as a pipe, from a
+// peeked prefix.  The returned file replays the prefix before the rest of fd
+// (see openPushbackStream); fd stays open when it is closed.
+DetectionResult detectStreamCompressionType(int fd, const std::string& filename);
+
+// Type of an input starting with the size bytes at data, falling back to the
+// extension of filename when no magic number matches.
+CompressionType compressionTypeOf(const void* data, size_t size, const std::string& filename);
+
+// Parses a --format name: none, gzip, bzip2, xz, zip, zstd or lz4.
+bool compressionTypeFromName(const std::string& name, CompressionType& type);
+
+// Replaces the detected type with the one format names; an empty format
+// keeps it.
+void overrideCompressionType(DetectionResult& det, const std::string& format);
+
 
 #endif // COMPRESSION_TYPE_H
@@ -1,9 +1,10 @@
 #include "compressor_bzip2.h"
+#include "trace.h"
 #include <stdexcept>
 #include <cerrno>
 
 CompressorBzip2::CompressorBzip2(FilePtr&& file, const std::string& filename)
-    : file(std::move(file)), bz(nullptr), bzerror(BZ_OK), eof(false), filename(filename)
+    : file(std::move(file)), bz(), inBuffer(IN_BUFFER_SIZE), inputEof(false), eof(false), filename(filename)
 {
     if (!this->file) {
         throw std::runtime_error("bzip2 error (" + std::to_string(errno) + ") while opening '" + filename + "'");
@@ -11,20 +12,15 @@ CompressorBzip2::CompressorBzip2(FilePtr&& file, const std::string& filename)
 
     std::fseek(this->file.get(), 0, SEEK_SET);
 
-    bz = BZ2_bzReadOpen(&bzerror, this->file.get(), 0, 0, nullptr, 0);
-    if (!bz || bzerror != BZ_OK) {
-        if (bz) {
-            BZ2_bzReadClose(&bzerror, bz);
-        }
+    const int ret = BZ2_bzDecompressInit(&bz, 0, 0);
+    if (ret != BZ_OK) {
         this->file.reset();
-        throw std::runtime_error("bzip2 error (" + std::to_string(bzerror) + ") while initializing '" + filename + "'");
+        throw std::runtime_error("bzip2 error (" + std::to_string(ret) + ") while initializing '" + filename + "'");
     }
 }
 
 CompressorBzip2::~CompressorBzip2() {
-    if (bz) {
-        BZ2_bzReadClose(&bzerror, bz);
-    }
+    BZ2_bzDecompressEnd(&bz);
     file.reset();
 }
 
@@ -34,18 +30,34 @@ bool CompressorBzip2::decompress(std::vector<char>& outBuffer, size_t& bytesDeco
         return false;
     }
 
-    int nread = BZ2_bzRead(&bzerror, bz, outBuffer.data(), static_cast<int>(outBuffer.size()));
-    if (bzerror != BZ_OK && bzerror != BZ_STREAM_END) {
-        throw std::runtime_error("bzip2 error (" + std::to_string(bzerror) + ") while decompressing '" + filename + "'");
-    }
-    if (bzerror == BZ_STREAM_END) {
-        eof = true;
-    }
-    if (nread < 0) {
-        bytesDecompressed = 0;
-        return false;
+    bz.next_out = outBuffer.data();
+    bz.avail_out = static_cast<unsigned int>(outBuffer.size());
+    while (bz.avail_out > 0) {
+        if (bz.avail_in == 0 && !inputEof) {
+            TraceSpan span("read");
+            const size_t nread = std::fread(inBuffer.data(), 1, inBuffer.size(), file.get());
+            if (nread == 0) {
+                inputEof = true;
+            }
+            bz.next_in = inBuffer.data();
+            bz.avail_in = static_cast<unsigned int>(nread);
+        }
+
+        const unsigned int before = bz.avail_out;
+        const int ret = BZ2_bzDecompress(&bz);
+        if (ret == BZ_STREAM_END) {
+            eof = true;
+            break;
+        }
+        if (ret != BZ_OK) {
+            throw std::runtime_error("bzip2 error (" + std::to_string(ret) + ") while decompressing '" + filename + "'");
+        }
+        if (inputEof && bz.avail_in == 0 && bz.avail_out == before) {
+            throw std::runtime_error("bzip2 error (" + std::to_string(BZ_UNEXPECTED_EOF) +
+                                     ") while decompressing '" + filename + "'");
+        }
     }
-    bytesDecompressed = static_cast<size_t>(nread);
+
+    bytesDecompressed = outBuffer.size() - bz.avail_out;
     return bytesDecompressed > 0;
 }
-
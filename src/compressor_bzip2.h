@@ -19,9 +19,14 @@ public:
     bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
 
 private:
+    // Compressed bytes read at a time, outside the decoder so the reads can
+    // be traced.
+    static constexpr size_t IN_BUFFER_SIZE = 64 * 1024;
+
     FilePtr file;
-    BZFILE* bz;
-    int bzerror;
+    bz_stream bz;
+    std::vector<char> inBuffer;
+    bool inputEof;
     bool eof;
     std::string filename;
 };
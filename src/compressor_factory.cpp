@@ -0,0 +1,47 @@
+#include "compressor_factory.h"
+#include "compressor_zlib.h"
+#include "compressor_zip.h"
+#include "compressor_bzip2.h"
+#include "compressor_xz.h"
+#include "compressor_zstd.h"
+#include "compressor_lz4.h"
+#include "compressor_libdeflate.h"
+#include "pushback_stream.h"
+#include <cstdint>
+#include <stdexcept>
+
+std::unique_ptr<ICompressor> openCompressor(DetectionResult& det, const std::string& filename,
+                                            const CLIOptions& options, ContextPool* pool) {
+    if (det.type == CompressionType::GZIP) {
+#ifdef ZTAIL_USE_LIBDEFLATE
+        if (CompressorLibdeflate::accepts(det.file.get())) {
+            return std::make_unique<CompressorLibdeflate>(std::move(det.file), filename, 64 << 20, pool);
+        }
+#endif
+        return std::make_unique<CompressorZlib>(std::move(det.file), filename, options.zlibBufferSize, pool);
+    } else if (det.type == CompressionType::BZIP2) {
+        return std::make_unique<CompressorBzip2>(std::move(det.file), filename);
+    } else if (det.type == CompressionType::XZ) {
+        return std::make_unique<CompressorXz>(std::move(det.file), filename, options.xzBufferSize,
+                                              options.xzMemLimit > 0 ? options.xzMemLimit : UINT64_MAX, pool);
+    } else if (det.type == CompressionType::ZIP) {
+        return std::make_unique<CompressorZip>(std::move(det.file), filename, options.zipEntry);
+    } else if (det.type == CompressionType::ZSTD) {
+        return std::make_unique<CompressorZstd>(std::move(det.file), filename, options.zstdWindowSize, pool);
+    } else if (det.type == CompressionType::LZ4) {
+        return std::make_unique<CompressorLz4>(std::move(det.file), filename, 1 << 16, pool);
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ICompressor> openReader(DetectionResult& det, const std::string& filename,
+                                        const CLIOptions& options, ContextPool* pool) {
+    if (det.type == CompressionType::ZIP && fileno(det.file.get()) < 0) {
+        throw std::runtime_error("zip archives need a seekable file; cannot read '" + filename + "' from a pipe");
+    }
+    std::unique_ptr<ICompressor> comp = openCompressor(det, filename, options, pool);
+    if (!comp) {
+        comp = std::make_unique<PlainStreamReader>(std::move(det.file), filename);
+    }
+    return comp;
+}
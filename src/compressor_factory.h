@@ -0,0 +1,24 @@
+#ifndef COMPRESSOR_FACTORY_H
+#define COMPRESSOR_FACTORY_H
+
+#include "cli.h"
+#include "compression_type.h"
+#include "icompressor.h"
+#include <memory>
+#include <string>
+
+class ContextPool;
+
+// Returns the decompressor matching the detected type, taking det.file, or
+// nullptr for plain input.  filename is only used in messages.  With a pool,
+// decoders that support it take their contexts and buffers from it.
+std::unique_ptr<ICompressor> openCompressor(DetectionResult& det, const std::string& filename,
+                                            const CLIOptions& options, ContextPool* pool = nullptr);
+
+// Like openCompressor, but plain input gets a reader handing on its bytes, so
+// the result is never null.  Throws for zip archives on streams that cannot
+// seek (see detectStreamCompressionType).
+std::unique_ptr<ICompressor> openReader(DetectionResult& det, const std::string& filename,
+                                        const CLIOptions& options, ContextPool* pool = nullptr);
+
+#endif // COMPRESSOR_FACTORY_H
@@ -0,0 +1,245 @@
+#include "compressor_libdeflate.h"
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+
+#include "context_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr size_t GZIP_FIXED_HEADER = 12; // up to and including XLEN
+
+uint32_t le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool isGzipMember(const char* p, size_t size) {
+    return size >= 2 && static_cast<unsigned char>(p[0]) == 0x1f && static_cast<unsigned char>(p[1]) == 0x8b;
+}
+
+// Total size of a BGZF block from its header and extra field (BSIZE + 1),
+// or 0 when the member carries no "BC" subfield.
+size_t bgzfBlockSize(const unsigned char* header, const unsigned char* extra, size_t xlen) {
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || (header[3] & 4) == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i + 4 <= xlen;) {
+        const uint32_t slen = le16(extra + i + 2);
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            return static_cast<size_t>(le16(extra + i + 4)) + 1;
+        }
+        i += 4 + slen;
+    }
+    return 0;
+}
+
+// Whether the first member of the file is a BGZF block.  Leaves the file
+// position at its start.
+bool startsWithBgzfBlock(FILE* file) {
+    std::fseek(file, 0, SEEK_SET);
+    unsigned char header[GZIP_FIXED_HEADER];
+    bool bgzf = false;
+    if (std::fread(header, 1, sizeof(header), file) == sizeof(header) && (header[3] & 4) != 0) {
+        std::vector<unsigned char> extra(le16(header + 10));
+        bgzf = std::fread(extra.data(), 1, extra.size(), file) == extra.size() &&
+               bgzfBlockSize(header, extra.data(), extra.size()) > 0;
+    }
+    std::fseek(file, 0, SEEK_SET);
+    return bgzf;
+}
+
+} // namespace
+
+CompressorLibdeflate::CompressorLibdeflate(FilePtr&& file, const std::string& filename, size_t maxMemberSize,
+                                           ContextPool* pool)
+    : file(std::move(file)), pool(pool), decompressor(nullptr, &libdeflate_free_decompressor), blocked(false), input(),
+      inPos(0), inSize(0), decoded(), decodedPos(0), fallback(), maxMemberSize(maxMemberSize),
+      eof(false), filename(filename)
+{
+    if (!this->file) {
+        throw std::runtime_error("zlib error (0) while opening '" + filename + "'");
+    }
+    if (pool) {
+        decompressor = pool->takeLibdeflate();
+    }
+    if (!decompressor) {
+        decompressor.reset(libdeflate_alloc_decompressor());
+    }
+    if (!decompressor) {
+        throw std::runtime_error("libdeflate error (0) while creating decompressor for '" + filename + "'");
+    }
+
+    std::fseek(this->file.get(), 0, SEEK_SET);
+    unsigned char magic[2];
+    if (std::fread(magic, 1, sizeof(magic), this->file.get()) != sizeof(magic) || magic[0] != 0x1f ||
+        magic[1] != 0x8b) {
+        throw std::runtime_error("zlib error (0) invalid header in '" + filename + "'");
+    }
+    blocked = startsWithBgzfBlock(this->file.get());
+    if (blocked) {
+        return;
+    }
+
+    TraceSpan span("read");
+    struct stat st;
+    if (pool && ::fstat(fileno(this->file.get()), &st) == 0) {
+        // One byte more than the file, so the first read reaches its end.
+        input = pool->takeBuffer(static_cast<size_t>(st.st_size) + 1);
+    }
+    while (!std::feof(this->file.get()) && !std::ferror(this->file.get())) {
+        if (inSize == input.size()) {
+            input.resize(std::max<size_t>(1 << 16, input.size() * 2));
+        }
+        inSize += std::fread(input.data() + inSize, 1, input.size() - inSize, this->file.get());
+    }
+    if (std::ferror(this->file.get())) {
+        throw std::runtime_error("zlib error (" + std::to_string(errno) + ") while reading '" + filename + "'");
+    }
+    input.resize(inSize);
+}
+
+CompressorLibdeflate::~CompressorLibdeflate() {
+    if (pool) {
+        pool->give(std::move(decompressor));
+        pool->give(std::move(input));
+        pool->give(std::move(decoded));
+    }
+}
+
+bool CompressorLibdeflate::accepts(FILE* file) {
+    struct stat st;
+    if (::fstat(fileno(file), &st) == 0 && static_cast<uint64_t>(st.st_size) <= LIBDEFLATE_MAX_INPUT) {
+        return true;
+    }
+    return startsWithBgzfBlock(file);
+}
+
+// Replaces the input with the next BGZF block; false at the end of the file.
+bool CompressorLibdeflate::readBgzfBlock() {
+    TraceSpan span("read");
+    input.resize(GZIP_FIXED_HEADER);
+    const size_t n = std::fread(input.data(), 1, GZIP_FIXED_HEADER, file.get());
+    inPos = 0;
+    inSize = 0;
+    if (n == 0 && !std::ferror(file.get())) {
+        return false;
+    }
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t xlen = n == GZIP_FIXED_HEADER ? le16(header + 10) : 0;
+    input.resize(GZIP_FIXED_HEADER + xlen);
+    if (n != GZIP_FIXED_HEADER || std::fread(input.data() + GZIP_FIXED_HEADER, 1, xlen, file.get()) != xlen) {
+        throw std::runtime_error("zlib error (" + std::to_string(Z_BUF_ERROR) + ") truncated BGZF block in '" +
+                                 filename + "'");
+    }
+    header = reinterpret_cast<const unsigned char*>(input.data());
+    const size_t blockSize = bgzfBlockSize(header, header + GZIP_FIXED_HEADER, xlen);
+    if (blockSize < GZIP_FIXED_HEADER + xlen) {
+        throw std::runtime_error("zlib error (" + std::to_string(Z_DATA_ERROR) + ") invalid BGZF block in '" +
+                                 filename + "'");
+    }
+    const size_t have = input.size();
+    input.resize(blockSize);
+    if (std::fread(input.data() + have, 1, blockSize - have, file.get()) != blockSize - have) {
+        throw std::runtime_error("zlib error (" + std::to_string(Z_BUF_ERROR) + ") truncated BGZF block in '" +
+                                 filename + "'");
+    }
+    inSize = blockSize;
+    return true;
+}
+
+// Inflates the member at inPos into decoded.  Returns false when the input
+// holds no further member; trailing bytes that are not gzip end the input
+// like they do for gzread().
+bool CompressorLibdeflate::nextMember() {
+    if (blocked && inPos == inSize && !readBgzfBlock()) {
+        return false;
+    }
+    const char* in = input.data() + inPos;
+    const size_t avail = inSize - inPos;
+    if (!isGzipMember(in, avail)) {
+        return false;
+    }
+
+    // ISIZE at the end of the input is exact for a BGZF block or a
+    // single-member file and a first guess otherwise.
+    const size_t trailerSize = avail >= 4 ? le32(reinterpret_cast<const unsigned char*>(input.data() + inSize - 4)) : 0;
+    size_t capacity = std::min(maxMemberSize, std::max<size_t>({trailerSize, avail, 1}));
+    if (pool && decoded.capacity() == 0) {
+        decoded = pool->takeBuffer(capacity);
+    }
+    while (true) {
+        decoded.resize(capacity);
+        size_t used = 0;
+        size_t produced = 0;
+        const libdeflate_result ret = libdeflate_gzip_decompress_ex(decompressor.get(), in, avail, decoded.data(),
+                                                                    decoded.size(), &used, &produced);
+        if (ret == LIBDEFLATE_SUCCESS) {
+            decoded.resize(produced);
+            decodedPos = 0;
+            inPos += used;
+            return true;
+        }
+        if (ret != LIBDEFLATE_INSUFFICIENT_SPACE) {
+            throw std::runtime_error("libdeflate error (" + std::to_string(static_cast<int>(ret)) +
+                                     ") while decompressing '" + filename + "'");
+        }
+        if (capacity == maxMemberSize) {
+            decoded.clear();
+            decodedPos = 0;
+            fallback = std::make_unique<GzipInflater>(filename);
+            return true;
+        }
+        capacity = std::min(maxMemberSize, capacity * 2);
+    }
+}
+
+// Streams the oversized member at inPos through zlib.
+size_t CompressorLibdeflate::inflateInto(char* out, size_t size) {
+    const GzipInflater::Result r = fallback->inflate(input.data() + inPos, inSize - inPos, out, size);
+    inPos += r.consumed;
+    if (r.boundary) {
+        fallback.reset();
+    } else if (r.produced == 0 && inPos == inSize) {
+        throw std::runtime_error("zlib error (" + std::to_string(Z_BUF_ERROR) + ") unexpected end of file in '" +
+                                 filename + "'");
+    }
+    return r.produced;
+}
+
+bool CompressorLibdeflate::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    if (eof) {
+        bytesDecompressed = 0;
+        return false;
+    }
+
+    size_t produced = 0;
+    while (produced < outBuffer.size()) {
+        if (fallback) {
+            produced += inflateInto(outBuffer.data() + produced, outBuffer.size() - produced);
+            continue;
+        }
+        if (decodedPos == decoded.size()) {
+            if (!nextMember()) {
+                eof = true;
+                break;
+            }
+            continue;
+        }
+        const size_t n = std::min(outBuffer.size() - produced, decoded.size() - decodedPos);
+        std::memcpy(outBuffer.data() + produced, decoded.data() + decodedPos, n);
+        produced += n;
+        decodedPos += n;
+    }
+
+    bytesDecompressed = produced;
+    return bytesDecompressed > 0;
+}
+
+#endif // ZTAIL_USE_LIBDEFLATE
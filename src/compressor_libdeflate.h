@@ -0,0 +1,62 @@
+#ifndef COMPRESSOR_LIBDEFLATE_H
+#define COMPRESSOR_LIBDEFLATE_H
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+
+#include <cstdint>
+#include <cstdio>
+#include <libdeflate.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gzip_inflater.h"
+#include "icompressor.h"
+#include "file_ptr.h"
+
+class ContextPool;
+
+// Gzip files up to this size are read whole and inflated member by member.
+constexpr uint64_t LIBDEFLATE_MAX_INPUT = 8 << 20;
+
+// Decodes gzip with libdeflate's whole-buffer inflate instead of zlib's
+// streaming one.  BGZF files are read one block at a time (every block
+// records its size), other files are read at once, which is why accepts()
+// limits them to LIBDEFLATE_MAX_INPUT bytes.  A member whose output would
+// exceed maxMemberSize is streamed through zlib instead of being inflated in
+// one piece.  With a pool the decompressor and the input and output buffers
+// are taken from it and given back on destruction.
+class CompressorLibdeflate : public ICompressor {
+public:
+    explicit CompressorLibdeflate(FilePtr&& file, const std::string& filename,
+                                  size_t maxMemberSize = 64 << 20, ContextPool* pool = nullptr);
+    ~CompressorLibdeflate();
+
+    // Whether the gzip file is BGZF or at most LIBDEFLATE_MAX_INPUT bytes.
+    // Leaves the file position at its start.
+    static bool accepts(FILE* file);
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    bool readBgzfBlock();
+    bool nextMember();
+    size_t inflateInto(char* out, size_t size);
+
+    FilePtr file;
+    ContextPool* pool;
+    std::unique_ptr<libdeflate_decompressor, decltype(&libdeflate_free_decompressor)> decompressor;
+    bool blocked;         // BGZF: input holds one block
+    std::vector<char> input;
+    size_t inPos;
+    size_t inSize;
+    std::vector<char> decoded; // the current member
+    size_t decodedPos;
+    std::unique_ptr<GzipInflater> fallback; // the member larger than maxMemberSize
+    size_t maxMemberSize;
+    bool eof;
+    std::string filename;
+};
+
+#endif // ZTAIL_USE_LIBDEFLATE
+
+#endif // COMPRESSOR_LIBDEFLATE_H
@@ -0,0 +1,86 @@
+#include "compressor_lz4.h"
+#include "trace.h"
+#include "context_pool.h"
+#include <stdexcept>
+#include <cerrno>
+
+namespace {
+
+LZ4F_dctx* createContext() {
+    LZ4F_dctx* ctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+        return nullptr;
+    }
+    return ctx;
+}
+
+} // namespace
+
+CompressorLz4::CompressorLz4(FilePtr&& file, const std::string& filename, size_t inBufferSize, ContextPool* pool)
+    : file(std::move(file)), pool(pool), dctx(nullptr, &LZ4F_freeDecompressionContext),
+      inBuffer(pool ? pool->takeBuffer(inBufferSize) : std::vector<char>(inBufferSize)),
+      inPos(0), inSize(0), frameLeft(0), eof(false), filename(filename)
+{
+    if (!this->file) {
+        throw std::runtime_error("lz4 error (" + std::to_string(errno) + ") while opening '" + filename + "'");
+    }
+    std::fseek(this->file.get(), 0, SEEK_SET);
+    if (pool) {
+        dctx = pool->takeLz4();
+    }
+    if (!dctx) {
+        dctx.reset(createContext());
+    }
+    if (!dctx) {
+        this->file.reset();
+        throw std::runtime_error("lz4 error (0) while creating context for '" + filename + "'");
+    }
+}
+
+CompressorLz4::~CompressorLz4() {
+    if (pool) {
+        pool->give(std::move(dctx));
+        pool->give(std::move(inBuffer));
+    }
+}
+
+bool CompressorLz4::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    if (eof) {
+        bytesDecompressed = 0;
+        return false;
+    }
+
+    // As with zstd, a frame end is not the end of the input: only a drained
+    // file stops decoding.
+    size_t produced = 0;
+    while (produced < outBuffer.size()) {
+        bool drained = false;
+        if (inPos == inSize) {
+            TraceSpan span("read");
+            inSize = fread(inBuffer.data(), 1, inBuffer.size(), file.get());
+            inPos = 0;
+            drained = inSize == 0;
+            if (drained && frameLeft == 0) {
+                eof = true;
+                break;
+            }
+        }
+
+        size_t outLen = outBuffer.size() - produced;
+        size_t inLen = inSize - inPos;
+        frameLeft = LZ4F_decompress(dctx.get(), outBuffer.data() + produced, &outLen,
+                                    inBuffer.data() + inPos, &inLen, nullptr);
+        if (LZ4F_isError(frameLeft)) {
+            throw std::runtime_error(std::string("lz4 error (") + LZ4F_getErrorName(frameLeft) +
+                                     ") while decompressing '" + filename + "'");
+        }
+        inPos += inLen;
+        produced += outLen;
+        if (drained && outLen == 0) {
+            throw std::runtime_error("lz4 error (truncated input) while decompressing '" + filename + "'");
+        }
+    }
+
+    bytesDecompressed = produced;
+    return bytesDecompressed > 0;
+}
@@ -0,0 +1,37 @@
+#ifndef COMPRESSOR_LZ4_H
+#define COMPRESSOR_LZ4_H
+
+#include <string>
+#include <vector>
+#include <lz4frame.h>
+#include <memory>
+#include "icompressor.h"
+#include "file_ptr.h"
+
+class ContextPool;
+
+// Streams LZ4 frame files (magic 04 22 4D 18), including concatenated and
+// skippable frames.  Legacy LZ4 files are not supported.  With a pool the
+// context and the input buffer are taken from it and given back on
+// destruction.
+class CompressorLz4 : public ICompressor {
+public:
+    explicit CompressorLz4(FilePtr&& file, const std::string& filename, size_t inBufferSize = 1 << 16,
+                           ContextPool* pool = nullptr);
+    ~CompressorLz4();
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    FilePtr file;
+    ContextPool* pool;
+    std::unique_ptr<LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext)> dctx;
+    std::vector<char> inBuffer;
+    size_t inPos;         // unconsumed input survives between calls
+    size_t inSize;
+    size_t frameLeft;     // last LZ4F_decompress hint; 0 at a frame end
+    bool eof;
+    std::string filename;
+};
+
+#endif // COMPRESSOR_LZ4_H
@@ -1,9 +1,15 @@
 #include "compressor_xz.h"
+#include "trace.h"
+#include "buffer_controller.h"
+#include "context_pool.h"
 #include <stdexcept>
 #include <cerrno>
 
-CompressorXz::CompressorXz(FilePtr&& file, const std::string& filename, size_t inBufferSize)
-    : file(std::move(file)), strm(LZMA_STREAM_INIT), eof(false), inBuffer(inBufferSize), filename(filename)
+CompressorXz::CompressorXz(FilePtr&& file, const std::string& filename, size_t inBufferSize,
+                           uint64_t memLimit, ContextPool* pool)
+    : file(std::move(file)), pool(pool), strm(pool ? pool->takeXz() : ContextPool::newXz()), eof(false),
+      inBuffer(pool ? pool->takeBuffer(inBufferSize) : std::vector<char>(inBufferSize)),
+      baseInSize(inBufferSize), baseOutSize(0), filename(filename)
 {
     if (!this->file) {
         throw std::runtime_error("lzma error (" + std::to_string(errno) + ") while opening '" + filename + "'");
@@ -11,7 +17,7 @@ CompressorXz::CompressorXz(FilePtr&& file, const std::string& filename, size_t i
 
     std::fseek(this->file.get(), 0, SEEK_SET);
 
-    lzma_ret ret = lzma_stream_decoder(&strm, UINT64_MAX, 0);
+    lzma_ret ret = lzma_stream_decoder(strm.get(), memLimit, 0);
     if (ret != LZMA_OK) {
         this->file.reset();
         throw std::runtime_error("lzma error (" + std::to_string(ret) + ") while initializing '" + filename + "'");
@@ -19,7 +25,10 @@ CompressorXz::CompressorXz(FilePtr&& file, const std::string& filename, size_t i
 }
 
 CompressorXz::~CompressorXz() {
-    lzma_end(&strm);
+    if (pool) {
+        pool->give(std::move(strm));
+        pool->give(std::move(inBuffer));
+    }
     file.reset();
 }
 
@@ -29,30 +38,44 @@ bool CompressorXz::decompress(std::vector<char>& outBuffer, size_t& bytesDecompr
         return false;
     }
 
-    strm.next_out = reinterpret_cast<uint8_t*>(outBuffer.data());
-    strm.avail_out = outBuffer.size();
+    // The input buffer follows the output buffer the pipeline asks for; it
+    // can only change while it holds no unconsumed input.
+    if (baseOutSize == 0) {
+        baseOutSize = outBuffer.size();
+    } else if (strm->avail_in == 0) {
+        inBuffer.resize(scaleCodecBuffer(baseInSize, baseOutSize, outBuffer.size()));
+    }
+
+    strm->next_out = reinterpret_cast<uint8_t*>(outBuffer.data());
+    strm->avail_out = outBuffer.size();
 
     bytesDecompressed = 0;
 
-    while (strm.avail_out > 0) {
-        if (strm.avail_in == 0 && !eof) {
+    while (strm->avail_out > 0) {
+        if (strm->avail_in == 0 && !eof) {
+            TraceSpan span("read");
             size_t nread = fread(inBuffer.data(), 1, inBuffer.size(), file.get());
             if (nread == 0) {
                 eof = true;
             }
-            strm.next_in = inBuffer.data();
-            strm.avail_in = nread;
+            strm->next_in = reinterpret_cast<const uint8_t*>(inBuffer.data());
+            strm->avail_in = nread;
         }
 
-        lzma_ret ret = lzma_code(&strm, eof && strm.avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
+        lzma_ret ret = lzma_code(strm.get(), eof && strm->avail_in == 0 ? LZMA_FINISH : LZMA_RUN);
         if (ret == LZMA_STREAM_END) {
             eof = true;
             break;
         }
+        if (ret == LZMA_MEMLIMIT_ERROR) {
+            throw std::runtime_error("lzma error: '" + filename + "' needs " +
+                                     std::to_string(lzma_memusage(strm.get()) >> 20) +
+                                     " MiB to decompress, more than the memory limit");
+        }
         if (ret != LZMA_OK && ret != LZMA_BUF_ERROR) {
             throw std::runtime_error("lzma error (" + std::to_string(ret) + ") while decompressing '" + filename + "'");
         }
-        if (ret == LZMA_BUF_ERROR && strm.avail_in == 0) {
+        if (ret == LZMA_BUF_ERROR && strm->avail_in == 0) {
             // Need more input
             continue;
         }
@@ -61,7 +84,7 @@ bool CompressorXz::decompress(std::vector<char>& outBuffer, size_t& bytesDecompr
         }
     }
 
-    bytesDecompressed = outBuffer.size() - strm.avail_out;
+    bytesDecompressed = outBuffer.size() - strm->avail_out;
     return bytesDecompressed > 0;
 }
 
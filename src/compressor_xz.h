@@ -5,13 +5,21 @@
 #include <string>
 #include <vector>
 #include <cstdio>
+#include <cstdint>
 #include <memory>
 #include "icompressor.h"
 #include "file_ptr.h"
 
+class ContextPool;
+
 class CompressorXz : public ICompressor {
 public:
-    explicit CompressorXz(FilePtr&& file, const std::string& filename, size_t inBufferSize = 1 << 15);
+    // memLimit bounds the decoder's memory (mostly the dictionary); streams
+    // that need more fail with an error instead of allocating it.  With a
+    // pool the stream and the input buffer are taken from it and given back
+    // on destruction.
+    explicit CompressorXz(FilePtr&& file, const std::string& filename, size_t inBufferSize = 1 << 15,
+                          uint64_t memLimit = UINT64_MAX, ContextPool* pool = nullptr);
     ~CompressorXz();
 
     // Reads the next chunk of decompressed data
@@ -20,9 +28,12 @@ public:
 
 private:
     FilePtr file;
-    lzma_stream strm;
+    ContextPool* pool;
+    std::unique_ptr<lzma_stream, void (*)(lzma_stream*)> strm;
     bool eof;
-    std::vector<uint8_t> inBuffer;
+    std::vector<char> inBuffer;
+    size_t baseInSize;  // configured input buffer size ...
+    size_t baseOutSize; // ... for the output size of the first call
     std::string filename;
 };
 
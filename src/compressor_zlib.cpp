@@ -1,34 +1,38 @@
 #include "compressor_zlib.h"
+#include "trace.h"
+#include "buffer_controller.h"
+#include "context_pool.h"
 #include <stdexcept>
 #include <cerrno>
-#include <unistd.h>
 
-CompressorZlib::CompressorZlib(FilePtr&& file, const std::string& filename, size_t bufferSize)
-    : gz(nullptr), eof(false), filename(filename)
+CompressorZlib::CompressorZlib(FilePtr&& file, const std::string& filename, size_t bufferSize, ContextPool* pool)
+    : file(std::move(file)), pool(pool),
+      gz(pool ? pool->takeGzip(filename) : std::make_unique<GzipInflater>(filename)),
+      inBuffer(pool ? pool->takeBuffer(bufferSize) : std::vector<char>(bufferSize)), inPos(0), inSize(0),
+      baseInSize(bufferSize), baseOutSize(0), onBoundary(), eof(false), filename(filename)
 {
-    if (!file) {
+    if (!this->file) {
         throw std::runtime_error("zlib error (0) while opening '" + filename + "'");
     }
-    std::fseek(file.get(), 0, SEEK_SET);
+    std::fseek(this->file.get(), 0, SEEK_SET);
     unsigned char header[2];
-    size_t n = std::fread(header, 1, 2, file.get());
+    size_t n = std::fread(header, 1, 2, this->file.get());
     if (n != 2 || header[0] != 0x1f || header[1] != 0x8b) {
         throw std::runtime_error("zlib error (0) invalid header in '" + filename + "'");
     }
-    std::fseek(file.get(), 0, SEEK_SET);
-    int fd = fileno(file.get());
-    int dupfd = dup(fd);
-    file.reset();
-    if (dupfd == -1) {
-        throw std::runtime_error("zlib error (" + std::to_string(errno) + ") while duplicating descriptor for '" + filename + "'");
-    }
-    ::lseek(dupfd, 0, SEEK_SET);
-    gz.reset(gzdopen(dupfd, "rb"));
-    if (!gz) {
-        ::close(dupfd);
-        throw std::runtime_error("zlib error (" + std::to_string(errno) + ") while opening '" + filename + "'");
+    std::fseek(this->file.get(), 0, SEEK_SET);
+}
+
+CompressorZlib::~CompressorZlib() {
+    if (pool) {
+        pool->give(std::move(gz));
+        pool->give(std::move(inBuffer));
     }
-    gzbuffer(gz.get(), static_cast<unsigned int>(bufferSize));
+}
+
+void CompressorZlib::setBoundaryCallback(std::function<void(const GzipBoundary&)> callback, bool blocks) {
+    onBoundary = std::move(callback);
+    gz->stopAtBlocks(blocks && onBoundary);
 }
 
 bool CompressorZlib::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
@@ -37,18 +41,47 @@ bool CompressorZlib::decompress(std::vector<char>& outBuffer, size_t& bytesDecom
         return false;
     }
 
-    int ret = gzread(gz.get(), outBuffer.data(), static_cast<unsigned int>(outBuffer.size()));
-    if (ret < 0) {
-        int errnum = 0;
-        gzerror(gz.get(), &errnum);
-        throw std::runtime_error("zlib error (" + std::to_string(errnum) + ") while decompressing '" + filename + "'");
+    // The input buffer follows the output buffer the pipeline asks for; it
+    // can only change while it holds no unconsumed input.
+    if (baseOutSize == 0) {
+        baseOutSize = outBuffer.size();
+    } else if (inPos == inSize) {
+        inBuffer.resize(scaleCodecBuffer(baseInSize, baseOutSize, outBuffer.size()));
     }
-    if (ret == 0) {
-        eof = true;
-        bytesDecompressed = 0;
-        return false;
+
+    size_t produced = 0;
+    while (produced < outBuffer.size()) {
+        if (inPos == inSize) {
+            TraceSpan span("read");
+            inSize = std::fread(inBuffer.data(), 1, inBuffer.size(), file.get());
+            inPos = 0;
+            if (inSize == 0) {
+                if (std::ferror(file.get())) {
+                    throw std::runtime_error("zlib error (" + std::to_string(errno) + ") while reading '" +
+                                             filename + "'");
+                }
+                if (gz->inMember()) {
+                    throw std::runtime_error("zlib error (" + std::to_string(Z_BUF_ERROR) +
+                                             ") unexpected end of file in '" + filename + "'");
+                }
+                eof = true;
+                break;
+            }
+        }
+
+        const GzipInflater::Result r = gz->inflate(inBuffer.data() + inPos, inSize - inPos,
+                                                  outBuffer.data() + produced, outBuffer.size() - produced);
+        inPos += r.consumed;
+        produced += r.produced;
+        if (r.boundary && onBoundary) {
+            onBoundary(gz->boundary());
+        }
+        if (gz->finished()) {
+            eof = true;
+            break;
+        }
     }
 
-    bytesDecompressed = static_cast<size_t>(ret);
-    return true;
+    bytesDecompressed = produced;
+    return bytesDecompressed > 0;
 }
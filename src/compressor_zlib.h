@@ -1,26 +1,48 @@
 #ifndef COMPRESSOR_ZLIB_H
 #define COMPRESSOR_ZLIB_H
 
-#include <zlib.h>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
-#include <memory>
+#include "gzip_inflater.h"
 #include "icompressor.h"
 #include "file_ptr.h"
 
-struct GzCloser { void operator()(gzFile f) const { if (f) gzclose(f); } };
+class ContextPool;
 
+// Streams gzip files, concatenated members included, through raw inflate():
+// input is read into a buffer of bufferSize bytes (scaled with the output
+// the pipeline asks for) and inflated straight into the caller's buffer.
+// With a pool the inflater and the input buffer are taken from it and given
+// back on destruction.
 class CompressorZlib : public ICompressor {
 public:
     explicit CompressorZlib(FilePtr&& file, const std::string& filename,
-                            size_t bufferSize = 1 << 20);
+                            size_t bufferSize = 1 << 20, ContextPool* pool = nullptr);
+    ~CompressorZlib();
 
     // Reads the next chunk of decompressed data
     // Returns true while data is available, false on EOF
     bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
 
+    // Calls onBoundary at every member end and, with blocks, every deflate
+    // block boundary as decoding passes it.  Offsets are relative to the
+    // start of the file and of the decompressed data.
+    void setBoundaryCallback(std::function<void(const GzipBoundary&)> onBoundary, bool blocks = false);
+
+    const GzipInflater& inflater() const { return *gz; }
+
 private:
-    std::unique_ptr<gzFile_s, GzCloser> gz;
+    FilePtr file;
+    ContextPool* pool;
+    std::unique_ptr<GzipInflater> gz;
+    std::vector<char> inBuffer;
+    size_t inPos;        // unconsumed input survives between calls
+    size_t inSize;
+    size_t baseInSize;   // configured input buffer size ...
+    size_t baseOutSize;  // ... for the output size of the first call, see scaleCodecBuffer
+    std::function<void(const GzipBoundary&)> onBoundary;
     bool eof;
     std::string filename;
 };
@@ -1,16 +1,29 @@
 #include "compressor_zstd.h"
+#include "trace.h"
+#include "buffer_controller.h"
+#include "context_pool.h"
+#include "zstd_dictionary.h"
 #include <stdexcept>
 #include <cerrno>
 #include <cmath>
+#include <cstring>
 
-CompressorZstd::CompressorZstd(FilePtr&& file, const std::string& filename, size_t windowSize)
-    : file(std::move(file)), stream(nullptr, &ZSTD_freeDStream), inBuffer(ZSTD_DStreamInSize()), eof(false), filename(filename)
+CompressorZstd::CompressorZstd(FilePtr&& file, const std::string& filename, size_t windowSize,
+                               ContextPool* pool)
+    : file(std::move(file)), pool(pool), stream(nullptr, &ZSTD_freeDStream),
+      inBuffer(pool ? pool->takeBuffer(ZSTD_DStreamInSize()) : std::vector<char>(ZSTD_DStreamInSize())),
+      in{inBuffer.data(), 0, 0}, baseOutSize(0), frameLeft(0), ddict(nullptr), eof(false), filename(filename)
 {
     if (!this->file) {
         throw std::runtime_error("zstd error (" + std::to_string(errno) + ") while opening '" + filename + "'");
     }
     std::fseek(this->file.get(), 0, SEEK_SET);
-    stream.reset(ZSTD_createDStream());
+    if (pool) {
+        stream = pool->takeZstd();
+    }
+    if (!stream) {
+        stream.reset(ZSTD_createDStream());
+    }
     if (!stream) {
         this->file.reset();
         throw std::runtime_error("zstd error (0) while creating stream for '" + filename + "'");
@@ -33,39 +46,82 @@ CompressorZstd::CompressorZstd(FilePtr&& file, const std::string& filename, size
 }
 
 CompressorZstd::~CompressorZstd() {
+    if (pool) {
+        pool->give(std::move(stream));
+        pool->give(std::move(inBuffer));
+    }
     stream.reset();
     file.reset();
 }
 
+// References the dictionary of the frame starting at in.pos.  A header that
+// straddles the end of the buffer is completed first.
+void CompressorZstd::startFrame() {
+    const size_t avail = in.size - in.pos;
+    if (avail < ZSTD_FRAME_HEADER_MAX && !std::feof(file.get())) {
+        TraceSpan span("read");
+        std::memmove(inBuffer.data(), static_cast<const char*>(in.src) + in.pos, avail);
+        in.src = inBuffer.data();
+        in.pos = 0;
+        in.size = avail + fread(inBuffer.data() + avail, 1, inBuffer.size() - avail, file.get());
+    }
+    const ZSTD_DDict* wanted = zstdDictionaryFor(static_cast<const char*>(in.src) + in.pos, in.size - in.pos, filename);
+    if (wanted != ddict) {
+        // Dictionaries change only between frames, where the stream holds nothing.
+        ZSTD_DCtx_reset(stream.get(), ZSTD_reset_session_only);
+        const size_t ret = ZSTD_DCtx_refDDict(stream.get(), wanted);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(ret)) +
+                                     ") while selecting the dictionary of '" + filename + "'");
+        }
+        ddict = wanted;
+    }
+}
+
 bool CompressorZstd::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
     if (eof) {
         bytesDecompressed = 0;
         return false;
     }
 
+    // The input buffer follows the output buffer the pipeline asks for; it
+    // can only change while it holds no unconsumed input.
+    if (baseOutSize == 0) {
+        baseOutSize = outBuffer.size();
+    } else if (in.pos == in.size) {
+        inBuffer.resize(scaleCodecBuffer(ZSTD_DStreamInSize(), baseOutSize, outBuffer.size()));
+    }
+
     ZSTD_outBuffer out{ outBuffer.data(), outBuffer.size(), 0 };
-    ZSTD_inBuffer in{ inBuffer.data(), 0, 0 };
 
+    // A frame end is not the end of the input: zstd files may hold several
+    // concatenated frames, so only a drained file stops decoding.
     while (out.pos < out.size) {
-        if (in.pos == in.size && !eof) {
+        bool drained = false;
+        if (in.pos == in.size) {
+            TraceSpan span("read");
+            in.src = inBuffer.data();
             in.size = fread(inBuffer.data(), 1, inBuffer.size(), file.get());
             in.pos = 0;
-            if (in.size == 0) {
+            drained = in.size == 0;
+            if (drained && frameLeft == 0) {
                 eof = true;
                 break;
             }
         }
 
-        size_t ret = ZSTD_decompressStream(stream.get(), &out, &in);
-        if (ZSTD_isError(ret)) {
-            throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(ret)) + ") while decompressing '" + filename + "'");
+        if (frameLeft == 0 && in.pos < in.size) {
+            startFrame();
         }
-        if (ret == 0 && in.pos == in.size) {
-            eof = true;
-            break;
+
+        // With no input left this still flushes output the stream holds back.
+        const size_t before = out.pos;
+        frameLeft = ZSTD_decompressStream(stream.get(), &out, &in);
+        if (ZSTD_isError(frameLeft)) {
+            throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(frameLeft)) + ") while decompressing '" + filename + "'");
         }
-        if (out.pos == out.size) {
-            break;
+        if (drained && out.pos == before) {
+            throw std::runtime_error("zstd error (truncated input) while decompressing '" + filename + "'");
         }
     }
 
@@ -8,17 +8,30 @@
 #include "icompressor.h"
 #include "file_ptr.h"
 
+class ContextPool;
+
+// Every frame is decoded with the registered dictionary its header names
+// (see zstd_dictionary.h).  With a pool the stream and the input buffer are
+// taken from it and given back on destruction.
 class CompressorZstd : public ICompressor {
 public:
-    explicit CompressorZstd(FilePtr&& file, const std::string& filename, size_t windowSize = 0);
+    explicit CompressorZstd(FilePtr&& file, const std::string& filename, size_t windowSize = 0,
+                            ContextPool* pool = nullptr);
     ~CompressorZstd();
 
     bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
 
 private:
+    void startFrame();
+
     FilePtr file;
+    ContextPool* pool;
     std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> stream;
     std::vector<char> inBuffer;
+    ZSTD_inBuffer in;     // unconsumed input survives between calls
+    size_t baseOutSize;   // output size of the first call, see scaleCodecBuffer
+    size_t frameLeft;     // last ZSTD_decompressStream hint; 0 at a frame end
+    const ZSTD_DDict* ddict; // referenced by stream, or nullptr
     bool eof;
     std::string filename;
 };
@@ -0,0 +1,156 @@
+#include "context_pool.h"
+
+namespace {
+
+void freeXz(lzma_stream* strm) {
+    lzma_end(strm);
+    delete strm;
+}
+
+} // namespace
+
+ContextPool::ContextPool(size_t maxPooled)
+    : maxPooled(maxPooled), reuses(0), buffers(maxPooled * 4)
+{
+}
+
+// Moves a pooled object into item, leaving item alone when none is pooled.
+template <typename T>
+void ContextPool::take(std::vector<T>& shelf, T& item) {
+    std::lock_guard<std::mutex> lock(m);
+    if (!shelf.empty()) {
+        item = std::move(shelf.back());
+        shelf.pop_back();
+        ++reuses;
+    }
+}
+
+template <typename T>
+void ContextPool::put(std::vector<T>& shelf, T&& item) {
+    if (!item) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m);
+    if (shelf.size() < maxPooled) {
+        shelf.push_back(std::move(item));
+    }
+}
+
+ContextPool::ZstdPtr ContextPool::takeZstd() {
+    ZstdPtr stream(nullptr, &ZSTD_freeDStream);
+    take(zstd, stream);
+    return stream;
+}
+
+std::unique_ptr<GzipInflater> ContextPool::takeGzip(const std::string& name) {
+    std::unique_ptr<GzipInflater> inflater;
+    take(gzip, inflater);
+    if (inflater) {
+        inflater->reset(name);
+        return inflater;
+    }
+    return std::make_unique<GzipInflater>(name);
+}
+
+ContextPool::XzPtr ContextPool::newXz() {
+    return XzPtr(new lzma_stream(LZMA_STREAM_INIT), &freeXz);
+}
+
+ContextPool::XzPtr ContextPool::takeXz() {
+    XzPtr strm(nullptr, &freeXz);
+    take(xz, strm);
+    return strm ? std::move(strm) : newXz();
+}
+
+ContextPool::Lz4Ptr ContextPool::takeLz4() {
+    Lz4Ptr dctx(nullptr, &LZ4F_freeDecompressionContext);
+    take(lz4, dctx);
+    return dctx;
+}
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+ContextPool::LibdeflatePtr ContextPool::takeLibdeflate() {
+    LibdeflatePtr decompressor(nullptr, &libdeflate_free_decompressor);
+    take(libdeflate, decompressor);
+    return decompressor;
+}
+#endif
+
+std::vector<char> ContextPool::takeBuffer(size_t size) {
+    std::lock_guard<std::mutex> lock(m);
+    const size_t before = buffers.pooled();
+    std::vector<char> buffer = buffers.acquire(size);
+    reuses += before - buffers.pooled();
+    return buffer;
+}
+
+std::unique_ptr<BufferPool> ContextPool::takePipeline() {
+    std::unique_ptr<BufferPool> pipeline;
+    take(pipelines, pipeline);
+    return pipeline ? std::move(pipeline) : std::make_unique<BufferPool>(2);
+}
+
+std::unique_ptr<CircularBuffer> ContextPool::takeRing() {
+    std::unique_ptr<CircularBuffer> ring;
+    take(rings, ring);
+    return ring;
+}
+
+void ContextPool::give(ZstdPtr stream) {
+    if (stream) {
+        ZSTD_DCtx_reset(stream.get(), ZSTD_reset_session_and_parameters);
+    }
+    put(zstd, std::move(stream));
+}
+
+void ContextPool::give(std::unique_ptr<GzipInflater> inflater) {
+    put(gzip, std::move(inflater));
+}
+
+void ContextPool::give(XzPtr stream) {
+    if (stream) {
+        // lzma_stream_decoder() resets the coder but not the caller's fields.
+        stream->next_in = nullptr;
+        stream->avail_in = 0;
+        stream->next_out = nullptr;
+        stream->avail_out = 0;
+    }
+    put(xz, std::move(stream));
+}
+
+void ContextPool::give(Lz4Ptr dctx) {
+    if (dctx) {
+        LZ4F_resetDecompressionContext(dctx.get());
+    }
+    put(lz4, std::move(dctx));
+}
+
+#ifdef ZTAIL_USE_LIBDEFLATE
+void ContextPool::give(LibdeflatePtr decompressor) {
+    put(libdeflate, std::move(decompressor)); // keeps no state between calls
+}
+#endif
+
+void ContextPool::give(std::vector<char>&& buffer) {
+    if (buffer.capacity() > MAX_POOLED_BUFFER) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m);
+    buffers.release(std::move(buffer));
+}
+
+void ContextPool::give(std::unique_ptr<BufferPool> pipeline) {
+    put(pipelines, std::move(pipeline));
+}
+
+void ContextPool::give(std::unique_ptr<CircularBuffer> ring) {
+    if (ring) {
+        ring->clear();
+    }
+    put(rings, std::move(ring));
+}
+
+size_t ContextPool::reused() const {
+    std::lock_guard<std::mutex> lock(m);
+    return reuses;
+}
@@ -0,0 +1,97 @@
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include "buffer_controller.h"
+#include "circular_buffer.h"
+#include "gzip_inflater.h"
+#include <lz4frame.h>
+#include <lzma.h>
+#include <zstd.h>
+#ifdef ZTAIL_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Per-input state kept between the inputs of a run so that tailing many small
+// files does not set it up again for each: codec contexts, codec input
+// buffers, pipeline buffers and rings.  Objects are taken for one input and
+// given back after it, reset for the next.  Taking and giving are
+// thread-safe, so concurrent tails sharing a pool each take their own; at
+// most maxPooled objects of each kind are kept, and no buffer larger than
+// MAX_POOLED_BUFFER.
+class ContextPool {
+public:
+    static constexpr size_t MAX_POOLED_BUFFER = 16u << 20;
+
+    using ZstdPtr = std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)>;
+    using XzPtr = std::unique_ptr<lzma_stream, void (*)(lzma_stream*)>;
+    using Lz4Ptr = std::unique_ptr<LZ4F_dctx, decltype(&LZ4F_freeDecompressionContext)>;
+#ifdef ZTAIL_USE_LIBDEFLATE
+    using LibdeflatePtr = std::unique_ptr<libdeflate_decompressor, decltype(&libdeflate_free_decompressor)>;
+#endif
+
+    explicit ContextPool(size_t maxPooled = 4);
+
+    // A pooled stream reset for a new input, or nullptr when none is pooled.
+    ZstdPtr takeZstd();
+    // A pooled inflater reset for name, or a new one.
+    std::unique_ptr<GzipInflater> takeGzip(const std::string& name);
+    // A stream for lzma_stream_decoder(), which reuses the memory of a pooled
+    // one instead of allocating a new decoder.  Also used without a pool.
+    static XzPtr newXz();
+    XzPtr takeXz();
+    // A pooled context reset for a new frame, or nullptr when none is pooled.
+    Lz4Ptr takeLz4();
+#ifdef ZTAIL_USE_LIBDEFLATE
+    // A pooled decompressor, or nullptr when none is pooled.
+    LibdeflatePtr takeLibdeflate();
+#endif
+    // A buffer of exactly size bytes; contents are unspecified.
+    std::vector<char> takeBuffer(size_t size);
+    // Pipeline buffers for one processStream() run.
+    std::unique_ptr<BufferPool> takePipeline();
+    // An empty ring, or nullptr when none is pooled.  All rings of a pool
+    // must be built with the same sizes.
+    std::unique_ptr<CircularBuffer> takeRing();
+
+    void give(ZstdPtr stream);
+    void give(std::unique_ptr<GzipInflater> inflater);
+    void give(XzPtr stream);
+    void give(Lz4Ptr dctx);
+#ifdef ZTAIL_USE_LIBDEFLATE
+    void give(LibdeflatePtr decompressor);
+#endif
+    void give(std::vector<char>&& buffer);
+    void give(std::unique_ptr<BufferPool> pipeline);
+    void give(std::unique_ptr<CircularBuffer> ring);
+
+    // Objects handed out from the pool instead of being created.
+    size_t reused() const;
+
+private:
+    template <typename T>
+    void take(std::vector<T>& shelf, T& item);
+    template <typename T>
+    void put(std::vector<T>& shelf, T&& item);
+
+    mutable std::mutex m;
+    size_t maxPooled;
+    size_t reuses;
+    std::vector<ZstdPtr> zstd;
+    std::vector<std::unique_ptr<GzipInflater>> gzip;
+    std::vector<XzPtr> xz;
+    std::vector<Lz4Ptr> lz4;
+#ifdef ZTAIL_USE_LIBDEFLATE
+    std::vector<LibdeflatePtr> libdeflate;
+#endif
+    BufferPool buffers;
+    std::vector<std::unique_ptr<BufferPool>> pipelines;
+    std::vector<std::unique_ptr<CircularBuffer>> rings;
+};
+
+#endif // CONTEXT_POOL_H
@@ -0,0 +1,12 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <functional>
+#include <string>
+
+// Receives the warnings of the library, one sentence without a trailing
+// newline.  The library never writes to stderr itself: an empty sink drops
+// them, and the command line prints them as "WARNING: ...".
+using DiagnosticSink = std::function<void(const std::string& message)>;
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,84 @@
+#include "gzip_inflater.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <string>
+
+GzipInflater::GzipInflater(const std::string& name, bool stopAtBlocks)
+    : zs(), state(State::MEMBER), blocks(stopAtBlocks), last{GzipBoundary::MEMBER, 0, 0, 0},
+      memberCount(0), inTotal(0), outTotal(0), name(name)
+{
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        throw std::runtime_error("zlib error (0) while initializing '" + name + "'");
+    }
+}
+
+GzipInflater::~GzipInflater() {
+    inflateEnd(&zs);
+}
+
+void GzipInflater::reset(const std::string& newName) {
+    inflateReset(&zs);
+    state = State::MEMBER;
+    blocks = false;
+    last = GzipBoundary{GzipBoundary::MEMBER, 0, 0, 0};
+    memberCount = 0;
+    inTotal = 0;
+    outTotal = 0;
+    name = newName;
+}
+
+GzipInflater::Result GzipInflater::inflate(const char* in, size_t inSize, char* out, size_t outSize) {
+    Result result{0, 0, false};
+    while (state != State::DONE) {
+        if (state == State::BETWEEN) {
+            const size_t left = inSize - result.consumed;
+            if (left == 0) {
+                break;
+            }
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(in + result.consumed);
+            if (p[0] != 0x1f || (left >= 2 && p[1] != 0x8b)) {
+                state = State::DONE;
+                break;
+            }
+            inflateReset(&zs);
+            state = State::MEMBER;
+        }
+
+        const uInt availIn = static_cast<uInt>(std::min<size_t>(inSize - result.consumed, UINT_MAX));
+        const uInt availOut = static_cast<uInt>(std::min<size_t>(outSize - result.produced, UINT_MAX));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in + result.consumed));
+        zs.avail_in = availIn;
+        zs.next_out = reinterpret_cast<Bytef*>(out + result.produced);
+        zs.avail_out = availOut;
+        const int ret = ::inflate(&zs, blocks ? Z_BLOCK : Z_NO_FLUSH);
+        const size_t used = availIn - zs.avail_in;
+        const size_t made = availOut - zs.avail_out;
+        result.consumed += used;
+        result.produced += made;
+        inTotal += used;
+        outTotal += made;
+
+        if (ret == Z_STREAM_END) {
+            state = State::BETWEEN;
+            ++memberCount;
+            last = GzipBoundary{GzipBoundary::MEMBER, inTotal, outTotal, 0};
+            result.boundary = true;
+            break;
+        }
+        if (ret == Z_BUF_ERROR || (used == 0 && made == 0)) {
+            break; // needs more input or more room
+        }
+        if (ret != Z_OK) {
+            throw std::runtime_error("zlib error (" + std::to_string(ret) + ") while decompressing '" + name + "'" +
+                                     (zs.msg ? std::string(": ") + zs.msg : std::string()));
+        }
+        // Bit 128: stopped at a block boundary; bit 64: inside the last block.
+        if (blocks && (zs.data_type & 128) != 0 && (zs.data_type & 64) == 0) {
+            last = GzipBoundary{GzipBoundary::BLOCK, inTotal, outTotal, zs.data_type & 7};
+            result.boundary = true;
+            break;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,72 @@
+#ifndef GZIP_INFLATER_H
+#define GZIP_INFLATER_H
+
+#include <zlib.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A point in a gzip input where decoding stopped: the end of a member or,
+// when block boundaries are requested, a deflate block boundary (also
+// reported once per member just after its header).  Offsets count from the
+// start of the input, compressed and decompressed.
+struct GzipBoundary {
+    enum Kind { BLOCK, MEMBER };
+    Kind kind;
+    uint64_t in;  // compressed bytes consumed up to the boundary
+    uint64_t out; // decompressed bytes produced up to the boundary
+    int bits;     // BLOCK: unused low bits of the last consumed byte (0-7)
+};
+
+// Raw zlib inflate() over a sequence of gzip members.  The input and output
+// buffers belong to the caller, which passes whatever it has; nothing is
+// copied and sizes are not limited to unsigned int.  After the first member,
+// bytes that do not start another member end the input like with gzread().
+class GzipInflater {
+public:
+    // name only appears in error messages.
+    explicit GzipInflater(const std::string& name, bool stopAtBlocks = false);
+    ~GzipInflater();
+
+    GzipInflater(const GzipInflater&) = delete;
+    GzipInflater& operator=(const GzipInflater&) = delete;
+
+    struct Result {
+        size_t consumed;
+        size_t produced;
+        bool boundary; // stopped at boundary()
+    };
+
+    // Decodes from in to out until the input is used up, the output is full,
+    // a member ends or, with stopAtBlocks, a deflate block boundary is
+    // reached.  Throws std::runtime_error on corrupt data.
+    Result inflate(const char* in, size_t inSize, char* out, size_t outSize);
+
+    void stopAtBlocks(bool stop) { blocks = stop; }
+
+    // Makes the inflater ready for a new input, keeping zlib's memory.
+    void reset(const std::string& name);
+
+    const GzipBoundary& boundary() const { return last; }
+    // Inside a member, i.e. more input is needed before the data may end.
+    bool inMember() const { return state == State::MEMBER; }
+    // Trailing bytes that are no gzip member were seen; the rest is ignored.
+    bool finished() const { return state == State::DONE; }
+    uint64_t members() const { return memberCount; }
+    uint64_t totalIn() const { return inTotal; }
+    uint64_t totalOut() const { return outTotal; }
+
+private:
+    enum class State { MEMBER, BETWEEN, DONE };
+
+    z_stream zs;
+    State state;
+    bool blocks;
+    GzipBoundary last;
+    uint64_t memberCount;
+    uint64_t inTotal;
+    uint64_t outTotal;
+    std::string name;
+};
+
+#endif // GZIP_INFLATER_H
@@ -0,0 +1,10 @@
+#ifndef JSON_UTIL_H
+#define JSON_UTIL_H
+
+#include <string>
+
+// s as a quoted JSON string: quotes and backslashes are escaped, control
+// characters written as \u00XX.
+std::string jsonString(const std::string& s);
+
+#endif // JSON_UTIL_H
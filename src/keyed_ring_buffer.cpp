@@ -0,0 +1,497 @@
+#include "keyed_ring_buffer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+inline bool isFieldSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool endsValue(char c) {
+    return isFieldSeparator(c) || c == ',' || c == ';' || c == '}' || c == ')' || c == ']' || c == '"' || c == '\'';
+}
+
+uint64_t hashKey(const char* key, size_t len) {
+    uint64_t h = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+} // namespace
+
+KeySpec KeySpec::parse(const std::string& spec) {
+    if (spec.empty()) {
+        throw std::runtime_error("--per-key requires a field number or key name");
+    }
+    KeySpec ks;
+    if (spec.find_first_not_of("0123456789") == std::string::npos) {
+        char* end = nullptr;
+        unsigned long long val = std::strtoull(spec.c_str(), &end, 10);
+        if (val == 0) {
+            throw std::runtime_error("--per-key field numbers start at 1");
+        }
+        ks.field = static_cast<size_t>(val);
+    } else {
+        ks.name = spec;
+    }
+    return ks;
+}
+
+bool KeySpec::extract(const char* line, size_t len, const char*& key, size_t& keyLen) const {
+    const char* end = line + len;
+    if (field > 0) {
+        const char* p = line;
+        for (size_t f = 1;; ++f) {
+            while (p < end && isFieldSeparator(*p)) ++p;
+            if (p == end) {
+                return false;
+            }
+            const char* start = p;
+            while (p < end && !isFieldSeparator(*p)) ++p;
+            if (f == field) {
+                key = start;
+                keyLen = static_cast<size_t>(p - start);
+                return true;
+            }
+        }
+    }
+
+    const char* p = line;
+    while (p < end) {
+        const char* hit = static_cast<const char*>(memchr(p, '=', static_cast<size_t>(end - p)));
+        if (!hit) {
+            return false;
+        }
+        const char* nameStart = hit - name.size();
+        if (nameStart >= line && std::memcmp(nameStart, name.data(), name.size()) == 0 &&
+            (nameStart == line || endsValue(nameStart[-1]) || nameStart[-1] == '{' || nameStart[-1] == '(' ||
+             nameStart[-1] == '[')) {
+            const char* v = hit + 1;
+            if (v < end && (*v == '"' || *v == '\'')) {
+                const char* close = static_cast<const char*>(memchr(v + 1, *v, static_cast<size_t>(end - v - 1)));
+                key = v + 1;
+                keyLen = static_cast<size_t>((close ? close : end) - key);
+                return true;
+            }
+            const char* ve = v;
+            while (ve < end && !endsValue(*ve)) ++ve;
+            key = v;
+            keyLen = static_cast<size_t>(ve - v);
+            return true;
+        }
+        p = hit + 1;
+    }
+    return false;
+}
+
+KeyedRingBuffer::KeyedRingBuffer(const KeySpec& keySpec, size_t cap, size_t lineCapacity, size_t bytesBudget)
+    : spec(keySpec), capacity(cap), budget(bytesBudget > 0 ? bytesBudget : DEFAULT_BUDGET), maxClass(0),
+      arena(), arenaUsed(0), keyBytes(0), freeSlabs(), entries(), freeEntries(), table(64, NONE),
+      liveKeys(0), lruHead(NONE), lruTail(NONE), sequence(0), evictions(0), pending()
+{
+    if (capacity == 0) {
+        return;
+    }
+    unsigned budgetClass = 0;
+    while (budgetClass < 63 && (static_cast<size_t>(1) << (budgetClass + 1)) <= budget) {
+        ++budgetClass;
+    }
+    const size_t perLine = lineCapacity > 0 ? lineCapacity : 512;
+    maxClass = std::min(classFor(capacity * perLine), budgetClass);
+    if (classFor(1) > maxClass) {
+        throw std::runtime_error("--bytes-budget is too small for " + std::to_string(capacity) + " lines per key");
+    }
+    freeSlabs.resize(maxClass + 1);
+}
+
+unsigned KeyedRingBuffer::classFor(size_t bytes) const {
+    const size_t total = capacity * sizeof(uint32_t) + bytes;
+    unsigned cls = MIN_CLASS;
+    while ((static_cast<size_t>(1) << cls) < total) {
+        ++cls;
+    }
+    return cls;
+}
+
+size_t KeyedRingBuffer::dataCapacity(unsigned cls) const {
+    return (static_cast<size_t>(1) << cls) - capacity * sizeof(uint32_t);
+}
+
+uint32_t KeyedRingBuffer::lineOffset(const Entry& e, size_t i) const {
+    uint32_t value;
+    std::memcpy(&value, &arena[e.slab + ((e.offsetStart + i) % capacity) * sizeof(uint32_t)], sizeof(value));
+    return value;
+}
+
+void KeyedRingBuffer::setLineOffset(Entry& e, size_t i, uint32_t value) {
+    std::memcpy(&arena[e.slab + ((e.offsetStart + i) % capacity) * sizeof(uint32_t)], &value, sizeof(value));
+}
+
+void KeyedRingBuffer::dropOldest(Entry& e) {
+    if (e.count == 0) {
+        return;
+    }
+    size_t len = e.used;
+    if (e.count > 1) {
+        const size_t a = lineOffset(e, 0);
+        const size_t b = lineOffset(e, 1);
+        len = (b >= a) ? b - a : dataCapacity(e.slabClass) - a + b;
+    }
+    e.used -= static_cast<uint32_t>(len);
+    e.offsetStart = static_cast<uint32_t>((e.offsetStart + 1) % capacity);
+    e.count--;
+}
+
+void KeyedRingBuffer::store(Entry& e, const char* line, size_t len) {
+    const size_t dataCap = dataCapacity(e.slabClass);
+    char* data = &arena[e.slab + capacity * sizeof(uint32_t)];
+    setLineOffset(e, e.count, e.end);
+    const size_t first = std::min(len, dataCap - e.end);
+    std::memcpy(data + e.end, line, first);
+    std::memcpy(data, line + first, len - first);
+    e.end = static_cast<uint32_t>((e.end + len) % dataCap);
+    e.used += static_cast<uint32_t>(len);
+    e.count++;
+}
+
+void KeyedRingBuffer::linearize(const Entry& e, std::string& out, std::vector<uint32_t>& lengths) const {
+    out.clear();
+    lengths.clear();
+    if (e.count == 0) {
+        return;
+    }
+    const size_t dataCap = dataCapacity(e.slabClass);
+    const char* data = &arena[e.slab + capacity * sizeof(uint32_t)];
+    const size_t used = e.used;
+    const size_t first = lineOffset(e, 0);
+    const size_t firstPart = std::min(used, dataCap - first);
+    out.append(data + first, firstPart);
+    out.append(data, used - firstPart);
+    size_t consumed = 0;
+    for (size_t i = 0; i < e.count; ++i) {
+        size_t len;
+        if (i + 1 < e.count) {
+            const size_t a = lineOffset(e, i);
+            const size_t b = lineOffset(e, i + 1);
+            len = (b >= a) ? b - a : dataCap - a + b;
+        } else {
+            len = used - consumed;
+        }
+        lengths.push_back(static_cast<uint32_t>(len));
+        consumed += len;
+    }
+}
+
+void KeyedRingBuffer::append_segment(const char* segment, size_t len) {
+    pending.append(segment, len);
+}
+
+void KeyedRingBuffer::end_line() {
+    append_line(pending.data(), pending.size());
+    pending.clear();
+}
+
+void KeyedRingBuffer::append_line(const char* line, size_t len) {
+    if (capacity == 0) {
+        return;
+    }
+    const char* key = nullptr;
+    size_t keyLen = 0;
+    if (!spec.extract(line, len, key, keyLen)) {
+        return;
+    }
+
+    const uint32_t idx = findOrInsert(key, keyLen, hashKey(key, keyLen));
+    touch(idx);
+    if (entries[idx].count == capacity) {
+        dropOldest(entries[idx]);
+    }
+
+    Entry* e = &entries[idx];
+    if (e->slabClass == 0 || dataCapacity(e->slabClass) - e->used < len) {
+        grow(idx, len);
+        e = &entries[idx];
+        if (e->slabClass == 0) {
+            return; // nothing could be allocated within the budget
+        }
+        while (dataCapacity(e->slabClass) - e->used < len && e->count > 0) {
+            dropOldest(*e);
+        }
+        if (dataCapacity(e->slabClass) - e->used < len) {
+            return; // line too large for a single key's ring
+        }
+    }
+    store(*e, line, len);
+}
+
+// Moves the key to a slab large enough for its retained lines plus needed
+// bytes, capped at maxClass.  Returns false when the slab did not change.
+bool KeyedRingBuffer::grow(uint32_t idx, size_t needed) {
+    Entry& e = entries[idx];
+    const unsigned target = std::min(classFor(e.used + needed), maxClass);
+    if (e.slabClass != 0 && target <= e.slabClass) {
+        return false;
+    }
+
+    std::string lines;
+    std::vector<uint32_t> lengths;
+    linearize(e, lines, lengths);
+    if (e.slabClass != 0) {
+        release(e.slab, e.slabClass);
+        e.slabClass = 0;
+    }
+
+    uint64_t slab = 0;
+    const bool ok = allocate(target, idx, slab);
+    Entry& moved = entries[idx];
+    moved.count = 0;
+    moved.offsetStart = 0;
+    moved.end = 0;
+    moved.used = 0;
+    if (!ok) {
+        return false;
+    }
+    moved.slab = slab;
+    moved.slabClass = target;
+    size_t pos = 0;
+    for (uint32_t len : lengths) {
+        store(moved, lines.data() + pos, len);
+        pos += len;
+    }
+    return true;
+}
+
+// Takes the lowest free slab of class cls, splitting a larger one or
+// extending the arena when none is free.  Evicts the least recently updated
+// keys other than keep, one at a time, until one of those succeeds.
+bool KeyedRingBuffer::allocate(unsigned cls, uint32_t keep, uint64_t& slab) {
+    const size_t size = static_cast<size_t>(1) << cls;
+    while (true) {
+        for (unsigned c = cls; c < freeSlabs.size(); ++c) {
+            if (freeSlabs[c].empty()) {
+                continue;
+            }
+            const uint64_t s = *freeSlabs[c].begin();
+            freeSlabs[c].erase(freeSlabs[c].begin());
+            while (c > cls) { // split, keeping the lower half
+                --c;
+                freeSlabs[c].insert(s + (static_cast<uint64_t>(1) << c));
+            }
+            slab = s;
+            return true;
+        }
+        const size_t start = (arenaUsed + size - 1) & ~(size - 1);
+        if (start + size + keyBytes <= budget) {
+            if (arena.size() < start + size) {
+                arena.resize(std::min(budget, std::max(arena.size() * 2, start + size)));
+            }
+            // The gap left by the alignment becomes free slabs.
+            uint64_t gap = arenaUsed;
+            arenaUsed = start + size;
+            while (gap < start) {
+                unsigned gapClass = MIN_CLASS;
+                while ((gap & (static_cast<uint64_t>(1) << gapClass)) == 0) {
+                    ++gapClass;
+                }
+                release(gap, gapClass);
+                gap += static_cast<uint64_t>(1) << gapClass;
+            }
+            slab = start;
+            return true;
+        }
+
+        uint32_t victim = lruHead;
+        if (victim == keep) {
+            victim = entries[victim].next;
+        }
+        if (victim == NONE) {
+            return false; // every other key is gone and the slab still does not fit
+        }
+        evict(victim);
+    }
+}
+
+// Merges the slab with its buddy while the buddy is free, and gives it back
+// to the arena when it ends at the bump pointer.
+void KeyedRingBuffer::release(uint64_t slab, unsigned cls) {
+    while (cls < maxClass) {
+        const uint64_t buddy = slab ^ (static_cast<uint64_t>(1) << cls);
+        auto it = freeSlabs[cls].find(buddy);
+        if (it == freeSlabs[cls].end()) {
+            break;
+        }
+        freeSlabs[cls].erase(it);
+        slab = std::min(slab, buddy);
+        ++cls;
+    }
+    if (slab + (static_cast<uint64_t>(1) << cls) != arenaUsed) {
+        freeSlabs[cls].insert(slab);
+        return;
+    }
+    arenaUsed = slab;
+    for (unsigned c = MIN_CLASS; c < freeSlabs.size();) {
+        const uint64_t below = arenaUsed - (static_cast<uint64_t>(1) << c);
+        if (arenaUsed >= (static_cast<uint64_t>(1) << c) && freeSlabs[c].erase(below) > 0) {
+            arenaUsed = below;
+            c = MIN_CLASS;
+        } else {
+            ++c;
+        }
+    }
+}
+
+uint32_t KeyedRingBuffer::findOrInsert(const char* key, size_t len, uint64_t hash) {
+    if ((liveKeys + 1) * 2 > table.size()) {
+        rehash(table.size() * 2);
+    }
+    const size_t mask = table.size() - 1;
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (table[i] != NONE) {
+        const Entry& e = entries[table[i]];
+        if (e.hash == hash && e.key.size() == len && std::memcmp(e.key.data(), key, len) == 0) {
+            return table[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    uint32_t idx;
+    if (!freeEntries.empty()) {
+        idx = freeEntries.back();
+        freeEntries.pop_back();
+        entries[idx] = Entry();
+    } else {
+        idx = static_cast<uint32_t>(entries.size());
+        entries.emplace_back();
+    }
+    Entry& e = entries[idx];
+    e.key.assign(key, len);
+    e.hash = hash;
+    e.firstSeen = sequence++;
+    e.live = true;
+    table[i] = idx;
+    liveKeys++;
+    keyBytes += len;
+    return idx;
+}
+
+void KeyedRingBuffer::rehash(size_t newSize) {
+    std::vector<uint32_t> old(newSize, NONE);
+    old.swap(table);
+    const size_t mask = newSize - 1;
+    for (uint32_t idx : old) {
+        if (idx == NONE) {
+            continue;
+        }
+        size_t i = static_cast<size_t>(entries[idx].hash) & mask;
+        while (table[i] != NONE) {
+            i = (i + 1) & mask;
+        }
+        table[i] = idx;
+    }
+}
+
+// Linear probing deletion by backward shift, so lookups never need tombstones.
+void KeyedRingBuffer::eraseFromTable(uint32_t idx) {
+    const size_t mask = table.size() - 1;
+    size_t i = static_cast<size_t>(entries[idx].hash) & mask;
+    while (table[i] != idx) {
+        i = (i + 1) & mask;
+    }
+    table[i] = NONE;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (table[j] == NONE) {
+            break;
+        }
+        const size_t home = static_cast<size_t>(entries[table[j]].hash) & mask;
+        const bool homeBetween = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!homeBetween) {
+            table[i] = table[j];
+            table[j] = NONE;
+            i = j;
+        }
+    }
+}
+
+void KeyedRingBuffer::unlink(uint32_t idx) {
+    Entry& e = entries[idx];
+    if (e.prev != NONE) entries[e.prev].next = e.next; else lruHead = e.next;
+    if (e.next != NONE) entries[e.next].prev = e.prev; else lruTail = e.prev;
+    e.prev = e.next = NONE;
+}
+
+void KeyedRingBuffer::touch(uint32_t idx) {
+    if (lruTail == idx) {
+        return;
+    }
+    Entry& e = entries[idx];
+    if (e.prev != NONE || e.next != NONE || lruHead == idx) {
+        unlink(idx);
+    }
+    e.prev = lruTail;
+    e.next = NONE;
+    if (lruTail != NONE) entries[lruTail].next = idx; else lruHead = idx;
+    lruTail = idx;
+}
+
+void KeyedRingBuffer::evict(uint32_t idx) {
+    Entry& e = entries[idx];
+    if (e.slabClass != 0) {
+        release(e.slab, e.slabClass);
+    }
+    eraseFromTable(idx);
+    unlink(idx);
+    keyBytes -= e.key.size();
+    e.key.clear();
+    e.key.shrink_to_fit();
+    e.live = false;
+    e.slabClass = 0;
+    freeEntries.push_back(idx);
+    liveKeys--;
+    evictions++;
+}
+
+void KeyedRingBuffer::print(size_t aggregationThreshold, OutputSink& out) const {
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].live && entries[i].count > 0) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return entries[a].firstSeen < entries[b].firstSeen;
+    });
+
+    std::string block;
+    block.reserve(std::min<size_t>(aggregationThreshold, 1 << 20));
+    std::string lines;
+    std::vector<uint32_t> lengths;
+    for (uint32_t idx : order) {
+        linearize(entries[idx], lines, lengths);
+        size_t pos = 0;
+        for (uint32_t len : lengths) {
+            if (block.size() + len + 1 > aggregationThreshold && !block.empty()) {
+                out.write(block.data(), block.size());
+                block.clear();
+            }
+            block.append(lines, pos, len);
+            block.push_back('\n');
+            pos += len;
+        }
+    }
+    if (!block.empty()) {
+        out.write(block.data(), block.size());
+    }
+}
+
+size_t KeyedRingBuffer::memoryUsage() const {
+    return sizeof(KeyedRingBuffer) + arena.size() + entries.capacity() * sizeof(Entry) + keyBytes +
+           table.capacity() * sizeof(uint32_t);
+}
@@ -0,0 +1,107 @@
+#ifndef KEYED_RING_BUFFER_H
+#define KEYED_RING_BUFFER_H
+
+#include "output_sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+// Selects the key of a line: either the N-th whitespace separated field
+// (1-based) or the value of a NAME=value pair.
+struct KeySpec {
+    size_t field = 0;  // 1-based field index, 0 when name is used
+    std::string name;  // key name for NAME=value lookups
+
+    // "3" selects the third field, anything else a NAME=value pair.
+    static KeySpec parse(const std::string& spec);
+
+    // Locates the key inside line; returns false when the line has none.
+    bool extract(const char* line, size_t len, const char*& key, size_t& keyLen) const;
+};
+
+// Keeps the last N lines of every distinct key.  Each key owns a small ring
+// with the CharRingBuffer layout (a ring of line offsets followed by a byte
+// ring) carved out of one shared arena.  Keys are found through an
+// open-addressing hash table.  Slabs are buddy blocks aligned to their size,
+// so a released slab merges with its free buddy; when the arena reaches its
+// byte budget the least recently updated keys are evicted until a slab of
+// the needed size is free.  Lines without a key are dropped.
+class KeyedRingBuffer {
+public:
+    static constexpr size_t DEFAULT_BUDGET = 64u << 20;
+
+    explicit KeyedRingBuffer(const KeySpec& keySpec, size_t capacity, size_t lineCapacity = 0,
+                             size_t bytesBudget = 0);
+
+    // Streaming API compatible with CharRingBuffer
+    void append_segment(const char* segment, size_t len);
+    void end_line();
+    void append_line(const char* line, size_t len);
+
+    // Prints every key's lines, keys in order of first appearance.
+    void print(size_t aggregationThreshold, OutputSink& out = stdoutSink()) const;
+    size_t memoryUsage() const;
+
+    size_t keyCount() const { return liveKeys; }
+    size_t evictedKeys() const { return evictions; }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr unsigned MIN_CLASS = 8; // 256-byte slabs
+
+    struct Entry {
+        std::string key;
+        uint64_t hash = 0;
+        uint64_t firstSeen = 0;
+        uint64_t slab = 0;      // arena offset of [offset ring][byte ring]
+        unsigned slabClass = 0; // log2 of the slab size, 0 when unallocated
+        uint32_t end = 0;       // one past the newest byte in the byte ring
+        uint32_t used = 0;      // bytes held by the stored lines
+        uint32_t offsetStart = 0;
+        uint32_t count = 0;
+        uint32_t prev = NONE;   // LRU neighbours, oldest first
+        uint32_t next = NONE;
+        bool live = false;
+    };
+
+    uint32_t findOrInsert(const char* key, size_t len, uint64_t hash);
+    void eraseFromTable(uint32_t entry);
+    void rehash(size_t newSize);
+    void touch(uint32_t entry);
+    void unlink(uint32_t entry);
+    void evict(uint32_t entry);
+
+    bool allocate(unsigned cls, uint32_t keep, uint64_t& slab);
+    void release(uint64_t slab, unsigned cls);
+    bool grow(uint32_t entry, size_t needed);
+    unsigned classFor(size_t bytes) const;
+
+    size_t dataCapacity(unsigned cls) const;
+    uint32_t lineOffset(const Entry& e, size_t i) const;
+    void setLineOffset(Entry& e, size_t i, uint32_t value);
+    void dropOldest(Entry& e);
+    void store(Entry& e, const char* line, size_t len);
+    void linearize(const Entry& e, std::string& out, std::vector<uint32_t>& lengths) const;
+
+    KeySpec spec;
+    size_t capacity;      // lines per key
+    size_t budget;        // total bytes for slabs and keys
+    unsigned maxClass;    // largest slab a single key may grow to
+    std::vector<char> arena;
+    size_t arenaUsed;     // bump pointer
+    size_t keyBytes;
+    std::vector<std::set<uint64_t>> freeSlabs; // indexed by size class
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    std::vector<uint32_t> table;  // open addressing, entry index or NONE
+    size_t liveKeys;
+    uint32_t lruHead;
+    uint32_t lruTail;
+    uint64_t sequence;
+    size_t evictions;
+    std::string pending;
+};
+
+#endif // KEYED_RING_BUFFER_H
@@ -0,0 +1,341 @@
+#include "line_count.h"
+#include "cold_read.h"
+#include "seekable_blocks.h"
+#include "simd_scan.h"
+#include <bzlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if ZTAIL_USE_THREADS
+#include <system_error>
+#include <thread>
+#endif
+
+namespace {
+
+constexpr size_t PLAIN_CHUNK = 8u << 20;       // work unit of the mmap scan
+constexpr size_t BZIP2_READ = 1u << 20;
+
+// Runs worker on the calling thread and threads - 1 helpers; the first
+// exception thrown by any of them is rethrown once all have finished.
+template <typename Worker>
+void runWorkers(unsigned threads, const Worker& worker) {
+#if ZTAIL_USE_THREADS
+    std::exception_ptr error;
+    std::mutex m;
+    auto guarded = [&]() {
+        try {
+            worker();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        try {
+            pool.emplace_back(guarded);
+        } catch (const std::system_error&) {
+            break; // keep going with the workers we have
+        }
+    }
+    guarded();
+    for (auto& th : pool) {
+        th.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+#else
+    (void)threads;
+    worker();
+#endif
+}
+
+bool readAt(int fd, char* buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t r = ::pread(fd, buf, len, static_cast<off_t>(offset));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r;
+        len -= static_cast<size_t>(r);
+        offset += static_cast<uint64_t>(r);
+    }
+    return true;
+}
+
+uint64_t fileSizeOf(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+// Returns the offsets of the bzip2 stream headers ("BZh" + level followed by
+// a block or end-of-stream magic) found at byte positions.  pbzip2 and
+// lbzip2 write one stream per block, which makes them decodable in
+// parallel.  A match inside compressed data is possible; decoding then
+// fails and the caller falls back to a single segment.
+std::vector<uint64_t> findBzip2Streams(int fd, uint64_t fileSize) {
+    static const unsigned char blockMagic[6] = {0x31, 0x41, 0x59, 0x26, 0x53, 0x59};
+    static const unsigned char endMagic[6] = {0x17, 0x72, 0x45, 0x38, 0x50, 0x90};
+    constexpr size_t HEADER = 10;
+
+    std::vector<uint64_t> starts;
+    std::vector<char> buf(BZIP2_READ + HEADER);
+    uint64_t base = 0;
+    size_t carried = 0;
+    while (base + carried < fileSize) {
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(BZIP2_READ, fileSize - base - carried));
+        if (!readAt(fd, buf.data() + carried, want, base + carried)) {
+            break;
+        }
+        const size_t avail = carried + want;
+        size_t pos = 0;
+        while (pos + HEADER <= avail) {
+            const char* hit = findLiteral(buf.data() + pos, avail - pos, "BZh", 3);
+            if (!hit || static_cast<size_t>(hit - buf.data()) + HEADER > avail) {
+                break;
+            }
+            const unsigned char* h = reinterpret_cast<const unsigned char*>(hit);
+            if (h[3] >= '1' && h[3] <= '9' &&
+                (std::memcmp(h + 4, blockMagic, 6) == 0 || std::memcmp(h + 4, endMagic, 6) == 0)) {
+                starts.push_back(base + static_cast<uint64_t>(hit - buf.data()));
+            }
+            pos = static_cast<size_t>(hit - buf.data()) + 1;
+        }
+        // Keep the last HEADER - 1 bytes so headers across reads are found.
+        const size_t keep = std::min(avail, HEADER - 1);
+        std::memmove(buf.data(), buf.data() + avail - keep, keep);
+        base += avail - keep;
+        carried = keep;
+    }
+    return starts;
+}
+
+// Decodes the bzip2 streams in [begin, end) and adds their lines to count.
+// Returns false unless the range holds only complete, valid streams.
+bool countBzip2Range(int fd, uint64_t begin, uint64_t end, std::vector<char>& in, std::vector<char>& out,
+                     LineCount& count) {
+    bz_stream bs;
+    std::memset(&bs, 0, sizeof(bs));
+    bool open = false;
+    bool ok = true;
+    uint64_t pos = begin;
+    while (true) {
+        if (bs.avail_in == 0 && pos < end) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(in.size(), end - pos));
+            if (!readAt(fd, in.data(), n, pos)) {
+                ok = false;
+                break;
+            }
+            pos += n;
+            bs.next_in = in.data();
+            bs.avail_in = static_cast<unsigned>(n);
+        }
+        if (bs.avail_in == 0) {
+            break;
+        }
+        if (!open) {
+            if (BZ2_bzDecompressInit(&bs, 0, 0) != BZ_OK) {
+                ok = false;
+                break;
+            }
+            open = true;
+        }
+        bs.next_out = out.data();
+        bs.avail_out = static_cast<unsigned>(out.size());
+        const int ret = BZ2_bzDecompress(&bs);
+        const size_t produced = out.size() - bs.avail_out;
+        count.lines += countNewlines(out.data(), produced);
+        count.bytes += produced;
+        if (ret == BZ_STREAM_END) {
+            BZ2_bzDecompressEnd(&bs);
+            open = false;
+        } else if (ret != BZ_OK) {
+            ok = false;
+            break;
+        }
+    }
+    if (open) {
+        BZ2_bzDecompressEnd(&bs);
+        ok = false; // truncated stream
+    }
+    return ok;
+}
+
+bool countBzip2(int fd, unsigned threads, LineCount& out) {
+    const uint64_t fileSize = fileSizeOf(fd);
+    std::vector<uint64_t> starts = findBzip2Streams(fd, fileSize);
+    if (starts.empty() || starts.front() != 0) {
+        starts.insert(starts.begin(), 0);
+    }
+    starts.push_back(fileSize);
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex m;
+    LineCount total;
+    const size_t segments = starts.size() - 1;
+    runWorkers(static_cast<unsigned>(std::min<size_t>(threads, segments)), [&]() {
+        std::vector<char> in(BZIP2_READ);
+        std::vector<char> decoded(BZIP2_READ);
+        LineCount local;
+        for (size_t i = next++; i < segments && !failed; i = next++) {
+            if (!countBzip2Range(fd, starts[i], starts[i + 1], in, decoded, local)) {
+                failed = true;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m);
+        total.lines += local.lines;
+        total.bytes += local.bytes;
+    });
+
+    if (failed) {
+        // A false stream header split a stream: decode the file as a whole.
+        std::vector<char> in(BZIP2_READ);
+        std::vector<char> decoded(BZIP2_READ);
+        total = LineCount();
+        if (!countBzip2Range(fd, 0, fileSize, in, decoded, total)) {
+            throw std::runtime_error("bzip2 error while counting lines");
+        }
+    }
+    out = total;
+    return true;
+}
+
+} // namespace
+
+unsigned defaultCountThreads() {
+#if ZTAIL_USE_THREADS
+    return std::max(1u, std::thread::hardware_concurrency());
+#else
+    return 1;
+#endif
+}
+
+LineCount countPlainFile(int fd, unsigned threads, bool dropCache) {
+    LineCount total;
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("fstat failed: " + std::string(std::strerror(errno)));
+    }
+
+    const CachedPages before(dropCache ? fd : -1);
+    void* map = MAP_FAILED;
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (S_ISREG(st.st_mode) && size > 0) {
+        map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        // Pipes, devices and empty files are read sequentially.
+        std::vector<char> buf(1 << 20);
+        while (true) {
+            ssize_t r = ::read(fd, buf.data(), buf.size());
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) {
+                throw std::runtime_error("read failed: " + std::string(std::strerror(errno)));
+            }
+            if (r == 0) break;
+            total.lines += countNewlines(buf.data(), static_cast<size_t>(r));
+            total.bytes += static_cast<uint64_t>(r);
+        }
+        return total;
+    }
+    ::madvise(map, size, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(map);
+    const size_t chunks = (size + PLAIN_CHUNK - 1) / PLAIN_CHUNK;
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> lines(0);
+    try {
+        runWorkers(static_cast<unsigned>(std::min<size_t>(threads, chunks)), [&]() {
+            uint64_t local = 0;
+            for (size_t i = next++; i < chunks; i = next++) {
+                const size_t begin = i * PLAIN_CHUNK;
+                const size_t length = std::min(PLAIN_CHUNK, size - begin);
+                local += countNewlines(data + begin, length);
+                if (dropCache) {
+                    // Mapped pages stay cached, so the chunk is unmapped first.
+                    ::madvise(const_cast<char*>(data) + begin, length, MADV_DONTNEED);
+                    before.dropNew(fd, begin, length);
+                }
+            }
+            lines += local;
+        });
+    } catch (...) {
+        ::munmap(map, size);
+        throw;
+    }
+    ::munmap(map, size);
+    total.lines = lines;
+    total.bytes = size;
+    return total;
+}
+
+bool countCompressedBlocks(int fd, CompressionType type, unsigned threads, LineCount& out,
+                           uint64_t decodedBudget, bool dropCache) {
+    if (type == CompressionType::BZIP2) {
+        // Every worker holds an input and a decoded buffer.
+        const uint64_t perWorker = 2 * BZIP2_READ;
+        return countBzip2(fd, static_cast<unsigned>(std::min<uint64_t>(threads, std::max<uint64_t>(1, decodedBudget / perWorker))), out);
+    }
+
+    const std::vector<CompressedBlock> blocks = listCompressedBlocks(fd, type);
+    if (blocks.size() < 2) {
+        return false;
+    }
+    uint64_t largest = 0;
+    for (const auto& b : blocks) {
+        largest = std::max(largest, b.rawSize);
+    }
+    if (largest > 0) {
+        threads = static_cast<unsigned>(std::min<uint64_t>(threads, std::max<uint64_t>(1, decodedBudget / largest)));
+    }
+    const CachedPages before(dropCache ? fd : -1);
+
+    std::atomic<size_t> next(0);
+    std::mutex m;
+    LineCount total;
+    runWorkers(static_cast<unsigned>(std::min<size_t>(threads, blocks.size())), [&]() {
+        BlockDecoder decoder(fd, type);
+        std::vector<char> decoded;
+        LineCount local;
+        for (size_t i = next++; i < blocks.size(); i = next++) {
+            decoder.decode(blocks[i], decoded);
+            if (dropCache) {
+                before.dropNew(fd, blocks[i].offset, blocks[i].size);
+            }
+            local.lines += countNewlines(decoded.data(), decoded.size());
+            local.bytes += decoded.size();
+        }
+        std::lock_guard<std::mutex> lock(m);
+        total.lines += local.lines;
+        total.bytes += local.bytes;
+    });
+    out = total;
+    return true;
+}
+
+LineCount countStream(ICompressor& comp, size_t bufferSize) {
+    LineCount total;
+    std::vector<char> buf(bufferSize);
+    size_t n = 0;
+    while (comp.decompress(buf, n)) {
+        total.lines += countNewlines(buf.data(), n);
+        total.bytes += n;
+    }
+    return total;
+}
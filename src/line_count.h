@@ -0,0 +1,38 @@
+#ifndef LINE_COUNT_H
+#define LINE_COUNT_H
+
+#include "compression_type.h"
+#include "icompressor.h"
+#include <cstdint>
+
+// Newline and byte totals of a decoded input, as reported by `wc -lc`.
+struct LineCount {
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+};
+
+// Returns the number of workers used when threads is 0: one per hardware
+// thread, or 1 when the build has no thread support.
+unsigned defaultCountThreads();
+
+// Counts a plain file by splitting a read-only mapping of it across threads.
+// With dropCache every chunk leaves the page cache once it is counted,
+// except the pages that were cached before.
+LineCount countPlainFile(int fd, unsigned threads, bool dropCache = false);
+
+// Decodes the independently decodable units of a compressed file (BGZF
+// blocks, zstd frames, xz blocks, bzip2 streams) on up to threads workers
+// and counts their lines.  Returns false without touching out when the file
+// has fewer than two such units, so callers can stream it instead.  bzip2
+// files are always handled here, including single-stream ones.  Fewer
+// threads run when decodedBudget cannot hold one decoded block per thread.
+// With dropCache the blocks leave the page cache once they are decoded,
+// except the pages that were cached before (bzip2 streams are left to the
+// caller).
+bool countCompressedBlocks(int fd, CompressionType type, unsigned threads, LineCount& out,
+                           uint64_t decodedBudget = 1u << 30, bool dropCache = false);
+
+// Counts everything a compressor produces, reading bufferSize bytes at a time.
+LineCount countStream(ICompressor& comp, size_t bufferSize);
+
+#endif // LINE_COUNT_H
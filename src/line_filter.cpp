@@ -0,0 +1,159 @@
+#include "line_filter.h"
+#include "simd_scan.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+LineFilter LineFilter::literal(const std::string& needle) {
+    if (needle.empty()) {
+        throw std::runtime_error("--grep requires a non-empty pattern");
+    }
+    if (needle.find('\n') != std::string::npos) {
+        throw std::runtime_error("--grep pattern must not contain a newline");
+    }
+    LineFilter filter;
+    filter.prefilter = needle;
+    return filter;
+}
+
+LineFilter LineFilter::regex(const std::string& pattern) {
+    LineFilter filter;
+    filter.isRegex = true;
+    try {
+        filter.re = std::regex(pattern, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& ex) {
+        throw std::runtime_error("invalid --regex pattern '" + pattern + "': " + ex.what());
+    }
+    filter.prefilter = extractRequiredLiteral(pattern);
+    return filter;
+}
+
+const char* LineFilter::findCandidate(const char* data, size_t size) const {
+    if (prefilter.empty()) {
+        return size > 0 ? data : nullptr;
+    }
+    return findLiteral(data, size, prefilter.data(), prefilter.size());
+}
+
+bool LineFilter::matches(const char* line, size_t len) const {
+    if (!prefilter.empty() && !findLiteral(line, len, prefilter.data(), prefilter.size())) {
+        return false;
+    }
+    if (!isRegex) {
+        return true;
+    }
+    return std::regex_search(line, line + len, re);
+}
+
+// Walks the top level of the pattern collecting runs of plain characters.
+// Anything that can make a character optional or variable (classes, groups,
+// quantifiers, escapes other than escaped punctuation) ends the current run.
+// Alternation makes every run optional, so no literal is returned in that
+// case.
+std::string LineFilter::extractRequiredLiteral(const std::string& pattern) {
+    std::string best;
+    std::string run;
+    int depth = 0;
+
+    auto flush = [&]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        const char c = pattern[i];
+        if (c == '|') {
+            return std::string();
+        }
+        if (c == '(') {
+            flush();
+            ++depth;
+            continue;
+        }
+        if (c == ')') {
+            if (depth > 0) {
+                --depth;
+            }
+            // A quantifier after a group applies to the group, which never
+            // contributes to the run anyway.
+            continue;
+        }
+        if (depth > 0) {
+            if (c == '\\') {
+                ++i;
+            }
+            continue;
+        }
+        if (c == '[') {
+            flush();
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') ++j;
+            if (j < pattern.size() && pattern[j] == ']') ++j;
+            while (j < pattern.size() && pattern[j] != ']') {
+                if (pattern[j] == '\\') ++j;
+                ++j;
+            }
+            i = j;
+            continue;
+        }
+        if (c == '*' || c == '?' || (c == '{' && i + 1 < pattern.size() && pattern[i + 1] == '0')) {
+            // The preceding character may be absent.
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            flush();
+            if (c == '{') {
+                while (i < pattern.size() && pattern[i] != '}') ++i;
+            }
+            continue;
+        }
+        if (c == '+' || c == '{') {
+            // The preceding character is required but may repeat.
+            flush();
+            if (c == '{') {
+                while (i < pattern.size() && pattern[i] != '}') ++i;
+            }
+            continue;
+        }
+        if (c == '.' || c == '^' || c == '$') {
+            flush();
+            continue;
+        }
+        if (c == '\\') {
+            if (i + 1 >= pattern.size()) {
+                flush();
+                continue;
+            }
+            const char next = pattern[++i];
+            if (next != '\0' && std::strchr("\\^$.|?*+()[]{}/-", next) != nullptr) {
+                run.push_back(next);
+            } else {
+                // Character classes and assertions (\d, \w, \b) end the run,
+                // and so do escapes whose operands are not literal text: \x41,
+                // \u0041, \cJ and backreferences such as \12.
+                flush();
+                size_t operand = 0;
+                if (next == 'x') {
+                    operand = 2;
+                } else if (next == 'u') {
+                    operand = 4;
+                } else if (next == 'c') {
+                    operand = 1;
+                } else if (std::isdigit(static_cast<unsigned char>(next))) {
+                    while (i + operand + 1 < pattern.size() &&
+                           std::isdigit(static_cast<unsigned char>(pattern[i + operand + 1]))) {
+                        ++operand;
+                    }
+                }
+                i = std::min(i + operand, pattern.size() - 1);
+            }
+            continue;
+        }
+        run.push_back(c);
+    }
+    flush();
+    return best;
+}
@@ -0,0 +1,45 @@
+#ifndef LINE_FILTER_H
+#define LINE_FILTER_H
+
+#include <string>
+#include <regex>
+#include <cstddef>
+
+// Selects which lines reach the ring buffer.  A literal filter matches lines
+// containing the needle; a regex filter matches lines for which
+// std::regex_search succeeds.  Both expose a literal prefilter so the parser
+// can jump straight to candidate lines instead of visiting every line.
+class LineFilter {
+public:
+    static LineFilter literal(const std::string& needle);
+    static LineFilter regex(const std::string& pattern);
+
+    // Returns a pointer inside [data, data + size) at or before which the
+    // next candidate line starts, or nullptr when no line in the range can
+    // match.  Without a usable prefilter this returns data itself.
+    const char* findCandidate(const char* data, size_t size) const;
+
+    // Returns true when the line [line, line + len) matches the filter.
+    bool matches(const char* line, size_t len) const;
+
+    // True when a hit from findCandidate() is already a confirmed match.
+    bool candidatesAreMatches() const { return !isRegex; }
+
+    bool usesRegex() const { return isRegex; }
+
+    // Literal every matching line is known to contain (may be empty).
+    const std::string& requiredLiteral() const { return prefilter; }
+
+    // Longest literal run that any match of the ECMAScript pattern must
+    // contain, or an empty string when none can be derived safely.
+    static std::string extractRequiredLiteral(const std::string& pattern);
+
+private:
+    LineFilter() = default;
+
+    bool isRegex = false;
+    std::string prefilter;
+    std::regex re;
+};
+
+#endif // LINE_FILTER_H
@@ -0,0 +1,258 @@
+#include "line_index.h"
+#include "sidecar.h"
+#include "simd_scan.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char INDEX_MAGIC[8] = {'Z', 'T', 'L', 'I', 'N', 'E', 'S', '1'};
+constexpr size_t SCAN_CHUNK = 4096;      // newline counting granularity
+constexpr size_t FLUSH_THRESHOLD = 1u << 20;
+
+// Returns the position just after the count-th newline of [p, end), which
+// must hold at least count newlines.
+const char* skipNewlines(const char* p, const char* end, uint64_t count) {
+    while (count > 0) {
+        const size_t chunk = std::min(SCAN_CHUNK, static_cast<size_t>(end - p));
+        const uint64_t c = countNewlines(p, chunk);
+        if (c < count) {
+            count -= c;
+            p += chunk;
+            continue;
+        }
+        for (; count > 0; --count) {
+            p = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p))) + 1;
+        }
+    }
+    return p;
+}
+
+} // namespace
+
+std::string LineIndex::pathFor(const std::string& filename) {
+    return filename + ".ztlines";
+}
+
+const LineIndex::Entry& LineIndex::entryFor(uint64_t line, uint64_t& entryLine) const {
+    const uint64_t j = std::min<uint64_t>(line > 0 ? (line - 1) / lineInterval : 0, entries.size() - 1);
+    entryLine = j * lineInterval + 1;
+    return entries[static_cast<size_t>(j)];
+}
+
+void LineIndex::save(const std::string& filename) const {
+    const SourceStamp stamp = sourceStampOf(filename);
+    std::string out;
+    out.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    putValue<uint64_t>(out, stamp.size);
+    putValue<int64_t>(out, stamp.mtimeSec);
+    putValue<int64_t>(out, stamp.mtimeNsec);
+    putValue<uint32_t>(out, static_cast<uint32_t>(type));
+    putValue<uint32_t>(out, lineInterval);
+    putValue<uint64_t>(out, lines);
+    putValue<uint64_t>(out, blockList.size());
+    for (const auto& b : blockList) {
+        putValue<uint64_t>(out, b.offset);
+        putValue<uint64_t>(out, b.size);
+        putValue<uint64_t>(out, b.rawSize);
+        putValue<uint32_t>(out, b.check);
+    }
+    putValue<uint64_t>(out, entries.size());
+    for (const auto& e : entries) {
+        putValue<uint64_t>(out, e.block);
+        putValue<uint64_t>(out, e.offset);
+    }
+    writeSidecarFile(pathFor(filename), out);
+}
+
+bool LineIndex::load(const std::string& filename) {
+    std::string bytes;
+    if (!readSidecarFile(pathFor(filename), bytes)) {
+        return false;
+    }
+    SidecarCursor cur(bytes);
+    char magic[sizeof(INDEX_MAGIC)];
+    SourceStamp stamp;
+    uint32_t storedType = 0;
+    uint64_t blockCount = 0;
+    if (!cur.getBytes(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+        !cur.get(stamp.size) || !cur.get(stamp.mtimeSec) || !cur.get(stamp.mtimeNsec) ||
+        !cur.get(storedType) || !cur.get(lineInterval) || !cur.get(lines) || !cur.get(blockCount) ||
+        lineInterval == 0) {
+        return false;
+    }
+    if (!(stamp == sourceStampOf(filename))) {
+        return false;
+    }
+    type = static_cast<CompressionType>(storedType);
+    blockList.clear();
+    entries.clear();
+    for (uint64_t i = 0; i < blockCount; ++i) {
+        CompressedBlock b{};
+        if (!cur.get(b.offset) || !cur.get(b.size) || !cur.get(b.rawSize) || !cur.get(b.check)) {
+            return false;
+        }
+        blockList.push_back(b);
+    }
+    uint64_t entryCount = 0;
+    if (!cur.get(entryCount) || entryCount == 0) {
+        return false;
+    }
+    for (uint64_t i = 0; i < entryCount; ++i) {
+        Entry e{};
+        if (!cur.get(e.block) || !cur.get(e.offset) || e.block > blockList.size()) {
+            return false;
+        }
+        entries.push_back(e);
+    }
+    return cur.atEnd();
+}
+
+LineIndexBuilder::LineIndexBuilder(CompressionType type, std::vector<CompressedBlock> blocks, uint32_t interval)
+    : index(), newlines(0), nextMark(interval), block(0), endsWithNewline(true)
+{
+    if (interval == 0) {
+        throw std::runtime_error("line index interval must be positive");
+    }
+    index.type = type;
+    index.lineInterval = interval;
+    index.blockList = std::move(blocks);
+    index.entries.push_back({0, 0});
+}
+
+void LineIndexBuilder::addBlock(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        const size_t chunk = std::min(SCAN_CHUNK, static_cast<size_t>(end - p));
+        const uint64_t c = countNewlines(p, chunk);
+        if (newlines + c < nextMark) {
+            newlines += c;
+            p += chunk;
+            continue;
+        }
+        p = skipNewlines(p, end, nextMark - newlines);
+        newlines = nextMark;
+        nextMark += index.lineInterval;
+        index.entries.push_back({block, static_cast<uint64_t>(p - data)});
+    }
+    if (size > 0) {
+        endsWithNewline = data[size - 1] == '\n';
+    }
+    ++block;
+}
+
+LineIndex LineIndexBuilder::finish() {
+    index.lines = newlines + (endsWithNewline ? 0 : 1);
+    return index;
+}
+
+IndexingBlockReader::IndexingBlockReader(FilePtr&& f, const std::string& name, CompressionType type,
+                                         std::vector<CompressedBlock> blocks, DiagnosticSink diagnostics)
+    : file(std::move(f)), filename(name), diagnostics(std::move(diagnostics)), blockList(blocks), decoder(fileno(file.get()), type),
+      builder(type, std::move(blocks)), next(0), decoded(), decodedPos(0), saved(false)
+{
+}
+
+bool IndexingBlockReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    bytesDecompressed = 0;
+    while (bytesDecompressed < outBuffer.size()) {
+        if (decodedPos == decoded.size()) {
+            if (next == blockList.size()) {
+                break;
+            }
+            decoder.decode(blockList[next++], decoded);
+            decodedPos = 0;
+            builder.addBlock(decoded.data(), decoded.size());
+            continue;
+        }
+        const size_t n = std::min(outBuffer.size() - bytesDecompressed, decoded.size() - decodedPos);
+        std::memcpy(outBuffer.data() + bytesDecompressed, decoded.data() + decodedPos, n);
+        bytesDecompressed += n;
+        decodedPos += n;
+    }
+    if (next == blockList.size() && decodedPos == decoded.size() && !saved) {
+        saved = true;
+        try {
+            builder.finish().save(filename);
+        } catch (const std::exception& ex) {
+            if (diagnostics) {
+                diagnostics(std::string("line index not written: ") + ex.what());
+            }
+        }
+    }
+    return bytesDecompressed > 0;
+}
+
+LineRangeWriter::LineRangeWriter(std::ostream& o, uint64_t f, uint64_t l, uint64_t startLine)
+    : out(o), first(f), last(l), line(startLine), midLine(false), buffer()
+{
+}
+
+bool LineRangeWriter::write(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end && line <= last) {
+        if (line < first) {
+            const uint64_t needed = first - line;
+            const uint64_t c = countNewlines(p, static_cast<size_t>(end - p));
+            if (c < needed) {
+                line += c;
+                return true;
+            }
+            p = skipNewlines(p, end, needed);
+            line = first;
+            continue;
+        }
+        const char* nl = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!nl) {
+            buffer.append(p, static_cast<size_t>(end - p));
+            midLine = true;
+            break;
+        }
+        buffer.append(p, static_cast<size_t>(nl + 1 - p));
+        midLine = false;
+        p = nl + 1;
+        ++line;
+        if (buffer.size() >= FLUSH_THRESHOLD) {
+            flush();
+        }
+    }
+    return line <= last;
+}
+
+void LineRangeWriter::finish() {
+    if (midLine) {
+        buffer.push_back('\n');
+        midLine = false;
+    }
+    flush();
+    out.flush();
+}
+
+void LineRangeWriter::flush() {
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+void writeIndexedRange(int fd, const LineIndex& index, uint64_t first, uint64_t last, std::ostream& out) {
+    if (first > index.lineCount() || first > last) {
+        return;
+    }
+    uint64_t entryLine = 0;
+    const LineIndex::Entry& entry = index.entryFor(first, entryLine);
+    const std::vector<CompressedBlock>& blocks = index.blocks();
+
+    BlockDecoder decoder(fd, index.compressionType());
+    LineRangeWriter writer(out, first, last, entryLine);
+    std::vector<char> decoded;
+    for (uint64_t b = entry.block; b < blocks.size(); ++b) {
+        decoder.decode(blocks[static_cast<size_t>(b)], decoded);
+        const size_t offset = b == entry.block ? static_cast<size_t>(std::min<uint64_t>(entry.offset, decoded.size())) : 0;
+        if (!writer.write(decoded.data() + offset, decoded.size() - offset)) {
+            break;
+        }
+    }
+    writer.finish();
+}
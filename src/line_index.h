@@ -0,0 +1,125 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include "compression_type.h"
+#include "diagnostics.h"
+#include "icompressor.h"
+#include "seekable_blocks.h"
+#include "file_ptr.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Sparse map from line numbers to positions inside a block-seekable archive,
+// stored next to it as "<archive>.ztlines".  Entry j locates the first byte
+// of line j * interval + 1 (lines are 1-based) as a block index plus an
+// offset into that block's decoded bytes.
+class LineIndex {
+public:
+    static constexpr uint32_t DEFAULT_INTERVAL = 4096;
+
+    struct Entry {
+        uint64_t block;
+        uint64_t offset;
+    };
+
+    static std::string pathFor(const std::string& filename);
+
+    // Loads the index of filename.  Returns false when it is missing,
+    // malformed or older than the archive.
+    bool load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+    CompressionType compressionType() const { return type; }
+    const std::vector<CompressedBlock>& blocks() const { return blockList; }
+    uint32_t interval() const { return lineInterval; }
+
+    // Number of lines, counting an unterminated last line.
+    uint64_t lineCount() const { return lines; }
+
+    // Returns the closest entry at or before line and stores the number of
+    // the line it locates in entryLine.
+    const Entry& entryFor(uint64_t line, uint64_t& entryLine) const;
+
+private:
+    friend class LineIndexBuilder;
+
+    CompressionType type = CompressionType::NONE;
+    uint32_t lineInterval = DEFAULT_INTERVAL;
+    uint64_t lines = 0;
+    std::vector<CompressedBlock> blockList;
+    std::vector<Entry> entries;
+};
+
+// Builds a LineIndex from the decoded blocks of an archive, in order.
+class LineIndexBuilder {
+public:
+    LineIndexBuilder(CompressionType type, std::vector<CompressedBlock> blocks,
+                     uint32_t interval = LineIndex::DEFAULT_INTERVAL);
+
+    void addBlock(const char* data, size_t size);
+    LineIndex finish();
+
+private:
+    LineIndex index;
+    uint64_t newlines;
+    uint64_t nextMark; // newline count after which the next entry starts
+    uint64_t block;
+    bool endsWithNewline;
+};
+
+// Streams every block of an archive like the regular decompressors while
+// building its line index, and writes "<archive>.ztlines" once the last
+// block has been read.  The index is a by-product of a normal tail.
+class IndexingBlockReader : public ICompressor {
+public:
+    // A failure to write the index is reported to diagnostics, and the tail
+    // goes on.
+    IndexingBlockReader(FilePtr&& file, const std::string& filename, CompressionType type,
+                        std::vector<CompressedBlock> blocks, DiagnosticSink diagnostics = DiagnosticSink());
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    FilePtr file;
+    std::string filename;
+    DiagnosticSink diagnostics;
+    std::vector<CompressedBlock> blockList;
+    BlockDecoder decoder;
+    LineIndexBuilder builder;
+    size_t next;
+    std::vector<char> decoded;
+    size_t decodedPos;
+    bool saved;
+};
+
+// Writes lines [first, last] (1-based, inclusive) of a stream of decoded
+// bytes whose first byte starts line startLine.  Every written line ends with
+// a newline, as in the regular tail output.
+class LineRangeWriter {
+public:
+    LineRangeWriter(std::ostream& out, uint64_t first, uint64_t last, uint64_t startLine = 1);
+
+    // Returns false once line last has been written.
+    bool write(const char* data, size_t size);
+
+    // Terminates an unfinished last line and flushes the output.
+    void finish();
+
+private:
+    void flush();
+
+    std::ostream& out;
+    uint64_t first;
+    uint64_t last;
+    uint64_t line;
+    bool midLine;
+    std::string buffer;
+};
+
+// Writes lines [first, last] of an indexed archive, decoding only the blocks
+// that hold them.
+void writeIndexedRange(int fd, const LineIndex& index, uint64_t first, uint64_t last, std::ostream& out);
+
+#endif // LINE_INDEX_H
@@ -1,145 +1,140 @@
-#include "circular_buffer.h"
 #include "cli.h"
-#include "parser.h"
-#include "compressor_zlib.h"
-#include "compressor_zip.h"
-#include "compressor_bzip2.h"
-#include "compressor_xz.h"
-#include "compressor_zstd.h"
-#include "icompressor.h"
+#include "compressor_factory.h"
 #include "compression_type.h"
-#include "tail_plain.h"
+#include "bloom_sidecar.h"
+#include "cold_read.h"
+#include "line_count.h"
+#include "line_index.h"
+#include "pipeline_stats.h"
+#include "tail_engine.h"
+#include "trace.h"
+#include "memory_planner.h"
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdio>      // for fread
 #include <vector>
 #include <cstdlib>     // for EXIT_SUCCESS/EXIT_FAILURE
-#include <fstream>
 #include <string>
-#if ZTAIL_USE_THREADS
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#endif
+#include <memory>
+#include <chrono>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifndef ZTAIL_NO_MAIN
 namespace {
 
-template <typename Reader>
-void processStream(Reader reader, Parser& parser, CircularBuffer& cb,
-                   size_t bufferSize, size_t aggregationThreshold, bool useThreads) {
-#if ZTAIL_USE_THREADS
-    auto memoryLimited = [](size_t bs) {
-#if defined(__linux__)
-        std::ifstream meminfo("/proc/meminfo");
-        std::string key, unit;
-        size_t value = 0;
-        while (meminfo >> key >> value >> unit) {
-            if (key == "MemAvailable:") {
-                size_t avail = value * 1024; // value in kB
-                return bs * 2 > avail / 2; // reserve at most half of available memory
-            }
+// Opens one input: the named file, or stdin, detected from a peeked prefix
+// when it cannot seek.
+DetectionResult openInput(const std::string* filename, const CLIOptions& options) {
+    DetectionResult det;
+    if (filename) {
+        det = detectCompressionType(*filename);
+        if (!det.file) {
+            throw std::runtime_error("Failed to open file: " + *filename);
         }
-#endif
-        return false;
-    };
-
-    bool threaded = useThreads && !memoryLimited(bufferSize);
-    if (threaded) {
-        size_t currentSize = bufferSize;
-        const size_t minSize = 64 * 1024;
-        int idleCount = 0;
-
-        std::vector<char> buffers[2] = {
-            std::vector<char>(currentSize),
-            std::vector<char>(currentSize)
-        };
-        size_t sizes[2] = {0, 0};
-        bool ready[2] = {false, false};
-        bool finished = false;
-        std::mutex m;
-        std::condition_variable cv;
-
-        std::thread producer([&]() {
-            int idx = 0;
-            size_t n = 0;
-            while (true) {
-                {
-                    std::unique_lock<std::mutex> lock(m);
-                    if (!ready[0] && !ready[1]) {
-                        ++idleCount;
-                        if (idleCount >= 3 && currentSize > minSize) {
-                            currentSize /= 2;
-                            for (auto &b : buffers) {
-                                std::vector<char>(currentSize).swap(b);
-                            }
-                            idleCount = 0;
-                        }
-                    } else {
-                        idleCount = 0;
-                    }
-                }
-                if (!reader(buffers[idx], n)) {
-                    break;
-                }
-                if (n > 0) {
-                    {
-                        std::unique_lock<std::mutex> lock(m);
-                        sizes[idx] = n;
-                        ready[idx] = true;
-                    }
-                    cv.notify_one();
-                    idx ^= 1;
-                }
-            }
-            {
-                std::unique_lock<std::mutex> lock(m);
-                finished = true;
+    } else {
+        struct stat st;
+        if (::fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+            const int fd = ::dup(STDIN_FILENO);
+            FilePtr file(fd >= 0 ? ::fdopen(fd, "rb") : nullptr);
+            if (!file) {
+                throw std::runtime_error("cannot open standard input (" + std::to_string(errno) + ")");
             }
-            cv.notify_all();
-        });
+            det = detectCompressionType(std::move(file), "standard input");
+        } else {
+            det = detectStreamCompressionType(STDIN_FILENO, "standard input");
+        }
+    }
+    overrideCompressionType(det, options.format);
+    return det;
+}
 
-        std::thread consumer([&]() {
-            int idx = 0;
-            while (true) {
-                std::unique_lock<std::mutex> lock(m);
-                cv.wait(lock, [&] { return ready[idx] || finished; });
-                if (ready[idx]) {
-                    size_t n = sizes[idx];
-                    ready[idx] = false;
-                    lock.unlock();
-                    parser.parse(buffers[idx].data(), n);
-                    idx ^= 1;
-                } else if (finished) {
-                    break;
-                }
-            }
-            parser.finalize();
-            cb.print(aggregationThreshold);
-        });
+// With --no-cache, drops the pages that reading one input (stdin when
+// filename is null) brings into the cache once the caller is done with it.
+// Created before the input is opened, so detection's reads count too.
+std::unique_ptr<DropOnClose> dropOnClose(const std::string* filename, const CLIOptions& options) {
+    struct stat st;
+    if (!options.noCache) {
+        return nullptr;
+    }
+    if (filename) {
+        return std::make_unique<DropOnClose>(*filename);
+    }
+    const bool regular = ::fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode);
+    return std::unique_ptr<DropOnClose>(regular ? new DropOnClose(STDIN_FILENO) : nullptr);
+}
 
-        producer.join();
-        consumer.join();
-    } else {
-        std::vector<char> buf(bufferSize);
-        size_t n = 0;
-        while (reader(buf, n)) {
-            parser.parse(buf.data(), n);
-        }
-        parser.finalize();
-        cb.print(aggregationThreshold);
+// Opens the reader of det, dropping what it has read behind it with --no-cache.
+std::unique_ptr<ICompressor> openColdReader(DetectionResult& det, const std::string& name, const CLIOptions& options) {
+    const int fd = fileno(det.file.get());
+    std::unique_ptr<ICompressor> comp = openReader(det, name, options);
+    if (options.noCache && fd >= 0) {
+        comp = std::make_unique<DropBehindReader>(std::move(comp), fd);
     }
-#else
-    (void)useThreads;
-    std::vector<char> buf(bufferSize);
+    return comp;
+}
+
+// Prints lines [first, last] of one input (stdin when filename is null).
+// Indexed archives only decode the blocks holding the range; everything else
+// is streamed from the start until the range is complete.
+void printLineRange(const std::string* filename, const CLIOptions& options) {
+    LineRangeWriter writer(std::cout, options.linesFirst, options.linesLast);
+    std::vector<char> buf(options.readBufferSize);
     size_t n = 0;
-    while (reader(buf, n)) {
-        parser.parse(buf.data(), n);
+    const std::unique_ptr<DropOnClose> cold = dropOnClose(filename, options);
+    DetectionResult det = openInput(filename, options);
+    const std::string name = filename ? *filename : "standard input";
+    if (det.type == CompressionType::NONE) {
+        FILE* in = det.file.get();
+        std::fseek(in, 0, SEEK_SET);
+        while ((n = std::fread(buf.data(), 1, buf.size(), in)) > 0 && writer.write(buf.data(), n)) {
+        }
+        writer.finish();
+        return;
+    }
+
+    LineIndex index;
+    if (filename && index.load(*filename) && index.compressionType() == det.type) {
+        writeIndexedRange(fileno(det.file.get()), index, options.linesFirst, options.linesLast, std::cout);
+        return;
     }
-    parser.finalize();
-    cb.print(aggregationThreshold);
-#endif
+    std::unique_ptr<ICompressor> comp = openColdReader(det, name, options);
+    while (comp->decompress(buf, n) && writer.write(buf.data(), n)) {
+    }
+    writer.finish();
+}
+
+// Counts the lines of one input (stdin when filename is null), decoding
+// independent blocks in parallel where the format has them.
+LineCount countInput(const std::string* filename, const CLIOptions& options) {
+    const unsigned threads = options.useThreads ? defaultCountThreads() : 1;
+    const std::unique_ptr<DropOnClose> cold = dropOnClose(filename, options);
+    DetectionResult det = openInput(filename, options);
+    const int fd = fileno(det.file.get()); // -1 for a pipe
+    if (fd >= 0 && det.type == CompressionType::NONE) {
+        return countPlainFile(fd, threads, options.noCache);
+    }
+
+    LineCount count;
+    if (fd >= 0 && det.type != CompressionType::ZIP &&
+        countCompressedBlocks(fd, det.type, threads, count, options.countMemory, options.noCache)) {
+        return count;
+    }
+    std::unique_ptr<ICompressor> comp = openColdReader(det, filename ? *filename : "standard input", options);
+    return countStream(*comp, options.readBufferSize);
+}
+
+void printCount(const LineCount& count, const std::string& name, bool withBytes) {
+    std::cout << count.lines;
+    if (withBytes) {
+        std::cout << ' ' << count.bytes;
+    }
+    if (!name.empty()) {
+        std::cout << ' ' << name;
+    }
+    std::cout << '\n';
 }
 
 } // namespace
@@ -151,49 +146,150 @@ int main(int argc, char* argv[]) {
         if (options.lineCapacity == 0) {
             std::cerr << "WARNING: line capacity is 0; no buffer will be preallocated for lines" << std::endl;
         }
+        const MemoryPlan plan = planMemory(options, memoryBudget(readMemoryLimits(), options.memoryLimit));
+        for (const auto& adjustment : plan.adjustments) {
+            std::cerr << "WARNING: memory budget of " << (plan.budget >> 20) << " MiB: " << adjustment << std::endl;
+        }
 
-        if (!options.filenames.empty()) {
+        const ztail::TailEngine engine(options, [](const std::string& message) {
+            std::cerr << "WARNING: " << message << std::endl;
+        });
+
+        // The trace is written however main is left, so failed runs can be
+        // inspected too.
+        std::unique_ptr<TraceRecorder> trace;
+        if (!options.traceFile.empty()) {
+            trace = std::make_unique<TraceRecorder>(options.traceFile);
+            if (!trace->countersAvailable()) {
+                std::cerr << "WARNING: hardware counters are unavailable (perf_event_open failed); "
+                             "the trace has timings only" << std::endl;
+            }
+            trace->activate();
+            trace->nameThread("main");
+        }
+        struct TraceWriter {
+            TraceRecorder* recorder;
+            ~TraceWriter() {
+                if (!recorder) {
+                    return;
+                }
+                try {
+                    recorder->finish();
+                } catch (const std::exception& ex) {
+                    std::cerr << "ERROR: " << ex.what() << std::endl;
+                }
+            }
+        } traceWriter{trace.get()};
+
+        if (options.buildBloom) {
+            if (options.filenames.empty()) {
+                throw std::runtime_error("--build-bloom requires at least one file");
+            }
+            int status = EXIT_SUCCESS;
             for (const auto& filename : options.filenames) {
-                CircularBuffer cb(options.n, options.lineCapacity, options.bytesBudget);
-                Parser parser(cb, options.lineCapacity);
-
-                DetectionResult det = detectCompressionType(filename);
-
-                std::unique_ptr<ICompressor> comp;
-                if (det.type == CompressionType::GZIP) {
-                    comp = std::make_unique<CompressorZlib>(std::move(det.file), filename, options.zlibBufferSize);
-                } else if (det.type == CompressionType::BZIP2) {
-                    comp = std::make_unique<CompressorBzip2>(std::move(det.file), filename);
-                } else if (det.type == CompressionType::XZ) {
-                    comp = std::make_unique<CompressorXz>(std::move(det.file), filename, options.xzBufferSize);
-                } else if (det.type == CompressionType::ZIP) {
-                    comp = std::make_unique<CompressorZip>(std::move(det.file), filename, options.zipEntry);
-                } else if (det.type == CompressionType::ZSTD) {
-                    comp = std::make_unique<CompressorZstd>(std::move(det.file), filename, options.zstdWindowSize);
+                try {
+                    size_t blocks = BloomSidecar::build(filename);
+                    std::cerr << "Wrote " << BloomSidecar::pathFor(filename) << " (" << blocks << " blocks)" << std::endl;
+                } catch (const std::exception& ex) {
+                    std::cerr << "ERROR: " << ex.what() << std::endl;
+                    status = EXIT_FAILURE;
                 }
+            }
+            return status;
+        }
 
-                if (comp) {
-                    processStream([
-                        &](std::vector<char>& buf, size_t& n) {
-                            return comp->decompress(buf, n);
-                        },
-                        parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads);
+        // Runs body for one input; with --stats, body fills the stage
+        // counters and the report follows the input's output.
+        PipelineStats totalStats;
+        size_t measuredInputs = 0;
+        auto measured = [&](const std::string* filename, auto&& body) {
+            if (!options.stats) {
+                body(static_cast<PipelineStats*>(nullptr));
+                return;
+            }
+            PipelineStats stats;
+            const uint64_t startRchar = processReadBytes();
+            const auto start = std::chrono::steady_clock::now();
+            body(&stats);
+            stats.finish(startRchar, start);
+            std::cout.flush();
+            stats.report(std::cerr, filename ? *filename : "-", options.statsJson);
+            totalStats.add(stats);
+            ++measuredInputs;
+        };
+        auto reportTotal = [&]() {
+            if (measuredInputs > 1) {
+                totalStats.report(std::cerr, "total", options.statsJson);
+            }
+        };
+
+        if (options.count) {
+            auto countOne = [&](const std::string* filename) {
+                LineCount count;
+                measured(filename, [&](PipelineStats* stats) {
+                    TraceSpan span("count");
+                    StageTimer timer(stats ? &stats->readNs : nullptr);
+                    count = countInput(filename, options);
+                    if (stats) {
+                        stats->bytesDecompressed = count.bytes;
+                    }
+                });
+                return count;
+            };
+            if (options.filenames.empty()) {
+                printCount(countOne(nullptr), "", options.countBytes);
+                return EXIT_SUCCESS;
+            }
+            LineCount total;
+            for (const auto& filename : options.filenames) {
+                LineCount count = countOne(&filename);
+                printCount(count, filename, options.countBytes);
+                total.lines += count.lines;
+                total.bytes += count.bytes;
+            }
+            if (options.filenames.size() > 1) {
+                printCount(total, "total", options.countBytes);
+            }
+            reportTotal();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.linesFirst > 0) {
+            auto rangeOne = [&](const std::string* filename) {
+                measured(filename, [&](PipelineStats* stats) {
+                    TraceSpan span("print");
+                    StageTimer timer(stats ? &stats->printNs : nullptr);
+                    printLineRange(filename, options);
+                });
+            };
+            if (options.filenames.empty()) {
+                rangeOne(nullptr);
+            }
+            for (const auto& filename : options.filenames) {
+                rangeOne(&filename);
+            }
+            reportTotal();
+            return EXIT_SUCCESS;
+        }
+
+        auto run = [&](const std::string* filename) {
+            measured(filename, [&](PipelineStats* stats) {
+                if (filename) {
+                    engine.tailFile(*filename, stdoutSink(), stats);
                 } else {
-                    det.file.reset();
-                    tailPlainFile(filename, parser, options.n, options.readBufferSize);
-                    cb.print(options.printAggregationThreshold);
+                    engine.tailFd(STDIN_FILENO, stdoutSink(), stats);
                 }
+            });
+        };
+
+        if (!options.filenames.empty()) {
+            for (const auto& filename : options.filenames) {
+                run(&filename);
             }
         } else {
-            CircularBuffer cb(options.n, options.lineCapacity, options.bytesBudget);
-            Parser parser(cb, options.lineCapacity);
-            processStream([
-                &](std::vector<char>& buf, size_t& n) {
-                    n = std::fread(buf.data(), 1, buf.size(), stdin);
-                    return n > 0;
-                },
-                parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads);
+            run(nullptr);
         }
+        reportTotal();
     } catch (const std::exception& ex) {
         std::cerr << "ERROR: " << ex.what() << std::endl;
         return EXIT_FAILURE;
@@ -0,0 +1,114 @@
+#include "mapped_array.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+void* reserveLazyMemory(size_t bytes) {
+    // MAP_NORESERVE keeps huge rings from failing under overcommit heuristics
+    // for memory they may never touch.
+    void* memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    if (bytes >= HUGEPAGE_THRESHOLD) {
+        ::madvise(memory, bytes, MADV_HUGEPAGE); // advisory; fails harmlessly without THP
+    }
+#endif
+    return memory;
+}
+
+void releaseLazyMemory(void* memory, size_t bytes) {
+    if (memory) {
+        ::munmap(memory, bytes);
+    }
+}
+
+void* mapSpillFile(const std::string& dir, size_t bytes, int& fd) {
+    std::string path = dir + "/ztail-spill-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd = ::mkstemp(name.data());
+    if (fd == -1) {
+        throw std::runtime_error("cannot create a spill file in '" + dir + "' (" + std::to_string(errno) + ")");
+    }
+    ::unlink(name.data()); // the space is returned however the process ends
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        const int err = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot size a spill file in '" + dir + "' (" + std::to_string(err) + ")");
+    }
+    void* memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        ::close(fd);
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* growSpillFile(void* memory, size_t oldBytes, size_t newBytes, int fd) {
+    if (::ftruncate(fd, static_cast<off_t>(newBytes)) != 0) {
+        throw std::runtime_error("cannot grow a spill file (" + std::to_string(errno) + ")");
+    }
+    void* grown = ::mremap(memory, oldBytes, newBytes, MREMAP_MAYMOVE);
+    if (grown == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    return grown;
+}
+
+void writebackSpillFile(void* memory, int fd, size_t offset, size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    ::sync_file_range(fd, static_cast<off_t>(offset), static_cast<off_t>(bytes), SYNC_FILE_RANGE_WRITE);
+    // Dirty pages stay in the page cache until written; only the mapping goes.
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    const size_t first = (offset + page - 1) / page * page;
+    const size_t last = (offset + bytes) / page * page;
+    if (last > first) {
+        ::madvise(static_cast<char*>(memory) + first, last - first, MADV_DONTNEED);
+    }
+}
+
+void sendSpillFile(const void* memory, int fd, size_t offset, size_t bytes, int outFd) {
+    off_t pos = static_cast<off_t>(offset);
+    while (bytes > 0) {
+        const ssize_t sent = ::sendfile(outFd, fd, &pos, std::min<size_t>(bytes, 1u << 30));
+        if (sent > 0) {
+            bytes -= static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && errno != EINVAL && errno != ENOSYS) {
+            throw std::runtime_error("write error (" + std::to_string(errno) + ") while printing spilled lines");
+        }
+        // outFd does not take sendfile: write from the mapping instead.
+        const char* p = static_cast<const char*>(memory) + pos;
+        while (bytes > 0) {
+            const ssize_t written = ::write(outFd, p, bytes);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("write error (" + std::to_string(errno) + ") while printing spilled lines");
+            }
+            p += written;
+            bytes -= static_cast<size_t>(written);
+        }
+    }
+}
+
+void closeSpillFile(void* memory, size_t bytes, int fd) {
+    if (memory) {
+        ::munmap(memory, bytes);
+    }
+    ::close(fd);
+}
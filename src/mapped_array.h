@@ -0,0 +1,116 @@
+#ifndef MAPPED_ARRAY_H
+#define MAPPED_ARRAY_H
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Reserves bytes of zeroed anonymous memory without committing it: pages are
+// only backed on first touch, so RSS follows what is actually written.
+// Reservations of at least HUGEPAGE_THRESHOLD bytes ask for transparent huge
+// pages.  Throws std::bad_alloc when the address space is exhausted.
+void* reserveLazyMemory(size_t bytes);
+void releaseLazyMemory(void* memory, size_t bytes);
+
+// Maps bytes of a sparse, already unlinked temporary file created in dir.
+// Written pages are backed by the file instead of RAM or swap.  Throws
+// std::runtime_error when the file cannot be created.
+void* mapSpillFile(const std::string& dir, size_t bytes, int& fd);
+// Extends the file and its mapping to newBytes, keeping the contents.
+void* growSpillFile(void* memory, size_t oldBytes, size_t newBytes, int fd);
+// Starts asynchronous writeback of [offset, offset + bytes) and drops the
+// whole pages in it from the process, so RSS stays flat while spilling.
+void writebackSpillFile(void* memory, int fd, size_t offset, size_t bytes);
+// Copies [offset, offset + bytes) of the file to outFd with sendfile.
+void sendSpillFile(const void* memory, int fd, size_t offset, size_t bytes, int outFd);
+void closeSpillFile(void* memory, size_t bytes, int fd);
+
+constexpr size_t HUGEPAGE_THRESHOLD = 32u << 20;
+
+// Fixed-size array of trivially copyable T on lazily committed memory.
+// Unlike std::vector nothing is zero-filled up front; elements read before
+// they are written are zero.  A spilled array lives in a temporary file
+// instead and may grow beyond RAM.
+template <typename T>
+class MappedArray {
+    static_assert(std::is_trivially_copyable<T>::value, "MappedArray holds plain data only");
+
+public:
+    MappedArray() = default;
+    explicit MappedArray(size_t n) { resize(n); }
+    ~MappedArray() { release(); }
+
+    MappedArray(const MappedArray&) = delete;
+    MappedArray& operator=(const MappedArray&) = delete;
+    MappedArray(MappedArray&& other) noexcept
+        : items(std::exchange(other.items, nullptr)), count(std::exchange(other.count, 0)),
+          file(std::exchange(other.file, -1)) {}
+    MappedArray& operator=(MappedArray&& other) noexcept {
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(file, other.file);
+        return *this;
+    }
+
+    // Replaces the array by n zero elements; the old contents are dropped.
+    void resize(size_t n) {
+        T* fresh = n > 0 ? static_cast<T*>(reserveLazyMemory(n * sizeof(T))) : nullptr;
+        release();
+        items = fresh;
+        count = n;
+    }
+
+    // Like resize, but the elements live in a temporary file in dir.
+    void spill(const std::string& dir, size_t n) {
+        int fresh = -1;
+        T* mapped = static_cast<T*>(mapSpillFile(dir, n * sizeof(T), fresh));
+        release();
+        items = mapped;
+        count = n;
+        file = fresh;
+    }
+
+    // Grows a spilled array to n elements, keeping its contents.
+    void grow(size_t n) {
+        items = static_cast<T*>(growSpillFile(items, count * sizeof(T), n * sizeof(T), file));
+        count = n;
+    }
+
+    // Writes elements [first, first + n) of a spilled array back to its file.
+    void writeback(size_t first, size_t n) {
+        writebackSpillFile(items, file, first * sizeof(T), n * sizeof(T));
+    }
+
+    // Sends elements [first, first + n) of a spilled array to outFd.
+    void sendTo(int outFd, size_t first, size_t n) const {
+        sendSpillFile(items, file, first * sizeof(T), n * sizeof(T), outFd);
+    }
+
+    bool spilled() const { return file >= 0; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() { return items; }
+    const T* data() const { return items; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+
+private:
+    void release() {
+        if (file >= 0) {
+            closeSpillFile(items, count * sizeof(T), file);
+        } else {
+            releaseLazyMemory(items, count * sizeof(T));
+        }
+        items = nullptr;
+        count = 0;
+        file = -1;
+    }
+
+    T* items = nullptr;
+    size_t count = 0;
+    int file = -1; // spill file, -1 for anonymous memory
+};
+
+#endif // MAPPED_ARRAY_H
@@ -0,0 +1,273 @@
+#include "memory_planner.h"
+#include "compression_type.h"
+#include "keyed_ring_buffer.h"
+#include "compressed_ring_buffer.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace {
+
+constexpr uint64_t MIB = 1u << 20;
+constexpr size_t MIN_READ_BUFFER = 64 * 1024;
+constexpr size_t MIN_ZLIB_BUFFER = 32 * 1024;
+constexpr size_t MIN_XZ_BUFFER = 4096;
+constexpr uint64_t DEFAULT_CODEC_WINDOW = 128 * MIB; // zstd's default window limit; xz -9 needs 64 MiB
+constexpr uint64_t MIN_CODEC_WINDOW = MIB;
+constexpr uint64_t MIN_RING = MIB;
+constexpr uint64_t COMPRESSION_ESTIMATE = 4; // zstd -1 on log text, conservatively
+constexpr uint64_t UNLIMITED_V1 = 1ull << 60; // cgroup v1 reports "no limit" as a huge page-aligned number
+
+// Reads the first whitespace separated token of a file.
+bool readToken(const std::string& path, std::string& token) {
+    std::ifstream in(path);
+    return static_cast<bool>(in >> token);
+}
+
+bool readNumber(const std::string& path, uint64_t& value) {
+    std::string token;
+    if (!readToken(path, token) || token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+        return false; // also "max"
+    }
+    value = std::stoull(token);
+    return true;
+}
+
+// Value of key in a file of "key value [unit]" lines such as memory.stat.
+uint64_t statValue(const std::string& path, const std::string& key) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string k;
+        uint64_t v = 0;
+        if (fields >> k >> v && k == key) {
+            return v;
+        }
+    }
+    return 0;
+}
+
+std::string mib(uint64_t bytes) {
+    std::ostringstream s;
+    s << (bytes + MIB / 2) / MIB << " MiB";
+    return s.str();
+}
+
+uint64_t floorPowerOfTwo(uint64_t v) {
+    uint64_t p = 1;
+    while (p * 2 <= v) {
+        p *= 2;
+    }
+    return p;
+}
+
+// Applies the tightest limit found in dir and its parents up to top.
+void scanCgroup(std::string dir, const std::string& top, const char* limitFile, const char* usageFile,
+                const char* inactiveKey, MemoryLimits& limits) {
+    while (true) {
+        uint64_t limit = 0;
+        if (readNumber(dir + "/" + limitFile, limit) && limit > 0 && limit < UNLIMITED_V1 &&
+            (limits.cgroupLimit == 0 || limit < limits.cgroupLimit)) {
+            uint64_t usage = 0;
+            readNumber(dir + "/" + usageFile, usage);
+            const uint64_t inactive = statValue(dir + "/memory.stat", inactiveKey);
+            limits.cgroupLimit = limit;
+            limits.cgroupUsage = usage > inactive ? usage - inactive : 0;
+        }
+        if (dir.size() <= top.size()) {
+            break;
+        }
+        dir = dir.substr(0, dir.find_last_of('/'));
+    }
+}
+
+uint64_t pipelineBytes(const CLIOptions& o) {
+    // The buffer controller may double the read buffers; counting streams
+    // through one buffer and spends its threads on workers.
+    const uint64_t buffers = (o.useThreads && !o.count ? 2u : 1u) * 2u * static_cast<uint64_t>(o.readBufferSize);
+    return buffers + std::max(o.zlibBufferSize, o.xzBufferSize);
+}
+
+// What the inputs add to the requested sizes.
+struct Inputs {
+    bool compressed = false; // a compressed file, or standard input, whose type is not known yet
+    uint64_t plainBytes = 0; // largest plain file; UINT64_MAX when some input's size is unknown
+};
+
+Inputs inspectInputs(const CLIOptions& o) {
+    Inputs inputs;
+    CompressionType format = CompressionType::NONE;
+    const bool forced = !o.format.empty() && compressionTypeFromName(o.format, format);
+    if (o.filenames.empty()) {
+        inputs.compressed = !forced || format != CompressionType::NONE;
+        inputs.plainBytes = UINT64_MAX;
+        return inputs;
+    }
+    for (const auto& filename : o.filenames) {
+        const CompressionType type = forced ? format : detectCompressionType(filename).type;
+        struct stat st;
+        if (type != CompressionType::NONE) {
+            inputs.compressed = true;
+            inputs.plainBytes = UINT64_MAX;
+        } else if (::stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            inputs.plainBytes = UINT64_MAX;
+        } else {
+            inputs.plainBytes = std::max(inputs.plainBytes, static_cast<uint64_t>(st.st_size));
+        }
+    }
+    return inputs;
+}
+
+uint64_t codecBytes(const CLIOptions& o) {
+    if (o.xzMemLimit > 0) {
+        return std::max<uint64_t>(o.zstdWindowSize, o.xzMemLimit); // both were capped together
+    }
+    return o.zstdWindowSize > 0 ? o.zstdWindowSize : DEFAULT_CODEC_WINDOW;
+}
+
+uint64_t ringOffsetBytes(const CLIOptions& o) {
+    return static_cast<uint64_t>(o.n) * sizeof(uint64_t);
+}
+
+// The plain ring is reserved lazily but its write position sweeps all of it,
+// so once more than the reservation has been stored every page is resident.
+// Only inputs known to be smaller, inputBytes, leave part of it untouched.
+uint64_t ringBytes(const CLIOptions& o, uint64_t inputBytes = UINT64_MAX) {
+    if (o.count || o.linesFirst > 0) {
+        return 0;
+    }
+    if (!o.perKey.empty()) {
+        return o.bytesBudget > 0 ? o.bytesBudget : KeyedRingBuffer::DEFAULT_BUDGET;
+    }
+    if (!o.spillDir.empty()) {
+        return ringOffsetBytes(o); // the lines themselves live in the page cache
+    }
+    if (o.compressRing) {
+        // Sealed segments plus the open one and its compression scratch.
+        const uint64_t sealed = static_cast<uint64_t>(o.n) * o.lineCapacity / COMPRESSION_ESTIMATE;
+        return (o.bytesBudget > 0 ? o.bytesBudget : sealed) + 2 * CompressedRingBuffer::SEGMENT_BYTES;
+    }
+    const uint64_t data = o.bytesBudget > 0 ? o.bytesBudget : static_cast<uint64_t>(o.n) * o.lineCapacity;
+    return std::min(data, inputBytes) + ringOffsetBytes(o);
+}
+
+} // namespace
+
+uint64_t MemoryLimits::available() const {
+    uint64_t avail = memAvailable;
+    if (cgroupLimit > 0) {
+        const uint64_t cgroupFree = cgroupLimit > cgroupUsage ? cgroupLimit - cgroupUsage : 0;
+        avail = avail > 0 ? std::min(avail, cgroupFree) : cgroupFree;
+    }
+    return avail;
+}
+
+MemoryLimits readMemoryLimits(const std::string& root) {
+    MemoryLimits limits;
+    limits.memAvailable = statValue(root + "/proc/meminfo", "MemAvailable:") * 1024; // kB
+
+    std::ifstream cgroups(root + "/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        // "hierarchy-id:controllers:path"; v2 is "0::path"
+        const size_t first = line.find(':');
+        const size_t second = first == std::string::npos ? first : line.find(':', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        const std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        if (path == "/") {
+            path.clear();
+        }
+        if (line.compare(0, first, "0") == 0 && controllers.empty()) {
+            const std::string top = root + "/sys/fs/cgroup";
+            scanCgroup(top + path, top, "memory.max", "memory.current", "inactive_file", limits);
+        } else if (("," + controllers + ",").find(",memory,") != std::string::npos) {
+            const std::string top = root + "/sys/fs/cgroup/memory";
+            scanCgroup(top + path, top, "memory.limit_in_bytes", "memory.usage_in_bytes", "total_inactive_file", limits);
+        }
+    }
+    return limits;
+}
+
+uint64_t memoryBudget(const MemoryLimits& limits, uint64_t limit) {
+    if (limit > 0) {
+        return limit;
+    }
+    return limits.available() / 2; // leave the other half to the page cache and the rest of the system
+}
+
+MemoryPlan planMemory(CLIOptions& options, uint64_t budget) {
+    MemoryPlan plan;
+    plan.budget = budget;
+    plan.pipeline = pipelineBytes(options);
+    plan.codec = codecBytes(options);
+    plan.ring = ringBytes(options);
+    plan.workers = options.count ? options.countMemory : 0;
+    if (budget == 0 || plan.pipeline + plan.codec + plan.ring + plan.workers <= budget) {
+        return plan;
+    }
+    // The inputs are opened only when the worst case does not fit.
+    const Inputs inputs = inspectInputs(options);
+    if (!inputs.compressed) {
+        plan.codec = 0;
+    }
+    plan.ring = ringBytes(options, inputs.plainBytes);
+    if (plan.pipeline + plan.codec + plan.ring + plan.workers <= budget) {
+        return plan;
+    }
+
+    // 1. Pipeline buffers: at most an eighth of the budget.
+    const uint64_t pipelineCap = std::max<uint64_t>(2 * MIN_READ_BUFFER + MIN_ZLIB_BUFFER, budget / 8);
+    if (plan.pipeline > pipelineCap && options.useThreads && !options.count) {
+        options.useThreads = false;
+        plan.adjustments.push_back("producer/consumer threads disabled");
+        plan.pipeline = pipelineBytes(options);
+    }
+    if (plan.pipeline > pipelineCap) {
+        const size_t share = static_cast<size_t>(pipelineCap / 4);
+        options.readBufferSize = std::max(MIN_READ_BUFFER, std::min(options.readBufferSize, share));
+        options.zlibBufferSize = std::max(MIN_ZLIB_BUFFER, std::min(options.zlibBufferSize, share));
+        options.xzBufferSize = std::max(MIN_XZ_BUFFER, std::min(options.xzBufferSize, share));
+        plan.adjustments.push_back("read buffer reduced to " + std::to_string(options.readBufferSize) + " bytes");
+        plan.pipeline = pipelineBytes(options);
+    }
+
+    // 2. Decoder windows: what the pipeline and the smallest ring leave.
+    CLIOptions smallestRing = options;
+    smallestRing.bytesBudget = MIN_RING;
+    const uint64_t floor = plan.pipeline + std::min(plan.ring, ringBytes(smallestRing, inputs.plainBytes));
+    const uint64_t codecCap = std::max(MIN_CODEC_WINDOW, budget > floor ? budget - floor : 0);
+    if (plan.codec > codecCap) {
+        options.zstdWindowSize = static_cast<size_t>(floorPowerOfTwo(codecCap));
+        options.xzMemLimit = codecCap;
+        plan.adjustments.push_back("zstd window limited to " + mib(options.zstdWindowSize) + " and xz memory to " +
+                                   mib(codecCap) + "; archives needing more fail with an error");
+        plan.codec = codecBytes(options);
+    }
+
+    const uint64_t fixed = plan.pipeline + plan.codec;
+    const uint64_t rest = budget > fixed ? budget - fixed : 0;
+
+    // 3. Counting workers share what is left; at least one always runs.
+    if (options.count && plan.workers > rest) {
+        options.countMemory = std::max<uint64_t>(rest, 1);
+        plan.adjustments.push_back("parallel decoding limited to " + mib(options.countMemory) + " in flight");
+        plan.workers = options.countMemory;
+    }
+
+    // 4. The ring gets the rest; a spilled ring's lines are not in memory.
+    if (plan.ring > rest && options.spillDir.empty()) {
+        const uint64_t offsets = options.perKey.empty() && !options.compressRing ? ringOffsetBytes(options) : 0;
+        const uint64_t data = std::max(MIN_RING, rest > offsets ? rest - offsets : 0);
+        options.bytesBudget = static_cast<size_t>(data);
+        plan.adjustments.push_back("stored lines limited to " + mib(data) +
+                                   (options.perKey.empty() ? "; fewer than -n lines are printed if they do not fit"
+                                                           : "; least recently updated keys are evicted"));
+        plan.ring = ringBytes(options, inputs.plainBytes);
+    }
+    return plan;
+}
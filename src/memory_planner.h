@@ -0,0 +1,50 @@
+#ifndef MEMORY_PLANNER_H
+#define MEMORY_PLANNER_H
+
+#include "cli.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the system lets this process use.  Zero means unknown or unlimited.
+struct MemoryLimits {
+    uint64_t memAvailable = 0; // MemAvailable of /proc/meminfo
+    uint64_t cgroupLimit = 0;  // tightest memory.max (v2) or memory.limit_in_bytes (v1) up the hierarchy
+    uint64_t cgroupUsage = 0;  // usage of that cgroup without reclaimable inactive page cache
+
+    // The memory that can still be allocated, or 0 when nothing is known.
+    uint64_t available() const;
+};
+
+// Reads /proc/meminfo and the cgroup of this process.  root prefixes every
+// path so tests can point it at a fake /proc and /sys.
+MemoryLimits readMemoryLimits(const std::string& root = "");
+
+// How one budget was split between the consumers of memory.  Each share is
+// what the adjusted options need at most.
+struct MemoryPlan {
+    uint64_t budget = 0;   // 0: unlimited, nothing was planned
+    uint64_t pipeline = 0; // processStream buffers and codec input buffers
+    uint64_t codec = 0;    // zstd window / xz dictionary, 0 when over budget and every input is plain text
+    uint64_t ring = 0;     // stored lines
+    uint64_t workers = 0;  // decoded blocks in flight while counting
+    std::vector<std::string> adjustments; // one sentence per option that was reduced
+};
+
+// The budget for a run: limit when it is set (--memory-limit), otherwise half
+// of what limits report as available, or 0 when that is unknown.
+uint64_t memoryBudget(const MemoryLimits& limits, uint64_t limit);
+
+// Splits budget across the ring, the pipeline buffers, the codec windows and
+// the counting workers, reducing options where the requested sizes do not
+// fit.  Instead of being OOM-killed a tight run loses threads and buffer
+// size first, then caps the decoder windows at what the pipeline and the
+// smallest ring leave (archives that need more fail with an error) and
+// finally bounds the ring, which may then hold fewer than -n lines.  When
+// the requested sizes do not fit, the inputs are inspected: only runs with
+// a compressed input, or standard input, are charged a decoder window, and
+// plain files smaller than the ring bound what it commits.  A run without a
+// budget, or one that fits, never opens them here.
+MemoryPlan planMemory(CLIOptions& options, uint64_t budget);
+
+#endif // MEMORY_PLANNER_H
@@ -0,0 +1,57 @@
+#include "output_sink.h"
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+class StdoutSink : public OutputSink {
+public:
+    void write(const char* data, size_t len) override {
+        std::cout.write(data, static_cast<std::streamsize>(len));
+    }
+    void flush() override { std::cout.flush(); }
+    int descriptor() const override { return STDOUT_FILENO; }
+};
+
+} // namespace
+
+OutputSink& stdoutSink() {
+    static StdoutSink sink;
+    return sink;
+}
+
+void StreamSink::write(const char* data, size_t len) {
+    out.write(data, static_cast<std::streamsize>(len));
+}
+
+void FdSink::write(const char* data, size_t len) {
+    while (len > 0) {
+        const ssize_t written = ::write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("write error (" + std::to_string(errno) + ") while printing lines");
+        }
+        data += written;
+        len -= static_cast<size_t>(written);
+    }
+}
+
+std::streamsize SinkStreamBuf::xsputn(const char* s, std::streamsize n) {
+    sink.write(s, static_cast<size_t>(n));
+    return n;
+}
+
+SinkStreamBuf::int_type SinkStreamBuf::overflow(int_type c) {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        const char ch = traits_type::to_char_type(c);
+        sink.write(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int SinkStreamBuf::sync() {
+    sink.flush();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+// Destination of printed lines.  Rings print through a sink instead of
+// std::cout, so engines embedded side by side write to their own output and
+// never contend for the global stream.  Bytes arrive in order, in blocks of
+// whole or partial lines.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    virtual void write(const char* data, size_t len) = 0;
+    // Pushes buffered bytes to the destination.
+    virtual void flush() {}
+    // Descriptor that may be written to directly after flush() (spilled rings
+    // sendfile to it), or -1 when the sink only takes write().
+    virtual int descriptor() const { return -1; }
+};
+
+// Writes to std::cout; its descriptor is STDOUT_FILENO.  This is what the
+// command line prints through.
+OutputSink& stdoutSink();
+
+class StreamSink : public OutputSink {
+public:
+    explicit StreamSink(std::ostream& out) : out(out) {}
+    void write(const char* data, size_t len) override;
+    void flush() override { out.flush(); }
+
+private:
+    std::ostream& out;
+};
+
+// Unbuffered writes to a descriptor the caller owns.
+class FdSink : public OutputSink {
+public:
+    explicit FdSink(int fd) : fd(fd) {}
+    void write(const char* data, size_t len) override;
+    int descriptor() const override { return fd; }
+
+private:
+    int fd;
+};
+
+// Collects everything printed in memory.
+class StringSink : public OutputSink {
+public:
+    void write(const char* data, size_t len) override { text.append(data, len); }
+    const std::string& str() const { return text; }
+    std::string take() { return std::move(text); }
+
+private:
+    std::string text;
+};
+
+// Hands every block to a function.
+class CallbackSink : public OutputSink {
+public:
+    explicit CallbackSink(std::function<void(const char*, size_t)> fn) : fn(std::move(fn)) {}
+    void write(const char* data, size_t len) override { fn(data, len); }
+
+private:
+    std::function<void(const char*, size_t)> fn;
+};
+
+// Lets writers that take a std::ostream print through a sink.
+class SinkStreamBuf : public std::streambuf {
+public:
+    explicit SinkStreamBuf(OutputSink& sink) : sink(sink) {}
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    OutputSink& sink;
+};
+
+#endif // OUTPUT_SINK_H
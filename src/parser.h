@@ -2,13 +2,23 @@
 #define PARSER_H
 
 #include "circular_buffer.h"
+#include "line_filter.h"
+#include "pipeline_stats.h"
 #include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
 
 // The Parser is responsible for splitting incoming data into lines
-// (separated by '\n') and adding them to the CircularBuffer.
-class Parser {
+// (separated by '\n') and adding them to the CircularBuffer.  Any buffer
+// with the append_segment/end_line/append_line API can be used; the
+// supported ones are instantiated in parser.cpp.
+template <typename Buffer>
+class BasicParser {
 public:
-    explicit Parser(CircularBuffer& cb, size_t lineCapacity = 0);
+    // When filter is set only matching lines are added to the buffer; the
+    // filter must outlive the parser.
+    explicit BasicParser(Buffer& cb, size_t lineCapacity = 0, const LineFilter* filter = nullptr);
 
     // Processes a chunk of data, splitting by '\n'
     void parse(const char* data, size_t size);
@@ -16,11 +26,28 @@ public:
     // After reading is complete, finalize any leftover partial data
     void finalize();
 
+    const LineFilter* lineFilter() const { return filter; }
+
+    // Times ring insertion into stats->ringNs; null turns it off.
+    void setStats(PipelineStats* s) { stats = s; }
+
 private:
-    CircularBuffer& circularBuffer;
+    void parseMeasured(const char* data, size_t size);
+    void appendLine(const char* data, size_t size);
+    void parseFiltered(const char* data, size_t size);
+    void storeResidual(const char* data, size_t size);
+
+    Buffer& circularBuffer;
+    const LineFilter* filter;
     static constexpr size_t RESIDUAL_SIZE = 4096;
     char residual[RESIDUAL_SIZE];
     size_t residualLen;
+    std::string lineScratch; // reassembles lines split across chunks when filtering
+    PipelineStats* stats;
+    std::vector<std::pair<const char*, size_t>> lineSpans; // complete lines of a measured chunk
 };
 
+using Parser = BasicParser<CircularBuffer>;
+using WideParser = BasicParser<WideCircularBuffer>;
+
 #endif // PARSER_H
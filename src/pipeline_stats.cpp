@@ -0,0 +1,115 @@
+#include "pipeline_stats.h"
+#include "json_util.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+
+namespace {
+
+double ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+} // namespace
+
+uint64_t processReadBytes() {
+#if defined(__linux__)
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value = 0;
+    while (io >> key >> value) {
+        if (key == "rchar:") {
+            return value;
+        }
+    }
+#endif
+    return 0;
+}
+
+uint64_t peakRssKb() {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(ru.ru_maxrss) / 1024; // bytes on macOS
+#else
+    return static_cast<uint64_t>(ru.ru_maxrss);
+#endif
+}
+
+void PipelineStats::finish(uint64_t startRchar, std::chrono::steady_clock::time_point start) {
+    const uint64_t rchar = processReadBytes();
+    bytesRead = rchar > startRchar ? rchar - startRchar : 0;
+    peakRssKb = ::peakRssKb();
+    wallNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+void PipelineStats::add(const PipelineStats& other) {
+    bytesRead += other.bytesRead;
+    bytesDecompressed += other.bytesDecompressed;
+    chunks += other.chunks;
+    readNs += other.readNs;
+    parseNs += other.parseNs;
+    ringNs += other.ringNs;
+    printNs += other.printNs;
+    producerWaitNs += other.producerWaitNs;
+    consumerWaitNs += other.consumerWaitNs;
+    bufferGrows += other.bufferGrows;
+    bufferShrinks += other.bufferShrinks;
+    peakBufferSize = std::max(peakBufferSize, other.peakBufferSize);
+    ringMemory = std::max(ringMemory, other.ringMemory);
+    peakRssKb = std::max(peakRssKb, other.peakRssKb);
+    wallNs += other.wallNs;
+}
+
+void PipelineStats::report(std::ostream& out, const std::string& name, bool json) const {
+    std::ostringstream s;
+    s << std::fixed << std::setprecision(3);
+    if (json) {
+        s << "{\"input\": " << jsonString(name)
+          << ", \"bytes_read\": " << bytesRead
+          << ", \"bytes_decompressed\": " << bytesDecompressed
+          << ", \"chunks\": " << chunks
+          << ", \"wall_ms\": " << ms(wallNs)
+          << ", \"read_ms\": " << ms(readNs)
+          << ", \"parse_ms\": " << ms(parseNs)
+          << ", \"ring_ms\": " << ms(ringNs)
+          << ", \"print_ms\": " << ms(printNs)
+          << ", \"producer_wait_ms\": " << ms(producerWaitNs)
+          << ", \"consumer_wait_ms\": " << ms(consumerWaitNs)
+          << ", \"buffer_grows\": " << bufferGrows
+          << ", \"buffer_shrinks\": " << bufferShrinks
+          << ", \"peak_buffer_bytes\": " << peakBufferSize
+          << ", \"ring_memory_bytes\": " << ringMemory
+          << ", \"peak_rss_kb\": " << peakRssKb << "}\n";
+    } else {
+        auto rate = [&](uint64_t bytes, uint64_t ns) {
+            std::ostringstream r;
+            r << std::fixed << std::setprecision(1);
+            if (ns > 0) {
+                r << " (" << static_cast<double>(bytes) / 1e6 / (static_cast<double>(ns) / 1e9) << " MB/s)";
+            }
+            return r.str();
+        };
+        s << "stats for " << name << ":\n"
+          << "  bytes read          " << bytesRead << "\n"
+          << "  bytes decompressed  " << bytesDecompressed << " in " << chunks << " chunks\n"
+          << "  wall                " << ms(wallNs) << " ms\n"
+          << "  read+decompress     " << ms(readNs) << " ms" << rate(bytesDecompressed, readNs) << "\n"
+          << "  parse               " << ms(parseNs) << " ms" << rate(bytesDecompressed, parseNs) << "\n"
+          << "    ring insertion    " << ms(ringNs) << " ms\n"
+          << "  print               " << ms(printNs) << " ms\n"
+          << "  producer wait       " << ms(producerWaitNs) << " ms\n"
+          << "  consumer wait       " << ms(consumerWaitNs) << " ms\n"
+          << "  buffer resizes      " << bufferGrows << " up, " << bufferShrinks << " down (peak "
+          << peakBufferSize << " bytes)\n"
+          << "  ring memory         " << ringMemory << " bytes\n"
+          << "  peak RSS            " << peakRssKb << " KiB\n";
+    }
+    out << s.str();
+    out.flush();
+}
@@ -0,0 +1,68 @@
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Per-input counters behind --stats.  Every stage owns its fields: the
+// producer of processStream writes the read fields, the consumer the parse,
+// ring and print fields, so no field is shared between threads while the
+// pipeline runs.  All times are in nanoseconds.
+struct PipelineStats {
+    uint64_t bytesRead = 0;         // read by the process (/proc/self/io rchar)
+    uint64_t bytesDecompressed = 0; // handed to the parser
+    uint64_t chunks = 0;
+    uint64_t readNs = 0;            // reading and decompressing
+    uint64_t parseNs = 0;           // Parser::parse, ring insertion included
+    uint64_t ringNs = 0;            // ring insertion, part of parseNs
+    uint64_t printNs = 0;
+    uint64_t producerWaitNs = 0;    // producer waiting for a free buffer
+    uint64_t consumerWaitNs = 0;    // consumer waiting for a filled buffer
+    uint64_t bufferGrows = 0;       // BufferController decisions
+    uint64_t bufferShrinks = 0;
+    uint64_t peakBufferSize = 0;    // largest pipeline buffer used
+    uint64_t ringMemory = 0;        // memoryUsage() of the ring after printing
+    uint64_t peakRssKb = 0;
+    uint64_t wallNs = 0;
+
+    // Records the counters that are only known at the end of an input.
+    void finish(uint64_t startRchar, std::chrono::steady_clock::time_point start);
+
+    void add(const PipelineStats& other);
+
+    // One block of "name: value" lines per input, or one JSON object per line.
+    void report(std::ostream& out, const std::string& name, bool json) const;
+};
+
+// Bytes read so far by this process, or 0 where /proc/self/io is unavailable.
+uint64_t processReadBytes();
+
+// Peak resident set size of this process in KiB.
+uint64_t peakRssKb();
+
+// Adds the lifetime of the timer to *slot; does nothing for a null slot, so
+// instrumented code costs one branch when --stats is off.
+class StageTimer {
+public:
+    explicit StageTimer(uint64_t* slot) : slot(slot) {
+        if (slot) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer() {
+        if (slot) {
+            *slot += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    uint64_t* slot;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PIPELINE_STATS_H
@@ -0,0 +1,246 @@
+#ifndef PROCESS_STREAM_H
+#define PROCESS_STREAM_H
+
+#include "buffer_controller.h"
+#include "output_sink.h"
+#include "pipeline_stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <vector>
+#if ZTAIL_USE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+// Feeds everything reader produces to parser, then finalizes the parser and
+// prints cb to out.  reader(buffer, n) fills buffer with n bytes and returns false
+// at the end of the input.
+//
+// With threads a producer reads into one of two buffers while the consumer
+// parses the other.  A buffer is handed back to the producer only after the
+// consumer has parsed it.  A BufferController sizes the buffers between
+// 64 KiB and 2 * bufferSize (at most 16 MiB) from the measured stalls and
+// codec output rate; a buffer is only resized while the producer owns it,
+// reusing pooled memory.
+//
+// When stats is set every stage is timed into it; a null stats costs one
+// branch per chunk.  Stages are also recorded as spans on the active
+// TraceRecorder, if any.
+//
+// The buffers come from, and go back to, buffers when it is set, so runs
+// over many small inputs allocate them once; one pool serves one run at a
+// time.
+template <typename Reader, typename ParserT, typename Buffer>
+void processStream(Reader reader, ParserT& parser, Buffer& cb,
+                   size_t bufferSize, size_t aggregationThreshold, bool useThreads,
+                   PipelineStats* stats = nullptr, OutputSink& out = stdoutSink(),
+                   BufferPool* buffers = nullptr) {
+    using Clock = std::chrono::steady_clock;
+    auto elapsedNs = [](Clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    };
+    auto slot = [stats](uint64_t PipelineStats::*field) { return stats ? &(stats->*field) : nullptr; };
+
+    constexpr size_t MAX_ADAPTIVE_SIZE = 16u << 20;
+    const size_t maxSize = std::max(bufferSize, std::min(bufferSize * 2, MAX_ADAPTIVE_SIZE));
+    BufferController controller(bufferSize, maxSize);
+    BufferPool local(2);
+    BufferPool& pool = buffers ? *buffers : local;
+
+    // Reads one chunk and returns the time it took in readNs.
+    auto readChunk = [&](std::vector<char>& buf, size_t& n, uint64_t& readNs) {
+        TraceSpan span("decompress");
+        const Clock::time_point start = Clock::now();
+        const bool more = reader(buf, n);
+        readNs = elapsedNs(start);
+        if (stats) {
+            stats->readNs += readNs;
+            if (more) {
+                stats->bytesDecompressed += n;
+                ++stats->chunks;
+            }
+        }
+        return more;
+    };
+    // Brings buf to the size the controller asks for.  Only buffers given up
+    // by a shrink are pooled; outgrown ones are freed.
+    auto resize = [&](std::vector<char>& buf) {
+        const size_t size = controller.size();
+        if (buf.size() == size) {
+            return;
+        }
+        if (size < buf.capacity()) {
+            pool.release(std::move(buf));
+        } else {
+            std::vector<char>().swap(buf);
+        }
+        buf = pool.acquire(size);
+    };
+    auto parseChunk = [&](const char* data, size_t n) {
+        TraceSpan span("parse");
+        StageTimer timer(slot(&PipelineStats::parseNs));
+        parser.parse(data, n);
+    };
+    auto finishStream = [&]() {
+        parser.finalize();
+        {
+            TraceSpan span("print");
+            StageTimer timer(slot(&PipelineStats::printNs));
+            cb.print(aggregationThreshold, out);
+        }
+        if (stats) {
+            stats->ringMemory = cb.memoryUsage();
+            stats->bufferGrows = controller.grows();
+            stats->bufferShrinks = controller.shrinks();
+            stats->peakBufferSize = controller.peakSize();
+        }
+    };
+    auto runSequential = [&]() {
+        std::vector<char> buf = pool.acquire(bufferSize);
+        size_t n = 0;
+        uint64_t readNs = 0;
+        while (readChunk(buf, n, readNs)) {
+            parseChunk(buf.data(), n);
+            controller.onChunk(n, readNs, 0, 0);
+            resize(buf);
+        }
+        pool.release(std::move(buf));
+        finishStream();
+    };
+
+#if ZTAIL_USE_THREADS
+    // Whether two buffers fit in memory is decided by planMemory.
+    if (useThreads) {
+        std::vector<char> chunks[2] = {pool.acquire(bufferSize), pool.acquire(bufferSize)};
+        size_t sizes[2] = {0, 0};
+        bool ready[2] = {false, false}; // filled and not yet parsed
+        bool finished = false;
+        bool aborted = false;
+        uint64_t consumerWaitNs = 0;    // consumer stalls not yet seen by the controller
+        std::exception_ptr error;
+        std::mutex m;
+        std::condition_variable cv;
+
+        auto fail = [&]() {
+            std::unique_lock<std::mutex> lock(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+            aborted = true;
+            cv.notify_all();
+        };
+
+        std::thread producer([&]() {
+            if (TraceRecorder* trace = TraceRecorder::active()) {
+                trace->nameThread("producer");
+            }
+            try {
+                int idx = 0;
+                size_t n = 0;
+                while (true) {
+                    uint64_t waitNs = 0;
+                    uint64_t consumerWaited = 0;
+                    {
+                        std::unique_lock<std::mutex> lock(m);
+                        {
+                            TraceSpan span("handoff");
+                            const Clock::time_point start = Clock::now();
+                            cv.wait(lock, [&] { return !ready[idx] || aborted; });
+                            waitNs = elapsedNs(start);
+                        }
+                        if (aborted) {
+                            return;
+                        }
+                        consumerWaited = consumerWaitNs;
+                        consumerWaitNs = 0;
+                    }
+                    if (stats) {
+                        stats->producerWaitNs += waitNs;
+                    }
+                    // The consumer is done with chunks[idx], so it may be swapped.
+                    resize(chunks[idx]);
+                    uint64_t readNs = 0;
+                    if (!readChunk(chunks[idx], n, readNs)) {
+                        break;
+                    }
+                    if (n > 0) {
+                        {
+                            std::unique_lock<std::mutex> lock(m);
+                            sizes[idx] = n;
+                            ready[idx] = true;
+                        }
+                        cv.notify_all();
+                        idx ^= 1;
+                        controller.onChunk(n, readNs, waitNs, consumerWaited);
+                    }
+                }
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    finished = true;
+                }
+                cv.notify_all();
+            } catch (...) {
+                fail();
+            }
+        });
+
+        std::thread consumer([&]() {
+            if (TraceRecorder* trace = TraceRecorder::active()) {
+                trace->nameThread("consumer");
+            }
+            try {
+                int idx = 0;
+                while (true) {
+                    std::unique_lock<std::mutex> lock(m);
+                    {
+                        TraceSpan span("handoff");
+                        const Clock::time_point start = Clock::now();
+                        cv.wait(lock, [&] { return ready[idx] || finished || aborted; });
+                        const uint64_t waitNs = elapsedNs(start);
+                        consumerWaitNs += waitNs;
+                        if (stats) {
+                            stats->consumerWaitNs += waitNs;
+                        }
+                    }
+                    if (aborted) {
+                        return;
+                    }
+                    if (!ready[idx]) {
+                        break; // finished and every filled buffer was parsed
+                    }
+                    const size_t n = sizes[idx];
+                    lock.unlock();
+                    parseChunk(chunks[idx].data(), n);
+                    lock.lock();
+                    ready[idx] = false;
+                    lock.unlock();
+                    cv.notify_all();
+                    idx ^= 1;
+                }
+                finishStream();
+            } catch (...) {
+                fail();
+            }
+        });
+
+        producer.join();
+        consumer.join();
+        pool.release(std::move(chunks[0]));
+        pool.release(std::move(chunks[1]));
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        runSequential();
+    }
+#else
+    (void)useThreads;
+    runSequential();
+#endif
+}
+
+#endif // PROCESS_STREAM_H
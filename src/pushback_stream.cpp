@@ -0,0 +1,96 @@
+#include "pushback_stream.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+struct PushbackCookie {
+    int fd;
+    std::string replay;  // the first bytes of the stream, while it is short enough
+    size_t replayLimit;
+    uint64_t pos;        // of the next byte handed out
+    uint64_t consumed;   // bytes taken from fd or the prefix so far
+};
+
+ssize_t pushbackRead(void* cookie, char* buf, size_t size) {
+    PushbackCookie* c = static_cast<PushbackCookie*>(cookie);
+    if (c->pos < c->replay.size()) {
+        const size_t n = std::min<size_t>(size, c->replay.size() - c->pos);
+        std::memcpy(buf, c->replay.data() + c->pos, n);
+        c->pos += n;
+        return static_cast<ssize_t>(n);
+    }
+    ssize_t r;
+    do {
+        r = ::read(c->fd, buf, size);
+    } while (r < 0 && errno == EINTR);
+    if (r > 0) {
+        // Kept bytes must be contiguous from the start to be replayed.
+        if (c->consumed == c->replay.size() && c->replay.size() < c->replayLimit) {
+            c->replay.append(buf, std::min<size_t>(static_cast<size_t>(r), c->replayLimit - c->replay.size()));
+        }
+        c->pos += static_cast<uint64_t>(r);
+        c->consumed += static_cast<uint64_t>(r);
+    }
+    return r;
+}
+
+int pushbackSeek(void* cookie, off64_t* offset, int whence) {
+    PushbackCookie* c = static_cast<PushbackCookie*>(cookie);
+    uint64_t target;
+    if (whence == SEEK_SET && *offset >= 0) {
+        target = static_cast<uint64_t>(*offset);
+    } else if (whence == SEEK_CUR && (*offset >= 0 || static_cast<uint64_t>(-*offset) <= c->pos)) {
+        target = c->pos + *offset;
+    } else {
+        errno = ESPIPE;
+        return -1;
+    }
+    // Only the kept prefix can be revisited, and only while nothing past
+    // it has been read.
+    if (target != c->pos && (target > c->replay.size() || c->consumed > c->replay.size())) {
+        errno = ESPIPE;
+        return -1;
+    }
+    c->pos = target;
+    *offset = static_cast<off64_t>(target);
+    return 0;
+}
+
+int pushbackClose(void* cookie) {
+    delete static_cast<PushbackCookie*>(cookie);
+    return 0;
+}
+
+} // namespace
+
+FilePtr openPushbackStream(int fd, std::string prefix, size_t replayLimit) {
+    const size_t size = prefix.size();
+    PushbackCookie* cookie = new PushbackCookie{fd, std::move(prefix), std::max(replayLimit, size), 0, size};
+    cookie_io_functions_t io{pushbackRead, nullptr, pushbackSeek, pushbackClose};
+    FILE* file = ::fopencookie(cookie, "rb", io);
+    if (!file) {
+        delete cookie;
+        throw std::runtime_error("cannot open stream on descriptor " + std::to_string(fd) + " (" +
+                                 std::to_string(errno) + ")");
+    }
+    return FilePtr(file);
+}
+
+PlainStreamReader::PlainStreamReader(FilePtr&& file, const std::string& name)
+    : file(std::move(file)), name(name)
+{
+}
+
+bool PlainStreamReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    TraceSpan span("read");
+    bytesDecompressed = std::fread(outBuffer.data(), 1, outBuffer.size(), file.get());
+    if (bytesDecompressed == 0 && std::ferror(file.get())) {
+        throw std::runtime_error("read error (" + std::to_string(errno) + ") while reading '" + name + "'");
+    }
+    return bytesDecompressed > 0;
+}
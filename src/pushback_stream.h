@@ -0,0 +1,29 @@
+#ifndef PUSHBACK_STREAM_H
+#define PUSHBACK_STREAM_H
+
+#include "file_ptr.h"
+#include "icompressor.h"
+#include <string>
+#include <vector>
+
+// Wraps a descriptor that cannot seek, such as a pipe, in a FILE that first
+// replays prefix, the bytes already read from it, then reads on from fd.  The
+// first replayLimit bytes are kept so readers can seek back within them, as
+// the decoders do after checking a header; other seeks fail with ESPIPE.
+// Closing the stream leaves fd open.
+FilePtr openPushbackStream(int fd, std::string prefix, size_t replayLimit = 1 << 16);
+
+// Hands the bytes of a stream on unchanged, for plain input read through the
+// ICompressor interface.
+class PlainStreamReader : public ICompressor {
+public:
+    PlainStreamReader(FilePtr&& file, const std::string& name);
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    FilePtr file;
+    std::string name;
+};
+
+#endif // PUSHBACK_STREAM_H
@@ -0,0 +1,452 @@
+#include "seekable_blocks.h"
+#include "zstd_dictionary.h"
+#include <lzma.h>
+#include <lz4.h>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+bool readAt(int fd, void* buf, size_t len, uint64_t offset) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t r = ::pread(fd, p, len, static_cast<off_t>(offset));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        len -= static_cast<size_t>(r);
+        offset += static_cast<uint64_t>(r);
+    }
+    return true;
+}
+
+uint32_t le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+uint32_t le24(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16); }
+uint32_t le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+uint64_t le64(const unsigned char* p) {
+    return static_cast<uint64_t>(le32(p)) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+}
+
+constexpr uint32_t LZ4_FRAME_MAGIC = 0x184D2204u;
+constexpr uint32_t LZ4_SKIPPABLE_MAGIC = 0x184D2A50u; // low four bits are free
+
+uint64_t fileSizeOf(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+// BGZF: every member carries a "BC" extra subfield holding its total size
+// minus one, and ends with the uncompressed size (ISIZE).
+std::vector<CompressedBlock> listBgzfBlocks(int fd, uint64_t fileSize) {
+    std::vector<CompressedBlock> blocks;
+    uint64_t pos = 0;
+    while (pos < fileSize) {
+        unsigned char header[12];
+        if (!readAt(fd, header, sizeof(header), pos) || header[0] != 0x1f || header[1] != 0x8b ||
+            header[2] != 8 || (header[3] & 4) == 0) {
+            return {};
+        }
+        const uint32_t xlen = le16(header + 10);
+        std::vector<unsigned char> extra(xlen);
+        if (!readAt(fd, extra.data(), xlen, pos + sizeof(header))) {
+            return {};
+        }
+        uint64_t blockSize = 0;
+        for (size_t i = 0; i + 4 <= xlen;) {
+            const uint32_t slen = le16(&extra[i + 2]);
+            if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen) {
+                blockSize = static_cast<uint64_t>(le16(&extra[i + 4])) + 1;
+                break;
+            }
+            i += 4 + slen;
+        }
+        if (blockSize == 0 || pos + blockSize > fileSize) {
+            return {};
+        }
+        unsigned char isize[4];
+        if (!readAt(fd, isize, sizeof(isize), pos + blockSize - 4)) {
+            return {};
+        }
+        const uint64_t rawSize = le32(isize);
+        if (rawSize > 0) { // skip the empty EOF marker block
+            blocks.push_back({pos, blockSize, rawSize, 0});
+        }
+        pos += blockSize;
+    }
+    return blocks;
+}
+
+// zstd: walk frame and block headers without decoding anything.  Skippable
+// frames are stepped over.
+std::vector<CompressedBlock> listZstdFrames(int fd, uint64_t fileSize) {
+    std::vector<CompressedBlock> blocks;
+    uint64_t pos = 0;
+    while (pos < fileSize) {
+        unsigned char header[18] = {0};
+        const size_t avail = static_cast<size_t>(std::min<uint64_t>(sizeof(header), fileSize - pos));
+        if (avail < 8 || !readAt(fd, header, avail, pos)) {
+            return {};
+        }
+        const uint32_t magic = le32(header);
+        if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE_START) {
+            pos += 8 + static_cast<uint64_t>(le32(header + 4));
+            continue;
+        }
+        if (magic != ZSTD_MAGICNUMBER) {
+            return {};
+        }
+        const unsigned char fhd = header[4];
+        const unsigned fcsFlag = fhd >> 6;
+        const bool singleSegment = (fhd & 0x20) != 0;
+        const bool hasChecksum = (fhd & 0x04) != 0;
+        static const unsigned didSizes[4] = {0, 1, 2, 4};
+        static const unsigned fcsSizes[4] = {0, 2, 4, 8};
+        const unsigned didSize = didSizes[fhd & 3];
+        const unsigned fcsSize = (fcsFlag == 0 && singleSegment) ? 1 : fcsSizes[fcsFlag];
+        const unsigned headerSize = 5 + (singleSegment ? 0 : 1) + didSize + fcsSize;
+        if (headerSize > avail) {
+            return {};
+        }
+        uint64_t rawSize = 0;
+        const unsigned char* fcs = header + headerSize - fcsSize;
+        switch (fcsSize) {
+        case 1: rawSize = fcs[0]; break;
+        case 2: rawSize = le16(fcs) + 256; break;
+        case 4: rawSize = le32(fcs); break;
+        case 8: rawSize = le64(fcs); break;
+        default: break;
+        }
+
+        uint64_t blockPos = pos + headerSize;
+        bool last = false;
+        while (!last) {
+            unsigned char bh[3];
+            if (!readAt(fd, bh, sizeof(bh), blockPos)) {
+                return {};
+            }
+            const uint32_t value = le24(bh);
+            last = (value & 1) != 0;
+            const uint32_t blockType = (value >> 1) & 3;
+            const uint32_t blockSize = value >> 3;
+            if (blockType == 3) {
+                return {};
+            }
+            blockPos += 3 + (blockType == 1 ? 1 : blockSize);
+        }
+        if (hasChecksum) {
+            blockPos += 4;
+        }
+        if (blockPos > fileSize) {
+            return {};
+        }
+        blocks.push_back({pos, blockPos - pos, rawSize, 0});
+        pos = blockPos;
+    }
+    return blocks;
+}
+
+// lz4: walk frame and block headers; every block header holds its size.
+// Only frames of independent blocks without a dictionary can be split.  The
+// format does not record decoded block sizes, so rawSize is the frame's
+// maximum block size; check is 1 for blocks stored uncompressed.
+std::vector<CompressedBlock> listLz4Blocks(int fd, uint64_t fileSize) {
+    std::vector<CompressedBlock> blocks;
+    uint64_t pos = 0;
+    while (pos < fileSize) {
+        unsigned char header[15] = {0};
+        const size_t avail = static_cast<size_t>(std::min<uint64_t>(sizeof(header), fileSize - pos));
+        if (avail < 8 || !readAt(fd, header, avail, pos)) {
+            return {};
+        }
+        const uint32_t magic = le32(header);
+        if ((magic & 0xFFFFFFF0u) == LZ4_SKIPPABLE_MAGIC) {
+            pos += 8 + static_cast<uint64_t>(le32(header + 4));
+            continue;
+        }
+        const unsigned char flg = header[4];
+        const bool independent = (flg & 0x20) != 0;
+        const bool hasDictId = (flg & 0x01) != 0;
+        if (magic != LZ4_FRAME_MAGIC || (flg >> 6) != 1 || !independent || hasDictId) {
+            return {};
+        }
+        const bool blockChecksums = (flg & 0x10) != 0;
+        const bool hasContentSize = (flg & 0x08) != 0;
+        const bool contentChecksum = (flg & 0x04) != 0;
+        const unsigned sizeId = (header[5] >> 4) & 7;
+        if (sizeId < 4) {
+            return {};
+        }
+        const uint32_t maxBlock = 1u << (2 * sizeId + 8); // 64 KiB to 4 MiB
+
+        uint64_t blockPos = pos + 7 + (hasContentSize ? 8 : 0);
+        while (true) {
+            unsigned char bh[4];
+            if (!readAt(fd, bh, sizeof(bh), blockPos)) {
+                return {};
+            }
+            blockPos += sizeof(bh);
+            const uint32_t value = le32(bh);
+            if (value == 0) {
+                break; // end mark
+            }
+            const uint32_t size = value & 0x7FFFFFFFu;
+            const bool stored = (value & 0x80000000u) != 0;
+            if (size > maxBlock || blockPos + size > fileSize) {
+                return {};
+            }
+            blocks.push_back({blockPos, size, stored ? size : maxBlock, stored ? 1u : 0u});
+            blockPos += size + (blockChecksums ? 4 : 0);
+        }
+        if (contentChecksum) {
+            blockPos += 4;
+        }
+        if (blockPos > fileSize) {
+            return {};
+        }
+        pos = blockPos;
+    }
+    return blocks;
+}
+
+// xz: read every stream's index from the end of the file backwards.
+std::vector<CompressedBlock> listXzBlocks(int fd, uint64_t fileSize) {
+    std::vector<CompressedBlock> blocks;
+    uint64_t pos = fileSize;
+    while (pos > 0) {
+        unsigned char word[4];
+        while (pos >= 4 && readAt(fd, word, 4, pos - 4) && le32(word) == 0) {
+            pos -= 4; // stream padding
+        }
+        if (pos < 2 * LZMA_STREAM_HEADER_SIZE) {
+            return {};
+        }
+        unsigned char footer[LZMA_STREAM_HEADER_SIZE];
+        lzma_stream_flags footerFlags;
+        if (!readAt(fd, footer, sizeof(footer), pos - sizeof(footer)) ||
+            lzma_stream_footer_decode(&footerFlags, footer) != LZMA_OK ||
+            footerFlags.backward_size > pos - sizeof(footer)) {
+            return {};
+        }
+        std::vector<uint8_t> indexBytes(static_cast<size_t>(footerFlags.backward_size));
+        const uint64_t indexPos = pos - sizeof(footer) - footerFlags.backward_size;
+        if (!readAt(fd, indexBytes.data(), indexBytes.size(), indexPos)) {
+            return {};
+        }
+        lzma_index* index = nullptr;
+        uint64_t memlimit = UINT64_MAX;
+        size_t inPos = 0;
+        if (lzma_index_buffer_decode(&index, &memlimit, nullptr, indexBytes.data(), &inPos,
+                                     indexBytes.size()) != LZMA_OK) {
+            return {};
+        }
+        const uint64_t streamSize = lzma_index_stream_size(index);
+        if (streamSize > pos) {
+            lzma_index_end(index, nullptr);
+            return {};
+        }
+        const uint64_t streamStart = pos - streamSize;
+
+        std::vector<CompressedBlock> streamBlocks;
+        lzma_index_iter iter;
+        lzma_index_iter_init(&iter, index);
+        while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK)) {
+            streamBlocks.push_back({streamStart + iter.block.compressed_stream_offset, iter.block.total_size,
+                                    iter.block.uncompressed_size, static_cast<uint32_t>(footerFlags.check)});
+        }
+        lzma_index_end(index, nullptr);
+        blocks.insert(blocks.begin(), streamBlocks.begin(), streamBlocks.end());
+        pos = streamStart;
+    }
+    return blocks;
+}
+
+} // namespace
+
+std::vector<CompressedBlock> listCompressedBlocks(int fd, CompressionType type) {
+    const uint64_t fileSize = fileSizeOf(fd);
+    if (fileSize == 0) {
+        return {};
+    }
+    switch (type) {
+    case CompressionType::GZIP:
+        return listBgzfBlocks(fd, fileSize);
+    case CompressionType::ZSTD:
+        return listZstdFrames(fd, fileSize);
+    case CompressionType::XZ:
+        return listXzBlocks(fd, fileSize);
+    case CompressionType::LZ4:
+        return listLz4Blocks(fd, fileSize);
+    default:
+        return {};
+    }
+}
+
+BlockDecoder::BlockDecoder(int fd, CompressionType type)
+    : fd(fd), type(type), input(), zs(), zsInitialized(false), dctx(nullptr, &ZSTD_freeDCtx)
+{
+}
+
+BlockDecoder::~BlockDecoder() {
+    if (zsInitialized) {
+        inflateEnd(&zs);
+    }
+}
+
+void BlockDecoder::decode(const CompressedBlock& block, std::vector<char>& out) {
+    input.resize(static_cast<size_t>(block.size));
+    if (!readAt(fd, input.data(), input.size(), block.offset)) {
+        throw std::runtime_error("read error (" + std::to_string(errno) + ") at block offset " +
+                                 std::to_string(block.offset));
+    }
+    out.resize(static_cast<size_t>(block.rawSize));
+    switch (type) {
+    case CompressionType::GZIP:
+        decodeGzip(out);
+        break;
+    case CompressionType::ZSTD:
+        decodeZstd(block, out);
+        break;
+    case CompressionType::XZ:
+        decodeXz(block, out);
+        break;
+    case CompressionType::LZ4:
+        decodeLz4(block, out);
+        break;
+    default:
+        throw std::runtime_error("block decoding is not supported for this format");
+    }
+}
+
+void BlockDecoder::decodeGzip(std::vector<char>& out) {
+#ifdef ZTAIL_USE_LIBDEFLATE
+    // BGZF records the exact decoded size, so one whole-buffer call does it.
+    if (!deflater) {
+        deflater.reset(libdeflate_alloc_decompressor());
+        if (!deflater) {
+            throw std::runtime_error("libdeflate error (0) while initializing block decoder");
+        }
+    }
+    size_t used = 0;
+    size_t produced = 0;
+    const libdeflate_result result = libdeflate_gzip_decompress_ex(deflater.get(), input.data(), input.size(),
+                                                                   out.data(), out.size(), &used, &produced);
+    if (result != LIBDEFLATE_SUCCESS) {
+        throw std::runtime_error("libdeflate error (" + std::to_string(static_cast<int>(result)) +
+                                 ") while decoding block");
+    }
+    out.resize(produced);
+#else
+    if (!zsInitialized) {
+        if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+            throw std::runtime_error("zlib error (0) while initializing block decoder");
+        }
+        zsInitialized = true;
+    } else {
+        inflateReset(&zs);
+    }
+    zs.next_in = reinterpret_cast<Bytef*>(input.data());
+    zs.avail_in = static_cast<uInt>(input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = inflate(&zs, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        throw std::runtime_error("zlib error (" + std::to_string(ret) + ") while decoding block");
+    }
+    out.resize(out.size() - zs.avail_out);
+#endif
+}
+
+void BlockDecoder::decodeZstd(const CompressedBlock& block, std::vector<char>& out) {
+    if (!dctx) {
+        dctx.reset(ZSTD_createDCtx());
+        if (!dctx) {
+            throw std::runtime_error("zstd error (0) while creating block decoder");
+        }
+    }
+    const ZSTD_DDict* ddict =
+        zstdDictionaryFor(input.data(), input.size(), "frame at offset " + std::to_string(block.offset));
+    ZSTD_DCtx_reset(dctx.get(), ZSTD_reset_session_only);
+    const size_t ref = ZSTD_DCtx_refDDict(dctx.get(), ddict);
+    if (ZSTD_isError(ref)) {
+        throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(ref)) + ") while selecting dictionary");
+    }
+    if (!out.empty()) {
+        size_t ret = ZSTD_decompressDCtx(dctx.get(), out.data(), out.size(), input.data(), input.size());
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(ret)) + ") while decoding frame");
+        }
+        out.resize(ret);
+        return;
+    }
+    // Frame without a recorded content size: stream into a growing buffer.
+    ZSTD_inBuffer in{input.data(), input.size(), 0};
+    size_t produced = 0;
+    while (true) {
+        if (out.size() - produced < ZSTD_DStreamOutSize()) {
+            out.resize(std::max(out.size() * 2, produced + ZSTD_DStreamOutSize()));
+        }
+        ZSTD_outBuffer o{out.data() + produced, out.size() - produced, 0};
+        size_t ret = ZSTD_decompressStream(dctx.get(), &o, &in);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error("zstd error (" + std::to_string(static_cast<int>(ret)) + ") while decoding frame");
+        }
+        produced += o.pos;
+        if (ret == 0 || (in.pos == in.size && o.pos < o.size)) {
+            break;
+        }
+    }
+    out.resize(produced);
+}
+
+void BlockDecoder::decodeXz(const CompressedBlock& block, std::vector<char>& out) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(input.data());
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block header{};
+    header.version = 0;
+    header.check = static_cast<lzma_check>(block.check);
+    header.filters = filters;
+    if (input.empty()) {
+        throw std::runtime_error("lzma error (0) empty block at offset " + std::to_string(block.offset));
+    }
+    header.header_size = lzma_block_header_size_decode(in[0]);
+    if (header.header_size > input.size() || lzma_block_header_decode(&header, nullptr, in) != LZMA_OK) {
+        throw std::runtime_error("lzma error (0) invalid block header at offset " + std::to_string(block.offset));
+    }
+    size_t inPos = header.header_size;
+    size_t outPos = 0;
+    lzma_ret ret = lzma_block_buffer_decode(&header, nullptr, in, &inPos, input.size(),
+                                            reinterpret_cast<uint8_t*>(out.data()), &outPos, out.size());
+    for (size_t i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i) {
+        std::free(filters[i].options);
+    }
+    if (ret != LZMA_OK) {
+        throw std::runtime_error("lzma error (" + std::to_string(ret) + ") while decoding block");
+    }
+    out.resize(outPos);
+}
+
+void BlockDecoder::decodeLz4(const CompressedBlock& block, std::vector<char>& out) {
+    if (block.check == 1) {
+        std::memcpy(out.data(), input.data(), input.size());
+        return;
+    }
+    const int n = LZ4_decompress_safe(input.data(), out.data(), static_cast<int>(input.size()),
+                                      static_cast<int>(out.size()));
+    if (n < 0) {
+        throw std::runtime_error("lz4 error (" + std::to_string(n) + ") while decoding block at offset " +
+                                 std::to_string(block.offset));
+    }
+    out.resize(static_cast<size_t>(n));
+}
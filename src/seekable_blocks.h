@@ -0,0 +1,60 @@
+#ifndef SEEKABLE_BLOCKS_H
+#define SEEKABLE_BLOCKS_H
+
+#include "compression_type.h"
+#include <zlib.h>
+#include <zstd.h>
+#ifdef ZTAIL_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// An independently decodable unit of a compressed file: a BGZF block, a
+// zstd frame, an xz block or an lz4 block.
+struct CompressedBlock {
+    uint64_t offset;  // file offset of the first compressed byte
+    uint64_t size;    // compressed size in bytes
+    uint64_t rawSize; // uncompressed size (lz4: an upper bound), 0 when the format does not record it
+    uint32_t check;   // codec specific metadata (xz integrity check id, lz4 stored flag)
+};
+
+// Lists the independently decodable blocks of an open file.  Returns an empty
+// list when the format or this particular file has no such structure (plain
+// gzip, bzip2, zip, lz4 with linked blocks) or when the layout cannot be
+// parsed, so callers can fall back to streaming.
+std::vector<CompressedBlock> listCompressedBlocks(int fd, CompressionType type);
+
+// Decodes blocks returned by listCompressedBlocks().  Codec contexts are kept
+// between calls; a decoder must only be used by one thread at a time.
+class BlockDecoder {
+public:
+    BlockDecoder(int fd, CompressionType type);
+    ~BlockDecoder();
+
+    BlockDecoder(const BlockDecoder&) = delete;
+    BlockDecoder& operator=(const BlockDecoder&) = delete;
+
+    // Replaces the contents of out with the decoded bytes of block.
+    void decode(const CompressedBlock& block, std::vector<char>& out);
+
+private:
+    void decodeGzip(std::vector<char>& out);
+    void decodeZstd(const CompressedBlock& block, std::vector<char>& out);
+    void decodeXz(const CompressedBlock& block, std::vector<char>& out);
+    void decodeLz4(const CompressedBlock& block, std::vector<char>& out);
+
+    int fd;
+    CompressionType type;
+    std::vector<char> input;
+    z_stream zs;
+    bool zsInitialized;
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx;
+#ifdef ZTAIL_USE_LIBDEFLATE
+    std::unique_ptr<libdeflate_decompressor, decltype(&libdeflate_free_decompressor)> deflater{
+        nullptr, &libdeflate_free_decompressor};
+#endif
+};
+
+#endif // SEEKABLE_BLOCKS_H
@@ -0,0 +1,50 @@
+#include "sidecar.h"
+#include "file_ptr.h"
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceStamp sourceStampOf(const std::string& filename) {
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0) {
+        throw std::runtime_error("Failed to stat file: " + filename);
+    }
+    SourceStamp stamp;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtimeSec = static_cast<int64_t>(st.st_mtim.tv_sec);
+    stamp.mtimeNsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+    return stamp;
+}
+
+void writeSidecarFile(const std::string& path, const std::string& bytes) {
+    const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+    FilePtr file(std::fopen(tmp.c_str(), "wb"));
+    if (!file) {
+        throw std::runtime_error("Failed to create sidecar (" + std::to_string(errno) + "): " + tmp);
+    }
+    if (std::fwrite(bytes.data(), 1, bytes.size(), file.get()) != bytes.size() ||
+        std::fclose(file.release()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to write sidecar: " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to install sidecar (" + std::to_string(errno) + "): " + path);
+    }
+}
+
+bool readSidecarFile(const std::string& path, std::string& bytes) {
+    FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file) {
+        return false;
+    }
+    bytes.clear();
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file.get())) > 0) {
+        bytes.append(chunk, n);
+    }
+    return std::ferror(file.get()) == 0;
+}
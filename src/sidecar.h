@@ -0,0 +1,67 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Identity of the source file a sidecar was built from.  A sidecar whose
+// stamp differs from the current file is stale and must be ignored.
+struct SourceStamp {
+    uint64_t size = 0;
+    int64_t mtimeSec = 0;
+    int64_t mtimeNsec = 0;
+
+    bool operator==(const SourceStamp& other) const {
+        return size == other.size && mtimeSec == other.mtimeSec && mtimeNsec == other.mtimeNsec;
+    }
+};
+
+// Throws std::runtime_error when the file cannot be stat'ed.
+SourceStamp sourceStampOf(const std::string& filename);
+
+// Writes bytes to path through a temporary file and rename(), so readers
+// never observe a partially written sidecar.
+void writeSidecarFile(const std::string& path, const std::string& bytes);
+
+// Reads the whole sidecar; returns false when it does not exist or cannot be read.
+bool readSidecarFile(const std::string& path, std::string& bytes);
+
+// Little helpers for the fixed-width native-endian sidecar encodings.
+template <typename T>
+void putValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+class SidecarCursor {
+public:
+    explicit SidecarCursor(const std::string& bytes) : bytes(bytes), pos(0) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (bytes.size() - pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, bytes.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    bool getBytes(void* dst, size_t len) {
+        if (bytes.size() - pos < len) {
+            return false;
+        }
+        std::memcpy(dst, bytes.data() + pos, len);
+        pos += len;
+        return true;
+    }
+
+    bool atEnd() const { return pos == bytes.size(); }
+    size_t remaining() const { return bytes.size() - pos; }
+
+private:
+    const std::string& bytes;
+    size_t pos;
+};
+
+#endif // SIDECAR_H
@@ -0,0 +1,108 @@
+#include "simd_scan.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const char* findLiteralScalar(const char* haystack, size_t size, const char* needle, size_t needleLen) {
+    return static_cast<const char*>(memmem(haystack, size, needle, needleLen));
+}
+
+} // namespace
+
+// Generic SIMD substring search: compare the first and last needle byte at
+// every position of a vector-wide window and only run memcmp on positions
+// where both match.  On log text this rejects almost every position without
+// touching the rest of the needle.
+const char* findLiteral(const char* haystack, size_t size, const char* needle, size_t needleLen) {
+    if (needleLen == 0) {
+        return haystack;
+    }
+    if (size < needleLen) {
+        return nullptr;
+    }
+    if (needleLen == 1) {
+        return static_cast<const char*>(memchr(haystack, needle[0], size));
+    }
+
+    size_t i = 0;
+    const size_t lastOffset = needleLen - 1;
+#if defined(__AVX2__)
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[lastOffset]);
+    for (; i + lastOffset + 32 <= size; i += 32) {
+        const __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+        const __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + lastOffset));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+        while (mask != 0) {
+            const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (memcmp(haystack + i + bit + 1, needle + 1, needleLen - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[lastOffset]);
+    for (; i + lastOffset + 16 <= size; i += 16) {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + lastOffset));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+        while (mask != 0) {
+            const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (memcmp(haystack + i + bit + 1, needle + 1, needleLen - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return findLiteralScalar(haystack + i, size - i, needle, needleLen);
+}
+
+// Counts '\n' bytes.  Compare results (0 or -1 per byte) are subtracted into
+// byte-wide counters, which are folded into 64-bit lanes with SAD before
+// they can overflow (every 255 vectors).
+size_t countNewlines(const char* data, size_t size) {
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    while (i + 32 <= size) {
+        __m256i counters = zero;
+        const size_t vectors = std::min<size_t>((size - i) / 32, 255);
+        for (size_t v = 0; v < vectors; ++v, i += 32) {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(block, nl));
+        }
+        const __m256i sums = _mm256_sad_epu8(counters, zero);
+        count += static_cast<size_t>(_mm256_extract_epi64(sums, 0)) + static_cast<size_t>(_mm256_extract_epi64(sums, 1)) +
+                 static_cast<size_t>(_mm256_extract_epi64(sums, 2)) + static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+    }
+#elif defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= size) {
+        __m128i counters = zero;
+        const size_t vectors = std::min<size_t>((size - i) / 16, 255);
+        for (size_t v = 0; v < vectors; ++v, i += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(block, nl));
+        }
+        const __m128i sums = _mm_sad_epu8(counters, zero);
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+    }
+#endif
+    for (; i < size; ++i) {
+        count += data[i] == '\n';
+    }
+    return count;
+}
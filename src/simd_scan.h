@@ -0,0 +1,14 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+
+// Returns a pointer to the first occurrence of needle[0, needleLen) inside
+// haystack[0, size), or nullptr when there is none.  Uses AVX2/SSE2 when the
+// build enables them and falls back to memmem otherwise.
+const char* findLiteral(const char* haystack, size_t size, const char* needle, size_t needleLen);
+
+// Returns the number of '\n' bytes in data[0, size).
+size_t countNewlines(const char* data, size_t size);
+
+#endif // SIMD_SCAN_H
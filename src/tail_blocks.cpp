@@ -0,0 +1,95 @@
+#include "tail_blocks.h"
+#include "compressed_ring_buffer.h"
+#include "trace.h"
+#include <cstring>
+#include <deque>
+#include <string>
+
+template <typename Buffer>
+void tailBlocks(int fd, CompressionType type, const std::vector<CompressedBlock>& blocks,
+                BasicParser<Buffer>& parser, size_t n, uint64_t heldBytes) {
+    const LineFilter* filter = parser.lineFilter();
+    BlockDecoder decoder(fd, type);
+    std::deque<std::vector<char>> decoded; // blocks first, first + 1, ... within heldBytes
+    uint64_t held = 0;                     // bytes in decoded
+    size_t first = blocks.size();
+    size_t startOffset = 0;                // of the first line to parse, in decoded.front()
+    size_t found = 0;
+    bool seenLastByte = false;
+    std::string carry; // start of the line that continues into the next block
+
+    // Walk backwards exactly like findTailStart does for plain files.
+    for (size_t b = blocks.size(); b-- > 0 && found < n;) {
+        decoded.emplace_front();
+        {
+            TraceSpan span("decompress");
+            decoder.decode(blocks[b], decoded.front());
+        }
+        first = b;
+        held += decoded.front().size();
+        while (held > heldBytes && decoded.size() > 1) {
+            held -= decoded.back().size();
+            decoded.pop_back();
+        }
+        const char* base = decoded.front().data();
+        const char* lineEnd = base + decoded.front().size();
+        if (!seenLastByte && lineEnd > base) {
+            seenLastByte = true;
+            if (lineEnd[-1] == '\n') {
+                --lineEnd; // a trailing newline does not start an extra empty line
+            }
+        }
+        while (const char* nl = static_cast<const char*>(
+                   memrchr(base, '\n', static_cast<size_t>(lineEnd - base)))) {
+            const char* lineStart = nl + 1;
+            bool counted = true;
+            if (filter) {
+                if (carry.empty()) {
+                    counted = filter->matches(lineStart, static_cast<size_t>(lineEnd - lineStart));
+                } else {
+                    carry.insert(0, lineStart, static_cast<size_t>(lineEnd - lineStart));
+                    counted = filter->matches(carry.data(), carry.size());
+                    carry.clear();
+                }
+            }
+            if (counted && ++found >= n) {
+                startOffset = static_cast<size_t>(lineStart - base);
+                break;
+            }
+            lineEnd = nl;
+        }
+        if (filter && found < n) {
+            carry.insert(0, base, static_cast<size_t>(lineEnd - base));
+        }
+    }
+
+    if (n > 0 && !decoded.empty()) {
+        {
+            TraceSpan span("parse");
+            parser.parse(decoded.front().data() + startOffset, decoded.front().size() - startOffset);
+        }
+        decoded.pop_front();
+        std::vector<char> block;
+        for (size_t b = first + 1; b < blocks.size(); ++b) {
+            if (!decoded.empty()) {
+                block.swap(decoded.front());
+                decoded.pop_front();
+            } else {
+                TraceSpan span("decompress");
+                decoder.decode(blocks[b], block);
+            }
+            TraceSpan span("parse");
+            parser.parse(block.data(), block.size());
+        }
+    }
+    TraceSpan span("parse");
+    parser.finalize();
+}
+
+template void tailBlocks(int, CompressionType, const std::vector<CompressedBlock>&, Parser&, size_t, uint64_t);
+template void tailBlocks(int, CompressionType, const std::vector<CompressedBlock>&,
+                         BasicParser<CompressedRingBuffer>&, size_t, uint64_t);
+#ifdef USE_CHAR_RING_BUFFER
+template void tailBlocks(int, CompressionType, const std::vector<CompressedBlock>&, WideParser&, size_t,
+                         uint64_t);
+#endif
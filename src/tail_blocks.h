@@ -0,0 +1,21 @@
+#ifndef TAIL_BLOCKS_H
+#define TAIL_BLOCKS_H
+
+#include "parser.h"
+#include "seekable_blocks.h"
+#include <cstdint>
+#include <vector>
+
+// Tails a file made of independently decodable blocks without decoding all
+// of it.  Blocks are decoded from the last one backwards until n lines (n
+// matching lines when the parser has a filter) are found; then only the bytes
+// from the first of those lines on are parsed, in file order.  Decoded blocks
+// are held for that pass while they fit in heldBytes; later ones past it are
+// dropped during the walk and decoded again one at a time.  The block holding
+// the first line is always held.  Works with the same parsers as
+// tailPlainRange.
+template <typename Buffer>
+void tailBlocks(int fd, CompressionType type, const std::vector<CompressedBlock>& blocks,
+                BasicParser<Buffer>& parser, size_t n, uint64_t heldBytes);
+
+#endif // TAIL_BLOCKS_H
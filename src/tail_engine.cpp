@@ -0,0 +1,783 @@
+#include "tail_engine.h"
+#include "circular_buffer.h"
+#include "cold_read.h"
+#include "compressed_ring_buffer.h"
+#include "compressor_factory.h"
+#include "compressor_zip.h"
+#include "context_pool.h"
+#include "keyed_ring_buffer.h"
+#include "bloom_sidecar.h"
+#include "line_count.h"
+#include "line_index.h"
+#include "parser.h"
+#include "process_stream.h"
+#include "tail_blocks.h"
+#include "tail_plain.h"
+#include "tar_reader.h"
+#include "trace.h"
+#include "zip_archive.h"
+#include "zstd_dictionary.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <mutex>
+#include <stdexcept>
+#if ZTAIL_USE_THREADS
+#include <condition_variable>
+#include <thread>
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ztail {
+namespace {
+
+// Returns a reader over the candidate blocks of filename when it has a fresh
+// bloom sidecar for the same format, or nullptr to fall back to streaming.
+std::unique_ptr<ICompressor> openBloomReader(const std::string& filename, DetectionResult& det,
+                                             const std::string& needle, const DiagnosticSink& diagnostics) {
+    BloomSidecar sidecar;
+    if (!det.file || !sidecar.load(filename) || sidecar.compressionType() != det.type) {
+        return nullptr;
+    }
+    if (!sidecar.canPrune(needle) && diagnostics) {
+        diagnostics("--bloom cannot look up '" + needle + "': it needs a token of " +
+                    std::to_string(BloomSidecar::GRAM) + " characters or one delimited on both sides; " +
+                    "every block of '" + filename + "' is decoded");
+    }
+    return std::make_unique<CandidateBlockReader>(std::move(det.file), sidecar, sidecar.candidates(needle));
+}
+
+// Returns a reader that writes the line index of filename while it is
+// streamed, or nullptr when the file has no independently decodable blocks.
+std::unique_ptr<ICompressor> openIndexingReader(const std::string& filename, DetectionResult& det,
+                                                const DiagnosticSink& diagnostics) {
+    if (!det.file || det.type == CompressionType::NONE || det.type == CompressionType::ZIP) {
+        return nullptr;
+    }
+    std::vector<CompressedBlock> blocks = listCompressedBlocks(fileno(det.file.get()), det.type);
+    if (blocks.size() < 2) {
+        if (diagnostics) {
+            diagnostics("'" + filename + "' has no independently decodable blocks; not indexed");
+        }
+        return nullptr;
+    }
+    return std::make_unique<IndexingBlockReader>(std::move(det.file), filename, det.type, std::move(blocks),
+                                                 diagnostics);
+}
+
+// Reads the bytes [begin, end) of a descriptor without moving its offset.
+auto rangeReader(int fd, uint64_t begin, uint64_t end) {
+    return [fd, pos = begin, end](std::vector<char>& buf, size_t& n) mutable {
+        TraceSpan span("read");
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(buf.size(), end - pos));
+        ssize_t r = 0;
+        do {
+            r = want > 0 ? ::pread(fd, buf.data(), want, static_cast<off_t>(pos)) : 0;
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            throw std::runtime_error("read error (" + std::to_string(errno) + ") while tailing input");
+        }
+        n = static_cast<size_t>(r);
+        pos += n;
+        return n > 0;
+    };
+}
+
+// Opens the decoder of a compressed input.  With --no-cache it reads through
+// an O_DIRECT stream when asked for and supported, and otherwise drops the
+// pages it has read behind it.
+std::unique_ptr<ICompressor> openColdCompressor(DetectionResult& det, const std::string& name,
+                                                const CLIOptions& options, ContextPool& pool) {
+    const int fd = fileno(det.file.get());
+    if (!options.noCache || fd < 0 || det.type == CompressionType::NONE || det.type == CompressionType::ZIP) {
+        return openCompressor(det, name, options, &pool);
+    }
+    if (options.directIo) {
+        FilePtr direct = openDirectStream(fd);
+        if (direct) {
+            det.file = std::move(direct);
+            return openCompressor(det, name, options, &pool);
+        }
+    }
+    return std::make_unique<DropBehindReader>(openCompressor(det, name, options, &pool), fd);
+}
+
+// Streams comp through parser with pipeline buffers from pool.
+template <typename Buffer>
+void streamInput(ICompressor& comp, BasicParser<Buffer>& parser, Buffer& cb, const CLIOptions& options,
+                 ContextPool& pool, PipelineStats* stats, OutputSink& out) {
+    std::unique_ptr<BufferPool> pipeline = pool.takePipeline();
+    processStream([&](std::vector<char>& buf, size_t& n) {
+        return comp.decompress(buf, n);
+    }, parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads, stats, out,
+       pipeline.get());
+    pool.give(std::move(pipeline));
+}
+
+template <typename Buffer>
+void printRing(const Buffer& cb, const CLIOptions& options, PipelineStats* stats, OutputSink& out) {
+    {
+        TraceSpan span("print");
+        StageTimer timer(stats ? &stats->printNs : nullptr);
+        cb.print(options.printAggregationThreshold, out);
+    }
+    if (stats) {
+        stats->ringMemory = cb.memoryUsage();
+    }
+}
+
+// Hands what is written to it to a parser, so that the lines of an indexed
+// range go through the ring like those of any other input.
+template <typename Buffer>
+class ParserStreamBuf : public std::streambuf {
+public:
+    explicit ParserStreamBuf(BasicParser<Buffer>& parser) : parser(parser) {}
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        parser.parse(s, static_cast<size_t>(n));
+        return n;
+    }
+
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            const char ch = traits_type::to_char_type(c);
+            parser.parse(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    BasicParser<Buffer>& parser;
+};
+
+// Plain bytes seek straight to their last N lines; the backward scan is
+// accounted as reading.
+template <typename Buffer>
+void tailPlainBytes(int fd, uint64_t begin, uint64_t end, BasicParser<Buffer>& parser, Buffer& cb,
+                    const CLIOptions& options, PipelineStats* stats, OutputSink& out) {
+    {
+        TraceSpan span("tail-plain");
+        StageTimer timer(stats ? &stats->readNs : nullptr);
+        tailPlainRange(fd, begin, end, parser, options.n, options.readBufferSize);
+    }
+    printRing(cb, options, stats, out);
+}
+
+// Per-key tails may end anywhere in the input, so every byte is read.
+void tailPlainBytes(int fd, uint64_t begin, uint64_t end, BasicParser<KeyedRingBuffer>& parser,
+                    KeyedRingBuffer& kb, const CLIOptions& options, PipelineStats* stats, OutputSink& out) {
+    auto read = rangeReader(fd, begin, end);
+    std::unique_ptr<DropBehind> behind(options.noCache ? new DropBehind(fd, begin) : nullptr);
+    uint64_t pos = begin;
+    processStream([&](std::vector<char>& buf, size_t& n) {
+        const bool more = read(buf, n);
+        if (behind) {
+            pos += n;
+            behind->advance(pos);
+        }
+        return more;
+    }, parser, kb, options.readBufferSize, options.printAggregationThreshold, options.useThreads, stats, out);
+}
+
+template <typename Buffer>
+void tailPlainInput(DetectionResult& det, BasicParser<Buffer>& parser, Buffer& cb, const CLIOptions& options,
+                    PipelineStats* stats, OutputSink& out) {
+    const int fd = fileno(det.file.get());
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("stat error (" + std::to_string(errno) + ") while tailing plain input");
+    }
+    tailPlainBytes(fd, 0, static_cast<uint64_t>(st.st_size), parser, cb, options, stats, out);
+}
+
+// Compressed files of independent blocks only decode the blocks holding
+// their last N lines; the backward walk is accounted as reading.  The blocks
+// held between the walk and the parse get the memory the ring and the
+// pipeline buffers are planned with.  Returns false, leaving det untouched,
+// when the file has no such blocks.
+template <typename Buffer>
+bool tailBlockInput(DetectionResult& det, BasicParser<Buffer>& parser, Buffer& cb, const CLIOptions& options,
+                    PipelineStats* stats, OutputSink& out) {
+    const int fd = fileno(det.file.get());
+    const std::vector<CompressedBlock> blocks = listCompressedBlocks(fd, det.type);
+    if (blocks.size() < 2) {
+        return false;
+    }
+    {
+        TraceSpan span("tail-blocks");
+        StageTimer timer(stats ? &stats->readNs : nullptr);
+        const uint64_t ring = options.bytesBudget > 0 ? options.bytesBudget
+                                                      : static_cast<uint64_t>(options.n) * options.lineCapacity;
+        tailBlocks(fd, det.type, blocks, parser, options.n,
+                   std::max<uint64_t>(ring, 2 * static_cast<uint64_t>(options.readBufferSize)));
+    }
+    printRing(cb, options, stats, out);
+    return true;
+}
+
+bool tailBlockInput(DetectionResult&, BasicParser<KeyedRingBuffer>&, KeyedRingBuffer&, const CLIOptions&,
+                    PipelineStats*, OutputSink&) {
+    return false; // every block is needed
+}
+
+// Entries stored without compression are tailed in place like plain files
+// and deflated ones are inflated straight from the archive.  Returns false
+// for other methods and for encrypted entries, which need libzip.
+template <typename Buffer>
+bool tailZipEntry(int fd, const std::string& name, const ZipEntry& entry, BasicParser<Buffer>& parser, Buffer& cb,
+                  const CLIOptions& options, PipelineStats* stats, OutputSink& out) {
+    if (entry.encrypted() || (entry.method != ZIP_METHOD_STORE && entry.method != ZIP_METHOD_DEFLATE)) {
+        return false;
+    }
+    const uint64_t begin = zipDataOffset(fd, entry);
+    if (entry.method == ZIP_METHOD_STORE) {
+        tailPlainBytes(fd, begin, begin + entry.size, parser, cb, options, stats, out);
+        return true;
+    }
+    ZipDeflateReader reader(fd, begin, entry.compressedSize, entry.crc, name + ":" + entry.name);
+    processStream([&](std::vector<char>& buf, size_t& n) {
+        return reader.decompress(buf, n);
+    }, parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads, stats, out);
+    return true;
+}
+
+// Tails the entry --entry names (or the first one) without libzip where
+// tailZipEntry can.  Returns false, leaving det untouched, otherwise.
+template <typename Buffer>
+bool tailZipInput(DetectionResult& det, const std::string& name, BasicParser<Buffer>& parser, Buffer& cb,
+                  const CLIOptions& options, PipelineStats* stats, OutputSink& out) {
+    const int fd = fileno(det.file.get());
+    std::vector<ZipEntry> entries;
+    try {
+        entries = readZipDirectory(fd);
+    } catch (const std::runtime_error&) {
+        return false; // libzip reports what is wrong with it
+    }
+    auto entry = options.zipEntry.empty()
+                     ? entries.begin()
+                     : std::find_if(entries.begin(), entries.end(),
+                                    [&](const ZipEntry& e) { return e.name == options.zipEntry; });
+    return entry != entries.end() && tailZipEntry(fd, name, *entry, parser, cb, options, stats, out);
+}
+
+// Tails one entry of an --all-entries run.  Entries tailZipEntry cannot
+// read go through libzip one at a time: its handle moves the offset that the
+// descriptors duplicated from fd share.
+template <typename Buffer>
+void tailArchiveEntry(int fd, const std::string& name, const ZipEntry& entry, Buffer& cb, const CLIOptions& options,
+                      const LineFilter* filter, PipelineStats* stats, OutputSink& out, std::mutex& libzip) {
+    BasicParser<Buffer> parser(cb, options.lineCapacity, filter);
+    parser.setStats(stats);
+    if (tailZipEntry(fd, name, entry, parser, cb, options, stats, out)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(libzip);
+    const int dupfd = ::dup(fd);
+    FilePtr file(dupfd >= 0 ? ::fdopen(dupfd, "rb") : nullptr);
+    if (!file) {
+        if (dupfd >= 0) {
+            ::close(dupfd);
+        }
+        throw std::runtime_error("cannot reopen '" + name + "' (" + std::to_string(errno) + ")");
+    }
+    CompressorZip comp(std::move(file), name, entry.name);
+    processStream([&](std::vector<char>& buf, size_t& n) {
+        return comp.decompress(buf, n);
+    }, parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads, stats, out);
+}
+
+// Tails the member tar stands on.  Members of an uncompressed archive, open
+// on plainFd, are tailed in place backwards from their end.
+template <typename Buffer>
+void tailTarMember(TarReader& tar, int plainFd, Buffer& cb, const CLIOptions& options, const LineFilter* filter,
+                   PipelineStats* stats, OutputSink& out) {
+    BasicParser<Buffer> parser(cb, options.lineCapacity, filter);
+    parser.setStats(stats);
+    const TarMember& member = tar.member();
+    if (plainFd >= 0) {
+        tailPlainBytes(plainFd, member.offset, member.offset + member.size, parser, cb, options, stats, out);
+        return;
+    }
+    processStream([&](std::vector<char>& buf, size_t& n) {
+        return tar.decompress(buf, n);
+    }, parser, cb, options.readBufferSize, options.printAggregationThreshold, options.useThreads, stats, out);
+}
+
+// Tails an opened input into cb and prints it to out.  Sidecars next to name
+// are only consulted (or written) for inputs named by a path.
+template <typename Buffer>
+void tailDetected(DetectionResult& det, const std::string& name, bool sidecars, Buffer& cb,
+                  const CLIOptions& options, const LineFilter* filter, ContextPool& pool, PipelineStats* stats,
+                  OutputSink& out, const DiagnosticSink& diagnostics) {
+    BasicParser<Buffer> parser(cb, options.lineCapacity, filter);
+    parser.setStats(stats);
+
+    if (sidecars && !filter && options.perKey.empty()) {
+        // An up-to-date line index decodes only the blocks of the last N
+        // lines.  They still fill the ring, so --bytes-budget and the line
+        // capacity bound the output as without the index.
+        LineIndex index;
+        if (index.load(name) && index.compressionType() == det.type) {
+            const uint64_t total = index.lineCount();
+            const uint64_t n = static_cast<uint64_t>(options.n);
+            {
+                TraceSpan span("decompress");
+                ParserStreamBuf<Buffer> buf(parser);
+                std::ostream stream(&buf);
+                writeIndexedRange(fileno(det.file.get()), index, total > n ? total - n + 1 : 1, total, stream);
+            }
+            parser.finalize();
+            printRing(cb, options, stats, out);
+            return;
+        }
+    }
+
+    std::unique_ptr<ICompressor> comp;
+    if (sidecars && options.useBloom) {
+        comp = openBloomReader(name, det, options.grepPattern, diagnostics);
+    }
+    if (!comp && sidecars && options.buildIndex) {
+        comp = openIndexingReader(name, det, diagnostics);
+    }
+    if (!comp && det.type != CompressionType::NONE && det.type != CompressionType::ZIP &&
+        tailBlockInput(det, parser, cb, options, stats, out)) {
+        return;
+    }
+    if (!comp && det.type == CompressionType::ZIP && tailZipInput(det, name, parser, cb, options, stats, out)) {
+        return;
+    }
+    if (!comp) {
+        comp = openColdCompressor(det, name, options, pool);
+    }
+
+    if (comp) {
+        streamInput(*comp, parser, cb, options, pool, stats, out);
+    } else {
+        tailPlainInput(det, parser, cb, options, stats, out);
+    }
+}
+
+// Streams an input that cannot seek, such as a pipe, from its start.
+template <typename Buffer>
+void tailStream(ICompressor& comp, Buffer& cb, const CLIOptions& options, const LineFilter* filter,
+                ContextPool& pool, PipelineStats* stats, OutputSink& out) {
+    BasicParser<Buffer> parser(cb, options.lineCapacity, filter);
+    parser.setStats(stats);
+    streamInput(comp, parser, cb, options, pool, stats, out);
+}
+
+// Parses a plain buffer in one go; the parser copies only stored lines.
+template <typename Buffer>
+void tailMemory(const char* data, size_t size, Buffer& cb, const CLIOptions& options, const LineFilter* filter,
+                PipelineStats* stats, OutputSink& out) {
+    BasicParser<Buffer> parser(cb, options.lineCapacity, filter);
+    parser.setStats(stats);
+    {
+        TraceSpan span("parse");
+        StageTimer timer(stats ? &stats->parseNs : nullptr);
+        parser.parse(data, size);
+        parser.finalize();
+    }
+    {
+        TraceSpan span("print");
+        StageTimer timer(stats ? &stats->printNs : nullptr);
+        cb.print(options.printAggregationThreshold, out);
+    }
+    if (stats) {
+        stats->bytesDecompressed = size;
+        stats->ringMemory = cb.memoryUsage();
+    }
+}
+
+// Appends views of the last n (matching) lines of [data, data + size) to
+// lines, in input order.  A trailing newline does not start an empty line.
+void lastLines(const char* data, size_t size, size_t n, const LineFilter* filter,
+               std::vector<std::string_view>& lines) {
+    if (size == 0 || n == 0) {
+        return;
+    }
+    const size_t first = lines.size();
+    const char* lineEnd = data + size;
+    if (lineEnd[-1] == '\n') {
+        --lineEnd;
+    }
+    while (true) {
+        const char* nl = static_cast<const char*>(memrchr(data, '\n', static_cast<size_t>(lineEnd - data)));
+        const char* lineStart = nl ? nl + 1 : data;
+        const size_t len = static_cast<size_t>(lineEnd - lineStart);
+        if (!filter || filter->matches(lineStart, len)) {
+            lines.emplace_back(lineStart, len);
+            if (lines.size() - first == n) {
+                break;
+            }
+        }
+        if (!nl) {
+            break;
+        }
+        lineEnd = nl;
+    }
+    std::reverse(lines.begin() + static_cast<std::ptrdiff_t>(first), lines.end());
+}
+
+// Splits printed output, where every line ends in a newline, into views.
+void splitLines(const std::string& text, std::vector<std::string_view>& lines) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char* lineEnd = nl ? nl : end;
+        lines.emplace_back(p, static_cast<size_t>(lineEnd - p));
+        p = lineEnd + 1;
+    }
+}
+
+} // namespace
+
+TailEngine::TailEngine(CLIOptions options, DiagnosticSink diagnostics)
+    : opts(std::move(options)), diagnostics(std::move(diagnostics)), pool(std::make_unique<ContextPool>())
+{
+    CompressionType format;
+    if (!opts.format.empty() && !compressionTypeFromName(opts.format, format)) {
+        throw std::runtime_error("unknown format '" + opts.format + "'");
+    }
+    for (const std::string& path : opts.zstdDictionaries) {
+        loadZstdDictionary(path);
+    }
+    if (!opts.grepPattern.empty()) {
+        filter = std::make_unique<LineFilter>(LineFilter::literal(opts.grepPattern));
+    } else if (!opts.regexPattern.empty()) {
+        filter = std::make_unique<LineFilter>(LineFilter::regex(opts.regexPattern));
+    }
+}
+
+TailEngine::TailEngine(TailEngine&&) noexcept = default;
+TailEngine& TailEngine::operator=(TailEngine&&) noexcept = default;
+TailEngine::~TailEngine() = default;
+
+size_t TailEngine::reusedContexts() const {
+    return pool->reused();
+}
+
+void TailEngine::warn(const std::string& message) const {
+    if (diagnostics) {
+        diagnostics(message);
+    }
+}
+
+// Calls body with an empty ring of the kind the options select, which body
+// prints to out.  Plain rings are pooled: one that saw no error is cleared
+// and kept for the next input.
+template <typename Body>
+void TailEngine::withRing(OutputSink& out, Body body) const {
+    if (!opts.perKey.empty()) {
+        KeyedRingBuffer kb(KeySpec::parse(opts.perKey), opts.n, opts.lineCapacity, opts.bytesBudget);
+        body(kb);
+        if (kb.evictedKeys() > 0) {
+            out.flush(); // the warning follows the lines it concerns
+            warn(std::to_string(kb.evictedKeys()) + " idle keys were evicted to stay within the byte budget");
+        }
+    } else if (opts.compressRing) {
+        CompressedRingBuffer cb(opts.n, opts.lineCapacity, opts.bytesBudget);
+        body(cb);
+    } else if (!opts.spillDir.empty() || needsWideRing(opts.n, opts.lineCapacity, opts.bytesBudget)) {
+        // A spilled ring grows with its lines, possibly past 4 GiB.
+        WideCircularBuffer cb(opts.n, opts.lineCapacity, opts.bytesBudget, opts.spillDir);
+        body(cb);
+    } else {
+        std::unique_ptr<CircularBuffer> cb = pool->takeRing();
+        if (!cb) {
+            cb = std::make_unique<CircularBuffer>(opts.n, opts.lineCapacity, opts.bytesBudget);
+        }
+        body(*cb);
+        pool->give(std::move(cb));
+    }
+}
+
+// Per-key tails need the whole input, so only plain tails can be cut out of
+// a buffer directly.
+bool TailEngine::tailsInPlace() const {
+    return opts.perKey.empty();
+}
+
+void TailEngine::tailZipEntries(DetectionResult& det, const std::string& name, OutputSink& out,
+                                PipelineStats* stats) const {
+    const int fd = fileno(det.file.get());
+    std::vector<ZipEntry> entries = readZipDirectory(fd);
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const ZipEntry& e) { return e.isDirectory(); }),
+                  entries.end());
+
+    const unsigned threads =
+        opts.useThreads ? static_cast<unsigned>(std::min<size_t>(defaultCountThreads(), entries.size())) : 1;
+    // Entries run side by side instead of the stages of one entry.
+    CLIOptions entryOptions = opts;
+    entryOptions.useThreads = opts.useThreads && threads <= 1;
+    std::mutex libzip;
+    auto tailOne = [&](size_t i, OutputSink& sink, PipelineStats* entryStats) {
+        withRing(sink, [&](auto& cb) {
+            tailArchiveEntry(fd, name, entries[i], cb, entryOptions, filter.get(), entryStats, sink, libzip);
+        });
+    };
+    auto printHeader = [&](size_t i) {
+        const std::string header = (i > 0 ? "\n==> " : "==> ") + name + ":" + entries[i].name + " <==\n";
+        out.write(header.data(), header.size());
+    };
+
+#if ZTAIL_USE_THREADS
+    if (threads > 1) {
+        // Workers tail entries into memory in directory order; this thread
+        // prints each one once those before it are printed.  The first
+        // failure stops the workers from taking new entries.
+        std::vector<std::string> outputs(entries.size());
+        std::vector<std::exception_ptr> errors(entries.size());
+        std::vector<char> done(entries.size(), 0);
+        std::mutex m;
+        std::condition_variable ready;
+        std::atomic<size_t> next(0);
+        auto worker = [&]() {
+            PipelineStats local;
+            for (size_t i = next++; i < entries.size(); i = next++) {
+                StringSink sink;
+                std::exception_ptr error;
+                try {
+                    tailOne(i, sink, stats ? &local : nullptr);
+                } catch (...) {
+                    error = std::current_exception();
+                    next = entries.size();
+                }
+                std::lock_guard<std::mutex> lock(m);
+                outputs[i] = sink.take();
+                errors[i] = error;
+                done[i] = 1;
+                ready.notify_all();
+            }
+            if (stats) {
+                std::lock_guard<std::mutex> lock(m);
+                stats->add(local);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) {
+            pool.emplace_back(worker);
+        }
+        std::exception_ptr error;
+        for (size_t i = 0; i < entries.size() && !error; ++i) {
+            std::string text;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                ready.wait(lock, [&] { return done[i] != 0; });
+                error = errors[i];
+                text.swap(outputs[i]);
+            }
+            if (error) {
+                break;
+            }
+            try {
+                TraceSpan span("print");
+                printHeader(i);
+                out.write(text.data(), text.size());
+            } catch (...) {
+                error = std::current_exception();
+                next = entries.size();
+            }
+        }
+        for (std::thread& t : pool) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < entries.size(); ++i) {
+        printHeader(i);
+        tailOne(i, out, stats);
+    }
+}
+
+void TailEngine::tailTarMembers(DetectionResult& det, const std::string& name, OutputSink& out,
+                                PipelineStats* stats) const {
+    const int fd = fileno(det.file.get()); // -1 for streams that cannot seek
+    int plainFd = -1;
+    std::unique_ptr<TarSource> source;
+    if (fd >= 0 && det.type == CompressionType::NONE) {
+        source = fileTarSource(fd);
+        plainFd = fd;
+    } else if (fd >= 0 && det.type != CompressionType::ZIP) {
+        source = blockTarSource(fd, det.type, listCompressedBlocks(fd, det.type));
+    }
+    if (!source) {
+        std::unique_ptr<ICompressor> reader = openReader(det, name, opts, pool.get());
+        if (opts.noCache && fd >= 0) {
+            reader = std::make_unique<DropBehindReader>(std::move(reader), fd);
+        }
+        source = streamTarSource(std::move(reader));
+    }
+
+    // A glob tails every member it matches, each under a header; a name
+    // stops at its first member without decoding the rest of the archive.
+    TarReader tar(std::move(source), name);
+    const bool several = isTarGlob(opts.tarMember);
+    size_t found = 0;
+    while (tar.nextMember(opts.tarMember)) {
+        if (several) {
+            const std::string header = (found > 0 ? "\n==> " : "==> ") + name + ":" + tar.member().name + " <==\n";
+            out.write(header.data(), header.size());
+        }
+        withRing(out, [&](auto& cb) {
+            tailTarMember(tar, plainFd, cb, opts, filter.get(), stats, out);
+        });
+        ++found;
+        if (!several) {
+            break;
+        }
+    }
+    if (found == 0) {
+        throw std::runtime_error("no member matching '" + opts.tarMember + "' in '" + name + "'");
+    }
+}
+
+void TailEngine::tailFile(const std::string& path, OutputSink& out, PipelineStats* stats) const {
+    // What this call brings into the cache, detection included, is dropped
+    // once the input is done.
+    std::unique_ptr<DropOnClose> cold(opts.noCache ? new DropOnClose(path) : nullptr);
+    DetectionResult det = detectCompressionType(path);
+    if (!det.file) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    overrideCompressionType(det, opts.format);
+    if (!opts.tarMember.empty()) {
+        tailTarMembers(det, path, out, stats);
+        return;
+    }
+    if (opts.allEntries && det.type == CompressionType::ZIP) {
+        tailZipEntries(det, path, out, stats);
+        return;
+    }
+    withRing(out, [&](auto& cb) {
+        tailDetected(det, path, true, cb, opts, filter.get(), *pool, stats, out, diagnostics);
+    });
+}
+
+void TailEngine::tailFd(int fd, OutputSink& out, PipelineStats* stats) const {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("stat error (" + std::to_string(errno) + ") on descriptor " + std::to_string(fd));
+    }
+    const std::string name = "descriptor " + std::to_string(fd);
+    if (!S_ISREG(st.st_mode)) {
+        // Detected from a peeked prefix and decoded in process.
+        DetectionResult det = detectStreamCompressionType(fd, name);
+        overrideCompressionType(det, opts.format);
+        if (!opts.tarMember.empty()) {
+            tailTarMembers(det, name, out, stats);
+            return;
+        }
+        std::unique_ptr<ICompressor> comp = openReader(det, name, opts, pool.get());
+        withRing(out, [&](auto& cb) {
+            tailStream(*comp, cb, opts, filter.get(), *pool, stats, out);
+        });
+        return;
+    }
+    std::unique_ptr<DropOnClose> cold(opts.noCache ? new DropOnClose(fd) : nullptr);
+    const int dupfd = ::dup(fd);
+    FilePtr file(dupfd >= 0 ? ::fdopen(dupfd, "rb") : nullptr);
+    if (!file) {
+        if (dupfd >= 0) {
+            ::close(dupfd);
+        }
+        throw std::runtime_error("cannot open descriptor " + std::to_string(fd) + " (" + std::to_string(errno) + ")");
+    }
+    std::fseek(file.get(), 0, SEEK_SET);
+    DetectionResult det = detectCompressionType(std::move(file), name);
+    overrideCompressionType(det, opts.format);
+    if (!opts.tarMember.empty()) {
+        tailTarMembers(det, name, out, stats);
+        return;
+    }
+    if (opts.allEntries && det.type == CompressionType::ZIP) {
+        tailZipEntries(det, name, out, stats);
+        return;
+    }
+    withRing(out, [&](auto& cb) {
+        tailDetected(det, name, false, cb, opts, filter.get(), *pool, stats, out, diagnostics);
+    });
+}
+
+void TailEngine::tailBuffer(const char* data, size_t size, OutputSink& out, PipelineStats* stats) const {
+    if (compressionTypeOf(data, size, "") != CompressionType::NONE) {
+        // The decoders read from descriptors, so the buffer becomes an
+        // anonymous in-memory file.
+        const int fd = ::memfd_create("ztail-buffer", MFD_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error("cannot create an in-memory file (" + std::to_string(errno) + ")");
+        }
+        try {
+            FdSink(fd).write(data, size);
+            tailFd(fd, out, stats);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        return;
+    }
+    if (tailsInPlace()) {
+        std::vector<std::string_view> lines;
+        {
+            TraceSpan span("tail-plain");
+            StageTimer timer(stats ? &stats->readNs : nullptr);
+            lastLines(data, size, static_cast<size_t>(std::max(opts.n, 0)), filter.get(), lines);
+        }
+        TraceSpan span("print");
+        StageTimer timer(stats ? &stats->printNs : nullptr);
+        for (std::string_view line : lines) {
+            out.write(line.data(), line.size());
+            out.write("\n", 1);
+        }
+        return;
+    }
+    withRing(out, [&](auto& cb) {
+        tailMemory(data, size, cb, opts, filter.get(), stats, out);
+    });
+}
+
+TailResult TailEngine::tailFile(const std::string& path) const {
+    StringSink sink;
+    tailFile(path, sink);
+    TailResult result;
+    result.owned = std::make_unique<std::string>(sink.take());
+    splitLines(*result.owned, result.lines);
+    return result;
+}
+
+TailResult TailEngine::tailFd(int fd) const {
+    StringSink sink;
+    tailFd(fd, sink);
+    TailResult result;
+    result.owned = std::make_unique<std::string>(sink.take());
+    splitLines(*result.owned, result.lines);
+    return result;
+}
+
+TailResult TailEngine::tailBuffer(const char* data, size_t size) const {
+    TailResult result;
+    if (tailsInPlace() && compressionTypeOf(data, size, "") == CompressionType::NONE) {
+        lastLines(data, size, static_cast<size_t>(std::max(opts.n, 0)), filter.get(), result.lines);
+        return result;
+    }
+    StringSink sink;
+    tailBuffer(data, size, sink);
+    result.owned = std::make_unique<std::string>(sink.take());
+    splitLines(*result.owned, result.lines);
+    return result;
+}
+
+} // namespace ztail
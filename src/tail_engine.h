@@ -0,0 +1,97 @@
+#ifndef TAIL_ENGINE_H
+#define TAIL_ENGINE_H
+
+#include "cli.h"
+#include "diagnostics.h"
+#include "line_filter.h"
+#include "output_sink.h"
+#include "pipeline_stats.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ContextPool;
+struct DetectionResult;
+
+namespace ztail {
+
+// The last lines of one input, without their newlines.  Lines view either
+// the result's own copy of the output or, for plain memory buffers, the
+// buffer itself, which must then outlive the result.
+class TailResult {
+public:
+    size_t size() const { return lines.size(); }
+    bool empty() const { return lines.empty(); }
+    std::string_view operator[](size_t i) const { return lines[i]; }
+    std::vector<std::string_view>::const_iterator begin() const { return lines.begin(); }
+    std::vector<std::string_view>::const_iterator end() const { return lines.end(); }
+
+private:
+    friend class TailEngine;
+    std::unique_ptr<std::string> owned; // on the heap, so moving the result keeps the views valid
+    std::vector<std::string_view> lines;
+};
+
+// Tails files, descriptors and memory buffers with the same pipeline as the
+// command line: the options select the ring (--per-key, --compress-ring,
+// --spill-dir), the filter, the zip entries and the codec limits; filenames,
+// --count, --lines-range and --build-bloom are ignored.  Zstd dictionaries
+// are loaded for the whole process (see zstd_dictionary.h).  Every call uses its
+// own ring and writes only to the sink it is given, so one engine may be used
+// from several threads and engines do not share output state.
+//
+// Decoder contexts, codec and pipeline buffers and plain rings are reset and
+// reused from one call to the next, so tailing many small inputs with one
+// engine costs little more than decoding them.
+//
+// Warnings, such as keys evicted by --per-key or a line index that could not
+// be written, go to diagnostics, which must be thread-safe when the engine
+// is shared; without one they are dropped.
+class TailEngine {
+public:
+    explicit TailEngine(CLIOptions options = CLIOptions(), DiagnosticSink diagnostics = DiagnosticSink());
+    TailEngine(TailEngine&&) noexcept;
+    TailEngine& operator=(TailEngine&&) noexcept;
+    ~TailEngine();
+
+    const CLIOptions& options() const { return opts; }
+
+    // Print the last lines of the input to out, timing the stages into stats
+    // when it is set.  A path may use line index and bloom sidecars.  A
+    // descriptor of a regular file is tailed from its start like a path
+    // (compressed or not, moving its offset); anything else, such as a pipe,
+    // is read to its end and decoded when it starts like a compressed format.
+    // A buffer may be compressed.
+    void tailFile(const std::string& path, OutputSink& out, PipelineStats* stats = nullptr) const;
+    void tailFd(int fd, OutputSink& out, PipelineStats* stats = nullptr) const;
+    void tailBuffer(const char* data, size_t size, OutputSink& out, PipelineStats* stats = nullptr) const;
+
+    // Same, returning the lines.  Plain buffers are tailed in place without
+    // copying a byte.
+    TailResult tailFile(const std::string& path) const;
+    TailResult tailFd(int fd) const;
+    TailResult tailBuffer(const char* data, size_t size) const;
+
+    // Contexts, buffers and rings taken from the engine's pool instead of
+    // being created, over the engine's lifetime.
+    size_t reusedContexts() const;
+
+private:
+    template <typename Body>
+    void withRing(OutputSink& out, Body body) const;
+    void warn(const std::string& message) const;
+    bool tailsInPlace() const;
+    void tailZipEntries(DetectionResult& det, const std::string& name, OutputSink& out, PipelineStats* stats) const;
+    void tailTarMembers(DetectionResult& det, const std::string& name, OutputSink& out, PipelineStats* stats) const;
+
+    CLIOptions opts;
+    DiagnosticSink diagnostics;
+    std::unique_ptr<LineFilter> filter;
+    std::unique_ptr<ContextPool> pool;
+};
+
+} // namespace ztail
+
+#endif // TAIL_ENGINE_H
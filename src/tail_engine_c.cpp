@@ -0,0 +1,163 @@
+#include "tail_engine_c.h"
+#include "tail_engine.h"
+#include <climits>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+struct ztail_engine {
+    ztail::TailEngine engine;
+};
+
+struct ztail_result {
+    ztail::TailResult lines;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+// Runs body, turning exceptions into a stored message and fallback.
+template <typename T, typename Body>
+T guarded(T fallback, Body body) {
+    try {
+        lastError.clear();
+        return body();
+    } catch (const std::exception& ex) {
+        lastError = ex.what();
+    } catch (...) {
+        lastError = "unknown error";
+    }
+    return fallback;
+}
+
+CLIOptions toOptions(const ztail_options& o) {
+    if (o.lines > static_cast<size_t>(INT_MAX)) {
+        throw std::runtime_error("lines must be at most " + std::to_string(INT_MAX));
+    }
+    CLIOptions options;
+    options.n = static_cast<int>(o.lines);
+    options.lineCapacity = o.line_capacity;
+    options.bytesBudget = o.bytes_budget;
+    options.grepPattern = o.grep ? o.grep : "";
+    options.regexPattern = o.regex ? o.regex : "";
+    options.perKey = o.per_key ? o.per_key : "";
+    options.zipEntry = o.zip_entry ? o.zip_entry : "";
+    options.spillDir = o.spill_dir ? o.spill_dir : "";
+    options.compressRing = o.compress_ring != 0;
+    options.useThreads = o.use_threads != 0;
+    options.allEntries = o.all_entries != 0;
+    options.tarMember = o.member ? o.member : "";
+    options.format = o.format ? o.format : "";
+    if (o.zstd_dict) {
+        options.zstdDictionaries.push_back(o.zstd_dict);
+    }
+    options.noCache = o.no_cache != 0;
+    options.directIo = options.noCache && o.direct_io != 0;
+    if (options.compressRing && !options.perKey.empty()) {
+        throw std::runtime_error("compress_ring cannot be combined with per_key");
+    }
+    if (!options.spillDir.empty() && (options.compressRing || !options.perKey.empty())) {
+        throw std::runtime_error("spill_dir cannot be combined with compress_ring or per_key");
+    }
+    if (options.allEntries && !options.zipEntry.empty()) {
+        throw std::runtime_error("all_entries cannot be combined with zip_entry");
+    }
+    if (options.allEntries && !options.tarMember.empty()) {
+        throw std::runtime_error("all_entries cannot be combined with member");
+    }
+    return options;
+}
+
+} // namespace
+
+extern "C" {
+
+void ztail_options_init(ztail_options* options) {
+    const CLIOptions defaults;
+    *options = ztail_options{};
+    options->lines = static_cast<size_t>(defaults.n);
+    options->line_capacity = defaults.lineCapacity;
+    options->use_threads = defaults.useThreads ? 1 : 0;
+}
+
+ztail_engine* ztail_engine_new(const ztail_options* options) {
+    return guarded<ztail_engine*>(nullptr, [&] {
+        ztail_options defaults;
+        ztail_options_init(&defaults);
+        const ztail_options& o = options ? *options : defaults;
+        DiagnosticSink diagnostics;
+        if (o.warn) {
+            diagnostics = [warn = o.warn, user = o.warn_user](const std::string& message) {
+                warn(user, message.c_str());
+            };
+        }
+        return new ztail_engine{ztail::TailEngine(toOptions(o), std::move(diagnostics))};
+    });
+}
+
+void ztail_engine_free(ztail_engine* engine) {
+    delete engine;
+}
+
+int ztail_tail_file(const ztail_engine* engine, const char* path, ztail_write_fn write, void* user) {
+    return guarded(-1, [&] {
+        CallbackSink sink([&](const char* data, size_t size) { write(user, data, size); });
+        engine->engine.tailFile(path, sink);
+        return 0;
+    });
+}
+
+int ztail_tail_fd(const ztail_engine* engine, int fd, ztail_write_fn write, void* user) {
+    return guarded(-1, [&] {
+        CallbackSink sink([&](const char* data, size_t size) { write(user, data, size); });
+        engine->engine.tailFd(fd, sink);
+        return 0;
+    });
+}
+
+int ztail_tail_buffer(const ztail_engine* engine, const void* data, size_t size, ztail_write_fn write, void* user) {
+    return guarded(-1, [&] {
+        CallbackSink sink([&](const char* block, size_t len) { write(user, block, len); });
+        engine->engine.tailBuffer(static_cast<const char*>(data), size, sink);
+        return 0;
+    });
+}
+
+ztail_result* ztail_tail_file_lines(const ztail_engine* engine, const char* path) {
+    return guarded<ztail_result*>(nullptr, [&] {
+        return new ztail_result{engine->engine.tailFile(path)};
+    });
+}
+
+ztail_result* ztail_tail_fd_lines(const ztail_engine* engine, int fd) {
+    return guarded<ztail_result*>(nullptr, [&] {
+        return new ztail_result{engine->engine.tailFd(fd)};
+    });
+}
+
+ztail_result* ztail_tail_buffer_lines(const ztail_engine* engine, const void* data, size_t size) {
+    return guarded<ztail_result*>(nullptr, [&] {
+        return new ztail_result{engine->engine.tailBuffer(static_cast<const char*>(data), size)};
+    });
+}
+
+size_t ztail_result_size(const ztail_result* result) {
+    return result->lines.size();
+}
+
+ztail_span ztail_result_line(const ztail_result* result, size_t i) {
+    const std::string_view line = result->lines[i];
+    return ztail_span{line.data(), line.size()};
+}
+
+void ztail_result_free(ztail_result* result) {
+    delete result;
+}
+
+const char* ztail_last_error(void) {
+    return lastError.c_str();
+}
+
+} // extern "C"
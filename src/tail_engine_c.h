@@ -0,0 +1,77 @@
+#ifndef TAIL_ENGINE_C_H
+#define TAIL_ENGINE_C_H
+
+/* C interface to ztail::TailEngine.  Calls returning int give 0 on success
+ * and -1 on failure, pointers are NULL on failure; ztail_last_error() then
+ * describes the failure of the calling thread's last call. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ztail_engine ztail_engine;
+typedef struct ztail_result ztail_result;
+
+/* Receives a warning, such as keys evicted by per_key, as one sentence
+ * without a newline.  Called from the tailing threads. */
+typedef void (*ztail_warn_fn)(void* user, const char* message);
+
+typedef struct ztail_options {
+    size_t lines;          /* lines to keep, per key with per_key (default 10) */
+    size_t line_capacity;  /* bytes reserved per line (default 512) */
+    size_t bytes_budget;   /* bound on stored line bytes, 0 for none */
+    const char* grep;      /* keep lines containing this literal, or NULL */
+    const char* regex;     /* keep lines matching this ECMAScript regex, or NULL */
+    const char* per_key;   /* --per-key spec, or NULL */
+    const char* zip_entry; /* zip entry to read, or NULL for the first */
+    const char* spill_dir; /* keep stored lines in a temporary file here, or NULL */
+    int compress_ring;     /* keep stored lines zstd-compressed */
+    int use_threads;       /* decode and parse on separate threads (default 1) */
+    int all_entries;       /* tail every zip entry under a "==> name:entry <==" header */
+    const char* member;    /* name or glob of the tar members to tail, or NULL */
+    const char* format;    /* "gzip", "zstd", ... to skip detection, or NULL */
+    const char* zstd_dict; /* zstd dictionary file, loaded for the process, or NULL */
+    int no_cache;          /* drop the inputs from the page cache as they are read */
+    int direct_io;         /* with no_cache, read compressed inputs with O_DIRECT */
+    ztail_warn_fn warn;    /* receives the warnings, or NULL to drop them */
+    void* warn_user;       /* passed to warn */
+} ztail_options;
+
+/* A line without its newline; valid as long as its result (or, for plain
+ * buffers, the buffer) is. */
+typedef struct ztail_span {
+    const char* data;
+    size_t size;
+} ztail_span;
+
+/* Receives the output in order, in blocks of newline-terminated lines. */
+typedef void (*ztail_write_fn)(void* user, const char* data, size_t size);
+
+void ztail_options_init(ztail_options* options);
+
+ztail_engine* ztail_engine_new(const ztail_options* options);
+void ztail_engine_free(ztail_engine* engine);
+
+/* An engine may be shared between threads. */
+int ztail_tail_file(const ztail_engine* engine, const char* path, ztail_write_fn write, void* user);
+int ztail_tail_fd(const ztail_engine* engine, int fd, ztail_write_fn write, void* user);
+int ztail_tail_buffer(const ztail_engine* engine, const void* data, size_t size, ztail_write_fn write, void* user);
+
+ztail_result* ztail_tail_file_lines(const ztail_engine* engine, const char* path);
+ztail_result* ztail_tail_fd_lines(const ztail_engine* engine, int fd);
+/* Plain buffers are not copied: the spans point into data. */
+ztail_result* ztail_tail_buffer_lines(const ztail_engine* engine, const void* data, size_t size);
+
+size_t ztail_result_size(const ztail_result* result);
+ztail_span ztail_result_line(const ztail_result* result, size_t i);
+void ztail_result_free(ztail_result* result);
+
+const char* ztail_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TAIL_ENGINE_C_H */
@@ -1,28 +1,130 @@
 #include "tail_plain.h"
-#include <fstream>
+#include "compressed_ring_buffer.h"
 #include <algorithm>
 #include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void tailPlainFile(const std::string& filename, Parser& parser, size_t n, size_t bufferSize) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Failed to open file: " + filename);
+namespace {
+
+void readFully(int fd, char* buf, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t r = ::pread(fd, buf, len, static_cast<off_t>(offset));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("read error (" + std::to_string(errno) + ") while tailing plain input");
+        }
+        if (r == 0) {
+            throw std::runtime_error("unexpected end of plain input");
+        }
+        buf += r;
+        len -= static_cast<size_t>(r);
+        offset += static_cast<uint64_t>(r);
+    }
+}
+
+// Walks [begin, end) backwards and returns the offset of the first byte of
+// the n-th last (matching) line.  A trailing newline does not start an extra
+// empty line.
+uint64_t findTailStart(int fd, uint64_t begin, uint64_t end, size_t n, size_t bufferSize,
+                       const LineFilter* filter) {
+    if (n == 0) {
+        return end;
+    }
+    if (end <= begin) {
+        return begin;
+    }
+
+    std::vector<char> chunk(bufferSize);
+    uint64_t limit = end;
+    char lastByte = 0;
+    readFully(fd, &lastByte, 1, end - 1);
+    if (lastByte == '\n') {
+        --limit;
+    }
+
+    std::string carry; // start of the line that continues into the next chunk
+    size_t found = 0;
+    uint64_t pos = limit;
+    while (pos > begin) {
+        size_t toRead = static_cast<size_t>(std::min<uint64_t>(bufferSize, pos - begin));
+        uint64_t chunkStart = pos - toRead;
+        readFully(fd, chunk.data(), toRead, chunkStart);
+
+        const char* base = chunk.data();
+        const char* lineEnd = base + toRead;
+        while (const char* nl = static_cast<const char*>(
+                   memrchr(base, '\n', static_cast<size_t>(lineEnd - base)))) {
+            const char* lineStart = nl + 1;
+            bool counted = true;
+            if (filter) {
+                if (carry.empty()) {
+                    counted = filter->matches(lineStart, static_cast<size_t>(lineEnd - lineStart));
+                } else {
+                    carry.insert(0, lineStart, static_cast<size_t>(lineEnd - lineStart));
+                    counted = filter->matches(carry.data(), carry.size());
+                    carry.clear();
+                }
+            }
+            if (counted && ++found >= n) {
+                return chunkStart + static_cast<uint64_t>(lineStart - base);
+            }
+            lineEnd = nl;
+        }
+        if (filter) {
+            carry.insert(0, base, static_cast<size_t>(lineEnd - base));
+        }
+        pos = chunkStart;
     }
+    return begin;
+}
+
+} // namespace
 
-    file.seekg(0, std::ios::end);
-    std::streamoff size = file.tellg();
-    std::string chunk(bufferSize, '\0');
-    size_t lines = 0;
+template <typename Buffer>
+void tailPlainRange(int fd, uint64_t begin, uint64_t end, BasicParser<Buffer>& parser, size_t n, size_t bufferSize) {
+    uint64_t pos = findTailStart(fd, begin, end, n, bufferSize, parser.lineFilter());
 
-    while (size > 0 && lines <= n) {
-        size_t toRead = static_cast<size_t>(std::min<std::streamoff>(bufferSize, size));
-        size -= toRead;
-        file.seekg(size, std::ios::beg);
-        file.read(&chunk[0], toRead);
-        lines += static_cast<size_t>(std::count(chunk.begin(), chunk.begin() + toRead, '\n'));
+    std::vector<char> chunk(bufferSize);
+    while (pos < end) {
+        size_t toRead = static_cast<size_t>(std::min<uint64_t>(bufferSize, end - pos));
+        readFully(fd, chunk.data(), toRead, pos);
         parser.parse(chunk.data(), toRead);
-        if (size == 0) break;
+        pos += toRead;
     }
 
     parser.finalize();
 }
+
+template <typename Buffer>
+void tailPlainFile(const std::string& filename, BasicParser<Buffer>& parser, size_t n, size_t bufferSize) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat file: " + filename);
+    }
+    try {
+        tailPlainRange(fd, 0, static_cast<uint64_t>(st.st_size), parser, n, bufferSize);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+template void tailPlainRange(int, uint64_t, uint64_t, Parser&, size_t, size_t);
+template void tailPlainFile(const std::string&, Parser&, size_t, size_t);
+template void tailPlainRange(int, uint64_t, uint64_t, BasicParser<CompressedRingBuffer>&, size_t, size_t);
+template void tailPlainFile(const std::string&, BasicParser<CompressedRingBuffer>&, size_t, size_t);
+#ifdef USE_CHAR_RING_BUFFER
+template void tailPlainRange(int, uint64_t, uint64_t, WideParser&, size_t, size_t);
+template void tailPlainFile(const std::string&, WideParser&, size_t, size_t);
+#endif
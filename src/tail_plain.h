@@ -2,8 +2,17 @@
 #define TAIL_PLAIN_H
 
 #include <string>
+#include <cstdint>
 #include "parser.h"
 
-void tailPlainFile(const std::string& filename, Parser& parser, size_t n, size_t bufferSize);
+// These work with Parser, WideParser and BasicParser<CompressedRingBuffer>.
+template <typename Buffer>
+void tailPlainFile(const std::string& filename, BasicParser<Buffer>& parser, size_t n, size_t bufferSize);
+
+// Tails the uncompressed byte range [begin, end) of an open descriptor.  The
+// range is scanned backwards until n lines (n matching lines when the parser
+// has a filter) are found and only those bytes are parsed, in file order.
+template <typename Buffer>
+void tailPlainRange(int fd, uint64_t begin, uint64_t end, BasicParser<Buffer>& parser, size_t n, size_t bufferSize);
 
 #endif
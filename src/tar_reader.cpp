@@ -0,0 +1,364 @@
+#include "tar_reader.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fnmatch.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t TAR_BLOCK = 512;
+constexpr uint64_t MAX_METADATA = 16 << 20; // pax and GNU long name records
+
+class StreamTarSource : public TarSource {
+public:
+    explicit StreamTarSource(std::unique_ptr<ICompressor> source)
+        : source(std::move(source)), buffer(1 << 20), pos(0), size(0), eof(false) {}
+
+    size_t read(char* out, size_t len) override {
+        if (pos == size && !fill()) {
+            return 0;
+        }
+        const size_t n = std::min(len, size - pos);
+        std::memcpy(out, buffer.data() + pos, n);
+        pos += n;
+        return n;
+    }
+
+    uint64_t skip(uint64_t count) override {
+        uint64_t skipped = 0;
+        while (skipped < count && (pos < size || fill())) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(count - skipped, size - pos));
+            pos += n;
+            skipped += n;
+        }
+        return skipped;
+    }
+
+private:
+    bool fill() {
+        size_t n = 0;
+        if (eof || !source->decompress(buffer, n) || n == 0) {
+            eof = true;
+            return false;
+        }
+        pos = 0;
+        size = n;
+        return true;
+    }
+
+    std::unique_ptr<ICompressor> source;
+    std::vector<char> buffer;
+    size_t pos;
+    size_t size;
+    bool eof;
+};
+
+class FileTarSource : public TarSource {
+public:
+    FileTarSource(int fd, uint64_t fileSize) : fd(fd), fileSize(fileSize), pos(0) {}
+
+    size_t read(char* out, size_t len) override {
+        if (pos >= fileSize) {
+            return 0;
+        }
+        TraceSpan span("read");
+        ssize_t r;
+        do {
+            r = ::pread(fd, out, static_cast<size_t>(std::min<uint64_t>(len, fileSize - pos)),
+                        static_cast<off_t>(pos));
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            throw std::runtime_error("read error (" + std::to_string(errno) + ") in tar archive");
+        }
+        pos += static_cast<uint64_t>(r);
+        return static_cast<size_t>(r);
+    }
+
+    uint64_t skip(uint64_t count) override {
+        const uint64_t n = std::min(count, fileSize - std::min(pos, fileSize));
+        pos += n;
+        return n;
+    }
+
+private:
+    int fd;
+    uint64_t fileSize;
+    uint64_t pos;
+};
+
+class BlockTarSource : public TarSource {
+public:
+    BlockTarSource(int fd, CompressionType type, std::vector<CompressedBlock> blocks)
+        : decoder(fd, type), blocks(std::move(blocks)), starts(1, 0), loaded(SIZE_MAX), pos(0)
+    {
+        for (const CompressedBlock& b : this->blocks) {
+            starts.push_back(starts.back() + b.rawSize);
+        }
+    }
+
+    size_t read(char* out, size_t len) override {
+        if (loaded == SIZE_MAX || pos < starts[loaded] || pos >= starts[loaded + 1]) {
+            // Blocks a skip passed over are never decoded.
+            const size_t k = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), pos) -
+                                                 starts.begin()) - 1;
+            if (k >= blocks.size()) {
+                return 0;
+            }
+            decoder.decode(blocks[k], data);
+            if (data.size() != blocks[k].rawSize) {
+                throw std::runtime_error("block at offset " + std::to_string(blocks[k].offset) +
+                                         " decoded to an unexpected size");
+            }
+            loaded = k;
+        }
+        const size_t offset = static_cast<size_t>(pos - starts[loaded]);
+        const size_t n = std::min(len, data.size() - offset);
+        std::memcpy(out, data.data() + offset, n);
+        pos += n;
+        return n;
+    }
+
+    uint64_t skip(uint64_t count) override {
+        const uint64_t n = std::min(count, starts.back() - pos);
+        pos += n;
+        return n;
+    }
+
+private:
+    BlockDecoder decoder;
+    std::vector<CompressedBlock> blocks;
+    std::vector<uint64_t> starts; // decoded offset of each block, then the total
+    std::vector<char> data;       // the decoded block loaded
+    size_t loaded;
+    uint64_t pos;
+};
+
+// Numeric header fields are octal, or big-endian base-256 when the high bit
+// of the first byte is set (GNU, for sizes of 8 GiB and more).
+uint64_t parseNumber(const char* field, size_t len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(field);
+    uint64_t value = 0;
+    if (p[0] & 0x80) {
+        value = p[0] & 0x3f;
+        for (size_t i = 1; i < len; ++i) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < len && p[i] == ' ') {
+        ++i;
+    }
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i) {
+        value = (value << 3) | (p[i] - '0');
+    }
+    return value;
+}
+
+bool validChecksum(const char* header) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(header);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; ++i) {
+        sum += (i >= 148 && i < 156) ? ' ' : p[i];
+    }
+    return sum == parseNumber(header + 148, 8);
+}
+
+std::string field(const char* p, size_t len) {
+    return std::string(p, strnlen(p, len));
+}
+
+// Applies the path and size records of a pax extended header.
+void applyPax(const std::string& records, std::string& path, uint64_t& size, bool& hasSize) {
+    size_t pos = 0;
+    while (pos < records.size()) {
+        const size_t space = records.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        const uint64_t len = std::strtoull(records.c_str() + pos, nullptr, 10);
+        if (len <= space - pos || pos + len > records.size()) {
+            break;
+        }
+        const std::string record = records.substr(space + 1, pos + len - space - 2); // without the newline
+        const size_t eq = record.find('=');
+        if (eq != std::string::npos) {
+            const std::string key = record.substr(0, eq);
+            if (key == "path") {
+                path = record.substr(eq + 1);
+            } else if (key == "size") {
+                size = std::strtoull(record.c_str() + eq + 1, nullptr, 10);
+                hasSize = true;
+            }
+        }
+        pos += len;
+    }
+}
+
+} // namespace
+
+std::unique_ptr<TarSource> streamTarSource(std::unique_ptr<ICompressor> source) {
+    return std::make_unique<StreamTarSource>(std::move(source));
+}
+
+std::unique_ptr<TarSource> fileTarSource(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("stat error (" + std::to_string(errno) + ") while opening tar archive");
+    }
+    return std::make_unique<FileTarSource>(fd, static_cast<uint64_t>(st.st_size));
+}
+
+std::unique_ptr<TarSource> blockTarSource(int fd, CompressionType type, std::vector<CompressedBlock> blocks,
+                                          uint64_t maxBlockBytes) {
+    // lz4 blocks record only an upper bound of their decoded size.
+    if (blocks.size() < 2 || type == CompressionType::LZ4 ||
+        std::any_of(blocks.begin(), blocks.end(), [&](const CompressedBlock& b) {
+            return b.rawSize == 0 || b.rawSize > maxBlockBytes;
+        })) {
+        return nullptr;
+    }
+    return std::make_unique<BlockTarSource>(fd, type, std::move(blocks));
+}
+
+bool isTarGlob(const std::string& pattern) {
+    return pattern.find_first_of("*?[") != std::string::npos;
+}
+
+TarReader::TarReader(std::unique_ptr<TarSource> source, const std::string& name)
+    : source(std::move(source)), current{"", 0, 0}, position(0), remaining(0), padding(0), ended(false), name(name)
+{
+}
+
+bool TarReader::readHeader(char* header) {
+    size_t got = 0;
+    while (got < TAR_BLOCK) {
+        const size_t n = source->read(header + got, TAR_BLOCK - got);
+        if (n == 0) {
+            break;
+        }
+        got += n;
+    }
+    position += got;
+    if (got == 0) {
+        return false; // archive without its end-of-archive blocks
+    }
+    if (got < TAR_BLOCK) {
+        throw std::runtime_error("tar error: truncated header at offset " + std::to_string(position - got) +
+                                 " in '" + name + "'");
+    }
+    if (std::all_of(header, header + TAR_BLOCK, [](char c) { return c == 0; })) {
+        return false;
+    }
+    if (!validChecksum(header)) {
+        throw std::runtime_error("tar error: bad header checksum at offset " +
+                                 std::to_string(position - TAR_BLOCK) + " in '" + name + "'");
+    }
+    return true;
+}
+
+std::string TarReader::readData(uint64_t size) {
+    if (size > MAX_METADATA) {
+        throw std::runtime_error("tar error: extended header of " + std::to_string(size) + " bytes in '" + name + "'");
+    }
+    std::string data(static_cast<size_t>(size), '\0');
+    size_t got = 0;
+    while (got < data.size()) {
+        const size_t n = source->read(&data[got], data.size() - got);
+        if (n == 0) {
+            throw std::runtime_error("tar error: unexpected end of archive '" + name + "'");
+        }
+        got += n;
+    }
+    position += size;
+    skip((TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK);
+    return data;
+}
+
+void TarReader::skip(uint64_t count) {
+    const uint64_t n = source->skip(count);
+    position += n;
+    if (n < count) {
+        throw std::runtime_error("tar error: unexpected end of archive '" + name + "'");
+    }
+}
+
+bool TarReader::nextMember(const std::string& pattern) {
+    skip(remaining + padding);
+    remaining = 0;
+    padding = 0;
+
+    char header[TAR_BLOCK];
+    std::string longName;
+    std::string paxPath;
+    uint64_t paxSize = 0;
+    bool hasPaxSize = false;
+    while (!ended) {
+        if (!readHeader(header)) {
+            ended = true;
+            break;
+        }
+        const char type = header[156];
+        uint64_t size = parseNumber(header + 124, 12);
+        if (type == 'x' || type == 'L') {
+            std::string data = readData(size);
+            if (type == 'x') {
+                applyPax(data, paxPath, paxSize, hasPaxSize);
+            } else {
+                longName = field(data.data(), data.size());
+            }
+            continue;
+        }
+
+        std::string path = field(header, 100);
+        // Only POSIX headers have a prefix; GNU ones ("ustar  ") keep times there.
+        if (std::memcmp(header + 257, "ustar", 6) == 0 && header[345] != 0) {
+            path = field(header + 345, 155) + "/" + path;
+        }
+        if (!longName.empty()) {
+            path = longName;
+        }
+        if (!paxPath.empty()) {
+            path = paxPath;
+        }
+        if (hasPaxSize) {
+            size = paxSize;
+        }
+        longName.clear();
+        paxPath.clear();
+        hasPaxSize = false;
+
+        const uint64_t pad = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+        const bool regular = type == '0' || type == '\0' || type == '7';
+        const char* bare = path.compare(0, 2, "./") == 0 ? path.c_str() + 2 : path.c_str();
+        if (regular && (fnmatch(pattern.c_str(), path.c_str(), 0) == 0 || fnmatch(pattern.c_str(), bare, 0) == 0)) {
+            current = TarMember{path, size, position};
+            remaining = size;
+            padding = pad;
+            return true;
+        }
+        skip(size + pad);
+    }
+    return false;
+}
+
+bool TarReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    size_t produced = 0;
+    const size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, outBuffer.size()));
+    while (produced < want) {
+        const size_t n = source->read(outBuffer.data() + produced, want - produced);
+        if (n == 0) {
+            throw std::runtime_error("tar error: unexpected end of archive '" + name + "' in member '" +
+                                     current.name + "'");
+        }
+        produced += n;
+    }
+    remaining -= produced;
+    position += produced;
+    bytesDecompressed = produced;
+    return produced > 0;
+}
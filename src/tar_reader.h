@@ -0,0 +1,77 @@
+#ifndef TAR_READER_H
+#define TAR_READER_H
+
+#include "compression_type.h"
+#include "icompressor.h"
+#include "seekable_blocks.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The decompressed bytes of a tar archive, read front to back.  skip() drops
+// bytes, without decoding them when the source can seek.
+class TarSource {
+public:
+    virtual ~TarSource() = default;
+    // Fills up to size bytes of out; returns 0 at the end of the data.
+    virtual size_t read(char* out, size_t size) = 0;
+    // Returns the number of bytes dropped, fewer than count at the end.
+    virtual uint64_t skip(uint64_t count) = 0;
+};
+
+// Decodes source to its end; skipped bytes are decoded and dropped.
+std::unique_ptr<TarSource> streamTarSource(std::unique_ptr<ICompressor> source);
+// Reads an uncompressed archive with pread(); skipping is free.
+std::unique_ptr<TarSource> fileTarSource(int fd);
+// Largest decoded block blockTarSource holds by default.
+constexpr uint64_t MAX_TAR_BLOCK = 8u << 20;
+
+// Decodes the blocks of a block-seekable file one at a time, jumping over
+// the blocks a skip passes entirely.  Returns nullptr unless there are
+// several blocks and every one records its exact decoded size (BGZF, xz,
+// zstd frames with a content size) of at most maxBlockBytes: the single
+// frame or block the zstd and xz tools write by default is the whole archive.
+std::unique_ptr<TarSource> blockTarSource(int fd, CompressionType type, std::vector<CompressedBlock> blocks,
+                                          uint64_t maxBlockBytes = MAX_TAR_BLOCK);
+
+struct TarMember {
+    std::string name;
+    uint64_t size;
+    uint64_t offset; // of the first data byte in the decompressed archive
+};
+
+// Walks the ustar, pax and GNU headers of a tar archive and yields the data of
+// the regular files whose names match a glob.  The data of other members is
+// skipped without being parsed as text.
+class TarReader : public ICompressor {
+public:
+    TarReader(std::unique_ptr<TarSource> source, const std::string& name);
+
+    // Moves to the next regular file whose name, with any leading "./",
+    // matches pattern (see fnmatch(3)).  Returns false at the end of the
+    // archive.  Data of the current member that was not read is skipped.
+    bool nextMember(const std::string& pattern);
+    const TarMember& member() const { return current; }
+
+    // Yields the data of the current member.
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    bool readHeader(char* header);
+    std::string readData(uint64_t size);
+    void skip(uint64_t count);
+
+    std::unique_ptr<TarSource> source;
+    TarMember current;
+    uint64_t position;  // in the decompressed archive
+    uint64_t remaining; // data bytes of the current member not read yet
+    uint64_t padding;   // bytes from its end to the next header
+    bool ended;
+    std::string name;
+};
+
+// True when pattern has glob metacharacters and may select several members.
+bool isTarGlob(const std::string& pattern);
+
+#endif // TAR_READER_H
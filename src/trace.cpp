@@ -0,0 +1,198 @@
+#include "trace.h"
+#include "json_util.h"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+TraceRecorder* TraceRecorder::current = nullptr;
+
+namespace {
+
+// The counter group of one thread: cycles (leader), instructions and LLC
+// misses, counted in user space for that thread only.
+class ThreadCounters {
+public:
+    ThreadCounters() {
+#if defined(__linux__)
+        const uint64_t configs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+        for (size_t i = 0; i < 3; ++i) {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                close();
+                return;
+            }
+        }
+        ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    ~ThreadCounters() { close(); }
+
+    bool ok() const { return fds[0] >= 0; }
+
+    bool read(uint64_t values[3]) const {
+        struct {
+            uint64_t nr;
+            uint64_t values[3];
+        } group;
+        if (!ok() || ::read(fds[0], &group, sizeof(group)) != static_cast<ssize_t>(sizeof(group)) || group.nr != 3) {
+            return false;
+        }
+        std::memcpy(values, group.values, sizeof(group.values));
+        return true;
+    }
+
+private:
+    void close() {
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    int fds[3] = {-1, -1, -1};
+};
+
+ThreadCounters& threadCounters() {
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder(const std::string& path)
+    : path(path), origin(std::chrono::steady_clock::now()), countersEnabled(threadCounters().ok()),
+      finished(false), nextTid(1)
+{
+}
+
+TraceRecorder::~TraceRecorder() {
+    if (current == this) {
+        current = nullptr;
+    }
+}
+
+double TraceRecorder::nowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+uint32_t TraceRecorder::threadId() {
+    thread_local const TraceRecorder* owner = nullptr;
+    thread_local uint32_t tid = 0;
+    if (owner != this) {
+        std::lock_guard<std::mutex> lock(m);
+        owner = this;
+        tid = nextTid++;
+    }
+    return tid;
+}
+
+bool TraceRecorder::readCounters(Counters& out) {
+    uint64_t values[3];
+    if (!countersEnabled || !threadCounters().read(values)) {
+        return false;
+    }
+    out.cycles = values[0];
+    out.instructions = values[1];
+    out.llcMisses = values[2];
+    return true;
+}
+
+void TraceRecorder::nameThread(const std::string& name) {
+    const uint32_t tid = threadId();
+    std::lock_guard<std::mutex> lock(m);
+    threadNames.emplace_back(tid, name);
+}
+
+void TraceRecorder::record(const Event& event) {
+    std::lock_guard<std::mutex> lock(m);
+    if (!finished) {
+        events.push_back(event);
+    }
+}
+
+void TraceRecorder::finish() {
+    std::vector<Event> done;
+    std::vector<std::pair<uint32_t, std::string>> names;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (finished) {
+            return;
+        }
+        finished = true;
+        done.swap(events);
+        names.swap(threadNames);
+    }
+
+    const long pid = static_cast<long>(::getpid());
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    auto separator = [&]() {
+        out << (first ? "" : ",\n");
+        first = false;
+    };
+    for (const auto& n : names) {
+        separator();
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << n.first
+            << ", \"args\": {\"name\": " << jsonString(n.second) << "}}";
+    }
+    for (const auto& e : done) {
+        separator();
+        out << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": " << pid << ", \"tid\": " << e.tid
+            << ", \"ts\": " << e.startUs << ", \"dur\": " << e.durationUs;
+        if (e.hasCounters) {
+            out << ", \"args\": {\"cycles\": " << e.counters.cycles << ", \"instructions\": " << e.counters.instructions
+                << ", \"llc_misses\": " << e.counters.llcMisses << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+
+    std::ofstream ofs(path, std::ios::trunc);
+    ofs << out.str();
+    if (!ofs) {
+        throw std::runtime_error("Failed to write trace: " + path);
+    }
+}
+
+void TraceSpan::begin() {
+    hasCounters = recorder->readCounters(startCounters);
+    startUs = recorder->nowUs();
+}
+
+void TraceSpan::end() {
+    TraceRecorder::Event event;
+    event.durationUs = recorder->nowUs() - startUs;
+    event.name = name;
+    event.tid = recorder->threadId();
+    event.startUs = startUs;
+    event.hasCounters = false;
+    TraceRecorder::Counters endCounters;
+    if (hasCounters && recorder->readCounters(endCounters)) {
+        event.hasCounters = true;
+        event.counters.cycles = endCounters.cycles - startCounters.cycles;
+        event.counters.instructions = endCounters.instructions - startCounters.instructions;
+        event.counters.llcMisses = endCounters.llcMisses - startCounters.llcMisses;
+    }
+    recorder->record(event);
+}
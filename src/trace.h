@@ -0,0 +1,100 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Collects spans for --trace and writes them as Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev).  Spans are recorded per thread; where
+// perf_event_open is permitted each span also carries the cycles,
+// instructions and last level cache misses of its thread.
+//
+// One recorder is active at a time, so instrumented code anywhere in the
+// pipeline opens a TraceSpan without a recorder being passed down to it.
+class TraceRecorder {
+public:
+    explicit TraceRecorder(const std::string& path);
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // The recorder spans go to, or nullptr when tracing is off.
+    static TraceRecorder* active() { return current; }
+    void activate() { current = this; }
+
+    // Names the calling thread in the trace viewer.
+    void nameThread(const std::string& name);
+
+    // Writes the trace file; later spans are dropped.  Throws on I/O errors.
+    void finish();
+
+    // False when perf_event_open failed; the trace then has timings only.
+    bool countersAvailable() const { return countersEnabled; }
+
+private:
+    friend class TraceSpan;
+
+    struct Counters {
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t llcMisses = 0;
+    };
+    struct Event {
+        const char* name;
+        uint32_t tid;
+        double startUs;
+        double durationUs;
+        bool hasCounters;
+        Counters counters;
+    };
+
+    double nowUs() const;
+    uint32_t threadId();
+    bool readCounters(Counters& out);
+    void record(const Event& event);
+
+    static TraceRecorder* current;
+
+    std::string path;
+    std::chrono::steady_clock::time_point origin;
+    bool countersEnabled;
+    bool finished;
+    std::mutex m;
+    std::vector<Event> events;
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+    uint32_t nextTid;
+};
+
+// Records one span on the active recorder; costs a null check when tracing
+// is off.  name must be a string literal.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : recorder(TraceRecorder::active()), name(name) {
+        if (recorder) {
+            begin();
+        }
+    }
+    ~TraceSpan() {
+        if (recorder) {
+            end();
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    void begin();
+    void end();
+
+    TraceRecorder* recorder;
+    const char* name;
+    double startUs = 0;
+    bool hasCounters = false;
+    TraceRecorder::Counters startCounters;
+};
+
+#endif // TRACE_H
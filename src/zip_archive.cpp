@@ -0,0 +1,214 @@
+#include "zip_archive.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t EOCD_SIG = 0x06054b50;
+constexpr uint32_t ZIP64_LOCATOR_SIG = 0x07064b50;
+constexpr uint32_t ZIP64_EOCD_SIG = 0x06064b50;
+constexpr uint32_t CENTRAL_SIG = 0x02014b50;
+constexpr uint32_t LOCAL_SIG = 0x04034b50;
+constexpr size_t EOCD_SIZE = 22;
+constexpr size_t MAX_COMMENT = 0xffff;
+constexpr size_t CENTRAL_SIZE = 46;
+constexpr size_t LOCAL_SIZE = 30;
+
+bool readAt(int fd, void* buf, size_t len, uint64_t offset) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t r = ::pread(fd, p, len, static_cast<off_t>(offset));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        len -= static_cast<size_t>(r);
+        offset += static_cast<uint64_t>(r);
+    }
+    return true;
+}
+
+uint32_t le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+uint32_t le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+uint64_t le64(const unsigned char* p) {
+    return static_cast<uint64_t>(le32(p)) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+}
+
+std::runtime_error malformed(const std::string& what) {
+    return std::runtime_error("zip error: " + what);
+}
+
+// Replaces the 0xffffffff placeholders of a central record with the values
+// of its zip64 extended information field, which lists only those.
+void applyZip64Extra(ZipEntry& entry, const unsigned char* extra, size_t len) {
+    for (size_t i = 0; i + 4 <= len;) {
+        const uint32_t id = le16(extra + i);
+        const size_t size = le16(extra + i + 2);
+        if (i + 4 + size > len) {
+            break;
+        }
+        if (id == 0x0001) {
+            const unsigned char* p = extra + i + 4;
+            const unsigned char* end = p + size;
+            for (uint64_t* field : {&entry.size, &entry.compressedSize, &entry.headerOffset}) {
+                if (*field == 0xffffffffu && p + 8 <= end) {
+                    *field = le64(p);
+                    p += 8;
+                }
+            }
+            return;
+        }
+        i += 4 + size;
+    }
+}
+
+} // namespace
+
+std::vector<ZipEntry> readZipDirectory(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("stat error (" + std::to_string(errno) + ") while reading zip directory");
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    if (fileSize < EOCD_SIZE) {
+        throw malformed("no end of central directory");
+    }
+
+    // The end record sits before a comment of at most 64 KiB.
+    const size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, EOCD_SIZE + MAX_COMMENT));
+    std::vector<unsigned char> tail(tailSize);
+    if (!readAt(fd, tail.data(), tail.size(), fileSize - tailSize)) {
+        throw malformed("cannot read end of central directory");
+    }
+    size_t eocd = tailSize - EOCD_SIZE + 1;
+    do {
+        --eocd;
+    } while (eocd > 0 && le32(&tail[eocd]) != EOCD_SIG);
+    if (le32(&tail[eocd]) != EOCD_SIG) {
+        throw malformed("no end of central directory");
+    }
+    const uint64_t eocdOffset = fileSize - tailSize + eocd;
+    uint64_t count = le16(&tail[eocd + 10]);
+    uint64_t cdSize = le32(&tail[eocd + 12]);
+    uint64_t cdOffset = le32(&tail[eocd + 16]);
+
+    if ((count == 0xffff || cdSize == 0xffffffffu || cdOffset == 0xffffffffu) && eocdOffset >= 20) {
+        unsigned char locator[20];
+        unsigned char record[56];
+        if (readAt(fd, locator, sizeof(locator), eocdOffset - 20) && le32(locator) == ZIP64_LOCATOR_SIG &&
+            readAt(fd, record, sizeof(record), le64(locator + 8)) && le32(record) == ZIP64_EOCD_SIG) {
+            count = le64(record + 32);
+            cdSize = le64(record + 40);
+            cdOffset = le64(record + 48);
+        }
+    }
+    if (cdOffset + cdSize > fileSize) {
+        throw malformed("central directory past the end of the file");
+    }
+
+    std::vector<unsigned char> cd(static_cast<size_t>(cdSize));
+    if (!readAt(fd, cd.data(), cd.size(), cdOffset)) {
+        throw malformed("cannot read central directory");
+    }
+    std::vector<ZipEntry> entries;
+    entries.reserve(static_cast<size_t>(std::min<uint64_t>(count, cd.size() / CENTRAL_SIZE)));
+    size_t pos = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (pos + CENTRAL_SIZE > cd.size() || le32(&cd[pos]) != CENTRAL_SIG) {
+            throw malformed("bad central directory record " + std::to_string(i));
+        }
+        const unsigned char* r = &cd[pos];
+        const size_t nameLen = le16(r + 28);
+        const size_t extraLen = le16(r + 30);
+        const size_t commentLen = le16(r + 32);
+        if (pos + CENTRAL_SIZE + nameLen + extraLen + commentLen > cd.size()) {
+            throw malformed("bad central directory record " + std::to_string(i));
+        }
+        ZipEntry entry;
+        entry.name.assign(reinterpret_cast<const char*>(r + CENTRAL_SIZE), nameLen);
+        entry.flags = static_cast<uint16_t>(le16(r + 8));
+        entry.method = static_cast<uint16_t>(le16(r + 10));
+        entry.crc = le32(r + 16);
+        entry.compressedSize = le32(r + 20);
+        entry.size = le32(r + 24);
+        entry.headerOffset = le32(r + 42);
+        applyZip64Extra(entry, r + CENTRAL_SIZE + nameLen, extraLen);
+        entries.push_back(std::move(entry));
+        pos += CENTRAL_SIZE + nameLen + extraLen + commentLen;
+    }
+    return entries;
+}
+
+uint64_t zipDataOffset(int fd, const ZipEntry& entry) {
+    unsigned char header[LOCAL_SIZE];
+    if (!readAt(fd, header, sizeof(header), entry.headerOffset) || le32(header) != LOCAL_SIG) {
+        throw malformed("bad local header for '" + entry.name + "'");
+    }
+    return entry.headerOffset + LOCAL_SIZE + le16(header + 26) + le16(header + 28);
+}
+
+ZipDeflateReader::ZipDeflateReader(int fd, uint64_t dataOffset, uint64_t compressedSize, uint32_t crc,
+                                   const std::string& name, size_t inBufferSize)
+    : fd(fd), offset(dataOffset), remaining(compressedSize), expectedCrc(crc), crc(crc32(0, Z_NULL, 0)),
+      inBuffer(inBufferSize), zs(), eof(false), name(name)
+{
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        throw std::runtime_error("zlib error (0) while initializing '" + name + "'");
+    }
+}
+
+ZipDeflateReader::~ZipDeflateReader() {
+    inflateEnd(&zs);
+}
+
+bool ZipDeflateReader::decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) {
+    if (eof) {
+        bytesDecompressed = 0;
+        return false;
+    }
+
+    size_t produced = 0;
+    while (produced < outBuffer.size()) {
+        if (zs.avail_in == 0 && remaining > 0) {
+            TraceSpan span("read");
+            const size_t len = static_cast<size_t>(std::min<uint64_t>(remaining, inBuffer.size()));
+            if (!readAt(fd, inBuffer.data(), len, offset)) {
+                throw std::runtime_error("read error (" + std::to_string(errno) + ") in '" + name + "'");
+            }
+            offset += len;
+            remaining -= len;
+            zs.next_in = reinterpret_cast<Bytef*>(inBuffer.data());
+            zs.avail_in = static_cast<uInt>(len);
+        }
+        const uInt room = static_cast<uInt>(std::min<size_t>(outBuffer.size() - produced, UINT_MAX));
+        zs.next_out = reinterpret_cast<Bytef*>(outBuffer.data() + produced);
+        zs.avail_out = room;
+        const int ret = inflate(&zs, Z_NO_FLUSH);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(outBuffer.data() + produced), room - zs.avail_out);
+        produced += room - zs.avail_out;
+        if (ret == Z_STREAM_END) {
+            eof = true;
+            if (static_cast<uint32_t>(crc) != expectedCrc) {
+                throw std::runtime_error("zlib error (" + std::to_string(Z_DATA_ERROR) + ") CRC-32 mismatch in '" +
+                                         name + "'");
+            }
+            break;
+        }
+        if (ret == Z_BUF_ERROR && zs.avail_in == 0 && remaining == 0) {
+            throw std::runtime_error("zlib error (" + std::to_string(ret) + ") truncated entry '" + name + "'");
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw std::runtime_error("zlib error (" + std::to_string(ret) + ") while decompressing '" + name + "'");
+        }
+    }
+
+    bytesDecompressed = produced;
+    return bytesDecompressed > 0;
+}
@@ -0,0 +1,61 @@
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+#include <zlib.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "icompressor.h"
+
+constexpr uint16_t ZIP_METHOD_STORE = 0;
+constexpr uint16_t ZIP_METHOD_DEFLATE = 8;
+
+// One central directory record of a zip archive.
+struct ZipEntry {
+    std::string name;
+    uint16_t method;         // compression method, ZIP_METHOD_*
+    uint16_t flags;          // general purpose bits; bit 0 marks encryption
+    uint32_t crc;            // CRC-32 of the uncompressed data
+    uint64_t compressedSize;
+    uint64_t size;
+    uint64_t headerOffset;   // of the local file header
+
+    bool isDirectory() const { return !name.empty() && name.back() == '/'; }
+    bool encrypted() const { return (flags & 1) != 0; }
+};
+
+// Reads the central directory of the zip archive open on fd, zip64 records
+// included, in directory order.  Throws std::runtime_error when the archive
+// has no readable end of central directory.
+std::vector<ZipEntry> readZipDirectory(int fd);
+
+// File offset of the first data byte of entry, past its local header.
+uint64_t zipDataOffset(int fd, const ZipEntry& entry);
+
+// Inflates one deflated entry straight from the archive with pread(), so
+// several readers may share a descriptor.  The CRC-32 of the inflated data
+// is checked against crc at the end of the entry, as libzip does.
+class ZipDeflateReader : public ICompressor {
+public:
+    ZipDeflateReader(int fd, uint64_t dataOffset, uint64_t compressedSize, uint32_t crc, const std::string& name,
+                     size_t inBufferSize = 1 << 16);
+    ~ZipDeflateReader();
+
+    ZipDeflateReader(const ZipDeflateReader&) = delete;
+    ZipDeflateReader& operator=(const ZipDeflateReader&) = delete;
+
+    bool decompress(std::vector<char>& outBuffer, size_t& bytesDecompressed) override;
+
+private:
+    int fd;
+    uint64_t offset;    // next compressed byte to read
+    uint64_t remaining; // compressed bytes not read yet
+    uint32_t expectedCrc;
+    uLong crc;          // of the bytes inflated so far
+    std::vector<char> inBuffer;
+    z_stream zs;
+    bool eof;
+    std::string name;
+};
+
+#endif // ZIP_ARCHIVE_H
@@ -0,0 +1,67 @@
+#include "zstd_dictionary.h"
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+struct Dictionary {
+    std::string content;
+    std::unique_ptr<ZSTD_DDict, decltype(&ZSTD_freeDDict)> ddict;
+};
+
+std::mutex registryMutex;
+
+std::map<unsigned, Dictionary>& registry() {
+    static std::map<unsigned, Dictionary> dictionaries;
+    return dictionaries;
+}
+
+} // namespace
+
+unsigned loadZstdDictionary(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!in.good() && !in.eof()) {
+        throw std::runtime_error("zstd error (" + std::to_string(errno) + ") while reading dictionary '" + path + "'");
+    }
+    if (content.empty()) {
+        throw std::runtime_error("zstd error (empty dictionary) while loading '" + path + "'");
+    }
+    const unsigned id = ZSTD_getDictID_fromDict(content.data(), content.size());
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry().find(id);
+    if (it != registry().end()) {
+        if (it->second.content != content) {
+            throw std::runtime_error("zstd dictionary '" + path + "' has the ID " + std::to_string(id) +
+                                     " of a dictionary loaded before");
+        }
+        return id;
+    }
+    Dictionary dict{std::move(content), {nullptr, &ZSTD_freeDDict}};
+    dict.ddict.reset(ZSTD_createDDict(dict.content.data(), dict.content.size()));
+    if (!dict.ddict) {
+        throw std::runtime_error("zstd error (0) while loading dictionary '" + path + "'");
+    }
+    registry().emplace(id, std::move(dict));
+    return id;
+}
+
+const ZSTD_DDict* zstdDictionaryFor(const void* frame, size_t size, const std::string& name) {
+    const unsigned id = ZSTD_getDictID_fromFrame(frame, size);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = registry().find(id);
+    if (it != registry().end()) {
+        return it->second.ddict.get();
+    }
+    if (id != 0) {
+        throw std::runtime_error("zstd error (dictionary " + std::to_string(id) + " not loaded) while decompressing '" +
+                                 name + "'; pass it with --zstd-dict");
+    }
+    return nullptr;
+}
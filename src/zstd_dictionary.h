@@ -0,0 +1,27 @@
+#ifndef ZSTD_DICTIONARY_H
+#define ZSTD_DICTIONARY_H
+
+#include <cstddef>
+#include <string>
+#include <zstd.h>
+
+// Zstd dictionaries are digested once into a ZSTD_DDict and registered for
+// the whole process under their dictionary ID, so every decoder, on any
+// thread, finds the one a frame header names without being handed it.
+// Registered dictionaries are never freed.
+
+// Loads the dictionary in path and registers it; loading it again does
+// nothing.  Returns its ID, 0 for a raw content dictionary.  Throws when the
+// file cannot be read or another dictionary has the same ID.
+unsigned loadZstdDictionary(const std::string& path);
+
+// The dictionary for the zstd frame at the start of [frame, frame + size):
+// the one its header names, or for frames naming none a raw content
+// dictionary if one was loaded, else nullptr.  Throws when the frame names a
+// dictionary that was not loaded; name is only used in the message.
+const ZSTD_DDict* zstdDictionaryFor(const void* frame, size_t size, const std::string& name);
+
+// Bytes a frame header may take, enough for zstdDictionaryFor().
+constexpr size_t ZSTD_FRAME_HEADER_MAX = 18;
+
+#endif // ZSTD_DICTIONARY_H
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "bloom_sidecar.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include "line_filter.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+
+static std::string request_log(int count) {
+    std::string content;
+    for (int i = 1; i <= count; ++i) {
+        content += "GET /api/items status=200 request_id=req" + std::to_string(i * 7919) + " done\n";
+    }
+    return content;
+}
+
+static std::string tail_with_bloom(const std::string& filename, const std::string& needle, size_t* candidatesOut) {
+    BloomSidecar sidecar;
+    EXPECT_TRUE(sidecar.load(filename));
+    std::vector<bool> candidates = sidecar.candidates(needle);
+    size_t count = 0;
+    for (bool c : candidates) count += c ? 1 : 0;
+    if (candidatesOut) *candidatesOut = count;
+
+    DetectionResult det = detectCompressionType(filename);
+    CandidateBlockReader reader(std::move(det.file), sidecar, candidates);
+    LineFilter filter = LineFilter::literal(needle);
+    CircularBuffer cb(10, 64);
+    Parser parser(cb, 64, &filter);
+    std::vector<char> buf(100);
+    size_t n = 0;
+    while (reader.decompress(buf, n)) {
+        parser.parse(buf.data(), n);
+    }
+    parser.finalize();
+
+    testing::internal::CaptureStdout();
+    cb.print(1 << 20);
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(BloomSidecarTest, SkipsBlocksWithoutNeedle) {
+    const std::string filename = "bloom.bgz";
+    create_bgzf_file(filename, request_log(2000), 4096);
+    ASSERT_GT(BloomSidecar::build(filename), 10u);
+
+    size_t candidates = 0;
+    const std::string id = "req" + std::to_string(1234 * 7919);
+    std::string out = tail_with_bloom(filename, "request_id=" + id + " done", &candidates);
+    EXPECT_EQ(out, "GET /api/items status=200 request_id=req" + std::to_string(1234 * 7919) + " done\n");
+    EXPECT_LE(candidates, 3u);
+
+    std::remove(BloomSidecar::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(BloomSidecarTest, FindsLinesSpanningBlocks) {
+    const std::string filename = "bloom_span.bgz";
+    const std::string content = request_log(200);
+    create_bgzf_file(filename, content, 37); // almost every line crosses a block boundary
+    BloomSidecar::build(filename);
+
+    for (int i : {1, 57, 200}) {
+        const std::string id = "req" + std::to_string(i * 7919);
+        EXPECT_EQ(tail_with_bloom(filename, "=" + id + " ", nullptr),
+                  "GET /api/items status=200 request_id=" + id + " done\n");
+    }
+
+    std::remove(BloomSidecar::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(BloomSidecarTest, NeedleCuttingTokensFindsLines) {
+    const std::string filename = "bloom_partial.bgz";
+    create_bgzf_file(filename, request_log(2000), 4096);
+    BloomSidecar::build(filename);
+
+    // Both ends of the needle are parts of longer tokens of the line; the
+    // id's n-grams still narrow the blocks down.
+    const std::string id = std::to_string(1234 * 7919);
+    size_t candidates = 0;
+    EXPECT_EQ(tail_with_bloom(filename, id.substr(1) + " do", &candidates),
+              "GET /api/items status=200 request_id=req" + id + " done\n");
+    EXPECT_LE(candidates, 3u);
+
+    // A bare id is a substring of its token.
+    EXPECT_EQ(tail_with_bloom(filename, id, &candidates),
+              "GET /api/items status=200 request_id=req" + id + " done\n");
+    EXPECT_LE(candidates, 3u);
+
+    // Cut tokens shorter than an n-gram cannot be looked up.
+    BloomSidecar sidecar;
+    ASSERT_TRUE(sidecar.load(filename));
+    EXPECT_FALSE(sidecar.canPrune(id.substr(3) + " do"));
+    EXPECT_TRUE(sidecar.canPrune(id));
+
+    // Inner tokens are looked up whole.
+    EXPECT_EQ(tail_with_bloom(filename, "st_id=req" + id + " do", &candidates),
+              "GET /api/items status=200 request_id=req" + id + " done\n");
+    EXPECT_LE(candidates, 3u);
+
+    std::remove(BloomSidecar::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(BloomSidecarTest, CorruptSidecarIsIgnored) {
+    const std::string filename = "bloom_corrupt.bgz";
+    create_bgzf_file(filename, request_log(200), 1024);
+    BloomSidecar::build(filename);
+    const std::string path = BloomSidecar::pathFor(filename);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    ASSERT_GT(bytes.size(), 80u);
+    auto loadPatched = [&](size_t offset, const void* value, size_t size) {
+        std::string patched = bytes;
+        patched.replace(offset, size, static_cast<const char*>(value), size);
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << patched;
+        BloomSidecar sidecar;
+        return sidecar.load(filename);
+    };
+
+    // The block count follows the magic, the source stamp, the type, the
+    // hash count and the n-gram length; the first block's filter size
+    // follows its fixed fields.
+    const uint64_t hugeCount = 1ull << 40;
+    EXPECT_FALSE(loadPatched(44, &hugeCount, sizeof(hugeCount)));
+    const uint32_t hugeWords = 0xfffffff0u;
+    EXPECT_FALSE(loadPatched(80, &hugeWords, sizeof(hugeWords)));
+    const uint32_t noGrams = 0;
+    EXPECT_FALSE(loadPatched(40, &noGrams, sizeof(noGrams)));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes.substr(0, bytes.size() / 2);
+    BloomSidecar truncated;
+    EXPECT_FALSE(truncated.load(filename));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+    BloomSidecar intact;
+    EXPECT_TRUE(intact.load(filename));
+
+    std::remove(path.c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(BloomSidecarTest, StaleSidecarIsIgnored) {
+    const std::string filename = "bloom_stale.bgz";
+    create_bgzf_file(filename, request_log(10), 4096);
+    BloomSidecar::build(filename);
+    create_bgzf_file(filename, request_log(20), 4096);
+
+    BloomSidecar sidecar;
+    EXPECT_FALSE(sidecar.load(filename));
+
+    std::remove(BloomSidecar::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "buffer_controller.h"
+#include <vector>
+
+// Feeds one decision window of chunks of the given size and rate.
+static size_t feed_window(BufferController& c, size_t bytes, double bytesPerNs,
+                          uint64_t producerWaitNs = 0, uint64_t consumerWaitNs = 0) {
+    size_t size = c.size();
+    for (unsigned i = 0; i < BufferController::WINDOW; ++i) {
+        size = c.onChunk(bytes, static_cast<uint64_t>(static_cast<double>(bytes) / bytesPerNs),
+                         producerWaitNs, consumerWaitNs);
+    }
+    return size;
+}
+
+TEST(BufferControllerTest, WaitsAWindowBeforeDeciding) {
+    BufferController c(1 << 20, 4 << 20);
+    for (unsigned i = 1; i < BufferController::WINDOW; ++i) {
+        EXPECT_EQ(c.onChunk(1 << 20, 1000000, 0, 0), 1u << 20);
+    }
+    EXPECT_EQ(c.onChunk(1 << 20, 1000000, 0, 0), 2u << 20);
+    EXPECT_EQ(c.grows(), 1u);
+}
+
+TEST(BufferControllerTest, GrowsWhileTheRateImprovesAndTurnsAround) {
+    BufferController c(1 << 20, 8 << 20);
+    EXPECT_EQ(feed_window(c, 1 << 20, 1.0), 2u << 20);
+    EXPECT_EQ(feed_window(c, 2 << 20, 1.5), 4u << 20);
+    EXPECT_EQ(feed_window(c, 4 << 20, 1.0), 2u << 20);  // slower: back off
+    EXPECT_EQ(feed_window(c, 2 << 20, 1.01), 2u << 20); // flat: hold
+    EXPECT_EQ(c.grows(), 2u);
+    EXPECT_EQ(c.shrinks(), 1u);
+    EXPECT_EQ(c.peakSize(), 4u << 20);
+}
+
+TEST(BufferControllerTest, UndoesAGrowthThatDoesNotPay) {
+    BufferController c(1 << 20, 8 << 20);
+    EXPECT_EQ(feed_window(c, 1 << 20, 1.0), 2u << 20);
+    EXPECT_EQ(feed_window(c, 2 << 20, 1.02), 1u << 20);
+    EXPECT_EQ(feed_window(c, 1 << 20, 1.0), 1u << 20);
+    EXPECT_EQ(feed_window(c, 1 << 20, 0.98), 1u << 20);
+}
+
+TEST(BufferControllerTest, StalledProducerShrinksToTheMinimum) {
+    BufferController c(1 << 20, 4 << 20);
+    size_t size = c.size();
+    for (int i = 0; i < 10; ++i) {
+        size = feed_window(c, size, 1.0, 10 * size, 0);
+    }
+    EXPECT_EQ(size, BufferController::MIN_SIZE);
+}
+
+TEST(BufferControllerTest, StaysWithinBounds) {
+    BufferController small(4096, 4096);
+    EXPECT_EQ(feed_window(small, 4096, 1.0), 4096u);
+    EXPECT_EQ(feed_window(small, 4096, 1.0, 1 << 20, 0), 4096u);
+}
+
+TEST(BufferPoolTest, ReusesReleasedBuffers) {
+    BufferPool pool;
+    std::vector<char> a = pool.acquire(1 << 20);
+    const char* data = a.data();
+    pool.release(std::move(a));
+    EXPECT_EQ(pool.pooled(), 1u);
+
+    std::vector<char> b = pool.acquire(512 << 10);
+    EXPECT_EQ(b.data(), data);
+    EXPECT_EQ(b.size(), 512u << 10);
+    EXPECT_EQ(pool.pooled(), 0u);
+
+    pool.release(std::move(b));
+    std::vector<char> tiny = pool.acquire(1024); // far smaller than anything pooled
+    EXPECT_NE(tiny.data(), data);
+    EXPECT_EQ(pool.pooled(), 1u);
+}
+
+TEST(BufferControllerTest, CodecBuffersScaleWithOutput) {
+    EXPECT_EQ(scaleCodecBuffer(32768, 1 << 20, 1 << 20), 32768u);
+    EXPECT_EQ(scaleCodecBuffer(32768, 1 << 20, 4 << 20), 131072u);
+    EXPECT_EQ(scaleCodecBuffer(32768, 1 << 20, 64 << 10), 4096u);
+    EXPECT_EQ(scaleCodecBuffer(32768, 0, 4 << 20), 32768u);
+}
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include "char_ring_buffer.h"
+#include "circular_buffer.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 TEST(CharRingBufferTest, AddAndRetrieve) {
     CharRingBuffer cb(3, 16);
@@ -93,3 +98,124 @@ TEST(CharRingBufferTest, LazyAllocatesData) {
 
     EXPECT_EQ(output, "Hi\n");
 }
+
+TEST(CharRingBufferTest, NonPowerOfTwoCapacityKeepsLastLines) {
+    CharRingBuffer cb(3, 4); // 4 line slots, 12 data bytes
+    for (int i = 0; i < 10; ++i) {
+        std::string line = "L" + std::to_string(i);
+        cb.append_line(line.data(), line.size());
+    }
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "L7\nL8\nL9\n");
+}
+
+TEST(CharRingBufferTest, LineEndingAtDataEndWrapsToStart) {
+    CharRingBuffer cb(2, 0, 8);
+    cb.append_line("abcd", 4);
+    cb.append_line("efgh", 4); // ends exactly at the end of the data
+    cb.append_line("ij", 2);
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "efgh\nij\n");
+}
+
+TEST(CharRingBufferTest, MemoryUsageCountsWrittenBytes) {
+    CharRingBuffer<> cb(4, 100); // 400 bytes of data, 4 offsets
+    const size_t empty = cb.memoryUsage();
+    cb.append_line("0123456789", 10);
+    EXPECT_EQ(cb.memoryUsage(), empty + 10 + sizeof(CharRingBuffer<>::Offset));
+    const std::string line(90, 'x');
+    for (int i = 0; i < 10; ++i) {
+        cb.append_line(line.data(), line.size());
+    }
+    EXPECT_EQ(cb.memoryUsage(), empty + 400 + 4 * sizeof(CharRingBuffer<>::Offset)); // a wrapped ring is fully committed
+}
+
+TEST(CharRingBufferTest, RejectsRingsItsOffsetsCannotAddress) {
+    const size_t tooLarge = static_cast<size_t>(UINT32_MAX) + 1;
+    EXPECT_THROW(CharRingBuffer<>(4, 0, tooLarge), std::runtime_error);
+    EXPECT_THROW(CharRingBuffer<>(10000000, 0), std::runtime_error);
+
+#ifdef USE_CHAR_RING_BUFFER
+    EXPECT_FALSE(needsWideRing(10, 512, 0));
+    EXPECT_TRUE(needsWideRing(10, 512, static_cast<size_t>(UINT32_MAX) + 1));
+    EXPECT_TRUE(needsWideRing(10000000, 0, 0)); // 512 bytes per line once the first line arrives
+#endif
+}
+
+static std::string spilled_tail(const std::vector<std::string>& lines, size_t n) {
+    std::string expected;
+    for (size_t i = lines.size() > n ? lines.size() - n : 0; i < lines.size(); ++i) {
+        expected += lines[i] + "\n";
+    }
+    return expected;
+}
+
+TEST(CharRingBufferTest, SpilledRingKeepsLinesLargerThanItsData) {
+    CharRingBuffer<> cb(2, 4, 0, ".");
+    const std::string big(100000, 'x');
+    cb.append_line("a", 1);
+    cb.append_line(big.data(), big.size());
+    cb.append_segment("b", 1);
+    cb.append_segment("c", 1);
+    cb.end_line();
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), big + "\nbc\n");
+    EXPECT_LT(cb.memoryUsage(), 1024u); // the data is not in memory
+}
+
+TEST(CharRingBufferTest, SpilledRingStaysWithinItsBytesBudget) {
+    CharRingBuffer<> cb(1000, 4, 4096, ".");
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < 2000; ++i) {
+        lines.push_back("line " + std::to_string(i) + std::string(i % 50, '.'));
+        cb.append_segment(lines.back().data(), 3);
+        cb.append_segment(lines.back().data() + 3, lines.back().size() - 3);
+        cb.end_line();
+    }
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    const std::string printed = testing::internal::GetCapturedStdout();
+    EXPECT_LT(printed.size(), 4096u);
+    EXPECT_GT(printed.size(), 4096u - 128); // only whole lines were dropped
+    EXPECT_EQ(printed, spilled_tail(lines, static_cast<size_t>(std::count(printed.begin(), printed.end(), '\n'))));
+
+    // A line longer than the budget grows the file to hold it.
+    const std::string big(10000, 'x');
+    cb.append_line(big.data(), big.size());
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), big + "\n");
+}
+
+TEST(CharRingBufferTest, SpilledRingGrowsWhileWrapped) {
+    CharRingBuffer<> cb(7, 4, 0, ".");
+    std::vector<std::string> lines;
+    unsigned seed = 12345;
+    for (size_t i = 0; i < 3000; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        const size_t len = (seed >> 16) % (i % 500 == 499 ? 5000 : 40);
+        lines.push_back(std::string(len, static_cast<char>('a' + i % 26)));
+        if (i % 3 == 0) {
+            cb.append_segment(lines.back().data(), len / 2);
+            cb.append_segment(lines.back().data() + len / 2, len - len / 2);
+            cb.end_line();
+        } else {
+            cb.append_line(lines.back().data(), len);
+        }
+        if (i % 250 == 0 || i % 500 == 499) {
+            testing::internal::CaptureStdout();
+            cb.print(1024);
+            ASSERT_EQ(testing::internal::GetCapturedStdout(), spilled_tail(lines, 7)) << "after line " << i;
+        }
+    }
+}
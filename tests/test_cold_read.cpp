@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include "cold_read.h"
+#include "tail_engine.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr long TMPFS_MAGIC_NUMBER = 0x01021994;
+
+std::string pattern(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>('a' + (i * 7 + i / 4093) % 26);
+    }
+    return data;
+}
+
+std::string rows(int first, int last) {
+    std::string text;
+    for (int i = first; i <= last; ++i) {
+        text += "row " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+std::string gzipOf(const std::string& text) {
+    std::string out(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+// Pages of [0, size) of fd in the page cache.
+size_t residentPages(int fd, size_t size) {
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    std::vector<unsigned char> vec((size + page - 1) / page);
+    size_t resident = 0;
+    if (::mincore(map, size, vec.data()) == 0) {
+        for (unsigned char v : vec) {
+            resident += v & 1;
+        }
+    }
+    ::munmap(map, size);
+    return resident;
+}
+
+// Creates a file of size bytes and drops it from the page cache.  Returns
+// -1 where its pages cannot be dropped.
+int coldFile(const std::string& path, size_t size) {
+    std::ofstream(path, std::ios::binary) << pattern(size);
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct statfs fs;
+    if (fd < 0 || (::statfs(path.c_str(), &fs) == 0 && static_cast<long>(fs.f_type) == TMPFS_MAGIC_NUMBER)) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return -1;
+    }
+    ::fdatasync(fd);
+    dropCached(fd);
+    if (residentPages(fd, size) > size / static_cast<size_t>(::sysconf(_SC_PAGESIZE)) / 16) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void readRange(int fd, uint64_t begin, uint64_t end) {
+    std::vector<char> buf(1 << 20);
+    for (uint64_t pos = begin; pos < end;) {
+        const ssize_t r = ::pread(fd, buf.data(), std::min<uint64_t>(buf.size(), end - pos), static_cast<off_t>(pos));
+        if (r <= 0) {
+            break;
+        }
+        pos += static_cast<uint64_t>(r);
+    }
+}
+
+} // namespace
+
+TEST(ColdReadTest, DirectStreamReadsAndSeeks) {
+    const std::string data = pattern(DIRECT_BUFFER * 2 + 12345);
+    std::ofstream("cold_direct.bin", std::ios::binary) << data;
+    const int fd = ::open("cold_direct.bin", O_RDONLY);
+    ASSERT_GE(fd, 0);
+    FilePtr file = openDirectStream(fd);
+    ::close(fd);
+    if (!file) {
+        std::remove("cold_direct.bin");
+        GTEST_SKIP() << "no O_DIRECT on this file system";
+    }
+    EXPECT_EQ(fileno(file.get()), -1);
+
+    // Odd read sizes cross the aligned blocks anywhere.
+    std::string got;
+    std::vector<char> buf(100003);
+    size_t n = 0;
+    while ((n = std::fread(buf.data(), 1, buf.size(), file.get())) > 0) {
+        got.append(buf.data(), n);
+    }
+    EXPECT_TRUE(got == data);
+
+    ASSERT_EQ(std::fseek(file.get(), static_cast<long>(DIRECT_BUFFER + 7), SEEK_SET), 0);
+    ASSERT_EQ(std::fread(buf.data(), 1, 64, file.get()), 64u);
+    EXPECT_EQ(std::string(buf.data(), 64), data.substr(DIRECT_BUFFER + 7, 64));
+    ASSERT_EQ(std::fseek(file.get(), -10, SEEK_END), 0);
+    EXPECT_EQ(std::ftell(file.get()), static_cast<long>(data.size() - 10));
+    ASSERT_EQ(std::fread(buf.data(), 1, 64, file.get()), 10u);
+    EXPECT_EQ(std::string(buf.data(), 10), data.substr(data.size() - 10));
+    std::remove("cold_direct.bin");
+}
+
+TEST(ColdReadTest, DropBehindEvictsConsumedPages) {
+    const size_t size = 4 * DropBehind::COLD_WINDOW;
+    const int fd = coldFile("cold_behind.bin", size);
+    if (fd < 0) {
+        std::remove("cold_behind.bin");
+        GTEST_SKIP() << "the file's pages cannot be dropped";
+    }
+    const size_t pages = size / static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+    DropBehind behind(fd);
+    readRange(fd, 0, size / 2);
+    behind.advance(DropBehind::COLD_WINDOW / 2);
+    EXPECT_GE(residentPages(fd, size / 2), pages / 4); // less than a window is kept
+    behind.advance(size / 2);
+    EXPECT_LT(residentPages(fd, size / 2), pages / 16);
+    ::close(fd);
+    std::remove("cold_behind.bin");
+}
+
+TEST(ColdReadTest, PagesCachedBeforeStayCached) {
+    const size_t size = 4 * DropBehind::COLD_WINDOW;
+    const int fd = coldFile("cold_warm.bin", size);
+    if (fd < 0) {
+        std::remove("cold_warm.bin");
+        GTEST_SKIP() << "the file's pages cannot be dropped";
+    }
+    const size_t pages = size / static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    readRange(fd, 0, size / 2); // another workload's cache
+    dropCached(fd, size / 2);    // without what its reads brought in ahead
+    const size_t warm = residentPages(fd, size / 2);
+    if (warm < pages / 4) {
+        ::close(fd);
+        std::remove("cold_warm.bin");
+        GTEST_SKIP() << "the file was not cached";
+    }
+
+    {
+        DropOnClose cold(fd);
+        DropBehind behind(fd);
+        readRange(fd, 0, size);
+        behind.advance(size);
+        EXPECT_GE(residentPages(fd, size / 2), warm - pages / 64);
+    }
+    EXPECT_GE(residentPages(fd, size / 2), warm - pages / 64);
+    EXPECT_LT(residentPages(fd, size) - residentPages(fd, size / 2), pages / 16);
+    ::close(fd);
+    std::remove("cold_warm.bin");
+}
+
+TEST(ColdReadTest, EngineTailsWithoutCaching) {
+    std::ofstream("cold_tail.gz", std::ios::binary) << gzipOf(rows(1, 200000));
+    CLIOptions options;
+    options.n = 3;
+    options.noCache = true;
+    ztail::TailEngine dropping(options);
+    StringSink sink;
+    dropping.tailFile("cold_tail.gz", sink);
+    EXPECT_EQ(sink.take(), rows(199998, 200000));
+
+    options.directIo = true;
+    ztail::TailEngine direct(options);
+    direct.tailFile("cold_tail.gz", sink);
+    EXPECT_EQ(sink.take(), rows(199998, 200000));
+
+    const int fd = ::open("cold_tail.gz", O_RDONLY);
+    ASSERT_GE(fd, 0);
+    direct.tailFd(fd, sink);
+    EXPECT_EQ(sink.take(), rows(199998, 200000));
+    ::close(fd);
+    std::remove("cold_tail.gz");
+}
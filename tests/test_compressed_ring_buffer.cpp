@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include "compressed_ring_buffer.h"
+#include "parser.h"
+#include <string>
+
+static std::string numbered_line(size_t i) {
+    return "2024-01-01T00:00:00Z INFO request " + std::to_string(i) + " served in 12ms status=200";
+}
+
+static std::string expected_tail(size_t total, size_t n) {
+    std::string expected;
+    for (size_t i = total - n; i < total; ++i) {
+        expected += numbered_line(i) + "\n";
+    }
+    return expected;
+}
+
+TEST(CompressedRingBufferTest, KeepsLastLinesAcrossSegments) {
+    const size_t total = 100000; // ~8 MB, several sealed segments
+    CompressedRingBuffer cb(30000);
+    for (size_t i = 0; i < total; ++i) {
+        const std::string line = numbered_line(i);
+        cb.append_line(line.data(), line.size());
+    }
+    EXPECT_GT(cb.sealedBytes(), 0u);
+    EXPECT_LT(cb.sealedBytes() * 5, cb.sealedRawBytes());
+
+    testing::internal::CaptureStdout();
+    cb.print(1 << 20);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expected_tail(total, 30000));
+}
+
+TEST(CompressedRingBufferTest, EvictsWholeSegmentsNoLongerNeeded) {
+    CompressedRingBuffer cb(10);
+    for (size_t i = 0; i < 100000; ++i) {
+        const std::string line = numbered_line(i);
+        cb.append_line(line.data(), line.size());
+    }
+    // Only the open segment and at most one sealed one are needed for 10 lines.
+    EXPECT_LE(cb.sealedRawBytes(), CompressedRingBuffer::SEGMENT_BYTES + 200);
+
+    testing::internal::CaptureStdout();
+    cb.print(64);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expected_tail(100000, 10));
+}
+
+TEST(CompressedRingBufferTest, BytesBudgetBoundsCompressedMemory) {
+    CompressedRingBuffer cb(1000000, 0, 2u << 20);
+    for (size_t i = 0; i < 200000; ++i) {
+        const std::string line = numbered_line(i);
+        cb.append_line(line.data(), line.size());
+    }
+    EXPECT_LE(cb.sealedBytes(), 2u << 20);
+}
+
+TEST(CompressedRingBufferTest, WorksWithParserSegments) {
+    CompressedRingBuffer cb(2);
+    BasicParser<CompressedRingBuffer> parser(cb);
+    const std::string input = "first\nsecond line\nthi";
+    parser.parse(input.data(), input.size());
+    parser.parse("rd\n", 3);
+    parser.finalize();
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "second line\nthird\n");
+}
+
+TEST(CompressedRingBufferTest, ZeroCapacityStoresNothing) {
+    CompressedRingBuffer cb(0);
+    cb.append_line("x", 1);
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+}
@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 #include "compressor_bzip2.h"
 #include "compression_type.h"
+#include "trace.h"
 #include <bzlib.h>
 #include <cstdio>
+#include <fstream>
+#include <sstream>
 
 // Helper function to create a temporary bz2 file for testing
 void create_bz2_file(const std::string& filename, const std::string& content) {
@@ -57,3 +60,26 @@ TEST(CompressorBzip2Test, DecompressInvalidFile) {
     remove(filename.c_str());
 }
 
+
+TEST(CompressorBzip2Test, ReadsAreTraced) {
+    const std::string filename = "test_traced.bz2";
+    const std::string path = "bzip2.trace.json";
+    create_bz2_file(filename, "Line A\nLine B\n");
+    {
+        TraceRecorder trace(path);
+        trace.activate();
+        DetectionResult det = detectCompressionType(filename);
+        CompressorBzip2 compressor(std::move(det.file), filename);
+        std::vector<char> buffer(1024);
+        size_t bytesDecompressed = 0;
+        while (compressor.decompress(buffer, bytesDecompressed)) {
+        }
+        trace.finish();
+    }
+    std::ifstream in(path);
+    std::stringstream json;
+    json << in.rdbuf();
+    EXPECT_NE(json.str().find("\"name\": \"read\""), std::string::npos);
+    remove(path.c_str());
+    remove(filename.c_str());
+}
@@ -0,0 +1,80 @@
+#ifdef ZTAIL_USE_LIBDEFLATE
+
+#include <gtest/gtest.h>
+#include "compressor_libdeflate.h"
+#include "compression_type.h"
+#include <fstream>
+
+void create_gz_file(const std::string& filename, const std::string& content);
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+
+static std::string numbered_lines(int count) {
+    std::string text;
+    for (int i = 0; i < count; ++i) {
+        text += "line " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+static std::string decompress_all(const std::string& filename, size_t maxMemberSize = 64 << 20,
+                                  size_t bufferSize = 1000) {
+    DetectionResult det = detectCompressionType(filename);
+    EXPECT_EQ(det.type, CompressionType::GZIP);
+    CompressorLibdeflate compressor(std::move(det.file), filename, maxMemberSize);
+    std::vector<char> buffer(bufferSize);
+    size_t n = 0;
+    std::string out;
+    while (compressor.decompress(buffer, n)) {
+        out.append(buffer.data(), n);
+    }
+    return out;
+}
+
+TEST(CompressorLibdeflateTest, ConcatenatedMembers) {
+    const std::string filename = "libdeflate_members.gz";
+    const std::string first = numbered_lines(3000);
+    const std::string second = "tail\n";
+    create_gz_file("libdeflate_a.gz", first);
+    create_gz_file("libdeflate_b.gz", second);
+    {
+        std::ofstream out(filename, std::ios::binary);
+        out << std::ifstream("libdeflate_a.gz", std::ios::binary).rdbuf()
+            << std::ifstream("libdeflate_b.gz", std::ios::binary).rdbuf();
+    }
+    EXPECT_EQ(decompress_all(filename), first + second);
+    remove("libdeflate_a.gz");
+    remove("libdeflate_b.gz");
+    remove(filename.c_str());
+}
+
+TEST(CompressorLibdeflateTest, BgzfIsReadBlockByBlock) {
+    const std::string filename = "libdeflate.bgz";
+    const std::string content = numbered_lines(20000);
+    create_bgzf_file(filename, content, 4096);
+    EXPECT_EQ(decompress_all(filename), content);
+    remove(filename.c_str());
+}
+
+TEST(CompressorLibdeflateTest, OversizedMemberIsStreamedThroughZlib) {
+    const std::string filename = "libdeflate_large.gz";
+    const std::string content = numbered_lines(50000);
+    create_gz_file(filename, content);
+    EXPECT_EQ(decompress_all(filename, 4096, 777), content);
+    remove(filename.c_str());
+}
+
+TEST(CompressorLibdeflateTest, CorruptMemberThrows) {
+    const std::string filename = "libdeflate_corrupt.gz";
+    create_gz_file(filename, numbered_lines(1000));
+    std::string bytes;
+    {
+        std::ifstream in(filename, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    bytes.resize(bytes.size() / 2);
+    std::ofstream(filename, std::ios::binary | std::ios::trunc) << bytes;
+    EXPECT_THROW(decompress_all(filename), std::runtime_error);
+    remove(filename.c_str());
+}
+
+#endif // ZTAIL_USE_LIBDEFLATE
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include "compressor_lz4.h"
+#include "compression_type.h"
+#include <lz4frame.h>
+#include <fstream>
+#include <cstdio>
+
+// Appends one LZ4 frame holding content to filename.
+void append_lz4_frame(const std::string& filename, const std::string& content, bool independent,
+                      bool blockChecksums) {
+    LZ4F_preferences_t prefs{};
+    prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+    prefs.frameInfo.blockMode = independent ? LZ4F_blockIndependent : LZ4F_blockLinked;
+    prefs.frameInfo.blockChecksumFlag = blockChecksums ? LZ4F_blockChecksumEnabled : LZ4F_noBlockChecksum;
+    prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    prefs.frameInfo.contentSize = content.size();
+    std::vector<char> out(LZ4F_compressFrameBound(content.size(), &prefs));
+    const size_t n = LZ4F_compressFrame(out.data(), out.size(), content.data(), content.size(), &prefs);
+    ASSERT_FALSE(LZ4F_isError(n));
+    std::ofstream ofs(filename, std::ios::binary | std::ios::app);
+    ofs.write(out.data(), static_cast<std::streamsize>(n));
+}
+
+static std::string decompress_all(const std::string& filename, size_t bufferSize) {
+    DetectionResult det = detectCompressionType(filename);
+    EXPECT_EQ(det.type, CompressionType::LZ4);
+    CompressorLz4 comp(std::move(det.file), filename);
+    std::vector<char> buf(bufferSize);
+    size_t n = 0;
+    std::string out;
+    while (comp.decompress(buf, n)) {
+        out.append(buf.data(), n);
+    }
+    return out;
+}
+
+TEST(CompressorLz4Test, DecompressValidFile) {
+    const std::string filename = "test.lz4";
+    std::remove(filename.c_str());
+    const std::string content = "Line1\nLine2\n";
+    append_lz4_frame(filename, content, true, false);
+    EXPECT_EQ(decompress_all(filename, 1024), content);
+    std::remove(filename.c_str());
+}
+
+TEST(CompressorLz4Test, DecompressConcatenatedFramesWithSmallOutput) {
+    const std::string filename = "multi.lz4";
+    std::remove(filename.c_str());
+    std::string content;
+    for (int frame = 0; frame < 3; ++frame) {
+        std::string part;
+        for (int i = 0; i < 40000; ++i) {
+            part += "frame " + std::to_string(frame) + " line " + std::to_string(i) + "\n";
+        }
+        append_lz4_frame(filename, part, frame != 1, frame == 2);
+        content += part;
+    }
+    EXPECT_EQ(decompress_all(filename, 1000), content);
+    std::remove(filename.c_str());
+}
+
+TEST(CompressorLz4Test, DecompressInvalidFile) {
+    const std::string filename = "bad.lz4";
+    std::ofstream ofs(filename); ofs << "\x04\x22\x4d\x18garbage"; ofs.close();
+    EXPECT_THROW(decompress_all(filename, 64), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(CompressorLz4Test, TruncatedFileThrows) {
+    const std::string filename = "truncated.lz4";
+    std::remove(filename.c_str());
+    std::string content;
+    for (int i = 0; i < 10000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    append_lz4_frame(filename, content, true, false);
+    std::ifstream in(filename, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream(filename, std::ios::binary) << bytes.substr(0, bytes.size() / 2);
+    EXPECT_THROW(decompress_all(filename, 4096), std::runtime_error);
+    std::remove(filename.c_str());
+}
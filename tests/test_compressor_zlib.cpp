@@ -46,3 +46,59 @@ TEST(CompressorZlibTest, DecompressInvalidFile) {
 
     remove(filename.c_str());
 }
+
+static std::string read_all(CompressorZlib& compressor, size_t bufferSize) {
+    std::vector<char> buffer(bufferSize);
+    size_t n = 0;
+    std::string out;
+    while (compressor.decompress(buffer, n)) {
+        out.append(buffer.data(), n);
+    }
+    return out;
+}
+
+static std::string file_bytes(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST(CompressorZlibTest, ConcatenatedMembersReportBoundaries) {
+    const std::string filename = "test_members.gz";
+    create_gz_file("test_member_a.gz", "first\n");
+    create_gz_file("test_member_b.gz", "second\n");
+    const std::string a = file_bytes("test_member_a.gz");
+    const std::string b = file_bytes("test_member_b.gz");
+    std::ofstream(filename, std::ios::binary) << a << b << "trailing garbage";
+
+    DetectionResult det = detectCompressionType(filename);
+    CompressorZlib compressor(std::move(det.file), filename, 5); // members straddle reads
+    std::vector<GzipBoundary> members;
+    compressor.setBoundaryCallback([&](const GzipBoundary& boundary) { members.push_back(boundary); });
+
+    EXPECT_EQ(read_all(compressor, 3), "first\nsecond\n");
+    ASSERT_EQ(members.size(), 2u);
+    EXPECT_EQ(members[0].kind, GzipBoundary::MEMBER);
+    EXPECT_EQ(members[0].in, a.size());
+    EXPECT_EQ(members[0].out, 6u);
+    EXPECT_EQ(members[1].in, a.size() + b.size());
+    EXPECT_EQ(members[1].out, 13u);
+    remove("test_member_a.gz");
+    remove("test_member_b.gz");
+    remove(filename.c_str());
+}
+
+TEST(CompressorZlibTest, TruncatedFileThrows) {
+    const std::string filename = "test_truncated.gz";
+    std::string content;
+    for (int i = 0; i < 10000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    create_gz_file(filename, content);
+    const std::string bytes = file_bytes(filename);
+    std::ofstream(filename, std::ios::binary | std::ios::trunc) << bytes.substr(0, bytes.size() - 6);
+
+    DetectionResult det = detectCompressionType(filename);
+    CompressorZlib compressor(std::move(det.file), filename);
+    EXPECT_THROW(read_all(compressor, 4096), std::runtime_error);
+    remove(filename.c_str());
+}
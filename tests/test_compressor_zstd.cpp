@@ -42,3 +42,56 @@ TEST(CompressorZstdTest, DecompressInvalidFile){
     }, std::runtime_error);
     std::remove(filename.c_str());
 }
+
+TEST(CompressorZstdTest, DecompressMultiFrameWithSmallOutput){
+    const std::string filename = "multi.zst";
+    std::string content;
+    std::ofstream ofs(filename, std::ios::binary);
+    for (int frame = 0; frame < 3; ++frame) {
+        std::string part;
+        for (int i = 0; i < 50000; ++i) {
+            part += "frame " + std::to_string(frame) + " line " + std::to_string(i % 7) + "\n";
+        }
+        std::vector<char> out(ZSTD_compressBound(part.size()));
+        size_t compSize = ZSTD_compress(out.data(), out.size(), part.data(), part.size(), 1);
+        ASSERT_FALSE(ZSTD_isError(compSize));
+        ofs.write(out.data(), compSize);
+        content += part;
+    }
+    ofs.close();
+
+    DetectionResult det = detectCompressionType(filename);
+    CompressorZstd comp(std::move(det.file), filename);
+    std::vector<char> buf(4096);
+    size_t n = 0;
+    std::string out;
+    while (comp.decompress(buf, n)) {
+        out.append(buf.data(), n);
+    }
+    EXPECT_EQ(out, content);
+    std::remove(filename.c_str());
+}
+
+TEST(CompressorZstdTest, DecompressTruncatedFileThrows){
+    const std::string filename = "truncated.zst";
+    std::string content;
+    for (int i = 0; i < 20000; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    std::vector<char> out(ZSTD_compressBound(content.size()));
+    size_t compSize = ZSTD_compress(out.data(), out.size(), content.data(), content.size(), 1);
+    ASSERT_FALSE(ZSTD_isError(compSize));
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs.write(out.data(), compSize / 2);
+    ofs.close();
+
+    EXPECT_THROW({
+        DetectionResult det = detectCompressionType(filename);
+        CompressorZstd c(std::move(det.file), filename);
+        std::vector<char> buf(4096);
+        size_t n = 0;
+        while (c.decompress(buf, n)) {
+        }
+    }, std::runtime_error);
+    std::remove(filename.c_str());
+}
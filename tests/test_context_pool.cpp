@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include "context_pool.h"
+#include "compression_type.h"
+#include "compressor_factory.h"
+#include "tail_engine.h"
+#include <lzma.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string rows(int first, int last) {
+    std::string text;
+    for (int i = first; i <= last; ++i) {
+        text += "row " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+std::string gzipOf(const std::string& text) {
+    std::string out(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+std::string zstdOf(const std::string& text) {
+    std::string out(ZSTD_compressBound(text.size()), '\0');
+    out.resize(ZSTD_compress(&out[0], out.size(), text.data(), text.size(), 3));
+    return out;
+}
+
+std::string xzOf(const std::string& text) {
+    std::string out(lzma_stream_buffer_bound(text.size()), '\0');
+    size_t pos = 0;
+    lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, nullptr, reinterpret_cast<const uint8_t*>(text.data()),
+                            text.size(), reinterpret_cast<uint8_t*>(&out[0]), &pos, out.size());
+    out.resize(pos);
+    return out;
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+std::string decodeWith(ContextPool& pool, const std::string& path) {
+    DetectionResult det = detectCompressionType(path);
+    CLIOptions options;
+    std::unique_ptr<ICompressor> comp = openCompressor(det, path, options, &pool);
+    std::vector<char> buf(4096);
+    size_t n = 0;
+    std::string decoded;
+    while (comp->decompress(buf, n)) {
+        decoded.append(buf.data(), n);
+    }
+    return decoded;
+}
+
+} // namespace
+
+TEST(ContextPoolTest, DecodersReuseContextsAcrossFiles) {
+    const std::vector<std::pair<std::string, std::string>> files = {
+        {"pool_a.gz", gzipOf(rows(1, 3000))},   {"pool_b.gz", gzipOf(rows(2, 3001))},
+        {"pool_a.zst", zstdOf(rows(1, 3000))},  {"pool_b.zst", zstdOf(rows(2, 3001))},
+        {"pool_a.xz", xzOf(rows(1, 3000))},     {"pool_b.xz", xzOf(rows(2, 3001))},
+    };
+    for (const auto& file : files) {
+        writeFile(file.first, file.second);
+    }
+
+    ContextPool pool;
+    EXPECT_EQ(decodeWith(pool, "pool_a.gz"), rows(1, 3000));
+    EXPECT_EQ(pool.reused(), 0u);
+    // The second file of a format gets at least the context and the input
+    // buffer back.
+    size_t before = pool.reused();
+    EXPECT_EQ(decodeWith(pool, "pool_b.gz"), rows(2, 3001));
+    EXPECT_GE(pool.reused(), before + 2);
+    EXPECT_EQ(decodeWith(pool, "pool_a.zst"), rows(1, 3000));
+    before = pool.reused();
+    EXPECT_EQ(decodeWith(pool, "pool_b.zst"), rows(2, 3001));
+    EXPECT_GE(pool.reused(), before + 2);
+    EXPECT_EQ(decodeWith(pool, "pool_a.xz"), rows(1, 3000));
+    before = pool.reused();
+    EXPECT_EQ(decodeWith(pool, "pool_b.xz"), rows(2, 3001));
+    EXPECT_GE(pool.reused(), before + 2);
+
+    for (const auto& file : files) {
+        std::remove(file.first.c_str());
+    }
+}
+
+TEST(ContextPoolTest, EngineClearsPooledRingBetweenFiles) {
+    writeFile("pool_long.gz", gzipOf(rows(1, 500)));
+    writeFile("pool_short.zst", zstdOf(rows(1, 2)));
+    CLIOptions options;
+    options.n = 5;
+    ztail::TailEngine engine(options);
+
+    StringSink first;
+    engine.tailFile("pool_long.gz", first);
+    EXPECT_EQ(first.take(), rows(496, 500));
+    // Fewer lines than the ring holds: nothing of the previous file remains.
+    StringSink second;
+    engine.tailFile("pool_short.zst", second);
+    EXPECT_EQ(second.take(), rows(1, 2));
+    StringSink third;
+    engine.tailFile("pool_long.gz", third);
+    EXPECT_EQ(third.take(), rows(496, 500));
+    EXPECT_GT(engine.reusedContexts(), 0u);
+
+    std::remove("pool_long.gz");
+    std::remove("pool_short.zst");
+}
+
+TEST(ContextPoolTest, FailedDecodeDoesNotPoisonThePool) {
+    std::string broken = gzipOf(rows(1, 2000));
+    broken.resize(broken.size() / 2);
+    writeFile("pool_broken.gz", broken);
+    writeFile("pool_good.gz", gzipOf(rows(1, 20)));
+    CLIOptions options;
+    options.n = 3;
+    ztail::TailEngine engine(options);
+
+    StringSink sink;
+    EXPECT_THROW(engine.tailFile("pool_broken.gz", sink), std::runtime_error);
+    StringSink good;
+    engine.tailFile("pool_good.gz", good);
+    EXPECT_EQ(good.take(), rows(18, 20));
+
+    std::remove("pool_broken.gz");
+    std::remove("pool_good.gz");
+}
@@ -94,6 +94,24 @@ TEST(CompressionDetection, ZstdNoExtension){
     std::remove(fname.c_str());
 }
 
+TEST(CompressionDetection, Lz4NoExtension){
+    const std::string fname = "compressed_lz4";
+    std::ofstream ofs(fname, std::ios::binary);
+    ofs << std::string("\x04\x22\x4d\x18\x64\x40", 6);
+    ofs.close();
+    EXPECT_EQ(detectCompressionType(fname).type, CompressionType::LZ4);
+    std::remove(fname.c_str());
+}
+
+TEST(CompressionDetection, Lz4Extension){
+    const std::string fname = "sample.lz4";
+    std::ofstream ofs(fname);
+    ofs << "not yet written";
+    ofs.close();
+    EXPECT_EQ(detectCompressionType(fname).type, CompressionType::LZ4);
+    std::remove(fname.c_str());
+}
+
 TEST(CompressionDetection, PlaintextFile){
     const std::string fname = "plain.txt";
     std::ofstream ofs(fname);
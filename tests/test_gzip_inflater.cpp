@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include "gzip_inflater.h"
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+static std::string gzip_member(const std::string& text, int level = Z_DEFAULT_COMPRESSION) {
+    std::string out(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static std::string log_lines(int count) {
+    std::string text;
+    for (int i = 0; i < count; ++i) {
+        text += "2024-05-01 INFO request " + std::to_string(i * 7919 % 100003) + " done\n";
+    }
+    return text;
+}
+
+TEST(GzipInflaterTest, ByteAtATimeAcrossMembers) {
+    const std::string first = log_lines(100);
+    const std::string second = log_lines(50);
+    const std::string input = gzip_member(first) + gzip_member(second);
+
+    GzipInflater inflater("test");
+    std::string out;
+    char chunk[7];
+    for (size_t pos = 0; pos < input.size();) {
+        const GzipInflater::Result r = inflater.inflate(input.data() + pos, 1, chunk, sizeof(chunk));
+        out.append(chunk, r.produced);
+        pos += r.consumed;
+    }
+    // Output held back by the last input byte.
+    for (GzipInflater::Result r{1, 1, false}; r.produced > 0;) {
+        r = inflater.inflate(nullptr, 0, chunk, sizeof(chunk));
+        out.append(chunk, r.produced);
+    }
+    EXPECT_EQ(out, first + second);
+    EXPECT_EQ(inflater.members(), 2u);
+    EXPECT_FALSE(inflater.inMember());
+    EXPECT_EQ(inflater.totalIn(), input.size());
+}
+
+TEST(GzipInflaterTest, BlockBoundariesAreResumePoints) {
+    const std::string text = log_lines(200000); // several deflate blocks
+    const std::string input = gzip_member(text);
+
+    GzipInflater inflater("test", true);
+    std::vector<char> out(text.size());
+    std::vector<GzipBoundary> boundaries;
+    size_t consumed = 0;
+    size_t produced = 0;
+    while (!inflater.members()) {
+        const GzipInflater::Result r = inflater.inflate(input.data() + consumed, input.size() - consumed,
+                                                        out.data() + produced, out.size() - produced);
+        consumed += r.consumed;
+        produced += r.produced;
+        ASSERT_TRUE(r.boundary);
+        boundaries.push_back(inflater.boundary());
+    }
+    EXPECT_EQ(std::string(out.data(), produced), text);
+    ASSERT_GT(boundaries.size(), 3u);
+    EXPECT_EQ(boundaries.front().kind, GzipBoundary::BLOCK);
+    EXPECT_EQ(boundaries.front().out, 0u); // just after the header
+    EXPECT_EQ(boundaries.back().kind, GzipBoundary::MEMBER);
+    for (size_t i = 1; i < boundaries.size(); ++i) {
+        EXPECT_GT(boundaries[i].out, boundaries[i - 1].out);
+        EXPECT_GE(boundaries[i].in, boundaries[i - 1].in);
+    }
+}
+
+TEST(GzipInflaterTest, CorruptDataThrows) {
+    std::string input = gzip_member(log_lines(1000));
+    input[input.size() / 2] ^= 0x55;
+    input[input.size() / 2 + 1] ^= 0x55;
+    GzipInflater inflater("corrupt.gz");
+    std::vector<char> out(1 << 20);
+    EXPECT_THROW(inflater.inflate(input.data(), input.size(), out.data(), out.size()), std::runtime_error);
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include "keyed_ring_buffer.h"
+#include "parser.h"
+#include <string>
+
+namespace {
+
+std::string printed(const KeyedRingBuffer& kb) {
+    testing::internal::CaptureStdout();
+    kb.print(1024);
+    return testing::internal::GetCapturedStdout();
+}
+
+void appendLine(KeyedRingBuffer& kb, const std::string& line) {
+    kb.append_line(line.data(), line.size());
+}
+
+} // namespace
+
+TEST(KeySpecTest, ExtractsWhitespaceField) {
+    KeySpec spec = KeySpec::parse("2");
+    const std::string line = "2024-01-01  host-a\tGET /";
+    const char* key = nullptr;
+    size_t len = 0;
+    ASSERT_TRUE(spec.extract(line.data(), line.size(), key, len));
+    EXPECT_EQ(std::string(key, len), "host-a");
+
+    const std::string shortLine = "onlyone";
+    EXPECT_FALSE(spec.extract(shortLine.data(), shortLine.size(), key, len));
+}
+
+TEST(KeySpecTest, ExtractsNamedValue) {
+    KeySpec spec = KeySpec::parse("user");
+    const char* key = nullptr;
+    size_t len = 0;
+
+    const std::string plain = "ts=1 subuser=x user=alice action=login";
+    ASSERT_TRUE(spec.extract(plain.data(), plain.size(), key, len));
+    EXPECT_EQ(std::string(key, len), "alice");
+
+    const std::string quoted = "ts=1 user=\"bob smith\" action=logout";
+    ASSERT_TRUE(spec.extract(quoted.data(), quoted.size(), key, len));
+    EXPECT_EQ(std::string(key, len), "bob smith");
+
+    const std::string missing = "ts=1 action=noop";
+    EXPECT_FALSE(spec.extract(missing.data(), missing.size(), key, len));
+}
+
+TEST(KeySpecTest, RejectsInvalidSpecs) {
+    EXPECT_THROW(KeySpec::parse(""), std::runtime_error);
+    EXPECT_THROW(KeySpec::parse("0"), std::runtime_error);
+}
+
+TEST(KeyedRingBufferTest, KeepsLastLinesPerKey) {
+    KeyedRingBuffer kb(KeySpec::parse("1"), 2, 16);
+    appendLine(kb, "a 1");
+    appendLine(kb, "b 1");
+    appendLine(kb, "a 2");
+    appendLine(kb, "a 3");
+    appendLine(kb, "");
+    appendLine(kb, "b 2");
+    appendLine(kb, "c 1");
+
+    EXPECT_EQ(kb.keyCount(), 3u);
+    EXPECT_EQ(printed(kb), "a 2\na 3\nb 1\nb 2\nc 1\n");
+}
+
+TEST(KeyedRingBufferTest, GrowsAcrossSlabClasses) {
+    KeyedRingBuffer kb(KeySpec::parse("1"), 4, 1024);
+    std::string expected;
+    for (int i = 0; i < 10; ++i) {
+        std::string line = "k " + std::string(static_cast<size_t>(40 * (i + 1)), static_cast<char>('a' + i));
+        appendLine(kb, line);
+        if (i >= 6) {
+            expected += line + "\n";
+        }
+    }
+    EXPECT_EQ(printed(kb), expected);
+}
+
+TEST(KeyedRingBufferTest, EvictsLeastRecentlyUpdatedKeys) {
+    KeyedRingBuffer kb(KeySpec::parse("1"), 2, 16, 1024);
+    for (int i = 0; i < 20; ++i) {
+        appendLine(kb, "key" + std::to_string(i) + " x");
+    }
+    appendLine(kb, "key19 y");
+
+    EXPECT_GT(kb.evictedKeys(), 0u);
+    EXPECT_LT(kb.keyCount(), 20u);
+    EXPECT_LE(kb.memoryUsage(), 1024u * 2);
+
+    testing::internal::CaptureStderr();
+    std::string output = printed(kb);
+    std::string warning = testing::internal::GetCapturedStderr();
+    EXPECT_NE(output.find("key19 x\nkey19 y\n"), std::string::npos);
+    EXPECT_EQ(output.find("key0 x"), std::string::npos);
+    EXPECT_EQ(warning, ""); // the engine reports evictions to its diagnostics
+}
+
+TEST(KeyedRingBufferTest, GrowingKeyEvictsOnlyItsBuddy) {
+    // 14 keys of one 256-byte slab each leave no room to bump a 512-byte
+    // slab; the first key grows into its slab merged with its evicted buddy.
+    KeyedRingBuffer kb(KeySpec::parse("1"), 4, 100, 4096);
+    for (char k = 'A'; k < 'A' + 14; ++k) {
+        appendLine(kb, std::string("k") + k + " short");
+    }
+    const std::string longLine = "kA " + std::string(100, 'x');
+    for (int i = 0; i < 3; ++i) {
+        appendLine(kb, longLine);
+    }
+
+    EXPECT_EQ(kb.evictedKeys(), 1u);
+    EXPECT_EQ(kb.keyCount(), 13u);
+    testing::internal::CaptureStderr();
+    const std::string output = printed(kb);
+    testing::internal::GetCapturedStderr();
+    EXPECT_EQ(output.find("kA short\n" + longLine + "\n" + longLine + "\n" + longLine + "\nkC short\n"), 0u);
+    EXPECT_EQ(output.find("kB short"), std::string::npos);
+}
+
+TEST(KeyedRingBufferTest, ParserFeedsKeyedBuffer) {
+    KeyedRingBuffer kb(KeySpec::parse("svc"), 1, 16);
+    BasicParser<KeyedRingBuffer> parser(kb, 16);
+
+    const std::string data = "svc=api msg=1\nsvc=db msg=2\nsvc=api ms";
+    parser.parse(data.data(), data.size());
+    const std::string rest = "g=3\nno key here\n";
+    parser.parse(rest.data(), rest.size());
+    parser.finalize();
+
+    EXPECT_EQ(printed(kb), "svc=api msg=3\nsvc=db msg=2\n");
+}
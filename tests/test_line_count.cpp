@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include "line_count.h"
+#include "simd_scan.h"
+#include "compression_type.h"
+#include "compressor_zlib.h"
+#include <zlib.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+void create_bz2_file(const std::string& filename, const std::string& content);
+
+static std::string counted_lines(int count) {
+    std::string content;
+    for (int i = 0; i < count; ++i) {
+        content += "line " + std::to_string(i) + std::string(static_cast<size_t>(i % 50), 'x') + "\n";
+    }
+    return content;
+}
+
+static LineCount count_file(const std::string& filename, unsigned threads) {
+    DetectionResult det = detectCompressionType(filename);
+    EXPECT_TRUE(det.file);
+    LineCount count;
+    const int fd = fileno(det.file.get());
+    if (det.type == CompressionType::NONE) {
+        return countPlainFile(fd, threads);
+    }
+    EXPECT_TRUE(countCompressedBlocks(fd, det.type, threads, count));
+    return count;
+}
+
+TEST(SimdScanTest, CountNewlinesMatchesScalar) {
+    std::string data;
+    for (size_t i = 0; i < 20000; ++i) {
+        data.push_back((i * 7) % 13 == 0 ? '\n' : 'a');
+    }
+    for (size_t size : {0u, 1u, 15u, 31u, 32u, 33u, 1000u, 8161u, 20000u}) {
+        size_t expected = 0;
+        for (size_t i = 0; i < size; ++i) expected += data[i] == '\n';
+        EXPECT_EQ(countNewlines(data.data(), size), expected) << "size " << size;
+    }
+    const std::string allNewlines(300 * 32 + 5, '\n');
+    EXPECT_EQ(countNewlines(allNewlines.data(), allNewlines.size()), allNewlines.size());
+}
+
+TEST(LineCountTest, PlainFileWithThreads) {
+    const std::string filename = "count_plain.txt";
+    const std::string content = counted_lines(5000) + "no trailing newline";
+    std::ofstream(filename, std::ios::binary) << content;
+
+    LineCount count = count_file(filename, 4);
+    EXPECT_EQ(count.lines, 5000u);
+    EXPECT_EQ(count.bytes, content.size());
+    std::remove(filename.c_str());
+}
+
+TEST(LineCountTest, BgzfBlocksInParallel) {
+    const std::string filename = "count.bgz";
+    const std::string content = counted_lines(3000);
+    create_bgzf_file(filename, content, 1000);
+
+    LineCount count = count_file(filename, 4);
+    EXPECT_EQ(count.lines, 3000u);
+    EXPECT_EQ(count.bytes, content.size());
+    std::remove(filename.c_str());
+}
+
+TEST(LineCountTest, ConcatenatedBzip2Streams) {
+    const std::string filename = "count.bz2";
+    const std::string parts[3] = {counted_lines(100), counted_lines(2000), "last\n"};
+    std::string all;
+    std::ofstream ofs(filename, std::ios::binary);
+    for (const auto& part : parts) {
+        const std::string partName = "count_part.bz2";
+        create_bz2_file(partName, part);
+        std::ifstream ifs(partName, std::ios::binary);
+        ofs << ifs.rdbuf();
+        std::remove(partName.c_str());
+        all += part;
+    }
+    ofs.close();
+
+    LineCount count = count_file(filename, 3);
+    EXPECT_EQ(count.lines, 2101u);
+    EXPECT_EQ(count.bytes, all.size());
+
+    LineCount single = count_file(filename, 1);
+    EXPECT_EQ(single.lines, count.lines);
+    std::remove(filename.c_str());
+}
+
+TEST(LineCountTest, TruncatedBzip2Throws) {
+    const std::string filename = "count_truncated.bz2";
+    create_bz2_file(filename, counted_lines(500));
+    std::ifstream ifs(filename, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    std::ofstream(filename, std::ios::binary) << data.substr(0, data.size() / 2);
+
+    DetectionResult det = detectCompressionType(filename);
+    LineCount count;
+    EXPECT_THROW(countCompressedBlocks(fileno(det.file.get()), det.type, 2, count), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(LineCountTest, SingleMemberGzipIsStreamed) {
+    const std::string filename = "count_single.gz";
+    const std::string content = counted_lines(1000);
+    gzFile gz = gzopen(filename.c_str(), "wb");
+    ASSERT_NE(gz, nullptr);
+    gzwrite(gz, content.data(), static_cast<unsigned>(content.size()));
+    gzclose(gz);
+
+    DetectionResult det = detectCompressionType(filename);
+    LineCount count;
+    EXPECT_FALSE(countCompressedBlocks(fileno(det.file.get()), det.type, 4, count));
+
+    CompressorZlib comp(std::move(det.file), filename);
+    count = countStream(comp, 4096);
+    EXPECT_EQ(count.lines, 1000u);
+    EXPECT_EQ(count.bytes, content.size());
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include "line_filter.h"
+#include "simd_scan.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include <string>
+
+TEST(SimdScanTest, FindLiteralAcrossVectorWidths) {
+    std::string hay(200, 'a');
+    hay.replace(150, 5, "ERROR");
+    const char* hit = findLiteral(hay.data(), hay.size(), "ERROR", 5);
+    ASSERT_NE(hit, nullptr);
+    EXPECT_EQ(hit - hay.data(), 150);
+    EXPECT_EQ(findLiteral(hay.data(), hay.size(), "ERRORS", 6), nullptr);
+    EXPECT_EQ(findLiteral(hay.data(), 152, "ERROR", 5), nullptr);
+
+    const std::string tail = "xxE";
+    EXPECT_EQ(findLiteral(tail.data(), tail.size(), "E", 1), tail.data() + 2);
+}
+
+TEST(LineFilterTest, ExtractRequiredLiteral) {
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("ERROR [0-9]+ timeout"), " timeout");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("user=\\w+ failed"), " failed");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("colou?r"), "colo");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("a\\.b"), "a.b");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("foo|bar"), "");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("(optional)?required"), "required");
+}
+
+TEST(LineFilterTest, ExtractRequiredLiteralSkipsEscapeOperands) {
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("code=\\x41BC"), "code=");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("\\x41status"), "status");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("\\u0041lpha"), "lpha");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("a\\cJXYZ"), "XYZ");
+    EXPECT_EQ(LineFilter::extractRequiredLiteral("(a)b\\1234"), "b");
+}
+
+TEST(LineFilterTest, RegexWithCodeEscapesMatches) {
+    LineFilter hex = LineFilter::regex("code \\x41\\x42 done");
+    const std::string line = "req code AB done";
+    EXPECT_TRUE(hex.matches(line.data(), line.size()));
+    LineFilter unicode = LineFilter::regex("\\u0041lpha=1");
+    const std::string alpha = "Alpha=1";
+    const std::string other = "Beta=1";
+    EXPECT_TRUE(unicode.matches(alpha.data(), alpha.size()));
+    EXPECT_FALSE(unicode.matches(other.data(), other.size()));
+}
+
+TEST(LineFilterTest, RegexConfirmsCandidates) {
+    LineFilter filter = LineFilter::regex("id=[0-9]+ done");
+    const std::string good = "req id=42 done";
+    const std::string bad = "req id=x done";
+    EXPECT_TRUE(filter.matches(good.data(), good.size()));
+    EXPECT_FALSE(filter.matches(bad.data(), bad.size()));
+}
+
+TEST(LineFilterTest, InvalidRegexThrows) {
+    EXPECT_THROW(LineFilter::regex("(unclosed"), std::runtime_error);
+}
+
+TEST(LineFilterTest, ParserKeepsLastMatchingLines) {
+    LineFilter filter = LineFilter::literal("ERROR");
+    CircularBuffer cb(2, 16);
+    Parser parser(cb, 16, &filter);
+
+    const std::string data = "INFO a\nERROR 1\nINFO b\nERROR 2\nWARN c\nERROR 3\nINFO d";
+    parser.parse(data.data(), data.size());
+    parser.finalize();
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "ERROR 2\nERROR 3\n");
+}
+
+TEST(LineFilterTest, ParserMatchesLinesSplitAcrossChunks) {
+    LineFilter filter = LineFilter::regex("ERR?OR [0-9]");
+    CircularBuffer cb(5, 16);
+    Parser parser(cb, 16, &filter);
+
+    const std::string data = "INFO a\nERROR 1\nINFO b\nEROR 2\nERROR x\n";
+    for (size_t i = 0; i < data.size(); i += 3) {
+        parser.parse(data.data() + i, std::min<size_t>(3, data.size() - i));
+    }
+    parser.finalize();
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "ERROR 1\nEROR 2\n");
+}
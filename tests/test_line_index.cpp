@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "line_index.h"
+#include "compression_type.h"
+#include "tail_engine.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+
+static std::string indexed_lines(int first, int last) {
+    std::string content;
+    for (int i = first; i <= last; ++i) {
+        content += "line " + std::to_string(i) + std::string(static_cast<size_t>(i % 17), '.') + "\n";
+    }
+    return content;
+}
+
+static void index_by_streaming(const std::string& filename) {
+    DetectionResult det = detectCompressionType(filename);
+    std::vector<CompressedBlock> blocks = listCompressedBlocks(fileno(det.file.get()), det.type);
+    ASSERT_GT(blocks.size(), 1u);
+    IndexingBlockReader reader(std::move(det.file), filename, det.type, std::move(blocks));
+    std::vector<char> buf(1000);
+    size_t n = 0;
+    while (reader.decompress(buf, n)) {
+    }
+}
+
+static std::string indexed_range(const std::string& filename, const LineIndex& index, uint64_t first, uint64_t last) {
+    DetectionResult det = detectCompressionType(filename);
+    std::ostringstream out;
+    writeIndexedRange(fileno(det.file.get()), index, first, last, out);
+    return out.str();
+}
+
+TEST(LineIndexTest, BuilderRecordsEveryIntervalLine) {
+    LineIndexBuilder builder(CompressionType::GZIP, std::vector<CompressedBlock>(3), 2);
+    builder.addBlock("a\nb\nc", 5);
+    builder.addBlock("c\nd\n", 4);
+    builder.addBlock("e", 1);
+    LineIndex index = builder.finish();
+
+    EXPECT_EQ(index.lineCount(), 5u);
+    uint64_t entryLine = 0;
+    const LineIndex::Entry& third = index.entryFor(3, entryLine);
+    EXPECT_EQ(entryLine, 3u);
+    EXPECT_EQ(third.block, 0u);
+    EXPECT_EQ(third.offset, 4u);
+    const LineIndex::Entry& fifth = index.entryFor(6, entryLine);
+    EXPECT_EQ(entryLine, 5u);
+    EXPECT_EQ(fifth.block, 1u);
+    EXPECT_EQ(fifth.offset, 4u);
+}
+
+TEST(LineIndexTest, RangesFromStreamedIndex) {
+    const std::string filename = "indexed.bgz";
+    create_bgzf_file(filename, indexed_lines(1, 20000), 3000);
+    index_by_streaming(filename);
+
+    LineIndex index;
+    ASSERT_TRUE(index.load(filename));
+    EXPECT_EQ(index.lineCount(), 20000u);
+    EXPECT_EQ(index.compressionType(), CompressionType::GZIP);
+
+    EXPECT_EQ(indexed_range(filename, index, 1, 3), indexed_lines(1, 3));
+    EXPECT_EQ(indexed_range(filename, index, 4096, 4098), indexed_lines(4096, 4098));
+    EXPECT_EQ(indexed_range(filename, index, 12345, 12999), indexed_lines(12345, 12999));
+    EXPECT_EQ(indexed_range(filename, index, 19999, UINT64_MAX), indexed_lines(19999, 20000));
+    EXPECT_EQ(indexed_range(filename, index, 20001, 20005), "");
+
+    std::remove(LineIndex::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(LineIndexTest, IndexedTailMatchesTheRingOutput) {
+    const std::string filename = "indexed_budget.bgz";
+    create_bgzf_file(filename, indexed_lines(1, 20000), 3000);
+
+    CLIOptions options;
+    options.n = 2000;
+    options.bytesBudget = 1000;
+    StringSink sink;
+    ztail::TailEngine(options).tailFile(filename, sink);
+    const std::string streamed = sink.take();
+    EXPECT_LT(streamed.size(), 2000u); // far fewer than 2000 lines fit the budget
+
+    index_by_streaming(filename);
+    LineIndex index;
+    ASSERT_TRUE(index.load(filename));
+    ztail::TailEngine(options).tailFile(filename, sink);
+    EXPECT_EQ(sink.take(), streamed);
+
+    options.bytesBudget = 0;
+    ztail::TailEngine(options).tailFile(filename, sink);
+    EXPECT_EQ(sink.take(), indexed_lines(18001, 20000));
+
+    std::remove(LineIndex::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(LineIndexTest, StaleIndexIsIgnored) {
+    const std::string filename = "stale.bgz";
+    create_bgzf_file(filename, indexed_lines(1, 500), 1000);
+    index_by_streaming(filename);
+
+    LineIndex index;
+    EXPECT_TRUE(index.load(filename));
+    create_bgzf_file(filename, indexed_lines(1, 600), 1000);
+    EXPECT_FALSE(index.load(filename));
+
+    std::remove(LineIndex::pathFor(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(LineRangeWriterTest, StopsAfterLastLineAndTerminatesOutput) {
+    std::ostringstream out;
+    LineRangeWriter writer(out, 2, 3);
+    EXPECT_TRUE(writer.write("one\ntw", 6));
+    EXPECT_FALSE(writer.write("o\nthree\nfour\n", 13));
+    writer.finish();
+    EXPECT_EQ(out.str(), "two\nthree\n");
+
+    std::ostringstream tail;
+    LineRangeWriter unterminated(tail, 2, UINT64_MAX);
+    EXPECT_TRUE(unterminated.write("a\nb\nc", 5));
+    unterminated.finish();
+    EXPECT_EQ(tail.str(), "b\nc\n");
+}
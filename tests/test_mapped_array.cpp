@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include "mapped_array.h"
+#include "char_ring_buffer.h"
+#include <cstdint>
+#include <fstream>
+#include <unistd.h>
+
+// Resident set size of this process in bytes.
+static size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+TEST(MappedArrayTest, StartsZeroedAndMoves) {
+    MappedArray<uint32_t> a(1000);
+    ASSERT_EQ(a.size(), 1000u);
+    EXPECT_EQ(a[0], 0u);
+    EXPECT_EQ(a[999], 0u);
+    a[7] = 42;
+
+    MappedArray<uint32_t> b(std::move(a));
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(b[7], 42u);
+
+    b.resize(10);
+    EXPECT_EQ(b.size(), 10u);
+    EXPECT_EQ(b[7], 0u);
+}
+
+TEST(MappedArrayTest, LargeRingOnlyCommitsWhatItStores) {
+    const size_t before = resident_bytes();
+    CharRingBuffer<> cb(2000000, 512); // ~1 GiB of line data, 8 MiB of offsets
+    for (int i = 0; i < 1000; ++i) {
+        cb.append_line("a short line", 12);
+    }
+    EXPECT_GE(cb.memoryUsage(), 12000u);
+    EXPECT_LT(cb.memoryUsage(), 1u << 20); // reports what is committed, not the reservation
+    EXPECT_LT(resident_bytes() - before, 16u << 20);
+}
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+#include "memory_planner.h"
+#include "tail_engine.h"
+#include <lzma.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ftw.h>
+#include <string>
+#include <sys/stat.h>
+
+// Writes content to root + path, creating the directories on the way.
+static void put(const std::string& root, const std::string& path, const std::string& content) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        ::mkdir((root + path.substr(0, slash)).c_str(), 0755);
+    }
+    std::ofstream(root + path) << content;
+}
+
+// A fake / under the test temp directory, removed with everything in it.
+struct FakeRoot {
+    std::string path;
+
+    FakeRoot() {
+        std::string pattern = testing::TempDir() + "planner_XXXXXX";
+        path = ::mkdtemp(&pattern[0]) ? pattern : "";
+    }
+
+    ~FakeRoot() {
+        if (!path.empty()) {
+            ::nftw(path.c_str(), [](const char* file, const struct stat*, int, struct FTW*) {
+                return std::remove(file);
+            }, 16, FTW_DEPTH | FTW_PHYS);
+        }
+    }
+};
+
+static constexpr uint64_t MIB = 1u << 20;
+
+TEST(MemoryPlannerTest, ReadsCgroupV2LimitsUpTheHierarchy) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string& root = fake.path;
+    put(root, "/proc/meminfo", "MemTotal: 16777216 kB\nMemAvailable: 8388608 kB\n");
+    put(root, "/proc/self/cgroup", "0::/user/job\n");
+    put(root, "/sys/fs/cgroup/user/job/memory.max", "max\n");
+    put(root, "/sys/fs/cgroup/user/memory.max", "536870912\n");
+    put(root, "/sys/fs/cgroup/user/memory.current", "209715200\n");
+    put(root, "/sys/fs/cgroup/user/memory.stat", "anon 1000\ninactive_file 104857600\n");
+
+    const MemoryLimits limits = readMemoryLimits(root);
+    EXPECT_EQ(limits.memAvailable, 8ull << 30);
+    EXPECT_EQ(limits.cgroupLimit, 512 * MIB);
+    EXPECT_EQ(limits.cgroupUsage, 100 * MIB);
+    EXPECT_EQ(limits.available(), 412 * MIB);
+    EXPECT_EQ(memoryBudget(limits, 0), 206 * MIB);
+    EXPECT_EQ(memoryBudget(limits, 64 * MIB), 64 * MIB);
+}
+
+TEST(MemoryPlannerTest, ReadsCgroupV1Limits) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string& root = fake.path;
+    put(root, "/proc/meminfo", "MemAvailable: 1048576 kB\n");
+    put(root, "/proc/self/cgroup", "4:cpu,cpuacct:/job\n3:memory:/job\n");
+    put(root, "/sys/fs/cgroup/memory/memory.limit_in_bytes", "9223372036854771712\n");
+    put(root, "/sys/fs/cgroup/memory/job/memory.limit_in_bytes", "268435456\n");
+    put(root, "/sys/fs/cgroup/memory/job/memory.usage_in_bytes", "67108864\n");
+
+    const MemoryLimits limits = readMemoryLimits(root);
+    EXPECT_EQ(limits.cgroupLimit, 256 * MIB);
+    EXPECT_EQ(limits.available(), 192 * MIB);
+}
+
+TEST(MemoryPlannerTest, NothingKnownMeansNoBudget) {
+    const FakeRoot fake;
+    const MemoryLimits limits = readMemoryLimits(fake.path + "/missing");
+    EXPECT_EQ(limits.available(), 0u);
+    EXPECT_EQ(memoryBudget(limits, 0), 0u);
+}
+
+TEST(MemoryPlannerTest, LeavesOptionsAloneWhenEverythingFits) {
+    CLIOptions options;
+    const MemoryPlan plan = planMemory(options, 1ull << 30);
+    EXPECT_TRUE(plan.adjustments.empty());
+    EXPECT_TRUE(options.useThreads);
+    EXPECT_EQ(options.zstdWindowSize, 0u);
+    EXPECT_EQ(options.bytesBudget, 0u);
+    EXPECT_LE(plan.pipeline + plan.codec + plan.ring, plan.budget);
+}
+
+TEST(MemoryPlannerTest, ShrinksThreadsWindowsAndRingToFit) {
+    CLIOptions options;
+    options.n = 1000000;
+    options.readBufferSize = 8 * MIB;
+    const MemoryPlan plan = planMemory(options, 64 * MIB);
+    EXPECT_FALSE(options.useThreads);
+    EXPECT_EQ(options.readBufferSize, 2 * MIB);
+    EXPECT_EQ(options.zstdWindowSize, 32 * MIB);
+    EXPECT_GT(options.xzMemLimit, 32 * MIB);
+    EXPECT_EQ(options.bytesBudget, MIB); // the decoder windows took what the smallest ring leaves
+    EXPECT_EQ(plan.adjustments.size(), 4u);
+    EXPECT_LE(plan.pipeline + plan.codec + plan.ring, plan.budget);
+}
+
+TEST(MemoryPlannerTest, BoundsCountingWorkers) {
+    CLIOptions options;
+    options.count = true;
+    const MemoryPlan plan = planMemory(options, 256 * MIB);
+    EXPECT_TRUE(options.useThreads);
+    EXPECT_LT(options.countMemory, 256 * MIB);
+    EXPECT_LE(plan.pipeline + plan.codec + plan.workers, plan.budget);
+}
+
+TEST(MemoryPlannerTest, RingKeepsAMinimumUnderTinyBudgets) {
+    CLIOptions options;
+    options.perKey = "1";
+    planMemory(options, 1 * MIB);
+    EXPECT_EQ(options.bytesBudget, MIB);
+}
+
+TEST(MemoryPlannerTest, PlainInputsAreNotChargedADecoderWindow) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string filename = fake.path + "/plain.log";
+    std::ofstream(filename) << "line\n";
+    CLIOptions options;
+    options.filenames = {filename};
+    const MemoryPlan plan = planMemory(options, 64 * MIB);
+    EXPECT_EQ(plan.codec, 0u);
+    EXPECT_TRUE(plan.adjustments.empty());
+
+    options.format = "zstd";
+    EXPECT_GT(planMemory(options, 64 * MIB).codec, 0u);
+}
+
+TEST(MemoryPlannerTest, InputsAreInspectedOnlyWhenOverBudget) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string filename = fake.path + "/plain.log";
+    std::ofstream(filename) << "line\n";
+    CLIOptions options;
+    options.filenames = {filename};
+    // Without a budget, or with room for the worst case, the window is
+    // charged without opening the input.
+    EXPECT_GT(planMemory(options, 0).codec, 0u);
+    EXPECT_GT(planMemory(options, 4096 * MIB).codec, 0u);
+    EXPECT_EQ(planMemory(options, 64 * MIB).codec, 0u);
+}
+
+TEST(MemoryPlannerTest, SmallPlainInputsBoundTheRing) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string filename = fake.path + "/plain.log";
+    std::ofstream(filename) << std::string(MIB, 'x');
+    CLIOptions options;
+    options.filenames = {filename};
+    options.n = 100000;
+    options.lineCapacity = 1024; // a 98 MiB reservation, of which the file touches 1 MiB
+    const MemoryPlan plan = planMemory(options, 64 * MIB);
+    EXPECT_EQ(options.bytesBudget, 0u);
+    EXPECT_TRUE(plan.adjustments.empty());
+    EXPECT_LE(plan.ring, 2 * MIB);
+
+    options.filenames.clear(); // standard input may fill it
+    planMemory(options, 64 * MIB);
+    EXPECT_GT(options.bytesBudget, 0u);
+}
+
+TEST(MemoryPlannerTest, Xz9InputFitsA256MibCgroup) {
+    const FakeRoot fake;
+    ASSERT_FALSE(fake.path.empty());
+    const std::string& root = fake.path;
+    put(root, "/proc/meminfo", "MemAvailable: 8388608 kB\n");
+    put(root, "/proc/self/cgroup", "0::/job\n");
+    put(root, "/sys/fs/cgroup/job/memory.max", "268435456\n");
+    put(root, "/sys/fs/cgroup/job/memory.current", "16777216\n");
+
+    std::string text;
+    for (int i = 1; i <= 1000; ++i) {
+        text += "row " + std::to_string(i) + "\n";
+    }
+    std::string xz(lzma_stream_buffer_bound(text.size()), '\0');
+    size_t outPos = 0;
+    ASSERT_EQ(lzma_easy_buffer_encode(9, LZMA_CHECK_CRC64, nullptr, reinterpret_cast<const uint8_t*>(text.data()),
+                                      text.size(), reinterpret_cast<uint8_t*>(&xz[0]), &outPos, xz.size()),
+              LZMA_OK);
+    xz.resize(outPos);
+    const std::string filename = root + "/rows.xz";
+    std::ofstream(filename, std::ios::binary) << xz;
+
+    CLIOptions options;
+    options.n = 2;
+    options.filenames = {filename};
+    const MemoryPlan plan = planMemory(options, memoryBudget(readMemoryLimits(root), 0));
+    EXPECT_EQ(plan.budget, 120 * MIB);
+    EXPECT_FALSE(plan.adjustments.empty());
+    EXPECT_GT(options.xzMemLimit, 65 * MIB); // xz -9 decodes with a 64 MiB dictionary
+    EXPECT_LE(plan.pipeline + plan.codec + plan.ring, plan.budget);
+
+    ztail::TailEngine engine(options);
+    StringSink sink;
+    engine.tailFile(filename, sink);
+    EXPECT_EQ(sink.take(), "row 999\nrow 1000\n");
+}
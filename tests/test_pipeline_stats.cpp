@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "pipeline_stats.h"
+#include "process_stream.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static PipelineStats stream_with_stats(const std::string& data, size_t chunk, bool threaded, std::string& printed) {
+    CircularBuffer cb(5, 16);
+    Parser parser(cb, 16);
+    PipelineStats stats;
+    parser.setStats(&stats);
+    size_t pos = 0;
+    testing::internal::CaptureStdout();
+    processStream([&](std::vector<char>& buf, size_t& n) {
+            n = std::min({buf.size(), chunk, data.size() - pos});
+            std::memcpy(buf.data(), data.data() + pos, n);
+            pos += n;
+            return n > 0;
+        },
+        parser, cb, 64 * 1024, 1024, threaded, &stats);
+    printed = testing::internal::GetCapturedStdout();
+    return stats;
+}
+
+TEST(PipelineStatsTest, ProcessStreamCountsEveryChunk) {
+    std::string data;
+    for (int i = 0; i < 10000; ++i) {
+        data += "line " + std::to_string(i) + "\n";
+    }
+    for (bool threaded : {false, true}) {
+        std::string printed;
+        const PipelineStats stats = stream_with_stats(data, 1000, threaded, printed);
+        EXPECT_EQ(printed, "line 9995\nline 9996\nline 9997\nline 9998\nline 9999\n");
+        EXPECT_EQ(stats.bytesDecompressed, data.size());
+        EXPECT_EQ(stats.chunks, (data.size() + 999) / 1000);
+        EXPECT_GT(stats.parseNs, 0u);
+        EXPECT_GT(stats.ringNs, 0u);
+        EXPECT_GT(stats.ringMemory, 0u);
+    }
+}
+
+TEST(PipelineStatsTest, TimerIgnoresNullSlot) {
+    uint64_t ns = 0;
+    {
+        StageTimer timer(nullptr);
+        StageTimer counted(&ns);
+    }
+    EXPECT_GT(ns, 0u);
+}
+
+TEST(PipelineStatsTest, JsonReportEscapesNames) {
+    PipelineStats stats;
+    stats.bytesDecompressed = 42;
+    stats.bufferShrinks = 2;
+    std::ostringstream out;
+    stats.report(out, "a\"b.gz", true);
+    const std::string json = out.str();
+    EXPECT_NE(json.find("\"input\": \"a\\\"b.gz\""), std::string::npos);
+    EXPECT_NE(json.find("\"bytes_decompressed\": 42"), std::string::npos);
+    EXPECT_NE(json.find("\"buffer_shrinks\": 2"), std::string::npos);
+    EXPECT_EQ(json.back(), '\n');
+    EXPECT_EQ(std::count(json.begin(), json.end(), '\n'), 1);
+}
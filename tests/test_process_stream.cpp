@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include "process_stream.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::string run_stream(const std::string& data, size_t chunk, size_t lines, bool threaded) {
+    CircularBuffer cb(lines, 16);
+    Parser parser(cb, 16);
+    size_t pos = 0;
+    testing::internal::CaptureStdout();
+    processStream([&](std::vector<char>& buf, size_t& n) {
+            n = std::min({buf.size(), chunk, data.size() - pos});
+            std::memcpy(buf.data(), data.data() + pos, n);
+            pos += n;
+            return n > 0;
+        },
+        parser, cb, 64 * 1024, 1024, threaded);
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(ProcessStreamTest, ThreadedMatchesSequential) {
+    std::string data;
+    for (int i = 0; i < 200000; ++i) {
+        data += "line " + std::to_string(i) + "\n";
+    }
+    const std::string expected = run_stream(data, 1000, 50, false);
+    ASSERT_EQ(expected.substr(0, 12), "line 199950\n");
+    for (size_t chunk : {7u, 4096u, 65536u}) {
+        for (int round = 0; round < 3; ++round) {
+            EXPECT_EQ(run_stream(data, chunk, 50, true), expected) << "chunk " << chunk;
+        }
+    }
+}
+
+TEST(ProcessStreamTest, ReaderErrorsPropagate) {
+    CircularBuffer cb(10, 16);
+    Parser parser(cb, 16);
+    int calls = 0;
+    auto reader = [&](std::vector<char>& buf, size_t& n) {
+        if (++calls > 3) {
+            throw std::runtime_error("read failed");
+        }
+        buf[0] = 'x';
+        buf[1] = '\n';
+        n = 2;
+        return true;
+    };
+    testing::internal::CaptureStdout();
+    EXPECT_THROW(processStream(reader, parser, cb, 4096, 1024, true), std::runtime_error);
+    testing::internal::GetCapturedStdout();
+}
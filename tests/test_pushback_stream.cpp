@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "pushback_stream.h"
+#include "compression_type.h"
+#include "compressor_factory.h"
+#include <zstd.h>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+std::string numbered(int count) {
+    std::string text;
+    for (int i = 1; i <= count; ++i) {
+        text += "row " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+// Feeds data into a pipe from another thread.
+class PipeFeeder {
+public:
+    explicit PipeFeeder(std::string data) : data(std::move(data)) {
+        int fds[2];
+        if (::pipe(fds) != 0) {
+            throw std::runtime_error("pipe failed");
+        }
+        readEnd = fds[0];
+        writeEnd = fds[1];
+        writer = std::thread([this] {
+            size_t pos = 0;
+            while (pos < this->data.size()) {
+                const ssize_t n = ::write(writeEnd, this->data.data() + pos, this->data.size() - pos);
+                if (n <= 0) {
+                    break;
+                }
+                pos += static_cast<size_t>(n);
+            }
+            ::close(writeEnd);
+        });
+    }
+    ~PipeFeeder() {
+        writer.join();
+        ::close(readEnd);
+    }
+
+    int fd() const { return readEnd; }
+
+private:
+    std::string data;
+    int readEnd;
+    int writeEnd;
+    std::thread writer;
+};
+
+} // namespace
+
+TEST(PushbackStreamTest, ReplaysPrefixAndSeeksWithinKeptBytes) {
+    PipeFeeder feeder("world, and more");
+    FilePtr file = openPushbackStream(feeder.fd(), "hello ", 8);
+    char buf[64] = {0};
+    ASSERT_EQ(std::fread(buf, 1, 3, file.get()), 3u);
+    EXPECT_EQ(std::string(buf, 3), "hel");
+    ASSERT_EQ(std::fseek(file.get(), 0, SEEK_SET), 0);
+
+    const size_t n = std::fread(buf, 1, sizeof(buf), file.get());
+    EXPECT_EQ(std::string(buf, n), "hello world, and more");
+    // Only the first 8 bytes were kept.
+    EXPECT_NE(std::fseek(file.get(), 0, SEEK_SET), 0);
+}
+
+TEST(PushbackStreamTest, DetectsAndDecodesCompressedPipe) {
+    const std::string text = numbered(20000);
+    std::string zst(ZSTD_compressBound(text.size()), '\0');
+    zst.resize(ZSTD_compress(&zst[0], zst.size(), text.data(), text.size(), 3));
+    PipeFeeder feeder(zst);
+
+    DetectionResult det = detectStreamCompressionType(feeder.fd(), "pipe");
+    ASSERT_EQ(det.type, CompressionType::ZSTD);
+    EXPECT_LT(fileno(det.file.get()), 0);
+    CLIOptions options;
+    std::unique_ptr<ICompressor> reader = openReader(det, "pipe", options);
+    std::vector<char> buffer(4096);
+    size_t n = 0;
+    std::string decoded;
+    while (reader->decompress(buffer, n)) {
+        decoded.append(buffer.data(), n);
+    }
+    EXPECT_EQ(decoded, text);
+}
+
+TEST(PushbackStreamTest, ShortPlainInputIsHandedOnUnchanged) {
+    PipeFeeder feeder("ab\n");
+    DetectionResult det = detectStreamCompressionType(feeder.fd(), "pipe");
+    ASSERT_EQ(det.type, CompressionType::NONE);
+    CLIOptions options;
+    std::unique_ptr<ICompressor> reader = openReader(det, "pipe", options);
+    std::vector<char> buffer(16);
+    size_t n = 0;
+    ASSERT_TRUE(reader->decompress(buffer, n));
+    EXPECT_EQ(std::string(buffer.data(), n), "ab\n");
+    EXPECT_FALSE(reader->decompress(buffer, n));
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "seekable_blocks.h"
+#include "compression_type.h"
+#include <zlib.h>
+#include <zstd.h>
+#include <lzma.h>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+void append_lz4_frame(const std::string& filename, const std::string& content, bool independent,
+                      bool blockChecksums);
+
+// Writes content as BGZF blocks of at most blockSize uncompressed bytes.
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize) {
+    std::ofstream ofs(filename, std::ios::binary);
+    auto writeBlock = [&](const char* data, size_t len) {
+        std::vector<unsigned char> deflated(compressBound(static_cast<uLong>(len)) + 64);
+        z_stream zs{};
+        ASSERT_EQ(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY), Z_OK);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zs.avail_in = static_cast<uInt>(len);
+        zs.next_out = deflated.data();
+        zs.avail_out = static_cast<uInt>(deflated.size());
+        ASSERT_EQ(deflate(&zs, Z_FINISH), Z_STREAM_END);
+        size_t clen = deflated.size() - zs.avail_out;
+        deflateEnd(&zs);
+        size_t bsize = 18 + clen + 8 - 1;
+        unsigned char header[18] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+                                    static_cast<unsigned char>(bsize & 0xff), static_cast<unsigned char>(bsize >> 8)};
+        ofs.write(reinterpret_cast<char*>(header), sizeof(header));
+        ofs.write(reinterpret_cast<char*>(deflated.data()), static_cast<std::streamsize>(clen));
+        uint32_t crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(len)));
+        uint32_t isize = static_cast<uint32_t>(len);
+        ofs.write(reinterpret_cast<char*>(&crc), 4);
+        ofs.write(reinterpret_cast<char*>(&isize), 4);
+    };
+    for (size_t pos = 0; pos < content.size(); pos += blockSize) {
+        writeBlock(content.data() + pos, std::min(blockSize, content.size() - pos));
+    }
+    writeBlock("", 0); // EOF marker
+}
+
+static std::string numbered_lines(int count) {
+    std::string content;
+    for (int i = 1; i <= count; ++i) {
+        content += "line " + std::to_string(i) + "\n";
+    }
+    return content;
+}
+
+static std::string decode_all(const std::string& filename, size_t expectedBlocks) {
+    DetectionResult det = detectCompressionType(filename);
+    int fd = fileno(det.file.get());
+    std::vector<CompressedBlock> blocks = listCompressedBlocks(fd, det.type);
+    EXPECT_EQ(blocks.size(), expectedBlocks);
+    BlockDecoder decoder(fd, det.type);
+    std::string out;
+    std::vector<char> buf;
+    for (const auto& b : blocks) {
+        decoder.decode(b, buf);
+        out.append(buf.data(), buf.size());
+    }
+    return out;
+}
+
+TEST(SeekableBlocksTest, BgzfBlocks) {
+    const std::string filename = "blocks.bgz";
+    const std::string content = numbered_lines(500);
+    create_bgzf_file(filename, content, 1000);
+    EXPECT_EQ(decode_all(filename, (content.size() + 999) / 1000), content);
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, PlainGzipHasNoBlocks) {
+    const std::string filename = "plain_member.gz";
+    gzFile gz = gzopen(filename.c_str(), "wb");
+    ASSERT_TRUE(gz);
+    gzputs(gz, "a\nb\n");
+    gzclose(gz);
+    DetectionResult det = detectCompressionType(filename);
+    EXPECT_TRUE(listCompressedBlocks(fileno(det.file.get()), det.type).empty());
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, ZstdFrames) {
+    const std::string filename = "frames.zst";
+    const std::string content = numbered_lines(300);
+    std::ofstream ofs(filename, std::ios::binary);
+    const size_t frameSize = 700;
+    size_t frames = 0;
+    for (size_t pos = 0; pos < content.size(); pos += frameSize, ++frames) {
+        size_t len = std::min(frameSize, content.size() - pos);
+        std::vector<char> out(ZSTD_compressBound(len));
+        size_t c = ZSTD_compress(out.data(), out.size(), content.data() + pos, len, 1);
+        ASSERT_FALSE(ZSTD_isError(c));
+        ofs.write(out.data(), static_cast<std::streamsize>(c));
+    }
+    ofs.close();
+    EXPECT_EQ(decode_all(filename, frames), content);
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, XzStreams) {
+    const std::string filename = "streams.xz";
+    const std::string parts[2] = {numbered_lines(100), "tail line\n"};
+    std::ofstream ofs(filename, std::ios::binary);
+    for (const auto& part : parts) {
+        std::vector<uint8_t> out(lzma_stream_buffer_bound(part.size()));
+        size_t outPos = 0;
+        ASSERT_EQ(lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, nullptr,
+                                          reinterpret_cast<const uint8_t*>(part.data()), part.size(),
+                                          out.data(), &outPos, out.size()), LZMA_OK);
+        ofs.write(reinterpret_cast<char*>(out.data()), static_cast<std::streamsize>(outPos));
+    }
+    ofs.close();
+    EXPECT_EQ(decode_all(filename, 2), parts[0] + parts[1]);
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, EmptyXzBlockIsAnError) {
+    const std::string filename = "empty_block.xz";
+    std::ofstream(filename, std::ios::binary) << "x";
+    DetectionResult det = detectCompressionType(filename);
+    BlockDecoder decoder(fileno(det.file.get()), CompressionType::XZ);
+    std::vector<char> out;
+    EXPECT_THROW(decoder.decode(CompressedBlock{0, 0, 16, LZMA_CHECK_CRC64}, out), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, Lz4IndependentBlocks) {
+    const std::string filename = "blocks.lz4";
+    std::remove(filename.c_str());
+    const std::string parts[2] = {numbered_lines(30000), numbered_lines(100)};
+    append_lz4_frame(filename, parts[0], true, true);
+    append_lz4_frame(filename, parts[1], true, false);
+    // 64 KiB blocks: the first frame needs several, the second one.
+    const size_t blocks = (parts[0].size() + 65535) / 65536 + 1;
+    EXPECT_EQ(decode_all(filename, blocks), parts[0] + parts[1]);
+    std::remove(filename.c_str());
+}
+
+TEST(SeekableBlocksTest, Lz4LinkedBlocksHaveNoBlocks) {
+    const std::string filename = "linked.lz4";
+    std::remove(filename.c_str());
+    append_lz4_frame(filename, numbered_lines(30000), false, false);
+    DetectionResult det = detectCompressionType(filename);
+    EXPECT_TRUE(listCompressedBlocks(fileno(det.file.get()), det.type).empty());
+    std::remove(filename.c_str());
+}
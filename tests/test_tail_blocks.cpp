@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "tail_blocks.h"
+#include "circular_buffer.h"
+#include "compression_type.h"
+#include <cstdio>
+#include <string>
+
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+void append_lz4_frame(const std::string& filename, const std::string& content, bool independent,
+                      bool blockChecksums);
+
+static std::string numbered_lines(int first, int last) {
+    std::string content;
+    for (int i = first; i <= last; ++i) {
+        content += "line " + std::to_string(i) + (i % 10 == 0 ? " ERROR" : "") + "\n";
+    }
+    return content;
+}
+
+// Tails filename with tailBlocks and returns what the ring prints.
+static std::string tail_blocks(const std::string& filename, size_t n, const LineFilter* filter = nullptr,
+                               uint64_t heldBytes = 64u << 20) {
+    DetectionResult det = detectCompressionType(filename);
+    const int fd = fileno(det.file.get());
+    const std::vector<CompressedBlock> blocks = listCompressedBlocks(fd, det.type);
+    EXPECT_GE(blocks.size(), 2u);
+    CircularBuffer cb(n, 16);
+    Parser parser(cb, 16, filter);
+    tailBlocks(fd, det.type, blocks, parser, n, heldBytes);
+    testing::internal::CaptureStdout();
+    cb.print(1 << 20);
+    return testing::internal::GetCapturedStdout();
+}
+
+TEST(TailBlocksTest, LastLinesAcrossSmallBlocks) {
+    const std::string filename = "tail_blocks.bgz";
+    create_bgzf_file(filename, numbered_lines(1, 2000), 37); // most lines cross a block boundary
+    EXPECT_EQ(tail_blocks(filename, 3), numbered_lines(1998, 2000));
+    EXPECT_EQ(tail_blocks(filename, 5000), numbered_lines(1, 2000));
+    EXPECT_EQ(tail_blocks(filename, 0), "");
+    std::remove(filename.c_str());
+}
+
+TEST(TailBlocksTest, BlocksPastTheBudgetAreDecodedAgain) {
+    const std::string filename = "tail_blocks_budget.bgz";
+    create_bgzf_file(filename, numbered_lines(1, 2000), 41);
+    LineFilter filter = LineFilter::literal("ERROR");
+    for (uint64_t held : {0u, 100u, 1000u}) {
+        EXPECT_EQ(tail_blocks(filename, 1500, nullptr, held), numbered_lines(501, 2000));
+        EXPECT_EQ(tail_blocks(filename, 3, &filter, held), "line 1980 ERROR\nline 1990 ERROR\nline 2000 ERROR\n");
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(TailBlocksTest, FilteredLinesAcrossBlocks) {
+    const std::string filename = "tail_blocks_filtered.bgz";
+    create_bgzf_file(filename, numbered_lines(1, 2000), 23);
+    LineFilter filter = LineFilter::literal("ERROR");
+    EXPECT_EQ(tail_blocks(filename, 2, &filter), "line 1990 ERROR\nline 2000 ERROR\n");
+    std::remove(filename.c_str());
+}
+
+TEST(TailBlocksTest, UnterminatedLastLine) {
+    const std::string filename = "tail_blocks_unterminated.bgz";
+    create_bgzf_file(filename, numbered_lines(1, 100) + "last", 50);
+    EXPECT_EQ(tail_blocks(filename, 2), "line 100 ERROR\nlast\n");
+    std::remove(filename.c_str());
+}
+
+TEST(TailBlocksTest, Lz4LastLinesAcrossFrames) {
+    const std::string filename = "tail_blocks.lz4";
+    std::remove(filename.c_str());
+    append_lz4_frame(filename, numbered_lines(1, 100000), true, true);
+    append_lz4_frame(filename, numbered_lines(100001, 100002), true, false);
+    EXPECT_EQ(tail_blocks(filename, 10000), numbered_lines(90003, 100002));
+    std::remove(filename.c_str());
+}
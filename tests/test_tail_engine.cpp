@@ -0,0 +1,266 @@
+#include <gtest/gtest.h>
+#include "tail_engine.h"
+#include "tail_engine_c.h"
+#include <zlib.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::string numbered_lines(int first, int last) {
+    std::string text;
+    for (int i = first; i <= last; ++i) {
+        text += "line " + std::to_string(i) + (i % 10 == 0 ? " ERROR" : "") + "\n";
+    }
+    return text;
+}
+
+static std::string gzipped(const std::string& text) {
+    uLongf size = compressBound(static_cast<uLong>(text.size())) + 32;
+    std::string out(size, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+static CLIOptions lines(int n) {
+    CLIOptions options;
+    options.n = n;
+    return options;
+}
+
+TEST(TailEngineTest, PlainBufferLinesViewTheBuffer) {
+    const std::string text = numbered_lines(1, 1000);
+    ztail::TailEngine engine(lines(3));
+    ztail::TailResult result = engine.tailBuffer(text.data(), text.size());
+
+    ASSERT_EQ(result.size(), 3u);
+    EXPECT_EQ(result[0], "line 998");
+    EXPECT_EQ(result[2], "line 1000 ERROR");
+    EXPECT_GE(result[0].data(), text.data());
+    EXPECT_LT(result[0].data(), text.data() + text.size());
+}
+
+TEST(TailEngineTest, UnterminatedLastLineAndFilter) {
+    const std::string text = "a ERROR\nb\nc ERROR\nd";
+    CLIOptions options = lines(5);
+    options.grepPattern = "ERROR";
+    ztail::TailResult filtered = ztail::TailEngine(options).tailBuffer(text.data(), text.size());
+    ASSERT_EQ(filtered.size(), 2u);
+    EXPECT_EQ(filtered[1], "c ERROR");
+
+    StringSink sink;
+    ztail::TailEngine(lines(2)).tailBuffer(text.data(), text.size(), sink);
+    EXPECT_EQ(sink.str(), "c ERROR\nd\n");
+}
+
+TEST(TailEngineTest, CompressedBufferAndFile) {
+    const std::string text = numbered_lines(1, 5000);
+    const std::string gz = gzipped(text);
+    ztail::TailEngine engine(lines(2));
+
+    ztail::TailResult fromBuffer = engine.tailBuffer(gz.data(), gz.size());
+    ASSERT_EQ(fromBuffer.size(), 2u);
+    EXPECT_EQ(fromBuffer[1], "line 5000 ERROR");
+
+    const std::string filename = "tail_engine.gz";
+    std::ofstream(filename, std::ios::binary) << gz;
+    StringSink sink;
+    engine.tailFile(filename, sink);
+    EXPECT_EQ(sink.str(), "line 4999\nline 5000 ERROR\n");
+    std::remove(filename.c_str());
+}
+
+TEST(TailEngineTest, RegularDescriptorIsTailedFromItsStart) {
+    const std::string filename = "tail_engine.txt";
+    std::ofstream(filename, std::ios::binary) << numbered_lines(1, 100);
+    FILE* file = std::fopen(filename.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, 500, SEEK_SET);
+
+    ztail::TailResult result = ztail::TailEngine(lines(1)).tailFd(fileno(file));
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result[0], "line 100 ERROR");
+    std::fclose(file);
+    std::remove(filename.c_str());
+}
+
+TEST(TailEngineTest, PipeIsStreamed) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    const std::string text = numbered_lines(1, 50);
+    std::thread writer([&] {
+        ASSERT_EQ(::write(fds[1], text.data(), text.size()), static_cast<ssize_t>(text.size()));
+        ::close(fds[1]);
+    });
+    ztail::TailResult result = ztail::TailEngine(lines(2)).tailFd(fds[0]);
+    writer.join();
+    ::close(fds[0]);
+
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_EQ(result[0], "line 49");
+}
+
+TEST(TailEngineTest, CompressedPipeIsDecoded) {
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    const std::string gz = gzipped(numbered_lines(1, 5000));
+    std::thread writer([&] {
+        // Dribble the header so detection has to gather it over several reads.
+        ASSERT_EQ(::write(fds[1], gz.data(), 1), 1);
+        ASSERT_EQ(::write(fds[1], gz.data() + 1, gz.size() - 1), static_cast<ssize_t>(gz.size() - 1));
+        ::close(fds[1]);
+    });
+    ztail::TailResult result = ztail::TailEngine(lines(2)).tailFd(fds[0]);
+    writer.join();
+    ::close(fds[0]);
+
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_EQ(result[0], "line 4999");
+    EXPECT_EQ(result[1], "line 5000 ERROR");
+}
+
+TEST(TailEngineTest, FormatOverridesDetection) {
+    const std::string filename = "test_engine_format.log";
+    std::ofstream(filename, std::ios::binary) << gzipped(numbered_lines(1, 100));
+    CLIOptions options = lines(1);
+    options.format = "gzip";
+    ztail::TailResult result = ztail::TailEngine(options).tailFile(filename);
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result[0], "line 100 ERROR");
+
+    options.format = "zstd";
+    EXPECT_THROW(ztail::TailEngine(options).tailFile(filename), std::runtime_error);
+    options.format = "rar";
+    EXPECT_THROW(ztail::TailEngine{options}, std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(TailEngineTest, PerKeyBufferGoesThroughTheRing) {
+    const std::string text = "k=a 1\nk=b 1\nk=a 2\nk=a 3\nk=b 2\n";
+    CLIOptions options = lines(1);
+    options.perKey = "k";
+    StringSink sink;
+    ztail::TailEngine(options).tailBuffer(text.data(), text.size(), sink);
+    EXPECT_EQ(sink.str(), "k=a 3\nk=b 2\n");
+}
+
+TEST(TailEngineTest, WarningsGoToTheDiagnosticSink) {
+    std::string text;
+    for (int i = 0; i < 20; ++i) {
+        text += "key" + std::to_string(i) + " x\n";
+    }
+    CLIOptions options = lines(2);
+    options.perKey = "1";
+    options.lineCapacity = 16;
+    options.bytesBudget = 1024;
+    std::vector<std::string> warnings;
+    StringSink sink;
+    testing::internal::CaptureStderr();
+    ztail::TailEngine(options, [&](const std::string& message) { warnings.push_back(message); })
+        .tailBuffer(text.data(), text.size(), sink);
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "");
+    ASSERT_EQ(warnings.size(), 1u);
+    EXPECT_NE(warnings[0].find("idle keys were evicted"), std::string::npos);
+
+    // Without a sink the warning is dropped.
+    testing::internal::CaptureStderr();
+    ztail::TailEngine(options).tailBuffer(text.data(), text.size(), sink);
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "");
+}
+
+TEST(TailEngineTest, ConcurrentEnginesKeepTheirOutputApart) {
+    std::vector<std::string> inputs;
+    for (int t = 0; t < 8; ++t) {
+        inputs.push_back(numbered_lines(t * 100000 + 1, t * 100000 + 20000));
+    }
+    std::vector<std::string> outputs(inputs.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < inputs.size(); ++t) {
+        threads.emplace_back([&, t] {
+            CLIOptions options = lines(1000);
+            options.perKey = "1"; // one key: goes through the keyed ring
+            StringSink sink;
+            ztail::TailEngine(options).tailBuffer(inputs[t].data(), inputs[t].size(), sink);
+            outputs[t] = sink.take();
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (size_t t = 0; t < inputs.size(); ++t) {
+        const int last = static_cast<int>(t) * 100000 + 20000;
+        EXPECT_EQ(outputs[t], numbered_lines(last - 999, last)) << "engine " << t;
+    }
+}
+
+TEST(TailEngineCApiTest, CallbackAndSpans) {
+    ztail_options options;
+    ztail_options_init(&options);
+    options.lines = 2;
+    ztail_engine* engine = ztail_engine_new(&options);
+    ASSERT_NE(engine, nullptr);
+
+    const std::string text = numbered_lines(1, 30);
+    std::string printed;
+    ASSERT_EQ(ztail_tail_buffer(engine, text.data(), text.size(), [](void* user, const char* data, size_t size) {
+        static_cast<std::string*>(user)->append(data, size);
+    }, &printed), 0);
+    EXPECT_EQ(printed, "line 29\nline 30 ERROR\n");
+
+    ztail_result* result = ztail_tail_buffer_lines(engine, text.data(), text.size());
+    ASSERT_NE(result, nullptr);
+    ASSERT_EQ(ztail_result_size(result), 2u);
+    const ztail_span span = ztail_result_line(result, 0);
+    EXPECT_EQ(std::string(span.data, span.size), "line 29");
+    ztail_result_free(result);
+
+    EXPECT_EQ(ztail_tail_file_lines(engine, "does-not-exist.log"), nullptr);
+    EXPECT_NE(std::string(ztail_last_error()).find("does-not-exist.log"), std::string::npos);
+    ztail_engine_free(engine);
+}
+
+TEST(TailEngineCApiTest, WarnCallback) {
+    ztail_options options;
+    ztail_options_init(&options);
+    options.lines = 2;
+    options.per_key = "1";
+    options.line_capacity = 16;
+    options.bytes_budget = 1024;
+    std::vector<std::string> warnings;
+    options.warn = [](void* user, const char* message) {
+        static_cast<std::vector<std::string>*>(user)->push_back(message);
+    };
+    options.warn_user = &warnings;
+    ztail_engine* engine = ztail_engine_new(&options);
+    ASSERT_NE(engine, nullptr);
+
+    std::string text;
+    for (int i = 0; i < 20; ++i) {
+        text += "key" + std::to_string(i) + " x\n";
+    }
+    ztail_result* result = ztail_tail_buffer_lines(engine, text.data(), text.size());
+    ASSERT_NE(result, nullptr);
+    ztail_result_free(result);
+    ASSERT_EQ(warnings.size(), 1u);
+    EXPECT_NE(warnings[0].find("evicted"), std::string::npos);
+    ztail_engine_free(engine);
+}
+
+TEST(TailEngineCApiTest, RejectsConflictingOptions) {
+    ztail_options options;
+    ztail_options_init(&options);
+    options.per_key = "k";
+    options.compress_ring = 1;
+    EXPECT_EQ(ztail_engine_new(&options), nullptr);
+    EXPECT_NE(std::string(ztail_last_error()), "");
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "tail_plain.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include <fstream>
+#include <cstdio>
+
+static void write_plain(const std::string& filename, int lines) {
+    std::ofstream ofs(filename, std::ios::binary);
+    for (int i = 1; i <= lines; ++i) {
+        ofs << "line " << i << (i % 10 == 0 ? " ERROR" : "") << "\n";
+    }
+}
+
+TEST(TailPlainTest, LastLinesAcrossChunks) {
+    const std::string filename = "tail_plain.txt";
+    write_plain(filename, 1000);
+
+    CircularBuffer cb(3, 16);
+    Parser parser(cb, 16);
+    tailPlainFile(filename, parser, 3, 64); // many small chunks
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "line 998\nline 999\nline 1000 ERROR\n");
+    std::remove(filename.c_str());
+}
+
+TEST(TailPlainTest, FilteredLastLinesAcrossChunks) {
+    const std::string filename = "tail_plain_filtered.txt";
+    write_plain(filename, 1000);
+
+    LineFilter filter = LineFilter::literal("ERROR");
+    CircularBuffer cb(2, 16);
+    Parser parser(cb, 16, &filter);
+    tailPlainFile(filename, parser, 2, 7);
+
+    testing::internal::CaptureStdout();
+    cb.print(1024);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(output, "line 990 ERROR\nline 1000 ERROR\n");
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+#include "tar_reader.h"
+#include "compression_type.h"
+#include "compressor_factory.h"
+#include "tail_engine.h"
+#include <zlib.h>
+#include <zstd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+void create_bgzf_file(const std::string& filename, const std::string& content, size_t blockSize);
+
+namespace {
+
+// A POSIX ustar header, or a GNU one with access and change times where
+// POSIX keeps the path prefix.
+std::string tarHeader(const std::string& name, uint64_t size, char type, bool gnu = false) {
+    std::string header(512, '\0');
+    std::memcpy(&header[0], name.data(), std::min<size_t>(name.size(), 100));
+    std::snprintf(&header[100], 8, "%07o", 0644);
+    std::snprintf(&header[124], 12, "%011llo", static_cast<unsigned long long>(size));
+    header[156] = type;
+    if (gnu) {
+        std::memcpy(&header[257], "ustar  ", 8);
+        std::snprintf(&header[345], 12, "%011o", 012345670123);
+        std::snprintf(&header[357], 12, "%011o", 012345670123);
+    } else {
+        std::memcpy(&header[257], "ustar\0" "00", 8);
+    }
+    std::memset(&header[148], ' ', 8);
+    unsigned sum = 0;
+    for (unsigned char c : header) {
+        sum += c;
+    }
+    std::snprintf(&header[148], 8, "%06o", sum);
+    return header;
+}
+
+void addMember(std::string& tar, const std::string& name, const std::string& data, char type = '0') {
+    tar += tarHeader(name, data.size(), type);
+    tar += data;
+    tar += std::string((512 - data.size() % 512) % 512, '\0');
+}
+
+std::string paxRecord(const std::string& key, const std::string& value) {
+    const std::string body = " " + key + "=" + value + "\n";
+    size_t len = body.size() + 1;
+    while (std::to_string(len).size() + body.size() != len) {
+        ++len;
+    }
+    return std::to_string(len) + body;
+}
+
+std::string numbered(const std::string& prefix, int count) {
+    std::string text;
+    for (int i = 1; i <= count; ++i) {
+        text += prefix + " " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+const std::string longName = "bundle/" + std::string(120, 'n') + "/deep.log";
+
+std::string sampleTar() {
+    std::string tar;
+    addMember(tar, "./bundle/", "", '5');
+    addMember(tar, "./bundle/big.bin", std::string(10000, 'x'));
+    addMember(tar, "./bundle/app.log", numbered("app", 300));
+    addMember(tar, "./bundle/link.log", "", '2');
+    addMember(tar, "././@PaxHeader", paxRecord("path", longName), 'x');
+    addMember(tar, "bundle/truncated-name", numbered("deep", 50));
+    addMember(tar, "./bundle/db.log", numbered("db", 40));
+    tar += std::string(1024, '\0');
+    return tar;
+}
+
+std::string readMember(TarReader& tar) {
+    std::vector<char> buffer(333);
+    size_t n = 0;
+    std::string data;
+    while (tar.decompress(buffer, n)) {
+        data.append(buffer.data(), n);
+    }
+    return data;
+}
+
+std::string gzipped(const std::string& text) {
+    std::string out(compressBound(static_cast<uLong>(text.size())) + 32, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+std::string zstdFrame(const std::string& text) {
+    std::string out(ZSTD_compressBound(text.size()), '\0');
+    out.resize(ZSTD_compress(&out[0], out.size(), text.data(), text.size(), 1));
+    return out;
+}
+
+} // namespace
+
+TEST(TarReaderTest, SelectsMembersByNameAndGlob) {
+    const std::string filename = "test_tar_plain.tar";
+    std::ofstream(filename, std::ios::binary) << sampleTar();
+    DetectionResult det = detectCompressionType(filename);
+    ASSERT_EQ(det.type, CompressionType::NONE);
+
+    TarReader exact(fileTarSource(fileno(det.file.get())), filename);
+    ASSERT_TRUE(exact.nextMember("bundle/app.log"));
+    EXPECT_EQ(exact.member().name, "./bundle/app.log");
+    EXPECT_EQ(exact.member().offset, 512u + 512u + 10240u + 512u);
+    EXPECT_EQ(readMember(exact), numbered("app", 300));
+
+    TarReader glob(fileTarSource(fileno(det.file.get())), filename);
+    std::vector<std::string> names;
+    while (glob.nextMember("*.log")) {
+        names.push_back(glob.member().name);
+        if (glob.member().name == longName) {
+            EXPECT_EQ(readMember(glob), numbered("deep", 50));
+        }
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"./bundle/app.log", longName, "./bundle/db.log"}));
+    std::remove(filename.c_str());
+}
+
+TEST(TarReaderTest, GnuHeadersHaveNoPathPrefix) {
+    const std::string filename = "test_tar_gnu.tar";
+    std::string tar = tarHeader("gnu/app.log", 8, '0', true) + "gnu one\n" + std::string(504, '\0');
+    tar += std::string(1024, '\0');
+    std::ofstream(filename, std::ios::binary) << tar;
+    DetectionResult det = detectCompressionType(filename);
+
+    TarReader reader(fileTarSource(fileno(det.file.get())), filename);
+    ASSERT_TRUE(reader.nextMember("gnu/app.log"));
+    EXPECT_EQ(reader.member().name, "gnu/app.log");
+    EXPECT_EQ(readMember(reader), "gnu one\n");
+    std::remove(filename.c_str());
+}
+
+TEST(TarReaderTest, BlockSourceJumpsOverSkippedBlocks) {
+    const std::string filename = "test_tar_blocks.tar.bgz";
+    create_bgzf_file(filename, sampleTar(), 1000);
+
+    // Corrupt a block that lies entirely inside big.bin: streaming fails on
+    // it, the block source never decodes it.
+    DetectionResult det = detectCompressionType(filename);
+    std::vector<CompressedBlock> blocks = listCompressedBlocks(fileno(det.file.get()), det.type);
+    ASSERT_GT(blocks.size(), 6u);
+    {
+        std::fstream f(filename, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(static_cast<std::streamoff>(blocks[5].offset + 20));
+        f.write("garbage!", 8);
+    }
+
+    TarReader tar(blockTarSource(fileno(det.file.get()), det.type, blocks), filename);
+    ASSERT_TRUE(tar.nextMember("*/db.log"));
+    EXPECT_EQ(readMember(tar), numbered("db", 40));
+
+    CLIOptions options;
+    options.n = 1;
+    options.tarMember = "bundle/db.log";
+    ztail::TailResult result = ztail::TailEngine(options).tailFile(filename);
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result[0], "db 40");
+
+    DetectionResult again = detectCompressionType(filename);
+    TarReader streamed(streamTarSource(openCompressor(again, filename, options)), filename);
+    EXPECT_THROW({
+        while (streamed.nextMember("*/db.log")) {
+        }
+    }, std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(TarReaderTest, SingleFrameArchivesAreStreamed) {
+    const std::string single = "test_tar_single.tar.zst";
+    const std::string framed = "test_tar_framed.tar.zst";
+    const std::string tar = sampleTar();
+    std::ofstream(single, std::ios::binary) << zstdFrame(tar);
+    std::ofstream(framed, std::ios::binary) << zstdFrame(tar.substr(0, 8192)) << zstdFrame(tar.substr(8192));
+
+    // The one frame the zstd tool writes is the whole archive.
+    DetectionResult one = detectCompressionType(single);
+    std::vector<CompressedBlock> blocks = listCompressedBlocks(fileno(one.file.get()), one.type);
+    ASSERT_EQ(blocks.size(), 1u);
+    EXPECT_EQ(blockTarSource(fileno(one.file.get()), one.type, blocks), nullptr);
+
+    DetectionResult two = detectCompressionType(framed);
+    blocks = listCompressedBlocks(fileno(two.file.get()), two.type);
+    ASSERT_EQ(blocks.size(), 2u);
+    EXPECT_NE(blockTarSource(fileno(two.file.get()), two.type, blocks), nullptr);
+    EXPECT_EQ(blockTarSource(fileno(two.file.get()), two.type, blocks, 4096), nullptr); // frames past the bound
+
+    CLIOptions options;
+    options.n = 1;
+    options.tarMember = "bundle/db.log";
+    for (const std::string& filename : {single, framed}) {
+        ztail::TailResult result = ztail::TailEngine(options).tailFile(filename);
+        ASSERT_EQ(result.size(), 1u);
+        EXPECT_EQ(result[0], "db 40");
+    }
+    std::remove(single.c_str());
+    std::remove(framed.c_str());
+}
+
+TEST(TarReaderTest, BadChecksumThrows) {
+    const std::string filename = "test_tar_bad.tar";
+    std::string tar = sampleTar();
+    tar[10] = 'Z';
+    std::ofstream(filename, std::ios::binary) << tar;
+    DetectionResult det = detectCompressionType(filename);
+    TarReader reader(fileTarSource(fileno(det.file.get())), filename);
+    EXPECT_THROW(reader.nextMember("*"), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(TarReaderTest, EngineTailsMembersOfCompressedAndPlainArchives) {
+    const std::string plain = "test_tar_engine.tar";
+    const std::string gz = "test_tar_engine.tar.gz";
+    std::ofstream(plain, std::ios::binary) << sampleTar();
+    std::ofstream(gz, std::ios::binary) << gzipped(sampleTar());
+
+    CLIOptions options;
+    options.n = 2;
+    options.tarMember = "bundle/*.log";
+    for (const std::string& filename : {plain, gz}) {
+        StringSink sink;
+        ztail::TailEngine(options).tailFile(filename, sink);
+        EXPECT_EQ(sink.take(), "==> " + filename + ":./bundle/app.log <==\napp 299\napp 300\n"
+                               "\n==> " + filename + ":" + longName + " <==\ndeep 49\ndeep 50\n"
+                               "\n==> " + filename + ":./bundle/db.log <==\ndb 39\ndb 40\n");
+    }
+
+    options.tarMember = "./bundle/db.log";
+    for (const std::string& filename : {plain, gz}) {
+        ztail::TailResult result = ztail::TailEngine(options).tailFile(filename);
+        ASSERT_EQ(result.size(), 2u);
+        EXPECT_EQ(result[1], "db 40");
+    }
+
+    options.tarMember = "missing.log";
+    EXPECT_THROW(ztail::TailEngine(options).tailFile(gz), std::runtime_error);
+    std::remove(plain.c_str());
+    std::remove(gz.c_str());
+}
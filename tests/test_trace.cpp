@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include "trace.h"
+#include "process_stream.h"
+#include "parser.h"
+#include "circular_buffer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static size_t count_of(const std::string& text, const std::string& needle) {
+    size_t n = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+TEST(TraceTest, SpansAreDroppedWithoutActiveRecorder) {
+    EXPECT_EQ(TraceRecorder::active(), nullptr);
+    TraceSpan span("idle");
+}
+
+TEST(TraceTest, ProcessStreamSpansPerThread) {
+    const std::string path = "pipeline.trace.json";
+    size_t chunks = 0;
+    {
+        TraceRecorder trace(path);
+        trace.activate();
+        trace.nameThread("main");
+
+        std::string data;
+        for (int i = 0; i < 5000; ++i) {
+            data += "line " + std::to_string(i) + "\n";
+        }
+        chunks = (data.size() + 999) / 1000;
+        CircularBuffer cb(3, 16);
+        Parser parser(cb, 16);
+        size_t pos = 0;
+        testing::internal::CaptureStdout();
+        processStream([&](std::vector<char>& buf, size_t& n) {
+                n = std::min({buf.size(), static_cast<size_t>(1000), data.size() - pos});
+                std::memcpy(buf.data(), data.data() + pos, n);
+                pos += n;
+                return n > 0;
+            },
+            parser, cb, 64 * 1024, 1024, true);
+        EXPECT_EQ(testing::internal::GetCapturedStdout(), "line 4997\nline 4998\nline 4999\n");
+        trace.finish();
+        {
+            TraceSpan late("late");
+        }
+    }
+    EXPECT_EQ(TraceRecorder::active(), nullptr);
+
+    const std::string json = read_file(path);
+    EXPECT_EQ(json.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["), 0u);
+    EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+    EXPECT_NE(json.find("\"args\": {\"name\": \"producer\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\": {\"name\": \"consumer\"}"), std::string::npos);
+    // A decompress span for every chunk plus the final empty read.
+    EXPECT_EQ(count_of(json, "\"name\": \"decompress\""), chunks + 1);
+    EXPECT_EQ(count_of(json, "\"name\": \"parse\""), chunks);
+    EXPECT_EQ(count_of(json, "\"name\": \"print\""), 1u);
+    EXPECT_GE(count_of(json, "\"name\": \"handoff\""), chunks);
+    EXPECT_EQ(count_of(json, "\"name\": \"late\""), 0u);
+    std::remove(path.c_str());
+}
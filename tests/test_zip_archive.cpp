@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+#include "zip_archive.h"
+#include "tail_engine.h"
+#include <zlib.h>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct ArchiveMember {
+    std::string name;
+    std::string data;
+    uint16_t method;
+};
+
+void put16(std::string& out, uint32_t v) {
+    out += static_cast<char>(v & 0xff);
+    out += static_cast<char>((v >> 8) & 0xff);
+}
+
+void put32(std::string& out, uint32_t v) {
+    put16(out, v & 0xffff);
+    put16(out, v >> 16);
+}
+
+std::string rawDeflate(const std::string& text) {
+    std::string out(compressBound(static_cast<uLong>(text.size())) + 16, '\0');
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    zs.avail_in = static_cast<uInt>(text.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+// Builds an archive by hand so both methods read without libzip are covered.
+void writeArchive(const std::string& filename, const std::vector<ArchiveMember>& members) {
+    std::string body;
+    std::string directory;
+    for (const ArchiveMember& m : members) {
+        const std::string stored = m.method == ZIP_METHOD_DEFLATE ? rawDeflate(m.data) : m.data;
+        const uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(m.data.data()), static_cast<uInt>(m.data.size()));
+        const uint32_t offset = static_cast<uint32_t>(body.size());
+
+        put32(body, 0x04034b50);
+        put16(body, 20);
+        put16(body, 0);
+        put16(body, m.method);
+        put32(body, 0);
+        put32(body, crc);
+        put32(body, static_cast<uint32_t>(stored.size()));
+        put32(body, static_cast<uint32_t>(m.data.size()));
+        put16(body, static_cast<uint32_t>(m.name.size()));
+        put16(body, 4);
+        body += m.name;
+        body += std::string(4, '\0'); // an empty extra field the reader must skip
+        body += stored;
+
+        put32(directory, 0x02014b50);
+        put16(directory, 20);
+        put16(directory, 20);
+        put16(directory, 0);
+        put16(directory, m.method);
+        put32(directory, 0);
+        put32(directory, crc);
+        put32(directory, static_cast<uint32_t>(stored.size()));
+        put32(directory, static_cast<uint32_t>(m.data.size()));
+        put16(directory, static_cast<uint32_t>(m.name.size()));
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put32(directory, 0);
+        put32(directory, offset);
+        directory += m.name;
+    }
+    const uint32_t directoryOffset = static_cast<uint32_t>(body.size());
+    body += directory;
+    put32(body, 0x06054b50);
+    put16(body, 0);
+    put16(body, 0);
+    put16(body, static_cast<uint32_t>(members.size()));
+    put16(body, static_cast<uint32_t>(members.size()));
+    put32(body, static_cast<uint32_t>(directory.size()));
+    put32(body, directoryOffset);
+    put16(body, 7);
+    body += "comment";
+
+    std::ofstream(filename, std::ios::binary) << body;
+}
+
+std::string numbered(const std::string& prefix, int count) {
+    std::string text;
+    for (int i = 1; i <= count; ++i) {
+        text += prefix + " " + std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+std::vector<ArchiveMember> sampleMembers() {
+    return {
+        {"logs/", "", ZIP_METHOD_STORE},
+        {"logs/a.log", numbered("stored", 500), ZIP_METHOD_STORE},
+        {"logs/b.log", numbered("deflated", 20000), ZIP_METHOD_DEFLATE},
+        {"logs/c.log", "no newline", ZIP_METHOD_STORE},
+    };
+}
+
+} // namespace
+
+TEST(ArchiveDirectoryTest, ReadsEntriesAndDataOffsets) {
+    const std::string filename = "test_archive_dir.zip";
+    const std::vector<ArchiveMember> members = sampleMembers();
+    writeArchive(filename, members);
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+
+    const std::vector<ZipEntry> entries = readZipDirectory(fd);
+    ASSERT_EQ(entries.size(), members.size());
+    EXPECT_TRUE(entries[0].isDirectory());
+    EXPECT_EQ(entries[1].name, "logs/a.log");
+    EXPECT_EQ(entries[1].method, ZIP_METHOD_STORE);
+    EXPECT_EQ(entries[1].size, members[1].data.size());
+    EXPECT_EQ(entries[2].method, ZIP_METHOD_DEFLATE);
+    EXPECT_LT(entries[2].compressedSize, entries[2].size);
+
+    std::string stored(entries[1].size, '\0');
+    ASSERT_EQ(::pread(fd, &stored[0], stored.size(), static_cast<off_t>(zipDataOffset(fd, entries[1]))),
+              static_cast<ssize_t>(stored.size()));
+    EXPECT_EQ(stored, members[1].data);
+
+    EXPECT_EQ(entries[2].crc, crc32(0, reinterpret_cast<const Bytef*>(members[2].data.data()),
+                                    static_cast<uInt>(members[2].data.size())));
+    ZipDeflateReader reader(fd, zipDataOffset(fd, entries[2]), entries[2].compressedSize, entries[2].crc, filename,
+                            256);
+    std::vector<char> buffer(1000);
+    size_t n = 0;
+    std::string inflated;
+    while (reader.decompress(buffer, n)) {
+        inflated.append(buffer.data(), n);
+    }
+    EXPECT_EQ(inflated, members[2].data);
+
+    ::close(fd);
+    std::remove(filename.c_str());
+}
+
+TEST(ArchiveDirectoryTest, RejectsFilesWithoutEndRecord) {
+    const std::string filename = "test_archive_bad.zip";
+    std::ofstream(filename, std::ios::binary) << std::string("PK\x03\x04", 4) << std::string(100, 'x');
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_THROW(readZipDirectory(fd), std::runtime_error);
+    ::close(fd);
+    std::remove(filename.c_str());
+}
+
+TEST(ArchiveDirectoryTest, TruncatedDeflateEntryThrows) {
+    const std::string filename = "test_archive_trunc.zip";
+    const std::vector<ArchiveMember> members = sampleMembers();
+    writeArchive(filename, members);
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    const ZipEntry entry = readZipDirectory(fd)[2];
+
+    ZipDeflateReader reader(fd, zipDataOffset(fd, entry), entry.compressedSize / 2, entry.crc, filename);
+    std::vector<char> buffer(1 << 16);
+    size_t n = 0;
+    EXPECT_THROW({
+        while (reader.decompress(buffer, n)) {
+        }
+    }, std::runtime_error);
+    ::close(fd);
+    std::remove(filename.c_str());
+}
+
+TEST(ArchiveTailTest, CorruptDeflateEntryFailsItsCrc) {
+    const std::string filename = "test_archive_crc.zip";
+    writeArchive(filename, sampleMembers());
+    std::string archive;
+    {
+        std::ifstream in(filename, std::ios::binary);
+        archive.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    // Flip a bit of logs/b.log's CRC in its central directory record.
+    size_t record = archive.find("PK\x01\x02");
+    record = archive.find("PK\x01\x02", record + 1);
+    record = archive.find("PK\x01\x02", record + 1);
+    ASSERT_NE(record, std::string::npos);
+    archive[record + 16] ^= 1;
+    std::ofstream(filename, std::ios::binary | std::ios::trunc) << archive;
+
+    CLIOptions options;
+    options.n = 2;
+    options.zipEntry = "logs/b.log";
+    StringSink sink;
+    EXPECT_THROW(ztail::TailEngine(options).tailFile(filename, sink), std::runtime_error);
+
+    options.zipEntry = "logs/a.log"; // the other entries are intact
+    ztail::TailEngine(options).tailFile(filename, sink);
+    EXPECT_EQ(sink.take(), "stored 499\nstored 500\n");
+    std::remove(filename.c_str());
+}
+
+TEST(ArchiveTailTest, AllEntriesPrintsEveryFileInDirectoryOrder) {
+    const std::string filename = "test_archive_all.zip";
+    writeArchive(filename, sampleMembers());
+    const std::string expected = "==> " + filename + ":logs/a.log <==\nstored 499\nstored 500\n"
+                                 "\n==> " + filename + ":logs/b.log <==\ndeflated 19999\ndeflated 20000\n"
+                                 "\n==> " + filename + ":logs/c.log <==\nno newline\n";
+
+    for (bool threads : {true, false}) {
+        CLIOptions options;
+        options.n = 2;
+        options.allEntries = true;
+        options.useThreads = threads;
+        StringSink sink;
+        ztail::TailEngine(options).tailFile(filename, sink);
+        EXPECT_EQ(sink.take(), expected) << "threads " << threads;
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(ArchiveTailTest, EntryOptionTailsStoredAndDeflatedEntries) {
+    const std::string filename = "test_archive_entry.zip";
+    writeArchive(filename, sampleMembers());
+
+    CLIOptions options;
+    options.n = 1;
+    options.zipEntry = "logs/a.log";
+    ztail::TailResult stored = ztail::TailEngine(options).tailFile(filename);
+    ASSERT_EQ(stored.size(), 1u);
+    EXPECT_EQ(stored[0], "stored 500");
+
+    options.zipEntry = "logs/b.log";
+    ztail::TailResult deflated = ztail::TailEngine(options).tailFile(filename);
+    ASSERT_EQ(deflated.size(), 1u);
+    EXPECT_EQ(deflated[0], "deflated 20000");
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "zstd_dictionary.h"
+#include "compressor_zstd.h"
+#include "compression_type.h"
+#include "tail_engine.h"
+#include <zdict.h>
+#include <zstd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Trains a dictionary on log lines of one service.
+std::string trainDictionary(const std::string& service) {
+    std::string samples;
+    std::vector<size_t> sizes;
+    for (int i = 0; i < 2000; ++i) {
+        const std::string line = "2024-05-01T12:00:" + std::to_string(i % 60) + " " + service +
+                                 " request id=" + std::to_string(i * 7919) + " status=" +
+                                 (i % 3 ? "ok" : "retry") + " path=/api/v1/items/" + std::to_string(i % 97) + "\n";
+        samples += line;
+        sizes.push_back(line.size());
+    }
+    std::string dict(16 << 10, '\0');
+    const size_t size = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), sizes.data(),
+                                              static_cast<unsigned>(sizes.size()));
+    EXPECT_FALSE(ZDICT_isError(size));
+    dict.resize(ZDICT_isError(size) ? 0 : size);
+    return dict;
+}
+
+std::string frameWith(const std::string& dict, const std::string& text) {
+    std::string out(ZSTD_compressBound(text.size()), '\0');
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    const size_t size = dict.empty()
+                            ? ZSTD_compressCCtx(cctx, &out[0], out.size(), text.data(), text.size(), 3)
+                            : ZSTD_compress_usingDict(cctx, &out[0], out.size(), text.data(), text.size(),
+                                                      dict.data(), dict.size(), 3);
+    ZSTD_freeCCtx(cctx);
+    out.resize(size);
+    return out;
+}
+
+std::string entries(const std::string& service, int first, int last) {
+    std::string text;
+    for (int i = first; i <= last; ++i) {
+        text += service + " request id=" + std::to_string(i) + " status=ok\n";
+    }
+    return text;
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream(path, std::ios::binary) << data;
+}
+
+std::string decodeAll(const std::string& path, size_t chunk) {
+    DetectionResult det = detectCompressionType(path);
+    CompressorZstd comp(std::move(det.file), path);
+    std::vector<char> buf(chunk);
+    size_t n = 0;
+    std::string out;
+    while (comp.decompress(buf, n)) {
+        out.append(buf.data(), n);
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(ZstdDictionaryTest, StreamedFramesUseTheDictionaryTheyName) {
+    const std::string dict = trainDictionary("checkout");
+    writeFile("dict_checkout.zdict", dict);
+    const unsigned id = loadZstdDictionary("dict_checkout.zdict");
+    EXPECT_NE(id, 0u);
+    EXPECT_EQ(loadZstdDictionary("dict_checkout.zdict"), id);
+
+    // Dictionary frames around one compressed without a dictionary.
+    const std::string a = entries("checkout", 1, 40);
+    const std::string b = entries("plain", 41, 60);
+    const std::string c = entries("checkout", 61, 100);
+    writeFile("dict_frames.zst", frameWith(dict, a) + frameWith("", b) + frameWith(dict, c));
+    EXPECT_EQ(decodeAll("dict_frames.zst", 64), a + b + c);
+    EXPECT_EQ(decodeAll("dict_frames.zst", 1 << 16), a + b + c);
+
+    std::remove("dict_checkout.zdict");
+    std::remove("dict_frames.zst");
+}
+
+TEST(ZstdDictionaryTest, EngineTailsDictionaryFrames) {
+    const std::string dict = trainDictionary("billing");
+    writeFile("dict_billing.zdict", dict);
+    std::string shard;
+    for (int i = 0; i < 20; ++i) {
+        shard += frameWith(dict, entries("billing", i * 50 + 1, i * 50 + 50));
+    }
+    writeFile("dict_shard.zst", shard);
+
+    CLIOptions options;
+    options.n = 3;
+    options.zstdDictionaries.push_back("dict_billing.zdict");
+    ztail::TailEngine engine(options);
+    StringSink sink;
+    engine.tailFile("dict_shard.zst", sink);
+    EXPECT_EQ(sink.take(), entries("billing", 998, 1000));
+
+    std::remove("dict_billing.zdict");
+    std::remove("dict_shard.zst");
+}
+
+TEST(ZstdDictionaryTest, MissingDictionaryIsNamed) {
+    const std::string dict = trainDictionary("inventory");
+    const unsigned id = ZDICT_getDictID(dict.data(), dict.size());
+    writeFile("dict_missing.zst", frameWith(dict, entries("inventory", 1, 10)));
+    try {
+        decodeAll("dict_missing.zst", 4096);
+        FAIL() << "expected a missing dictionary error";
+    } catch (const std::runtime_error& ex) {
+        EXPECT_NE(std::string(ex.what()).find("dictionary " + std::to_string(id) + " not loaded"), std::string::npos)
+            << ex.what();
+    }
+    std::remove("dict_missing.zst");
+}